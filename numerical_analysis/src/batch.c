@@ -0,0 +1,285 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "framebatch.h"
+#include "matrixmarket.h"
+#include "mpiutility.h"
+#include "trace.h"
+
+// Solves models without graphics and writes their results to files
+// Text and binary results can be viewed afterwards with: numerical_analysis model results
+static void print_usage(const char* program)
+{
+    fprintf(stderr,
+        "Usage: %s model [more models] [options]\n"
+        "  Models are frame files or Matrix Market systems (system.mtx with system_b.mtx as the right hand side)\n"
+        "  -o path        Write the per node results to path (a directory with several models)\n"
+        "  -f format      Results format: text, binary or vtk (default from the -o extension)\n"
+        "  -m method      cg, sor or jacobi (sor and jacobi need several MPI processes, default cg)\n"
+        "                 Matrix Market systems are always solved with cg\n"
+        "  -i count       Most iterations to run (default 1000)\n"
+        "  -t tolerance   Stop once the residual norm is below tolerance (default 0.001)\n"
+        "  -j threads     OpenMP threads per process (default OMP_NUM_THREADS)\n"
+        "  --overlap n    Layers of overlap between Schwarz subdomains (default 1)\n"
+        "  --subdomains n Schwarz subdomains per process (default one per thread)\n"
+        "  --ic0          Use incomplete Cholesky subdomain solves instead of exact ones\n"
+        "  --no-coarse    Leave out the rigid body coarse correction\n"
+        "  --checkpoint n Save the solver state every n iterations next to the results (or model)\n"
+        "                 and resume from it when run again. Removed once the solve converges\n"
+        "  --trace path   Write a Chrome trace of import, assembly, every solver iteration and output\n"
+        "                 (needs a build with -DENABLE_TRACE=true)\n"
+        "  -q             Do not print timings\n",
+        program);
+}
+
+int main(int argc, char* argv[])
+{
+#if ENABLE_MPI
+    initialize_mpi(&argc, &argv);
+    const int rank = get_rank_mpi();
+    const int procs = get_procs_mpi();
+    const int main_proc = get_main_mpi();
+#else
+    const int rank = 0;
+    const int procs = 1;
+    const int main_proc = 0;
+#endif
+
+    struct BatchSettings settings;
+    batch_default_settings(&settings, 1000, 0.001f);
+    settings.verbose = 1;
+
+    const char** models = malloc(sizeof(*models) * argc);
+    int model_count = 0;
+    const char* output = NULL;
+    int format = -1;
+    int checkpoints = 0;
+    const char* trace_path = NULL;
+
+    int valid = 1;
+
+    for (int i = 1; i < argc && valid; ++i)
+    {
+        const char* arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+
+        if (arg[0] != '-')
+        {
+            models[model_count++] = arg;
+        }
+        else if (strcmp(arg, "-q") == 0)
+        {
+            settings.verbose = 0;
+        }
+        else if (strcmp(arg, "--ic0") == 0)
+        {
+            settings.solve.schwarz.local_solver = SCHWARZ_IC0;
+        }
+        else if (strcmp(arg, "--no-coarse") == 0)
+        {
+            settings.solve.schwarz.coarse = 0;
+        }
+        else if (!value)
+        {
+            valid = 0;
+        }
+        else
+        {
+            // Every other option takes a value
+            if (strcmp(arg, "-o") == 0)
+            {
+                output = value;
+            }
+            else if (strcmp(arg, "-f") == 0)
+            {
+                if (strcmp(value, "text") == 0)
+                {
+                    format = RESULTS_TEXT;
+                }
+                else if (strcmp(value, "binary") == 0)
+                {
+                    format = RESULTS_BINARY;
+                }
+                else if (strcmp(value, "vtk") == 0)
+                {
+                    format = RESULTS_VTK;
+                }
+                else
+                {
+                    valid = 0;
+                }
+            }
+            else if (strcmp(arg, "-m") == 0)
+            {
+                if (strcmp(value, "cg") == 0)
+                {
+                    settings.solve.method = MPI_SOLVE_CG;
+                }
+                else if (strcmp(value, "sor") == 0)
+                {
+                    settings.solve.method = MPI_SOLVE_SOR;
+                }
+                else if (strcmp(value, "jacobi") == 0)
+                {
+                    settings.solve.method = MPI_SOLVE_JACOBI;
+                }
+                else
+                {
+                    valid = 0;
+                }
+            }
+            else if (strcmp(arg, "-i") == 0)
+            {
+                settings.solve.iterations = atoi(value);
+                valid = settings.solve.iterations > 0;
+            }
+            else if (strcmp(arg, "-t") == 0)
+            {
+                settings.solve.tolerance = (float)atof(value);
+            }
+            else if (strcmp(arg, "-j") == 0)
+            {
+                settings.solve.threads = atoi(value);
+                valid = settings.solve.threads > 0;
+            }
+            else if (strcmp(arg, "--overlap") == 0)
+            {
+                settings.solve.schwarz.overlap = atoi(value);
+                valid = settings.solve.schwarz.overlap >= 0;
+            }
+            else if (strcmp(arg, "--subdomains") == 0)
+            {
+                settings.solve.schwarz.subdomains = atoi(value);
+                valid = settings.solve.schwarz.subdomains >= 0;
+            }
+            else if (strcmp(arg, "--checkpoint") == 0)
+            {
+                settings.solve.checkpoint.interval = atoi(value);
+                valid = settings.solve.checkpoint.interval > 0;
+                checkpoints = 1;
+            }
+            else if (strcmp(arg, "--trace") == 0)
+            {
+                trace_path = value;
+            }
+            else
+            {
+                valid = 0;
+            }
+
+            i++;
+        }
+    }
+
+    // A single process only has conjugate gradients (see BatchSettings)
+    if (valid && procs == 1 && settings.solve.method != MPI_SOLVE_CG)
+    {
+        fprintf(stderr, "Error: -m sor and -m jacobi need several MPI processes. Use -m cg with one process\n");
+        free(models);
+        finalize_mpi(0);
+        return 2;
+    }
+
+    if (!valid || model_count == 0)
+    {
+        if (rank == main_proc)
+        {
+            print_usage(argv[0]);
+        }
+
+        free(models);
+        finalize_mpi(0);
+        return 2;
+    }
+
+    // With one model the format can come from the output's extension
+    settings.results_format = format >= 0 ? format :
+        output && model_count == 1 ? results_format_from_path(output) : RESULTS_TEXT;
+
+    // Results are written in the background while the next model is solved
+    struct ResultsWriter writer;
+    results_writer_init(&writer);
+    settings.writer = &writer;
+
+    if (trace_path)
+    {
+        trace_start();
+    }
+
+    int failures = 0;
+
+    for (int m = 0; m < model_count; ++m)
+    {
+        char* results_path = NULL;
+
+        if (output && model_count == 1)
+        {
+            results_path = malloc(strlen(output) + 1);
+            strcpy(results_path, output);
+        }
+        else if (output)
+        {
+            // Name the results after the model without its directory or extension
+            const char* name = models[m];
+            for (const char* c = models[m]; *c; ++c)
+            {
+                if (*c == '/' || *c == '\\')
+                {
+                    name = c + 1;
+                }
+            }
+
+            const char* dot = strrchr(name, '.');
+            int name_length = dot ? (int)(dot - name) : (int)strlen(name);
+            // Solutions of Matrix Market systems are vectors next to them ("system_x.mtx")
+            const char* extension = matrixmarket_is_path(models[m])
+                ? "_x" MATRIXMARKET_EXTENSION : results_format_extension(settings.results_format);
+
+            results_path = malloc(strlen(output) + name_length + strlen(extension) + 2);
+            sprintf(results_path, "%s/%.*s%s", output, name_length, name, extension);
+        }
+
+        // Checkpoints are kept until the model's solve converges so a job that is stopped and run
+        // again picks up from the last one
+        char* checkpoint_path = NULL;
+
+        if (checkpoints)
+        {
+            const char* base = results_path ? results_path : models[m];
+            checkpoint_path = malloc(strlen(base) + strlen(".checkpoint") + 1);
+            sprintf(checkpoint_path, "%s.checkpoint", base);
+        }
+
+        settings.model_path = models[m];
+        settings.results_path = results_path;
+        settings.solve.checkpoint.path = checkpoint_path;
+
+        int converged = 0;
+        int failed = frame_batch_run(&settings, NULL, &converged) != 0;
+        failures += failed;
+
+        // A solve that ran out of iterations keeps its checkpoint so it can be continued
+        if (checkpoint_path && converged && rank == main_proc)
+        {
+            remove(checkpoint_path);
+        }
+
+        // The writer keeps its own copy of the path
+        free(checkpoint_path);
+        free(results_path);
+    }
+
+    results_writer_release(&writer);
+    failures += writer.failures;
+
+    // After the writer has finished so its thread's scopes are complete
+    if (trace_path)
+    {
+        failures += trace_write(trace_path) != 0;
+    }
+
+    free(models);
+    finalize_mpi(0);
+    return failures ? 1 : 0;
+}
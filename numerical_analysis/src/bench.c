@@ -0,0 +1,204 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "framebench.h"
+#include "framegenerate.h"
+#include "mpiutility.h"
+
+#define BENCH_MAX_SIZES 16
+
+// Benchmarks import, coloring, assembly, the solvers and core kernels and writes the timings as JSON
+static void print_usage(const char* program)
+{
+    fprintf(stderr,
+        "Usage: %s [models] [options]\n"
+        "  Models are frame files. Without any a truss of 1000 and 8000 nodes is generated\n"
+        "  -o path        Write the JSON report to path (default standard output)\n"
+        "  -r count       Samples of each benchmark (default 5)\n"
+        "  -j threads     Comma separated thread counts for the threaded benchmarks (default 1 and OMP_NUM_THREADS)\n"
+        "  -i count       Most solver iterations (default 1000)\n"
+        "  -t tolerance   Solvers stop once the residual norm is below tolerance (default 0.001)\n"
+        "  --nodes list   Comma separated node counts of synthetic models to generate (see frame_generate)\n"
+        "  --shape name   Shape of the synthetic models: grid2d, grid3d, truss, tower or bridge (default truss)\n"
+        "  --seed n       Seed of the synthetic models (default 1)\n"
+        "  --dense rows   Largest system for the dense assembly and solvers (default 1000)\n"
+        "  --counters     Also count cycles, instructions and last level cache misses (Linux only)\n"
+        "  With several MPI processes only import and the distributed solvers are timed\n",
+        program);
+}
+
+// Parse a comma separated list of positive integers. Returns the number parsed or -1 if invalid
+static int parse_list(const char* text, long long* values, int capacity)
+{
+    int count = 0;
+    const char* p = text;
+
+    while (*p)
+    {
+        char* end;
+        long long value = strtoll(p, &end, 10);
+
+        if (end == p || value <= 0 || count == capacity || (*end != ',' && *end != '\0'))
+        {
+            return -1;
+        }
+
+        values[count++] = value;
+        p = *end == ',' ? end + 1 : end;
+    }
+
+    return count > 0 ? count : -1;
+}
+
+int main(int argc, char* argv[])
+{
+#if ENABLE_MPI
+    initialize_mpi(&argc, &argv);
+    const int rank = get_rank_mpi();
+    const int main_proc = get_main_mpi();
+#else
+    const int rank = 0;
+    const int main_proc = 0;
+#endif
+
+    struct BenchSettings settings;
+    bench_default_settings(&settings);
+
+    struct FrameGenerateSettings generate;
+    frame_generate_default_settings(&generate);
+
+    const char** models = malloc(sizeof(*models) * argc);
+    int model_count = 0;
+    const char* output = NULL;
+    long long sizes[BENCH_MAX_SIZES] = { 1000, 8000 };
+    int size_count = 0;
+
+    int valid = 1;
+
+    for (int i = 1; i < argc && valid; ++i)
+    {
+        const char* arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+
+        if (arg[0] != '-')
+        {
+            models[model_count++] = arg;
+            continue;
+        }
+
+        if (strcmp(arg, "--counters") == 0)
+        {
+            settings.counters = 1;
+            continue;
+        }
+
+        // Every other option takes a value
+        if (!value)
+        {
+            valid = 0;
+        }
+        else if (strcmp(arg, "-o") == 0)
+        {
+            output = value;
+        }
+        else if (strcmp(arg, "-r") == 0)
+        {
+            settings.repeat = atoi(value);
+            valid = settings.repeat > 0;
+        }
+        else if (strcmp(arg, "-j") == 0)
+        {
+            long long threads[BENCH_MAX_THREAD_COUNTS];
+            settings.thread_count_count = parse_list(value, threads, BENCH_MAX_THREAD_COUNTS);
+            valid = settings.thread_count_count > 0;
+
+            for (int t = 0; t < settings.thread_count_count; ++t)
+            {
+                settings.thread_counts[t] = (int)threads[t];
+            }
+        }
+        else if (strcmp(arg, "-i") == 0)
+        {
+            settings.iterations = atoi(value);
+            valid = settings.iterations > 0;
+        }
+        else if (strcmp(arg, "-t") == 0)
+        {
+            settings.tolerance = (float)atof(value);
+        }
+        else if (strcmp(arg, "--nodes") == 0)
+        {
+            size_count = parse_list(value, sizes, BENCH_MAX_SIZES);
+            valid = size_count > 0;
+        }
+        else if (strcmp(arg, "--shape") == 0)
+        {
+            valid = frame_parse_shape(value, &generate.shape) == 0;
+        }
+        else if (strcmp(arg, "--seed") == 0)
+        {
+            generate.seed = strtoull(value, NULL, 10);
+        }
+        else if (strcmp(arg, "--dense") == 0)
+        {
+            settings.dense_rows = atoi(value);
+        }
+        else
+        {
+            valid = 0;
+        }
+
+        i++;
+    }
+
+    if (!valid)
+    {
+        if (rank == main_proc)
+        {
+            print_usage(argv[0]);
+        }
+
+        free(models);
+        finalize_mpi(0);
+        return 2;
+    }
+
+    // Generate the default sizes when there is nothing else to run
+    if (model_count == 0 && size_count == 0)
+    {
+        size_count = 2;
+    }
+
+    struct BenchReport report;
+    if (bench_report_open(&report, output, &settings))
+    {
+        free(models);
+        finalize_mpi(0);
+        return 1;
+    }
+
+    int failures = 0;
+
+    for (int m = 0; m < model_count; ++m)
+    {
+        failures += frame_bench_file(&settings, models[m], &report) != 0;
+    }
+
+    for (int s = 0; s < size_count; ++s)
+    {
+        if (frame_generate_size(&generate, sizes[s]))
+        {
+            failures++;
+            continue;
+        }
+
+        failures += frame_bench_generated(&settings, &generate, &report) != 0;
+    }
+
+    failures += bench_report_close(&report) != 0;
+
+    free(models);
+    finalize_mpi(0);
+    return failures > 0 ? 1 : 0;
+}
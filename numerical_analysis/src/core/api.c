@@ -2,13 +2,17 @@
 
 #include <stdio.h>
 
+#include <omp.h>
+
 #include "graphics.h"
 #include "fluid.h"
 #include "frame.h"
 #include "mesh.h"
 #include "model.h"
 #include "frameimport.h"
+#include "framebinary.h"
 #include "frameprocess.h"
+#include "permutation.h"
 
 #include "mpiutility.h"
 #include "mpitest.h"
@@ -21,16 +25,16 @@ void run_demo(const char* filename)
     fputc('\n', stdout);
     fflush(stdout);
 
-    // Import a frame model from a file
+    // Import a frame model from a text or binary file
     struct Frame frame;
-    if (frame_import(filename, &frame))
+    if (frame_load(filename, &frame))
     {
         fprintf(stderr, "Error: Failed to import frame with filename: %s\n", filename);
         return;
     }
 
     // Assign nodes a group color such that neighbors are never in the same group
-    frame_assign_multicolor(&frame);
+    frame_assign_multicolor(&frame, COLORING_DSATUR, 1, NULL);
 
     // Produce the set of matrices and vectors representing the problem
     struct EquationSet eqset;
@@ -42,8 +46,14 @@ void run_demo(const char* filename)
     struct vecf residuals;
     vecf_init(&residuals, iterations);
 
-    // Solve the system representing the frame
-    solve_sor_single(eqset, residuals.elements, iterations, 1.1f);
+    // Solve the system representing the frame. Visiting the rows color by color lets
+    // the nodes of each color be updated by several threads at once
+    struct Permutation perm;
+    eqset_reorder(&frame, &eqset, &perm);
+
+    solve_sor_multicolor(eqset, &perm, residuals.elements, iterations, 1.1f, omp_get_max_threads());
+
+    permutation_release(&perm);
 
     // Populate per node properties using displacements to back calculate forces
     frame_update_results(&frame, &eqset);
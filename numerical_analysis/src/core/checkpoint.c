@@ -0,0 +1,497 @@
+#include "checkpoint.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#include "mpiutility.h"
+#include "sparse.h"
+
+#ifndef ENABLE_MPI
+#define ENABLE_MPI 0
+#endif
+
+#if ENABLE_MPI
+#include <mpi.h>
+#endif
+
+// Largest piece handed to a single MPI-IO call (counts are ints)
+#define CHECKPOINT_CHUNK (1 << 30)
+
+void checkpoint_default_settings(struct CheckpointSettings* settings)
+{
+    settings->path = NULL;
+    settings->interval = 100;
+    settings->resume = 1;
+}
+
+int checkpoint_due(const struct CheckpointSettings* settings, int iterations)
+{
+    return settings && settings->path && settings->interval > 0 && iterations > 0 && iterations % settings->interval == 0;
+}
+
+// FNV-1a over bytes continuing from hash
+static uint64_t hash_bytes(uint64_t hash, const void* data, size_t size)
+{
+    const unsigned char* bytes = (const unsigned char*)data;
+
+    for (size_t i = 0; data && i < size; ++i)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+
+    return hash;
+}
+
+// Hash of the owned matrix rows and right hand side. Only used to tell systems apart so a
+// changed stiffness is not resumed from a state that converged for the old one
+static uint64_t hash_system(const struct CheckpointState* state)
+{
+    uint64_t hash = 14695981039346656037ull;
+
+    const struct SparseMatrix* matrix = state->matrix;
+    if (matrix)
+    {
+        hash = hash_bytes(hash, &matrix->nnz, sizeof(matrix->nnz));
+        hash = hash_bytes(hash, matrix->row_offsets, sizeof(*matrix->row_offsets) * ((size_t)matrix->rows + 1));
+        hash = hash_bytes(hash, matrix->columns, sizeof(*matrix->columns) * (size_t)matrix->nnz);
+        hash = hash_bytes(hash, matrix->values, sizeof(*matrix->values) * (size_t)matrix->nnz);
+    }
+
+    return hash_bytes(hash, state->system, sizeof(*state->system) * (size_t)state->rows);
+}
+
+static uint64_t block_size(const struct CheckpointState* state, int residual_count)
+{
+    return sizeof(struct CheckpointBlock) + sizeof(double) * (uint64_t)state->scalar_count +
+        sizeof(float) * ((uint64_t)state->rows * state->vector_count + residual_count);
+}
+
+// Either a stdio file read and written in order or an MPI file shared by every process
+struct CheckpointFile
+{
+    FILE* file;
+    int distributed;
+#if ENABLE_MPI
+    MPI_File mpi_file;
+#endif
+};
+
+static int file_write(struct CheckpointFile* file, uint64_t offset, const void* data, uint64_t bytes)
+{
+#if ENABLE_MPI
+    if (file->distributed)
+    {
+        for (uint64_t done = 0; done < bytes; done += CHECKPOINT_CHUNK)
+        {
+            const int count = (int)(bytes - done < CHECKPOINT_CHUNK ? bytes - done : CHECKPOINT_CHUNK);
+
+            if (MPI_File_write_at(file->mpi_file, (MPI_Offset)(offset + done), (const char*)data + done,
+                count, MPI_BYTE, MPI_STATUS_IGNORE) != MPI_SUCCESS)
+            {
+                return -1;
+            }
+        }
+
+        return 0;
+    }
+#endif
+
+    (void)offset;
+    return bytes > 0 && fwrite(data, 1, bytes, file->file) != bytes ? -1 : 0;
+}
+
+static int file_read(struct CheckpointFile* file, uint64_t offset, void* data, uint64_t bytes)
+{
+#if ENABLE_MPI
+    if (file->distributed)
+    {
+        for (uint64_t done = 0; done < bytes; done += CHECKPOINT_CHUNK)
+        {
+            const int count = (int)(bytes - done < CHECKPOINT_CHUNK ? bytes - done : CHECKPOINT_CHUNK);
+
+            if (MPI_File_read_at(file->mpi_file, (MPI_Offset)(offset + done), (char*)data + done,
+                count, MPI_BYTE, MPI_STATUS_IGNORE) != MPI_SUCCESS)
+            {
+                return -1;
+            }
+        }
+
+        return 0;
+    }
+#endif
+
+    (void)offset;
+    return bytes > 0 && fread(data, 1, bytes, file->file) != bytes ? -1 : 0;
+}
+
+// Write one process' block starting at offset
+static int write_block(struct CheckpointFile* file, uint64_t offset, const struct CheckpointState* state, int residual_count)
+{
+    struct CheckpointBlock block;
+    memset(&block, 0, sizeof(block));
+    block.rows = state->rows;
+    block.vector_count = state->vector_count;
+    block.scalar_count = state->scalar_count;
+    block.residual_count = residual_count;
+    block.system_hash = hash_system(state);
+
+    int failed = file_write(file, offset, &block, sizeof(block)) != 0;
+    offset += sizeof(block);
+
+    failed = failed || file_write(file, offset, state->scalars, sizeof(double) * state->scalar_count) != 0;
+    offset += sizeof(double) * state->scalar_count;
+
+    for (int v = 0; v < state->vector_count && !failed; ++v)
+    {
+        failed = file_write(file, offset, state->vectors[v], sizeof(float) * (uint64_t)state->rows) != 0;
+        offset += sizeof(float) * (uint64_t)state->rows;
+    }
+
+    failed = failed || file_write(file, offset, state->residuals, sizeof(float) * residual_count) != 0;
+
+    return failed ? -1 : 0;
+}
+
+static void fill_header(struct CheckpointHeader* header, const struct CheckpointState* state, int procs, uint64_t file_size)
+{
+    memset(header, 0, sizeof(*header));
+    memcpy(header->magic, CHECKPOINT_MAGIC, sizeof(header->magic));
+    header->version = CHECKPOINT_VERSION;
+    header->byte_order = CHECKPOINT_BYTE_ORDER;
+    header->header_size = sizeof(*header);
+    header->method = state->method;
+    header->procs = procs;
+    header->iteration = state->iteration;
+    header->file_size = file_size;
+}
+
+// Rename over an existing file in one step so there is always a complete checkpoint at path
+static int replace_file(const char* from, const char* to)
+{
+#ifdef _WIN32
+    return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING) ? 0 : -1;
+#else
+    return rename(from, to);
+#endif
+}
+
+int checkpoint_save(const struct CheckpointSettings* settings, const struct CheckpointState* state, int distributed)
+{
+#if ENABLE_MPI == 0
+    if (distributed)
+    {
+        fprintf(stderr, "Warning: Attempting to use MPI functionality with MPI disabled\n");
+        return -1;
+    }
+#endif
+
+    if (!settings || !settings->path)
+    {
+        return 0;
+    }
+
+    const int rank = distributed ? get_rank_mpi() : 0;
+    const int procs = distributed ? get_procs_mpi() : 1;
+    const int root = distributed ? get_main_mpi() : 0;
+
+    // Only the main process of a distributed solve keeps the residual history
+    const int residual_count = state->residuals ? state->residual_count : 0;
+
+    char* temp_path = malloc(strlen(settings->path) + 5);
+    sprintf(temp_path, "%s.tmp", settings->path);
+
+    // The blocks follow the header and offset table in rank order
+    const uint64_t table_end = sizeof(struct CheckpointHeader) + sizeof(uint64_t) * procs;
+    const uint64_t size = block_size(state, residual_count);
+    uint64_t offset = table_end;
+    uint64_t file_size = table_end + size;
+    uint64_t* offsets = malloc(sizeof(*offsets) * procs);
+    offsets[0] = offset;
+
+    struct CheckpointFile file;
+    file.distributed = distributed;
+    file.file = NULL;
+    int failed = 0;
+
+#if ENABLE_MPI
+    if (distributed)
+    {
+        uint64_t before = 0;
+        MPI_Exscan(&size, &before, 1, MPI_UINT64_T, MPI_SUM, MPI_COMM_WORLD);
+        offset = table_end + (rank == 0 ? 0 : before);
+
+        uint64_t end = offset + size;
+        MPI_Allreduce(&end, &file_size, 1, MPI_UINT64_T, MPI_MAX, MPI_COMM_WORLD);
+        MPI_Gather(&offset, 1, MPI_UINT64_T, offsets, 1, MPI_UINT64_T, root, MPI_COMM_WORLD);
+
+        // Opening is collective and fails on every process together
+        if (MPI_File_open(MPI_COMM_WORLD, temp_path, MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &file.mpi_file) != MPI_SUCCESS)
+        {
+            fprintf(stderr, "Failed to open file at: %s\n", temp_path);
+            free(offsets);
+            free(temp_path);
+            return -1;
+        }
+
+        // Drop anything left from a larger checkpoint
+        MPI_File_set_size(file.mpi_file, (MPI_Offset)file_size);
+    }
+    else
+#endif
+    {
+        file.file = fopen(temp_path, "wb");
+        if (!file.file)
+        {
+            fprintf(stderr, "Failed to open file at: %s\n", temp_path);
+            free(offsets);
+            free(temp_path);
+            return -1;
+        }
+    }
+
+    if (rank == root)
+    {
+        struct CheckpointHeader header;
+        fill_header(&header, state, procs, file_size);
+
+        failed = file_write(&file, 0, &header, sizeof(header)) != 0 ||
+            file_write(&file, sizeof(header), offsets, sizeof(*offsets) * procs) != 0;
+    }
+
+    failed = failed || write_block(&file, offset, state, residual_count) != 0;
+
+#if ENABLE_MPI
+    if (distributed)
+    {
+        MPI_File_close(&file.mpi_file);
+        MPI_Allreduce(MPI_IN_PLACE, &failed, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+    }
+    else
+#endif
+    {
+        failed = fclose(file.file) != 0 || failed;
+    }
+
+    // Every block is complete once the file is closed so the checkpoint can replace the last one
+    if (!failed && rank == root)
+    {
+        failed = replace_file(temp_path, settings->path) != 0;
+    }
+
+#if ENABLE_MPI
+    if (distributed)
+    {
+        MPI_Bcast(&failed, 1, MPI_INT, root, MPI_COMM_WORLD);
+    }
+#endif
+
+    if (failed && rank == root)
+    {
+        fprintf(stderr, "Checkpoint Error: failed to write %s\n", settings->path);
+    }
+
+    free(offsets);
+    free(temp_path);
+
+    return failed ? -1 : 0;
+}
+
+// Check a saved header and block against the state being resumed
+// Returns 0 if they match or -1 (printing why if report is set)
+static int check_saved(const struct CheckpointHeader* header, uint64_t size, const struct CheckpointBlock* block,
+    const struct CheckpointState* state, int procs, const char* path, int report)
+{
+    const char* reason = NULL;
+
+    if (memcmp(header->magic, CHECKPOINT_MAGIC, sizeof(header->magic)) != 0)
+    {
+        reason = "is not a checkpoint";
+    }
+    else if (header->byte_order != CHECKPOINT_BYTE_ORDER || header->version != CHECKPOINT_VERSION ||
+        header->header_size != sizeof(*header))
+    {
+        reason = "was written by a different version or machine";
+    }
+    else if (header->file_size != size)
+    {
+        reason = "is truncated";
+    }
+    else if (header->method != (int32_t)state->method || header->procs != procs)
+    {
+        reason = "was saved by a different solver or number of processes";
+    }
+    else if (block && (block->rows != state->rows || block->vector_count != state->vector_count ||
+        block->scalar_count != state->scalar_count || block->system_hash != hash_system(state)))
+    {
+        reason = "was saved for a different system";
+    }
+    else if (block && (block->residual_count < 0 || (state->residuals && block->residual_count > state->residual_count)))
+    {
+        reason = "has a longer residual history than requested";
+    }
+
+    if (reason && report)
+    {
+        fprintf(stderr, "Checkpoint Warning: %s %s. Starting from the beginning\n", path, reason);
+    }
+
+    return reason ? -1 : 0;
+}
+
+int checkpoint_load(const struct CheckpointSettings* settings, struct CheckpointState* state, int distributed)
+{
+#if ENABLE_MPI == 0
+    if (distributed)
+    {
+        fprintf(stderr, "Warning: Attempting to use MPI functionality with MPI disabled\n");
+        return 0;
+    }
+#endif
+
+    if (!settings || !settings->path || !settings->resume)
+    {
+        return 0;
+    }
+
+    const int rank = distributed ? get_rank_mpi() : 0;
+    const int procs = distributed ? get_procs_mpi() : 1;
+    const int root = distributed ? get_main_mpi() : 0;
+
+    struct CheckpointFile file;
+    file.distributed = distributed;
+    file.file = NULL;
+    uint64_t size = 0;
+
+    // No checkpoint yet is the usual case for a new solve so it is not reported
+#if ENABLE_MPI
+    if (distributed)
+    {
+        if (MPI_File_open(MPI_COMM_WORLD, settings->path, MPI_MODE_RDONLY, MPI_INFO_NULL, &file.mpi_file) != MPI_SUCCESS)
+        {
+            return 0;
+        }
+
+        MPI_Offset mpi_size = 0;
+        MPI_File_get_size(file.mpi_file, &mpi_size);
+        size = (uint64_t)mpi_size;
+    }
+    else
+#endif
+    {
+        file.file = fopen(settings->path, "rb");
+        if (!file.file)
+        {
+            return 0;
+        }
+
+        fseek(file.file, 0, SEEK_END);
+        size = (uint64_t)ftell(file.file);
+        fseek(file.file, 0, SEEK_SET);
+    }
+
+    // Everything is read into separate buffers so a process that fails part way (or another
+    // process failing) leaves the solver's vectors untouched
+    struct CheckpointHeader header;
+    struct CheckpointBlock block;
+    uint64_t offset = 0;
+    double scalars[CHECKPOINT_MAX_SCALARS];
+    float* vectors[CHECKPOINT_MAX_VECTORS] = { NULL };
+    float* residuals = NULL;
+
+    memset(&header, 0, sizeof(header));
+    memset(&block, 0, sizeof(block));
+
+    // A file too short for a header is checked like one that is not a checkpoint
+    int loaded = (size < sizeof(header) || file_read(&file, 0, &header, sizeof(header)) == 0) &&
+        check_saved(&header, size, NULL, state, procs, settings->path, rank == root) == 0;
+
+    // The serial file is read in order so only the distributed one needs the offset table
+    if (loaded && distributed)
+    {
+        loaded = file_read(&file, sizeof(header) + sizeof(offset) * rank, &offset, sizeof(offset)) == 0 &&
+            offset + sizeof(block) <= size;
+    }
+    else if (loaded)
+    {
+        loaded = file_read(&file, sizeof(header), &offset, sizeof(offset)) == 0 &&
+            offset == sizeof(header) + sizeof(offset);
+    }
+
+    loaded = loaded && file_read(&file, offset, &block, sizeof(block)) == 0 &&
+        check_saved(&header, size, &block, state, procs, settings->path, rank == root) == 0 &&
+        offset + block_size(state, block.residual_count) <= size;
+    offset += sizeof(block);
+
+    loaded = loaded && file_read(&file, offset, scalars, sizeof(double) * state->scalar_count) == 0;
+    offset += sizeof(double) * state->scalar_count;
+
+    for (int v = 0; v < state->vector_count && loaded; ++v)
+    {
+        vectors[v] = malloc(sizeof(float) * (state->rows > 0 ? state->rows : 1));
+        loaded = file_read(&file, offset, vectors[v], sizeof(float) * (uint64_t)state->rows) == 0;
+        offset += sizeof(float) * (uint64_t)state->rows;
+    }
+
+    if (loaded && state->residuals)
+    {
+        residuals = malloc(sizeof(float) * (block.residual_count > 0 ? block.residual_count : 1));
+        loaded = file_read(&file, offset, residuals, sizeof(float) * block.residual_count) == 0;
+    }
+
+#if ENABLE_MPI
+    if (distributed)
+    {
+        MPI_File_close(&file.mpi_file);
+
+        // Resume only if every process can
+        const int local_loaded = loaded;
+        MPI_Allreduce(MPI_IN_PLACE, &loaded, 1, MPI_INT, MPI_MIN, MPI_COMM_WORLD);
+
+        if (rank == root && local_loaded && !loaded)
+        {
+            fprintf(stderr, "Checkpoint Warning: part of %s does not match another process' system. Starting from the beginning\n",
+                settings->path);
+        }
+    }
+    else
+#endif
+    {
+        fclose(file.file);
+    }
+
+    if (loaded)
+    {
+        state->iteration = header.iteration;
+
+        for (int s = 0; s < state->scalar_count; ++s)
+        {
+            state->scalars[s] = scalars[s];
+        }
+
+        for (int v = 0; v < state->vector_count; ++v)
+        {
+            memcpy(state->vectors[v], vectors[v], sizeof(float) * state->rows);
+        }
+
+        if (state->residuals)
+        {
+            memcpy(state->residuals, residuals, sizeof(float) * block.residual_count);
+            state->residual_count = block.residual_count;
+        }
+    }
+
+    for (int v = 0; v < state->vector_count; ++v)
+    {
+        free(vectors[v]);
+    }
+
+    free(residuals);
+
+    return loaded;
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <stdint.h>
+
+struct SparseMatrix;
+
+// Checkpoints hold the state of an iterative solve (the iterate, any other vectors the method
+// carries between iterations, a few scalars and the residual history) so a solve that was
+// stopped can continue from the last checkpoint instead of starting over
+// A resumed solve redoes exactly the same arithmetic so it ends with the same result as a solve
+// that was never stopped, as long as the process and thread counts are the same
+// (OpenMP reductions are only repeatable for a fixed number of threads)
+
+#define CHECKPOINT_MAGIC "SOLVECKP"
+#define CHECKPOINT_VERSION 2
+#define CHECKPOINT_BYTE_ORDER 0x01020304u
+
+// Most vectors and scalars a solver can save
+#define CHECKPOINT_MAX_VECTORS 4
+#define CHECKPOINT_MAX_SCALARS 4
+
+// Solver that wrote a checkpoint. A checkpoint is only resumed by the same solver
+enum CheckpointMethod
+{
+    CHECKPOINT_CG = 1,
+    CHECKPOINT_CG_MPI,
+    CHECKPOINT_JACOBI_MPI,
+    CHECKPOINT_SOR_MPI
+};
+
+// A fixed header and a table with the byte offset of each process' block
+// Each block is a CheckpointBlock followed by the scalars (double), the vectors (float per owned
+// row) and the residual history (float). Values are in the byte order of the machine that wrote them
+struct CheckpointHeader
+{
+    char magic[8]; // CHECKPOINT_MAGIC without the terminating null
+    uint32_t version;
+    uint32_t byte_order; // CHECKPOINT_BYTE_ORDER
+    uint32_t header_size;
+    int32_t method; // enum CheckpointMethod
+    int32_t procs;
+    int32_t iteration;
+    uint64_t file_size;
+};
+
+struct CheckpointBlock
+{
+    int32_t rows;
+    int32_t vector_count;
+    int32_t scalar_count;
+    int32_t residual_count;
+    uint64_t system_hash; // Hash of the matrix rows and right hand side to recognize the system
+};
+
+// Options for saving and resuming solves (see MpiSolveSettings and solve_cg_sparse)
+struct CheckpointSettings
+{
+    const char* path; // File the state is saved to. NULL disables checkpoints
+    int interval; // Iterations between saves
+    int resume; // Continue from the state in path if it was saved by the same solver for the same system
+};
+
+// No path, a save every 100 iterations and resuming enabled
+void checkpoint_default_settings(struct CheckpointSettings* settings);
+
+// Returns 1 if a checkpoint should be saved after the given number of iterations
+int checkpoint_due(const struct CheckpointSettings* settings, int iterations);
+
+// State of one process' part of a solve. The vectors belong to the solver
+struct CheckpointState
+{
+    enum CheckpointMethod method;
+    int iteration; // Iterations finished. A resumed solve goes on with this one
+    int rows; // Owned rows of every vector
+    const struct SparseMatrix* matrix; // Owned rows of the matrix (may be NULL if the rows are not sparse)
+    const float* system; // Right hand side (rows entries)
+
+    int vector_count;
+    float* vectors[CHECKPOINT_MAX_VECTORS];
+
+    int scalar_count;
+    double scalars[CHECKPOINT_MAX_SCALARS];
+
+    float* residuals; // Residual history (may be NULL)
+    int residual_count; // Entries of residuals that are filled in
+};
+
+// Collective if distributed. Save the state of every process to settings->path
+// The file is written next to path and renamed over it once complete so a solve stopped while
+// saving still has the previous checkpoint. Returns 0 on success or -1 on failure
+int checkpoint_save(const struct CheckpointSettings* settings, const struct CheckpointState* state, int distributed);
+
+// Collective if distributed. Fill in the vectors, scalars, iteration and residual history of state
+// from settings->path. method, rows, matrix, system, vector_count and scalar_count must be set and
+// must match the saved state. residuals (may be NULL) has room for residual_count entries
+// Returns 1 if the state was resumed (on every process) or 0 if the solve should start from the
+// beginning (resuming is disabled, there is no checkpoint or it does not match)
+int checkpoint_load(const struct CheckpointSettings* settings, struct CheckpointState* state, int distributed);
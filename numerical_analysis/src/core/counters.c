@@ -0,0 +1,191 @@
+#include "counters.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <omp.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Used if the cache line size cannot be read from the system
+#define COUNTERS_DEFAULT_LINE_BYTES 64
+
+#ifdef __linux__
+
+static const unsigned long long event_configs[COUNTER_EVENT_COUNT] =
+{
+    PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES // Last level cache misses on most processors
+};
+
+// Value of an event along with how long it was enabled and how long it actually had a counter
+struct CounterRead
+{
+    unsigned long long value;
+    unsigned long long time_enabled;
+    unsigned long long time_running;
+};
+
+// Open an event counting the calling thread on whichever cpu it runs
+static int open_event(unsigned long long config)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+#endif
+
+int counters_open(struct Counters* counters, int threads)
+{
+    counters->threads = threads > 0 ? threads : 1;
+    counters->fds = malloc(sizeof(*counters->fds) * counters->threads * COUNTER_EVENT_COUNT);
+
+    for (int i = 0; i < counters->threads * COUNTER_EVENT_COUNT; ++i)
+    {
+        counters->fds[i] = -1;
+    }
+
+#ifdef __linux__
+    // Each thread of the team opens its own events since an event only follows the thread that
+    // opened it. Spare threads left over if the team is smaller keep their -1 descriptors
+    int* fds = counters->fds;
+
+#pragma omp parallel num_threads(counters->threads)
+    {
+        int* thread_fds = fds + omp_get_thread_num() * COUNTER_EVENT_COUNT;
+
+        for (int e = 0; e < COUNTER_EVENT_COUNT; ++e)
+        {
+            thread_fds[e] = open_event(event_configs[e]);
+        }
+    }
+#endif
+
+    int available = 0;
+
+    for (int e = 0; e < COUNTER_EVENT_COUNT; ++e)
+    {
+        int opened = 1;
+
+        for (int t = 0; t < counters->threads; ++t)
+        {
+            opened &= counters->fds[t * COUNTER_EVENT_COUNT + e] >= 0;
+        }
+
+        available += opened;
+    }
+
+    return available;
+}
+
+void counters_start(struct Counters* counters)
+{
+#ifdef __linux__
+    for (int i = 0; i < counters->threads * COUNTER_EVENT_COUNT; ++i)
+    {
+        if (counters->fds[i] >= 0)
+        {
+            ioctl(counters->fds[i], PERF_EVENT_IOC_RESET, 0);
+            ioctl(counters->fds[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+#endif
+}
+
+void counters_stop(struct Counters* counters, struct CounterValues* values)
+{
+    memset(values, 0, sizeof(*values));
+
+#ifdef __linux__
+    for (int i = 0; i < counters->threads * COUNTER_EVENT_COUNT; ++i)
+    {
+        if (counters->fds[i] >= 0)
+        {
+            ioctl(counters->fds[i], PERF_EVENT_IOC_DISABLE, 0);
+        }
+    }
+
+    for (int e = 0; e < COUNTER_EVENT_COUNT; ++e)
+    {
+        values->valid[e] = 1;
+
+        for (int t = 0; t < counters->threads; ++t)
+        {
+            const int fd = counters->fds[t * COUNTER_EVENT_COUNT + e];
+
+            struct CounterRead read_value;
+            if (fd < 0 || read(fd, &read_value, sizeof(read_value)) != sizeof(read_value))
+            {
+                values->valid[e] = 0;
+                continue;
+            }
+
+            // Estimate the full count from the part of the time the event was on a counter
+            double value = (double)read_value.value;
+            if (read_value.time_running > 0 && read_value.time_running < read_value.time_enabled)
+            {
+                value *= (double)read_value.time_enabled / read_value.time_running;
+            }
+
+            values->values[e] += (long long)value;
+        }
+    }
+#endif
+}
+
+void counters_close(struct Counters* counters)
+{
+#ifdef __linux__
+    for (int i = 0; i < counters->threads * COUNTER_EVENT_COUNT; ++i)
+    {
+        if (counters->fds[i] >= 0)
+        {
+            close(counters->fds[i]);
+        }
+    }
+#endif
+
+    free(counters->fds);
+    counters->fds = NULL;
+    counters->threads = 0;
+}
+
+const char* counter_event_name(enum CounterEvent event)
+{
+    switch (event)
+    {
+    case COUNTER_CYCLES: return "cycles";
+    case COUNTER_INSTRUCTIONS: return "instructions";
+    case COUNTER_LLC_MISSES: return "llc_misses";
+    default: return "unknown";
+    }
+}
+
+int counters_line_bytes(void)
+{
+#if defined(__linux__) && defined(_SC_LEVEL3_CACHE_LINESIZE)
+    long bytes = sysconf(_SC_LEVEL3_CACHE_LINESIZE);
+    if (bytes > 0)
+    {
+        return (int)bytes;
+    }
+#endif
+
+    return COUNTERS_DEFAULT_LINE_BYTES;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+// Hardware performance counters read through Linux perf_event_open so kernels can be placed on a
+// roofline (are they limited by memory bandwidth or by instruction throughput) without external tools
+// Only the user space work of the calling process is counted. On other platforms, in virtual machines
+// without a performance monitoring unit or when /proc/sys/kernel/perf_event_paranoid does not allow
+// it no events open and every value is reported as invalid
+
+// Memory traffic is estimated as one cache line moved for every last level cache miss. This misses
+// hardware prefetches that hit and counts write backs only when they cause a miss so it is a lower
+// bound for streaming kernels
+
+enum CounterEvent
+{
+    COUNTER_CYCLES = 0,
+    COUNTER_INSTRUCTIONS,
+    COUNTER_LLC_MISSES,
+    COUNTER_EVENT_COUNT
+};
+
+// Counters of one event per thread of an OpenMP team
+struct Counters
+{
+    int threads;
+    int* fds; // threads * COUNTER_EVENT_COUNT file descriptors (-1 if the event could not be opened)
+};
+
+struct CounterValues
+{
+    long long values[COUNTER_EVENT_COUNT]; // Summed over the threads
+    int valid[COUNTER_EVENT_COUNT]; // 0 if an event could not be counted on every thread
+};
+
+// Open every event on each thread of a team of the given size. Counting follows the threads that
+// opened the events so the counted code must run in teams of at most that many threads (OpenMP
+// keeps its threads between parallel regions). Threads of the team that are idle still count
+// while they wait for work
+// Returns the number of events that can be counted on every thread (0 if none can)
+int counters_open(struct Counters* counters, int threads);
+
+// Reset the counters to zero and start counting
+void counters_start(struct Counters* counters);
+
+// Stop counting and read the totals since counters_start. Counts are scaled up when the kernel had
+// to share the hardware counters between events (multiplexing)
+void counters_stop(struct Counters* counters, struct CounterValues* values);
+
+void counters_close(struct Counters* counters);
+
+// Name of an event as written in reports ("cycles", "instructions" or "llc_misses")
+const char* counter_event_name(enum CounterEvent event);
+
+// Bytes moved from memory for each last level cache miss (the cache line size)
+int counters_line_bytes(void);
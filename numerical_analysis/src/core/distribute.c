@@ -0,0 +1,241 @@
+#include "distribute.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "mpiutility.h"
+#include "frame.h"
+
+#ifndef ENABLE_MPI
+#define ENABLE_MPI 0
+#endif
+
+#if ENABLE_MPI
+#include <mpi.h>
+#endif
+
+void rowdist_balance(struct RowDistribution* dist, const int* row_offsets, int rows, int procs)
+{
+    dist->procs = procs;
+    dist->row_starts = malloc(sizeof(*dist->row_starts) * (procs + 1));
+
+    // Work done before row j is row_offsets[j] + j so the blocks are cut where
+    // the running total first reaches each rank's share
+    long long total = (long long)row_offsets[rows] + rows;
+    int row = 0;
+
+    dist->row_starts[0] = 0;
+
+    for (int r = 1; r < procs; ++r)
+    {
+        long long target = total * r / procs;
+
+        while (row < rows && (long long)row_offsets[row] + row < target)
+        {
+            ++row;
+        }
+
+        dist->row_starts[r] = row;
+    }
+
+    dist->row_starts[procs] = rows;
+}
+
+int rowdist_owner(const struct RowDistribution* dist, int row)
+{
+    // Binary search for the last rank starting at or before row
+    int low = 0;
+    int high = dist->procs - 1;
+
+    while (low < high)
+    {
+        int mid = (low + high + 1) / 2;
+
+        if (dist->row_starts[mid] <= row)
+        {
+            low = mid;
+        }
+        else
+        {
+            high = mid - 1;
+        }
+    }
+
+    // Skip ranks that own no rows
+    while (low < dist->procs - 1 && dist->row_starts[low + 1] <= row)
+    {
+        ++low;
+    }
+
+    return low;
+}
+
+void rowdist_release(struct RowDistribution* dist)
+{
+    if (dist)
+    {
+        free(dist->row_starts);
+        dist->row_starts = NULL;
+        dist->procs = 0;
+    }
+}
+
+int distribute_equations(const struct EquationSet* eqset, struct DistributedSystem* system)
+{
+#if ENABLE_MPI == 0
+    fprintf(stderr, "Warning: Attempting to use MPI functionality with MPI disabled\n");
+    return -1;
+#else
+
+    int rank = get_rank_mpi();
+    int procs = get_procs_mpi();
+    int root = get_main_mpi();
+
+    // Only the non zero values are sent so the root converts the matrix to sparse form
+    // and balances the ranks by the number of values rather than the number of rows
+    struct SparseMatrix full = { 0 };
+    int global_rows = 0;
+
+    system->dist.procs = procs;
+    system->dist.row_starts = malloc(sizeof(*system->dist.row_starts) * (procs + 1));
+
+    if (rank == root)
+    {
+        sparse_from_dense(&full, eqset->stiff_bc);
+        global_rows = full.rows;
+
+        struct RowDistribution dist;
+        rowdist_balance(&dist, full.row_offsets, full.rows, procs);
+
+        for (int r = 0; r <= procs; ++r)
+        {
+            system->dist.row_starts[r] = dist.row_starts[r];
+        }
+
+        rowdist_release(&dist);
+    }
+
+    MPI_Bcast(&global_rows, 1, MPI_INT, root, MPI_COMM_WORLD);
+    MPI_Bcast(system->dist.row_starts, procs + 1, MPI_INT, root, MPI_COMM_WORLD);
+
+    const int* row_starts = system->dist.row_starts;
+
+    system->global_rows = global_rows;
+    system->row_start = row_starts[rank];
+
+    int local_rows = row_starts[rank + 1] - row_starts[rank];
+
+    // MPI_Scatterv works like MPI_Scatter but every rank can receive a different amount
+    // given by counts and taken from the send buffer starting at displacements
+    // Only the root needs the counts for values but every rank knows its row counts
+    int* row_counts = malloc(sizeof(*row_counts) * procs);
+    int* row_displs = malloc(sizeof(*row_displs) * procs);
+    int* value_counts = malloc(sizeof(*value_counts) * procs);
+    int* value_displs = malloc(sizeof(*value_displs) * procs);
+    int* row_lengths = NULL;
+
+    for (int r = 0; r < procs; ++r)
+    {
+        row_counts[r] = row_starts[r + 1] - row_starts[r];
+        row_displs[r] = row_starts[r];
+    }
+
+    if (rank == root)
+    {
+        row_lengths = malloc(sizeof(*row_lengths) * (global_rows > 0 ? global_rows : 1));
+
+        for (int j = 0; j < global_rows; ++j)
+        {
+            row_lengths[j] = full.row_offsets[j + 1] - full.row_offsets[j];
+        }
+
+        for (int r = 0; r < procs; ++r)
+        {
+            value_displs[r] = full.row_offsets[row_starts[r]];
+            value_counts[r] = full.row_offsets[row_starts[r + 1]] - value_displs[r];
+        }
+    }
+
+    // Send the number of values in each row so ranks can size their buffers
+    int* local_lengths = malloc(sizeof(*local_lengths) * (local_rows > 0 ? local_rows : 1));
+    MPI_Scatterv(row_lengths, row_counts, row_displs, MPI_INT,
+        local_lengths, local_rows, MPI_INT, root, MPI_COMM_WORLD);
+
+    int local_nnz = 0;
+    for (int j = 0; j < local_rows; ++j)
+    {
+        local_nnz += local_lengths[j];
+    }
+
+    sparse_init(&system->matrix, local_rows, global_rows, local_nnz);
+
+    for (int j = 0; j < local_rows; ++j)
+    {
+        system->matrix.row_offsets[j + 1] = system->matrix.row_offsets[j] + local_lengths[j];
+    }
+
+    // Columns stay as global indices
+    MPI_Scatterv(full.columns, value_counts, value_displs, MPI_INT,
+        system->matrix.columns, local_nnz, MPI_INT, root, MPI_COMM_WORLD);
+
+    MPI_Scatterv(full.values, value_counts, value_displs, MPI_FLOAT,
+        system->matrix.values, local_nnz, MPI_FLOAT, root, MPI_COMM_WORLD);
+
+    system->forces = malloc(sizeof(*system->forces) * (local_rows > 0 ? local_rows : 1));
+    MPI_Scatterv(rank == root ? eqset->forces.elements : NULL, row_counts, row_displs, MPI_FLOAT,
+        system->forces, local_rows, MPI_FLOAT, root, MPI_COMM_WORLD);
+
+    free(local_lengths);
+    free(row_lengths);
+    free(value_displs);
+    free(value_counts);
+    free(row_displs);
+    free(row_counts);
+
+    if (rank == root)
+    {
+        sparse_release(&full);
+    }
+
+    return 0;
+
+#endif
+}
+
+void distributed_gather(const struct DistributedSystem* system, const float* local, float* full)
+{
+#if ENABLE_MPI == 0
+    fprintf(stderr, "Warning: Attempting to use MPI functionality with MPI disabled\n");
+#else
+
+    const int procs = system->dist.procs;
+
+    int* counts = malloc(sizeof(*counts) * procs);
+    int* displs = malloc(sizeof(*displs) * procs);
+
+    for (int r = 0; r < procs; ++r)
+    {
+        counts[r] = system->dist.row_starts[r + 1] - system->dist.row_starts[r];
+        displs[r] = system->dist.row_starts[r];
+    }
+
+    MPI_Gatherv(local, system->matrix.rows, MPI_FLOAT, full, counts, displs, MPI_FLOAT, get_main_mpi(), MPI_COMM_WORLD);
+
+    free(displs);
+    free(counts);
+
+#endif
+}
+
+void distributed_release(struct DistributedSystem* system)
+{
+    if (system)
+    {
+        rowdist_release(&system->dist);
+        sparse_release(&system->matrix);
+        free(system->forces);
+        system->forces = NULL;
+        system->row_start = 0;
+        system->global_rows = 0;
+    }
+}
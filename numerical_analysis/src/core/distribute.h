@@ -0,0 +1,44 @@
+#pragma once
+
+#include "sparse.h"
+
+struct EquationSet;
+
+// Contiguous blocks of rows owned by each rank
+// Rank r owns rows row_starts[r] up to (not including) row_starts[r + 1]
+struct RowDistribution
+{
+    int* row_starts; // procs + 1 entries
+    int procs;
+};
+
+// The part of an equation set owned by one rank
+struct DistributedSystem
+{
+    struct RowDistribution dist;
+    struct SparseMatrix matrix; // Owned rows with global column indices
+    float* forces; // Force entries for the owned rows
+    int row_start; // Global index of the first owned row
+    int global_rows;
+};
+
+// Split rows into contiguous blocks with close to the same amount of work in each
+// The work of a row is its number of stored values plus one so empty rows still count
+// Any number of ranks is allowed (some ranks get no rows if there are more ranks than rows)
+void rowdist_balance(struct RowDistribution* dist, const int* row_offsets, int rows, int procs);
+
+// Rank that owns a global row
+int rowdist_owner(const struct RowDistribution* dist, int row);
+
+void rowdist_release(struct RowDistribution* dist);
+
+// Collective. Convert the equation set to sparse form and send each rank only its rows
+// eqset is only read on the main rank and may be NULL elsewhere
+int distribute_equations(const struct EquationSet* eqset, struct DistributedSystem* system);
+
+// Collective. Collect a vector of owned rows from every rank into a full length vector on the main rank
+// full is only written on the main rank and may be NULL elsewhere
+void distributed_gather(const struct DistributedSystem* system, const float* local, float* full);
+
+// Frees resources held by the distributed system
+void distributed_release(struct DistributedSystem* system);
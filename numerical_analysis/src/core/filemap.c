@@ -0,0 +1,120 @@
+#include "filemap.h"
+
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+int filemap_open(const char* path, struct FileMap* map)
+{
+    memset(map, 0, sizeof(*map));
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        return -1;
+    }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size))
+    {
+        CloseHandle(file);
+        return -1;
+    }
+
+    // Empty files can not be mapped
+    if (size.QuadPart == 0)
+    {
+        CloseHandle(file);
+        return 0;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    void* data = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+    if (!data)
+    {
+        if (mapping)
+        {
+            CloseHandle(mapping);
+        }
+        CloseHandle(file);
+        return -1;
+    }
+
+    map->data = data;
+    map->size = (size_t)size.QuadPart;
+    map->file_handle = file;
+    map->mapping_handle = mapping;
+#else
+    int file = open(path, O_RDONLY);
+    if (file < 0)
+    {
+        return -1;
+    }
+
+    struct stat info;
+    if (fstat(file, &info))
+    {
+        close(file);
+        return -1;
+    }
+
+    // Empty files can not be mapped
+    if (info.st_size == 0)
+    {
+        close(file);
+        return 0;
+    }
+
+    void* data = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+
+    // The mapping stays valid after the descriptor is closed
+    close(file);
+
+    if (data == MAP_FAILED)
+    {
+        return -1;
+    }
+
+    map->data = data;
+    map->size = (size_t)info.st_size;
+#endif
+
+    return 0;
+}
+
+void filemap_will_need(const struct FileMap* map)
+{
+#ifndef _WIN32
+    if (map->data)
+    {
+        posix_madvise((void*)map->data, map->size, POSIX_MADV_WILLNEED);
+    }
+#endif
+}
+
+void filemap_close(struct FileMap* map)
+{
+    if (map && map->data)
+    {
+#ifdef _WIN32
+        UnmapViewOfFile(map->data);
+        CloseHandle(map->mapping_handle);
+        CloseHandle(map->file_handle);
+#else
+        munmap((void*)map->data, map->size);
+#endif
+    }
+
+    if (map)
+    {
+        memset(map, 0, sizeof(*map));
+    }
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stddef.h>
+
+// A whole file mapped into memory read only
+// Pages are only read from disk when first touched
+struct FileMap
+{
+    const char* data; // NULL for an empty file
+    size_t size;
+
+    // Handles kept open while mapped on Windows (unused elsewhere)
+    void* file_handle;
+    void* mapping_handle;
+};
+
+// Map the file at path. Returns 0 on success or -1 if it could not be opened or mapped
+int filemap_open(const char* path, struct FileMap* map);
+
+// Hint that the whole file is about to be read so the OS can read ahead of the reader
+void filemap_will_need(const struct FileMap* map);
+
+// Unmap the file
+void filemap_close(struct FileMap* map);
@@ -0,0 +1,637 @@
+#include "halo.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "mpiutility.h"
+#include "distribute.h"
+
+#ifndef ENABLE_MPI
+#define ENABLE_MPI 0
+#endif
+
+#if ENABLE_MPI
+#include <mpi.h>
+#endif
+
+#define TAG_HALO 10
+#define TAG_HALO_GROUPS 11
+#define TAG_HALO_REVERSE 12
+
+static int compare_ints(const void* a, const void* b)
+{
+    int left = *(const int*)a;
+    int right = *(const int*)b;
+    return (left > right) - (left < right);
+}
+
+// Binary search a sorted array
+static int find_sorted(const int* values, int count, int value)
+{
+    int low = 0;
+    int high = count - 1;
+
+    while (low <= high)
+    {
+        int mid = (low + high) / 2;
+
+        if (values[mid] < value)
+        {
+            low = mid + 1;
+        }
+        else if (values[mid] > value)
+        {
+            high = mid - 1;
+        }
+        else
+        {
+            return mid;
+        }
+    }
+
+    return -1;
+}
+
+// Build the plan from sorted, unique ghost indices (takes ownership of ghosts)
+static int halo_plan(const struct RowDistribution* dist, int rank, int* ghosts, int ghost_count, struct HaloExchange* halo)
+{
+#if ENABLE_MPI == 0
+    fprintf(stderr, "Warning: Attempting to use MPI functionality with MPI disabled\n");
+    free(ghosts);
+    return -1;
+#else
+
+    const int procs = dist->procs;
+
+    memset(halo, 0, sizeof(*halo));
+    halo->local_rows = dist->row_starts[rank + 1] - dist->row_starts[rank];
+    halo->ghost_count = ghost_count;
+    halo->ghost_globals = ghosts;
+
+    // Ghosts are sorted and ownership is contiguous so the ghosts from each rank are consecutive
+    int* need_counts = calloc(procs, sizeof(*need_counts));
+
+    for (int g = 0; g < ghost_count; ++g)
+    {
+        need_counts[rowdist_owner(dist, ghosts[g])]++;
+    }
+
+    halo->recv_ranks = malloc(sizeof(*halo->recv_ranks) * (procs > 0 ? procs : 1));
+    halo->recv_offsets = malloc(sizeof(*halo->recv_offsets) * (procs + 1));
+    halo->recv_offsets[0] = 0;
+
+    for (int r = 0; r < procs; ++r)
+    {
+        if (need_counts[r] > 0)
+        {
+            halo->recv_ranks[halo->recv_count] = r;
+            halo->recv_offsets[halo->recv_count + 1] = halo->recv_offsets[halo->recv_count] + need_counts[r];
+            halo->recv_count++;
+        }
+    }
+
+    // Every rank tells every other rank how many entries it needs from it.
+    // This is the only step that involves all ranks and only happens during setup
+    int* give_counts = malloc(sizeof(*give_counts) * procs);
+    MPI_Alltoall(need_counts, 1, MPI_INT, give_counts, 1, MPI_INT, MPI_COMM_WORLD);
+
+    // Then sends the list of global indices it needs
+    int* need_displs = malloc(sizeof(*need_displs) * procs);
+    int* give_displs = malloc(sizeof(*give_displs) * procs);
+    int give_total = 0;
+
+    for (int r = 0, need_total = 0; r < procs; ++r)
+    {
+        need_displs[r] = need_total;
+        need_total += need_counts[r];
+        give_displs[r] = give_total;
+        give_total += give_counts[r];
+    }
+
+    halo->send_indices = malloc(sizeof(*halo->send_indices) * (give_total > 0 ? give_total : 1));
+    MPI_Alltoallv(ghosts, need_counts, need_displs, MPI_INT,
+        halo->send_indices, give_counts, give_displs, MPI_INT, MPI_COMM_WORLD);
+
+    // Convert the requested global indices into local indices of owned entries
+    const int row_start = dist->row_starts[rank];
+    for (int i = 0; i < give_total; ++i)
+    {
+        halo->send_indices[i] -= row_start;
+    }
+
+    halo->send_ranks = malloc(sizeof(*halo->send_ranks) * (procs > 0 ? procs : 1));
+    halo->send_offsets = malloc(sizeof(*halo->send_offsets) * (procs + 1));
+    halo->send_offsets[0] = 0;
+
+    for (int r = 0; r < procs; ++r)
+    {
+        if (give_counts[r] > 0)
+        {
+            halo->send_ranks[halo->send_count] = r;
+            halo->send_offsets[halo->send_count + 1] = halo->send_offsets[halo->send_count] + give_counts[r];
+            halo->send_count++;
+        }
+    }
+
+    halo->send_buffer = malloc(sizeof(*halo->send_buffer) * (give_total > 0 ? give_total : 1));
+
+    free(give_displs);
+    free(need_displs);
+    free(give_counts);
+    free(need_counts);
+
+    return 0;
+
+#endif
+}
+
+int halo_create(struct DistributedSystem* system, struct HaloExchange* halo)
+{
+    const int rank = get_rank_mpi();
+    const int row_start = system->row_start;
+    const int row_end = row_start + system->matrix.rows;
+    struct SparseMatrix* matrix = &system->matrix;
+
+    // Every column outside the owned range is a ghost
+    int* ghosts = malloc(sizeof(*ghosts) * (matrix->nnz > 0 ? matrix->nnz : 1));
+    int ghost_count = 0;
+
+    for (int k = 0; k < matrix->nnz; ++k)
+    {
+        int col = matrix->columns[k];
+        if (col < row_start || col >= row_end)
+        {
+            ghosts[ghost_count++] = col;
+        }
+    }
+
+    qsort(ghosts, ghost_count, sizeof(*ghosts), compare_ints);
+
+    int unique = 0;
+    for (int g = 0; g < ghost_count; ++g)
+    {
+        if (unique == 0 || ghosts[unique - 1] != ghosts[g])
+        {
+            ghosts[unique++] = ghosts[g];
+        }
+    }
+
+    if (halo_plan(&system->dist, rank, ghosts, unique, halo))
+    {
+        return -1;
+    }
+
+    // Renumber columns so the matrix can be used directly with local vectors
+    for (int k = 0; k < matrix->nnz; ++k)
+    {
+        matrix->columns[k] = halo_local_index(halo, row_start, matrix->columns[k]);
+    }
+
+    matrix->cols = halo->local_rows + halo->ghost_count;
+
+    return 0;
+}
+
+int halo_create_indices(const struct RowDistribution* dist, int rank, const int* needed, int count, struct HaloExchange* halo)
+{
+    const int row_start = dist->row_starts[rank];
+    const int row_end = dist->row_starts[rank + 1];
+
+    int* ghosts = malloc(sizeof(*ghosts) * (count > 0 ? count : 1));
+    int ghost_count = 0;
+
+    for (int i = 0; i < count; ++i)
+    {
+        if (needed[i] < row_start || needed[i] >= row_end)
+        {
+            ghosts[ghost_count++] = needed[i];
+        }
+    }
+
+    qsort(ghosts, ghost_count, sizeof(*ghosts), compare_ints);
+
+    int unique = 0;
+    for (int g = 0; g < ghost_count; ++g)
+    {
+        if (unique == 0 || ghosts[unique - 1] != ghosts[g])
+        {
+            ghosts[unique++] = ghosts[g];
+        }
+    }
+
+    return halo_plan(dist, rank, ghosts, unique, halo);
+}
+
+int halo_local_index(const struct HaloExchange* halo, int row_start, int global)
+{
+    if (global >= row_start && global < row_start + halo->local_rows)
+    {
+        return global - row_start;
+    }
+
+    int g = find_sorted(halo->ghost_globals, halo->ghost_count, global);
+
+    return g == -1 ? -1 : halo->local_rows + g;
+}
+
+void halo_bind(struct HaloExchange* halo, float* x)
+{
+#if ENABLE_MPI
+
+    // Persistent requests are set up once and restarted every exchange which saves
+    // MPI from matching the message parameters every iteration
+    int total = halo->recv_count + halo->send_count;
+
+    if (halo->requests)
+    {
+        MPI_Request* old = halo->requests;
+        for (int i = 0; i < total; ++i)
+        {
+            MPI_Request_free(&old[i]);
+        }
+        free(old);
+    }
+
+    MPI_Request* requests = malloc(sizeof(*requests) * (total > 0 ? total : 1));
+
+    for (int n = 0; n < halo->recv_count; ++n)
+    {
+        int offset = halo->recv_offsets[n];
+        int count = halo->recv_offsets[n + 1] - offset;
+
+        // Ghosts land directly in the vector after the owned entries
+        MPI_Recv_init(x + halo->local_rows + offset, count, MPI_FLOAT, halo->recv_ranks[n],
+            TAG_HALO, MPI_COMM_WORLD, &requests[n]);
+    }
+
+    for (int n = 0; n < halo->send_count; ++n)
+    {
+        int offset = halo->send_offsets[n];
+        int count = halo->send_offsets[n + 1] - offset;
+
+        MPI_Send_init(halo->send_buffer + offset, count, MPI_FLOAT, halo->send_ranks[n],
+            TAG_HALO, MPI_COMM_WORLD, &requests[halo->recv_count + n]);
+    }
+
+    halo->bound = x;
+    halo->requests = requests;
+
+#endif
+}
+
+void halo_start(struct HaloExchange* halo)
+{
+#if ENABLE_MPI
+
+    // Pack the owned values other ranks need into the contiguous send buffer
+    int total_send = halo->send_offsets[halo->send_count];
+    for (int i = 0; i < total_send; ++i)
+    {
+        halo->send_buffer[i] = halo->bound[halo->send_indices[i]];
+    }
+
+    MPI_Startall(halo->recv_count + halo->send_count, halo->requests);
+
+#endif
+}
+
+void halo_finish(struct HaloExchange* halo)
+{
+#if ENABLE_MPI
+
+    MPI_Waitall(halo->recv_count + halo->send_count, halo->requests, MPI_STATUSES_IGNORE);
+
+#endif
+}
+
+int halo_test(struct HaloExchange* halo)
+{
+#if ENABLE_MPI
+
+    int complete = 0;
+    MPI_Testall(halo->recv_count + halo->send_count, halo->requests, &complete, MPI_STATUSES_IGNORE);
+
+    return complete;
+
+#else
+
+    return 1;
+
+#endif
+}
+
+void halo_exchange(struct HaloExchange* halo)
+{
+    halo_start(halo);
+    halo_finish(halo);
+}
+
+void halo_reverse_add(struct HaloExchange* halo, float* x)
+{
+#if ENABLE_MPI
+
+    // The send lists of the forward exchange say which owned entries each neighbor holds
+    // as ghosts so the same lists tell where the returned values go. The send buffer
+    // is free between forward exchanges and receives the returned values
+    const int total = halo->recv_count + halo->send_count;
+    MPI_Request* requests = malloc(sizeof(*requests) * (total > 0 ? total : 1));
+
+    for (int n = 0; n < halo->send_count; ++n)
+    {
+        int offset = halo->send_offsets[n];
+        int count = halo->send_offsets[n + 1] - offset;
+
+        MPI_Irecv(halo->send_buffer + offset, count, MPI_FLOAT, halo->send_ranks[n],
+            TAG_HALO_REVERSE, MPI_COMM_WORLD, &requests[n]);
+    }
+
+    for (int n = 0; n < halo->recv_count; ++n)
+    {
+        int offset = halo->recv_offsets[n];
+        int count = halo->recv_offsets[n + 1] - offset;
+
+        MPI_Isend(x + halo->local_rows + offset, count, MPI_FLOAT, halo->recv_ranks[n],
+            TAG_HALO_REVERSE, MPI_COMM_WORLD, &requests[halo->send_count + n]);
+    }
+
+    MPI_Waitall(total, requests, MPI_STATUSES_IGNORE);
+
+    // An entry can be a ghost on several neighbors so each value is added in turn
+    int total_send = halo->send_offsets[halo->send_count];
+    for (int i = 0; i < total_send; ++i)
+    {
+        x[halo->send_indices[i]] += halo->send_buffer[i];
+    }
+
+    free(requests);
+
+#endif
+}
+
+void halo_release(struct HaloExchange* halo)
+{
+    if (!halo)
+    {
+        return;
+    }
+
+#if ENABLE_MPI
+
+    if (halo->requests)
+    {
+        MPI_Request* requests = halo->requests;
+        for (int i = 0; i < halo->recv_count + halo->send_count; ++i)
+        {
+            MPI_Request_free(&requests[i]);
+        }
+    }
+
+#endif
+
+    free(halo->requests);
+    free(halo->ghost_globals);
+    free(halo->recv_ranks);
+    free(halo->recv_offsets);
+    free(halo->send_ranks);
+    free(halo->send_offsets);
+    free(halo->send_indices);
+    free(halo->send_buffer);
+
+    memset(halo, 0, sizeof(*halo));
+}
+
+
+#if ENABLE_MPI
+
+// Counting sort of entries by (group, neighbor) into offsets and a list of entry values
+static void sort_by_group(const int* entry_groups, const int* neighbor_offsets, int neighbor_count, int group_count,
+    const int* values, int* offsets, int* sorted)
+{
+    const int keys = group_count * neighbor_count;
+
+    for (int k = 0; k <= keys; ++k)
+    {
+        offsets[k] = 0;
+    }
+
+    for (int n = 0; n < neighbor_count; ++n)
+    {
+        for (int i = neighbor_offsets[n]; i < neighbor_offsets[n + 1]; ++i)
+        {
+            offsets[entry_groups[i] * neighbor_count + n + 1]++;
+        }
+    }
+
+    for (int k = 0; k < keys; ++k)
+    {
+        offsets[k + 1] += offsets[k];
+    }
+
+    int* cursor = malloc(sizeof(*cursor) * (keys > 0 ? keys : 1));
+    for (int k = 0; k < keys; ++k)
+    {
+        cursor[k] = offsets[k];
+    }
+
+    // Entries keep their order within a neighbor so both sides of a message agree on it
+    for (int n = 0; n < neighbor_count; ++n)
+    {
+        for (int i = neighbor_offsets[n]; i < neighbor_offsets[n + 1]; ++i)
+        {
+            sorted[cursor[entry_groups[i] * neighbor_count + n]++] = values[i];
+        }
+    }
+
+    free(cursor);
+}
+
+#endif
+
+int halo_groups_create(const struct HaloExchange* halo, const int* owned_groups, int group_count, struct HaloGroups* groups)
+{
+    memset(groups, 0, sizeof(*groups));
+
+#if ENABLE_MPI == 0
+    fprintf(stderr, "Warning: Attempting to use MPI functionality with MPI disabled\n");
+    return -1;
+#else
+
+    const int total_send = halo->send_offsets[halo->send_count];
+    const int total_recv = halo->recv_offsets[halo->recv_count];
+
+    // Send the group of every entry a neighbor receives so both sides can split their
+    // messages the same way. Only done once so plain non blocking messages are used
+    int* send_groups = malloc(sizeof(*send_groups) * (total_send > 0 ? total_send : 1));
+    int* recv_groups = malloc(sizeof(*recv_groups) * (total_recv > 0 ? total_recv : 1));
+    MPI_Request* requests = malloc(sizeof(*requests) * (halo->recv_count + halo->send_count + 1));
+
+    for (int i = 0; i < total_send; ++i)
+    {
+        send_groups[i] = owned_groups[halo->send_indices[i]];
+
+        if (send_groups[i] < 0 || send_groups[i] >= group_count)
+        {
+            fprintf(stderr, "Error creating halo groups: entry %i has group %i outside of 0 to %i\n",
+                halo->send_indices[i], send_groups[i], group_count - 1);
+            send_groups[i] = 0;
+        }
+    }
+
+    for (int n = 0; n < halo->recv_count; ++n)
+    {
+        MPI_Irecv(recv_groups + halo->recv_offsets[n], halo->recv_offsets[n + 1] - halo->recv_offsets[n], MPI_INT,
+            halo->recv_ranks[n], TAG_HALO_GROUPS, MPI_COMM_WORLD, &requests[n]);
+    }
+
+    for (int n = 0; n < halo->send_count; ++n)
+    {
+        MPI_Isend(send_groups + halo->send_offsets[n], halo->send_offsets[n + 1] - halo->send_offsets[n], MPI_INT,
+            halo->send_ranks[n], TAG_HALO_GROUPS, MPI_COMM_WORLD, &requests[halo->recv_count + n]);
+    }
+
+    MPI_Waitall(halo->recv_count + halo->send_count, requests, MPI_STATUSES_IGNORE);
+    free(requests);
+
+    groups->group_count = group_count;
+    groups->send_count = halo->send_count;
+    groups->recv_count = halo->recv_count;
+
+    groups->send_offsets = malloc(sizeof(*groups->send_offsets) * (group_count * halo->send_count + 1));
+    groups->send_indices = malloc(sizeof(*groups->send_indices) * (total_send > 0 ? total_send : 1));
+    groups->send_buffer = malloc(sizeof(*groups->send_buffer) * (total_send > 0 ? total_send : 1));
+
+    sort_by_group(send_groups, halo->send_offsets, halo->send_count, group_count,
+        halo->send_indices, groups->send_offsets, groups->send_indices);
+
+    // Ghost k sits at local index local_rows + k
+    int* ghost_indices = malloc(sizeof(*ghost_indices) * (total_recv > 0 ? total_recv : 1));
+    for (int k = 0; k < total_recv; ++k)
+    {
+        ghost_indices[k] = halo->local_rows + k;
+    }
+
+    groups->recv_offsets = malloc(sizeof(*groups->recv_offsets) * (group_count * halo->recv_count + 1));
+    groups->recv_indices = malloc(sizeof(*groups->recv_indices) * (total_recv > 0 ? total_recv : 1));
+    groups->recv_buffer = malloc(sizeof(*groups->recv_buffer) * (total_recv > 0 ? total_recv : 1));
+
+    sort_by_group(recv_groups, halo->recv_offsets, halo->recv_count, group_count,
+        ghost_indices, groups->recv_offsets, groups->recv_indices);
+
+    free(ghost_indices);
+    free(recv_groups);
+    free(send_groups);
+
+    // Persistent requests for every non empty message of every group
+    groups->request_offsets = calloc(group_count + 1, sizeof(*groups->request_offsets));
+    requests = malloc(sizeof(*requests) * (group_count * (halo->recv_count + halo->send_count) + 1));
+
+    int count = 0;
+    for (int g = 0; g < group_count; ++g)
+    {
+        for (int n = 0; n < halo->recv_count; ++n)
+        {
+            int first = groups->recv_offsets[g * halo->recv_count + n];
+            int size = groups->recv_offsets[g * halo->recv_count + n + 1] - first;
+
+            if (size > 0)
+            {
+                MPI_Recv_init(groups->recv_buffer + first, size, MPI_FLOAT, halo->recv_ranks[n],
+                    TAG_HALO_GROUPS, MPI_COMM_WORLD, &requests[count++]);
+            }
+        }
+
+        for (int n = 0; n < halo->send_count; ++n)
+        {
+            int first = groups->send_offsets[g * halo->send_count + n];
+            int size = groups->send_offsets[g * halo->send_count + n + 1] - first;
+
+            if (size > 0)
+            {
+                MPI_Send_init(groups->send_buffer + first, size, MPI_FLOAT, halo->send_ranks[n],
+                    TAG_HALO_GROUPS, MPI_COMM_WORLD, &requests[count++]);
+            }
+        }
+
+        groups->request_offsets[g + 1] = count;
+    }
+
+    groups->requests = requests;
+
+    return 0;
+
+#endif
+}
+
+void halo_groups_start(struct HaloGroups* groups, const float* x, int group)
+{
+#if ENABLE_MPI
+
+    // The entries of one group are contiguous across all of its neighbors
+    const int first = groups->send_offsets[group * groups->send_count];
+    const int last = groups->send_offsets[(group + 1) * groups->send_count];
+
+    for (int i = first; i < last; ++i)
+    {
+        groups->send_buffer[i] = x[groups->send_indices[i]];
+    }
+
+    MPI_Request* requests = groups->requests;
+    const int first_request = groups->request_offsets[group];
+
+    MPI_Startall(groups->request_offsets[group + 1] - first_request, requests + first_request);
+
+#endif
+}
+
+void halo_groups_finish(struct HaloGroups* groups, float* x, int group)
+{
+#if ENABLE_MPI
+
+    MPI_Request* requests = groups->requests;
+    const int first_request = groups->request_offsets[group];
+
+    MPI_Waitall(groups->request_offsets[group + 1] - first_request, requests + first_request, MPI_STATUSES_IGNORE);
+
+    const int first = groups->recv_offsets[group * groups->recv_count];
+    const int last = groups->recv_offsets[(group + 1) * groups->recv_count];
+
+    for (int i = first; i < last; ++i)
+    {
+        x[groups->recv_indices[i]] = groups->recv_buffer[i];
+    }
+
+#endif
+}
+
+void halo_groups_release(struct HaloGroups* groups)
+{
+    if (!groups)
+    {
+        return;
+    }
+
+#if ENABLE_MPI
+
+    if (groups->requests)
+    {
+        MPI_Request* requests = groups->requests;
+        for (int i = 0; i < groups->request_offsets[groups->group_count]; ++i)
+        {
+            MPI_Request_free(&requests[i]);
+        }
+    }
+
+#endif
+
+    free(groups->requests);
+    free(groups->request_offsets);
+    free(groups->send_offsets);
+    free(groups->send_indices);
+    free(groups->send_buffer);
+    free(groups->recv_offsets);
+    free(groups->recv_indices);
+    free(groups->recv_buffer);
+
+    memset(groups, 0, sizeof(*groups));
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+struct DistributedSystem;
+struct RowDistribution;
+
+// Plan for exchanging only the vector entries a rank needs from other ranks
+// A local vector holds the owned rows first followed by "ghost" entries owned by other ranks
+// Ghosts are sorted by global index so the ghosts from each rank are consecutive
+struct HaloExchange
+{
+    int local_rows; // Owned entries at the start of a local vector
+    int ghost_count; // Entries after the owned ones that are received from other ranks
+    int* ghost_globals; // Global index of each ghost
+
+    // Ranks ghosts are received from. Ghosts from recv_ranks[n] are entries
+    // recv_offsets[n] up to (not including) recv_offsets[n + 1] after the owned entries
+    int recv_count;
+    int* recv_ranks;
+    int* recv_offsets;
+
+    // Ranks owned entries are sent to. The local indices sent to send_ranks[n] are
+    // send_indices[send_offsets[n]] up to (not including) send_indices[send_offsets[n + 1]]
+    int send_count;
+    int* send_ranks;
+    int* send_offsets;
+    int* send_indices;
+    float* send_buffer;
+
+    // Persistent requests for the vector the plan is bound to (see halo_bind)
+    float* bound;
+    void* requests;
+};
+
+// Exchange of only the entries belonging to one group at a time (such as the rows of one color)
+// Built on top of a HaloExchange plan. Entries sent to send_ranks[n] for group g are
+// send_indices[send_offsets[g * send_count + n]] up to (not including) send_offsets[g * send_count + n + 1]
+// and received entries are laid out the same way with recv_indices giving their place in the vector
+struct HaloGroups
+{
+    int group_count;
+    int send_count; // Same neighbors as the plan the groups were built from
+    int recv_count;
+
+    int* send_offsets; // group_count * send_count + 1 entries
+    int* send_indices;
+    float* send_buffer;
+
+    int* recv_offsets; // group_count * recv_count + 1 entries
+    int* recv_indices;
+    float* recv_buffer;
+
+    // Persistent requests of group g are requests[request_offsets[g]] up to request_offsets[g + 1]
+    // Neighbors that share no entries of a group do not exchange a message for it
+    int* request_offsets;
+    void* requests;
+};
+
+// Collective. Build the exchange plan for a distributed system from the columns its rows use
+// and renumber the system's matrix columns to local vector indices (owned then ghosts)
+int halo_create(struct DistributedSystem* system, struct HaloExchange* halo);
+
+// Collective. Build an exchange plan for an arbitrary set of global indices that this rank needs
+// (indices owned by this rank are ignored). needed does not need to be sorted or unique
+int halo_create_indices(const struct RowDistribution* dist, int rank, const int* needed, int count, struct HaloExchange* halo);
+
+// Local index of a global index in a vector laid out by the plan or -1 if it is not present
+int halo_local_index(const struct HaloExchange* halo, int row_start, int global);
+
+// Create the persistent send/receive requests for a local vector of local_rows + ghost_count entries
+// The vector must stay at the same address while bound. Binding again replaces the previous binding
+void halo_bind(struct HaloExchange* halo, float* x);
+
+// Pack the owned values other ranks need and start all sends and receives
+void halo_start(struct HaloExchange* halo);
+
+// Wait until all ghosts of the bound vector have arrived (and sends have completed)
+void halo_finish(struct HaloExchange* halo);
+
+// Check whether the exchange has completed without blocking. Returns 1 once every send and
+// receive is done (halo_finish must still be called). Calling this while doing other work
+// lets MPI make progress on the messages
+int halo_test(struct HaloExchange* halo);
+
+// Start and finish in one call
+void halo_exchange(struct HaloExchange* halo);
+
+// Exchange in the opposite direction. The ghosts of x are sent back to their owners and added
+// to the owned entries (such as corrections computed for rows owned by other processes)
+// Uses its own messages so x does not need to be bound. Ghosts of x are left unchanged
+void halo_reverse_add(struct HaloExchange* halo, float* x);
+
+// Frees resources (and requests) held by the plan
+void halo_release(struct HaloExchange* halo);
+
+// Collective. Split a plan into groups given the group (0 to group_count - 1) of every owned entry
+// The groups of the ghosts are learned from their owners
+int halo_groups_create(const struct HaloExchange* halo, const int* owned_groups, int group_count, struct HaloGroups* groups);
+
+// Pack the owned entries of one group from x and start sending and receiving them
+void halo_groups_start(struct HaloGroups* groups, const float* x, int group);
+
+// Wait for one group's messages and place the received ghosts in x
+void halo_groups_finish(struct HaloGroups* groups, float* x, int group);
+
+// Frees resources (and requests) held by the groups
+void halo_groups_release(struct HaloGroups* groups);
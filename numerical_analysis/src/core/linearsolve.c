@@ -4,6 +4,11 @@
 #include <omp.h>
 
 #include "frame.h"
+#include "permutation.h"
+#include "sparse.h"
+#include "schwarz.h"
+#include "checkpoint.h"
+#include "trace.h"
 
 #define PRINT_DEBUG 0
 
@@ -64,6 +69,8 @@ void solve_jacobi_single(struct EquationSet eqset, float* residuals, int iterati
 
     for (int t = 0; t < iterations; ++t)
     {
+        TRACE_BEGIN("jacobi iteration");
+
         float sum_sqr_residual = 0;
 
         for (int j = 0; j < rows; ++j)
@@ -115,6 +122,8 @@ void solve_jacobi_single(struct EquationSet eqset, float* residuals, int iterati
 
         // store the norm of residuals for this iteration
         residuals[t] = sqrt(sum_sqr_residual);
+
+        TRACE_END();
     }
 
     free(vec_x_prev);
@@ -122,79 +131,115 @@ void solve_jacobi_single(struct EquationSet eqset, float* residuals, int iterati
 
 
 void solve_jacobi_parallel(struct EquationSet eqset, float* residuals, int iterations, int desired_threads)
+{
+    // Plain Jacobi is weighted Jacobi with a weight of 1
+    solve_jacobi_weighted_parallel(eqset, residuals, iterations, desired_threads, 1.0f);
+}
+
+
+void solve_jacobi_weighted_parallel(struct EquationSet eqset, float* residuals, int iterations, int desired_threads, float weight)
 {
     // See solve_jacobi_single for more details on the math involved
 
+    // Weighted (damped) Jacobi only moves part way towards the Jacobi estimate
+    // x_j( k+1 ) = x_j( k ) + w * r_j( k ) / A_jj
+    // which can make an otherwise divergent Jacobi iteration converge when 0 < w < 1
+
+    // Each iteration is a single pass over the rows that computes the row times x,
+    // the residual, the update and the partial residual norm together. The rows are
+    // split into one contiguous block per thread so each thread streams through its
+    // own part of the matrix. The vectors for consecutive iterations trade places by
+    // swapping pointers instead of copying
+
     if (desired_threads < 1)
     {
         // Most likely not intended
         printf("Warning: Attempted to solve with desired_threads less than 1");
         return;
     }
-    else if (desired_threads == 1)
-    {
-        // Use the single threaded solution instead
-        solve_jacobi_single(eqset, residuals, iterations);
-        return;
-    }
 
     const float* matrix_a = eqset.stiff_bc.elements;
     const float* vector_b = eqset.forces.elements;
-    float* vec_x_curr = eqset.displacements.elements;
     const int rows = eqset.stiff_bc.rows;
     const int cols = eqset.stiff_bc.cols;
 
-    // Need space to store the values from the previous iteration
-    float* vec_x_prev = malloc(sizeof(*vec_x_prev) * cols);
+    // The result must end up in the equation set so it is one of the two buffers
+    float* buffer = malloc(sizeof(*buffer) * cols);
+    float* inv_diag = malloc(sizeof(*inv_diag) * rows);
+
+    float* vec_x_prev = buffer;
+    float* vec_x_curr = eqset.displacements.elements;
+
+    // Shared between threads. Only written inside the reduction or by a single thread
+    float sum_sqr_residual = 0;
 
-    // Multi-threaded
 #pragma omp parallel num_threads(desired_threads)
-    // for (int t = 0; t < 10; ++t) dohh
-    for (int t = 0; t < iterations; ++t)
     {
-        float sum_sqr_residual = 0;
+        // Set initial guess to x_i = b_i / A_ii and store the inverse of the diagonal
+        // Normally would need to check if the diagonal could be zero but that should
+        // have been ensured when applying boundary conditions
+#pragma omp for schedule(static)
+        for (int i = 0; i < rows; ++i)
+        {
+            inv_diag[i] = 1.0f / matrix_a[i + i * cols];
+            vec_x_prev[i] = vector_b[i] * inv_diag[i];
+        }
 
-        // update multiple rows at a time
-#pragma omp for schedule(dynamic)
-        for (int j = 0; j < rows; ++j)
+        for (int t = 0; t < iterations; ++t)
         {
-            // sum up A_ij * x_i
-            float sum_ax = 0;
-            for (int i = 0; i < cols; ++i)
+            TRACE_BEGIN("jacobi iteration");
+
+#pragma omp for schedule(static) reduction(+:sum_sqr_residual)
+            for (int j = 0; j < rows; ++j)
             {
-                sum_ax += matrix_a[i + j * cols] * vec_x_prev[i];
-            }
+                const float* row = matrix_a + j * cols;
 
-            // subtract the sum from b_j to get the residual
-            float residual = vector_b[j] - sum_ax;
+                // sum up A_ij * x_i
+                float sum_ax = 0;
+                for (int i = 0; i < cols; ++i)
+                {
+                    sum_ax += row[i] * vec_x_prev[i];
+                }
 
-            // Add the square residual to the running sum of square residuals
-            sum_sqr_residual += residual * residual;
+                // subtract the sum from b_j to get the residual
+                float residual = vector_b[j] - sum_ax;
 
-            // The diagonal element for row j
-            float k_jj = matrix_a[j + j * cols];
+                sum_sqr_residual += residual * residual;
 
-            // Solve for the new estimate of x_j
-            float x_j = (residual + k_jj * vec_x_prev[j]) / k_jj;
+                // Move x_j towards the new estimate
+                vec_x_curr[j] = vec_x_prev[j] + weight * residual * inv_diag[j];
+            }
 
-            // update x_j to the new estimate
-            vec_x_curr[j] = x_j;
+            // The loop above ends with a barrier so every thread has finished both
+            // reading prev and writing curr. One thread records the residual and swaps
+            // and the barrier at the end of single publishes the swap to the others
+#pragma omp single
+            {
+                residuals[t] = sqrt(sum_sqr_residual);
+                sum_sqr_residual = 0;
+
+                float* temp = vec_x_prev;
+                vec_x_prev = vec_x_curr;
+                vec_x_curr = temp;
+            }
+
+            TRACE_END();
         }
 
-        // Update previous x to current x for the next iteration if there are still iterations to do
-        if (t < iterations - 1)
+        // After the final swap the latest values are in prev. Copy them into the
+        // equation set if they ended up in the temporary buffer
+        if (vec_x_prev != eqset.displacements.elements)
         {
-            for (int i = 0; i < cols; ++i)
+#pragma omp for schedule(static)
+            for (int i = 0; i < rows; ++i)
             {
-                vec_x_prev[i] = vec_x_curr[i];
+                eqset.displacements.elements[i] = vec_x_prev[i];
             }
         }
-
-        // store the norm of residuals for this iteration
-        residuals[t] = sqrt(sum_sqr_residual);
     }
 
-    free(vec_x_prev);
+    free(inv_diag);
+    free(buffer);
 }
 
 
@@ -233,6 +278,8 @@ void solve_sor_single(struct EquationSet eqset, float* residuals, int iterations
 
     for (int t = 0; t < iterations; ++t)
     {
+        TRACE_BEGIN("sor iteration");
+
         float sum_sqr_residual = 0;
 
         for (int j = 0; j < rows; ++j)
@@ -279,12 +326,302 @@ void solve_sor_single(struct EquationSet eqset, float* residuals, int iterations
 
         // store the norm of residuals for this iteration
         residuals[t] = sqrt(sum_sqr_residual);
+
+        TRACE_END();
     }
 
     free(vec_x_prev);
 }
 
 
+void solve_sor_multicolor(struct EquationSet eqset, const struct Permutation* perm, float* residuals, int iterations, float relax_factor, int desired_threads)
+{
+    // See solve_sor_single for more details on the math involved
+
+    // Rows are visited in the order given by the permutation instead of the storage order
+    // so the matrix never has to be rearranged. When the permutation groups rows by color
+    // the blocks of rows within a group do not depend on each other so each group can be
+    // split between threads. Groups are processed one after another so later colors
+    // see the values just computed for earlier colors (like Gauss-Seidel)
+
+    // The rows of one block (the degrees of freedom of a node) are coupled to each other
+    // so a block is always updated by a single thread in order
+
+    if (desired_threads < 1)
+    {
+        // Most likely not intended
+        printf("Warning: Attempted to solve with desired_threads less than 1");
+        return;
+    }
+
+    const float* matrix_a = eqset.stiff_bc.elements;
+    const float* vector_b = eqset.forces.elements;
+    float* vec_x = eqset.displacements.elements;
+    const int cols = eqset.stiff_bc.cols;
+
+    const int* order = perm->order;
+    const int block_size = perm->block_size > 0 ? perm->block_size : 1;
+
+    // Without groups there is no independence information so the whole permutation
+    // is treated as one group processed by a single thread
+    const int has_groups = perm->group_offsets != NULL;
+    const int group_count = has_groups ? perm->group_count : 1;
+    const int threads = has_groups ? desired_threads : 1;
+
+    // Set initial guess to x_i = b_i / A_ii
+    for (int i = 0; i < cols; ++i)
+    {
+        vec_x[i] = vector_b[i] / matrix_a[i + i * cols];
+    }
+
+    for (int t = 0; t < iterations; ++t)
+    {
+        TRACE_BEGIN("sor iteration");
+
+        float sum_sqr_residual = 0;
+
+#pragma omp parallel num_threads(threads) reduction(+:sum_sqr_residual)
+        for (int g = 0; g < group_count; ++g)
+        {
+            const int first = has_groups ? perm->group_offsets[g] : 0;
+            const int last = has_groups ? perm->group_offsets[g + 1] : perm->count;
+            const int blocks = (last - first + block_size - 1) / block_size;
+
+            // The implicit barrier at the end of the loop keeps groups in order
+#pragma omp for schedule(static)
+            for (int b = 0; b < blocks; ++b)
+            {
+                const int block_end = first + (b + 1) * block_size < last ? first + (b + 1) * block_size : last;
+
+                for (int p = first + b * block_size; p < block_end; ++p)
+                {
+                    const int j = order[p];
+
+                    float sum_ax = 0;
+                    for (int i = 0; i < cols; ++i)
+                    {
+                        sum_ax += matrix_a[i + j * cols] * vec_x[i];
+                    }
+
+                    float residual = vector_b[j] - sum_ax;
+                    sum_sqr_residual += residual * residual;
+
+                    // x_j has not been updated yet so it still holds the previous estimate
+                    float a_jj = matrix_a[j + j * cols];
+                    float x_prev = vec_x[j];
+                    float x_j = (residual + a_jj * x_prev) / a_jj;
+
+                    vec_x[j] = relax_factor * x_j + (1 - relax_factor) * x_prev;
+                }
+            }
+        }
+
+        // store the norm of residuals for this iteration
+        residuals[t] = sqrt(sum_sqr_residual);
+
+        TRACE_END();
+    }
+}
+
+
+int solve_cg_sparse(const struct SparseMatrix* matrix, const float* vector_b, float* vec_x, struct SchwarzPreconditioner* precond,
+    float* residuals, int iterations, float tolerance, int desired_threads, const struct CheckpointSettings* checkpoint,
+    int* converged)
+{
+    if (converged)
+    {
+        *converged = 0;
+    }
+
+    // Conjugate gradients builds each step from the previous search directions so that every
+    // step is the best possible over all the directions so far (measured in the energy norm)
+    // which converges much faster than Jacobi or SOR for symmetric positive definite systems
+
+    // Preconditioning solves a cheaper approximation of the system M z = r every iteration
+    // and searches along z instead of r. The closer M is to A the fewer iterations are needed
+
+    // Each iteration needs one matrix product, one preconditioner solve and two sets of dot
+    // products. Dot products are accumulated in double since they sum over every row
+
+    if (desired_threads < 1)
+    {
+        // Most likely not intended
+        printf("Warning: Attempted to solve with desired_threads less than 1");
+        return 0;
+    }
+
+    const int rows = matrix->rows;
+
+    float* vec_r = malloc(sizeof(*vec_r) * (rows > 0 ? rows : 1));
+    float* vec_z = malloc(sizeof(*vec_z) * (rows > 0 ? rows : 1));
+    float* vec_p = malloc(sizeof(*vec_p) * (rows > 0 ? rows : 1));
+    float* vec_q = malloc(sizeof(*vec_q) * (rows > 0 ? rows : 1));
+    float* inv_diag = malloc(sizeof(*inv_diag) * (rows > 0 ? rows : 1));
+
+    // Shared between threads. Accumulated in reductions and reset by a single thread
+    double p_dot_q = 0.0;
+    double r_dot_r = 0.0;
+    double r_dot_z = 0.0;
+    double r_dot_z_prev = 0.0;
+    int completed = 0;
+    int stop = 0;
+
+    // Everything carried from one iteration to the next. z and q are recomputed from these
+    struct CheckpointState state;
+    state.method = CHECKPOINT_CG;
+    state.iteration = 0;
+    state.rows = rows;
+    state.matrix = matrix;
+    state.system = vector_b;
+    state.vector_count = 3;
+    state.vectors[0] = vec_x;
+    state.vectors[1] = vec_r;
+    state.vectors[2] = vec_p;
+    state.scalar_count = 1;
+    state.scalars[0] = 0.0;
+    state.residuals = residuals;
+    state.residual_count = iterations;
+
+#pragma omp parallel num_threads(desired_threads)
+    {
+        // Start from zero so the residual is the force vector
+#pragma omp for schedule(static)
+        for (int j = 0; j < rows; ++j)
+        {
+            float a_jj = 0.0f;
+            for (int k = matrix->row_offsets[j]; k < matrix->row_offsets[j + 1]; ++k)
+            {
+                if (matrix->columns[k] == j)
+                {
+                    a_jj = matrix->values[k];
+                }
+            }
+
+            inv_diag[j] = a_jj != 0.0f ? 1.0f / a_jj : 1.0f;
+            vec_x[j] = 0.0f;
+            vec_r[j] = vector_b[j];
+            vec_p[j] = 0.0f;
+        }
+
+        // Or pick up where a previous solve of the same system left off
+#pragma omp single
+        {
+            if (checkpoint_load(checkpoint, &state, 0))
+            {
+                r_dot_z_prev = state.scalars[0];
+                completed = state.iteration;
+            }
+        }
+
+        for (int t = state.iteration; t < iterations; ++t)
+        {
+            TRACE_BEGIN("cg iteration");
+
+            // z = M^-1 r then the new direction p = z + beta p
+            if (precond)
+            {
+                schwarz_apply(precond, vec_r, vec_z);
+            }
+            else
+            {
+#pragma omp for schedule(static)
+                for (int j = 0; j < rows; ++j)
+                {
+                    vec_z[j] = vec_r[j] * inv_diag[j];
+                }
+            }
+
+#pragma omp for schedule(static) reduction(+:r_dot_z)
+            for (int j = 0; j < rows; ++j)
+            {
+                r_dot_z += (double)vec_r[j] * vec_z[j];
+            }
+
+            const double beta = t > 0 && r_dot_z_prev != 0.0 ? r_dot_z / r_dot_z_prev : 0.0;
+
+#pragma omp for schedule(static)
+            for (int j = 0; j < rows; ++j)
+            {
+                vec_p[j] = vec_z[j] + (float)beta * vec_p[j];
+            }
+
+            // q = A p along with p . q
+#pragma omp for schedule(static) reduction(+:p_dot_q)
+            for (int j = 0; j < rows; ++j)
+            {
+                float sum = 0.0f;
+                for (int k = matrix->row_offsets[j]; k < matrix->row_offsets[j + 1]; ++k)
+                {
+                    sum += matrix->values[k] * vec_p[matrix->columns[k]];
+                }
+
+                vec_q[j] = sum;
+                p_dot_q += (double)vec_p[j] * sum;
+            }
+
+            const double alpha = p_dot_q != 0.0 ? r_dot_z / p_dot_q : 0.0;
+
+            // Step along p and update the residual to match
+#pragma omp for schedule(static) reduction(+:r_dot_r)
+            for (int j = 0; j < rows; ++j)
+            {
+                vec_x[j] += (float)alpha * vec_p[j];
+                vec_r[j] -= (float)alpha * vec_q[j];
+                r_dot_r += (double)vec_r[j] * vec_r[j];
+            }
+
+            // Every thread has read the sums above before passing the barrier at the end of the
+            // previous loop so one thread records the residual and resets them for the next iteration
+#pragma omp single
+            {
+                const float norm = (float)sqrt(r_dot_r);
+
+                if (residuals)
+                {
+                    residuals[t] = norm;
+                }
+
+                completed = t + 1;
+                stop = norm < tolerance;
+
+                r_dot_z_prev = r_dot_z;
+                r_dot_z = 0.0;
+                p_dot_q = 0.0;
+                r_dot_r = 0.0;
+
+                if (!stop && checkpoint_due(checkpoint, completed))
+                {
+                    state.iteration = completed;
+                    state.scalars[0] = r_dot_z_prev;
+                    state.residual_count = completed;
+                    checkpoint_save(checkpoint, &state, 0);
+                }
+            }
+
+            TRACE_END();
+
+            if (stop)
+            {
+                break;
+            }
+        }
+    }
+
+    free(inv_diag);
+    free(vec_q);
+    free(vec_p);
+    free(vec_z);
+    free(vec_r);
+
+    if (converged)
+    {
+        *converged = stop;
+    }
+
+    return completed;
+}
+
+
 void update_chunk_jacobi(struct EquationChunk chunk)
 {
     // Perform one iteration on a partial data set or chunk made up of rows from the stiffness matrix
@@ -352,3 +689,41 @@ void update_chunk_jacobi(struct EquationChunk chunk)
         chunk.curr_x[j] = x;
     }
 }
+
+
+void update_chunk_jacobi_sparse(struct SparseChunk chunk)
+{
+    // Same as update_chunk_jacobi except only the stored values of each row are visited
+    // so the cost is proportional to the number of non zeros instead of rows * cols
+
+    for (int j = 0; j < chunk.rows; ++j)
+    {
+        const int diag_col = chunk.row_start + j;
+
+        // sum up A_ij * x_i as long as i != j and pick out the diagonal on the way
+        float x = 0;
+        float a_jj = 0.f;
+        for (int k = chunk.row_offsets[j]; k < chunk.row_offsets[j + 1]; ++k)
+        {
+            const int col = chunk.columns[k];
+
+            if (col != diag_col)
+            {
+                x += chunk.values[k] * chunk.prev_x[col];
+            }
+            else
+            {
+                a_jj = chunk.values[k];
+            }
+        }
+
+        // if you ensure diagonals are set to 1 if not active this check can be skipped
+        if (a_jj == 0.f)
+        {
+            a_jj = 1.0f;
+        }
+
+        // subtract the sum from b_j and divide by the diagonal that was skipped in summation
+        chunk.curr_x[j] = (chunk.vector_b[j] - x) / a_jj;
+    }
+}
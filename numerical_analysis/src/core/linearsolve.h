@@ -1,6 +1,10 @@
 #pragma once
 
 struct EquationSet;
+struct Permutation;
+struct SparseMatrix;
+struct SchwarzPreconditioner;
+struct CheckpointSettings;
 
 // Non owning. Just a view for a full or partial equation set
 struct EquationChunk
@@ -14,14 +18,49 @@ struct EquationChunk
     int id;
 };
 
+// Non owning. View of a block of rows stored in sparse (CSR) form
+// prev_x is indexed by column and curr_x by row within the chunk
+struct SparseChunk
+{
+    const float* values;
+    const int* columns;
+    const int* row_offsets;
+    const float* vector_b;
+    const float* prev_x;
+    float* curr_x;
+    int rows;
+    int row_start; // Column of the first row's diagonal
+};
+
 // Solve the equation set using the Jacobi iterative method
 void solve_jacobi_single(struct EquationSet eqset, float* residuals, int iterations);
 
 // Use OpenMP to solve with the Jacobi method using multiple threads
 void solve_jacobi_parallel(struct EquationSet eqset, float* residuals, int iterations, int desired_threads);
 
+// Use OpenMP to solve with the weighted Jacobi method (weight of 1 is plain Jacobi)
+void solve_jacobi_weighted_parallel(struct EquationSet eqset, float* residuals, int iterations, int desired_threads, float weight);
+
 // Solve the equation set using Successive Over-relaxation (or Gauss-Seidel if relaxation factor = 1)
 void solve_sor_single(struct EquationSet eqset, float* residuals, int iterations, int relax_factor);
 
+// SOR visiting rows in permutation order. Groups in the permutation (such as multicolor sets
+// from eqset_reorder) are split between threads so groups must not couple blocks within them
+void solve_sor_multicolor(struct EquationSet eqset, const struct Permutation* perm, float* residuals, int iterations, float relax_factor, int desired_threads);
+
+// Use OpenMP to solve a symmetric positive definite sparse system with preconditioned conjugate gradients
+// precond may be an additive Schwarz preconditioner built for the matrix (see schwarz.h)
+// or NULL to scale by the diagonal. Stops once the residual norm is below tolerance
+// residuals receives the residual norm of every iteration (may be NULL)
+// checkpoint (may be NULL) saves the state every few iterations and resumes a saved solve (see checkpoint.h)
+// converged (may be NULL) is set to 1 if the residual norm fell below tolerance
+// Returns the number of iterations run (including any run before a resumed checkpoint)
+int solve_cg_sparse(const struct SparseMatrix* matrix, const float* vector_b, float* vec_x, struct SchwarzPreconditioner* precond,
+    float* residuals, int iterations, float tolerance, int desired_threads, const struct CheckpointSettings* checkpoint,
+    int* converged);
+
 // Update a chunk of an equation set for one iteration (used with MPI)
 void update_chunk_jacobi(struct EquationChunk chunk);
+
+// Update a chunk of sparse rows for one iteration (used with MPI)
+void update_chunk_jacobi_sparse(struct SparseChunk chunk);
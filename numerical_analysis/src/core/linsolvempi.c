@@ -2,10 +2,19 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <math.h>
+
+#include <omp.h>
 
 #include "mpiutility.h"
 #include "frame.h"
 #include "linearsolve.h"
+#include "distribute.h"
+#include "halo.h"
+#include "permutation.h"
+#include "schwarz.h"
+#include "checkpoint.h"
+#include "trace.h"
 
 #ifndef ENABLE_MPI
 #define ENABLE_MPI 0
@@ -20,184 +29,953 @@
 #define TAG_FORCE 3
 #define TAG_DISPLACEMENT 4
 
-int solve_equations_mpi(struct EquationSet* eqset, int iterations)
+// Rows handed out at a time when threads share the interior rows
+#define INTERIOR_CHUNK 64
+
+int solve_equations_mpi(struct EquationSet* eqset, float* residuals, int iterations)
 {
 #if ENABLE_MPI == 0
     fprintf(stderr, "Warning: Attempting to use MPI functionality with MPI disabled\n");
+    return -1;
 #else
 
-    double startTime = MPI_Wtime();
     int rank = get_rank_mpi();
-    int procs = get_procs_mpi();
     int root = get_main_mpi();
 
-    //int print = rank == 1;
-    int print = 0;
+    // Note only the root process has any memory allocated in the eqset at the start
+    // Each process receives a contiguous block of rows in sparse form along with the
+    // matching part of the force vector. Blocks are balanced by the number of stored
+    // values so the work per process is even and the number of rows does not need to
+    // divide evenly by the number of processes (see distribute.h)
+    struct DistributedSystem system;
+    distribute_equations(rank == root ? eqset : NULL, &system);
+
+    // This also renumbers the columns of the local rows to local vector indices
+    struct HaloExchange halo;
+    halo_create(&system, &halo);
+
+    float* x = malloc(sizeof(*x) * (system.matrix.rows + halo.ghost_count + 1));
+
+    struct MpiSolveSettings settings;
+    mpisolve_default_settings(&settings, iterations);
+    settings.residuals = rank == root ? residuals : NULL;
+
+    int failed = solve_system_mpi(&system, &halo, x, &settings, NULL) < 0;
+
+    // Gather the results onto the root and copy them to the equation set
+    distributed_gather(&system, x, rank == root ? eqset->displacements.elements : NULL);
+
+    // Free process specific resources
+    free(x);
+    halo_release(&halo);
+    distributed_release(&system);
+
+    return failed ? -1 : 0;
+
+#endif
+}
+
+
+void mpisolve_default_settings(struct MpiSolveSettings* settings, int iterations)
+{
+    settings->iterations = iterations;
+
+    // Run every iteration and check the residual each time unless told otherwise
+    settings->tolerance = 0.0f;
+    settings->check_interval = 1;
+    settings->nonblocking = 0;
+    settings->residuals = NULL;
+
+    settings->method = MPI_SOLVE_JACOBI;
+    settings->relax_factor = 1.0f;
+    schwarz_default_settings(&settings->schwarz);
+    checkpoint_default_settings(&settings->checkpoint);
+
+    // Controlled per process with OMP_NUM_THREADS. Typically one process per socket
+    // (NUMA domain) with a thread per core inside it
+    settings->threads = omp_get_max_threads();
+}
 
-    // Note only the root process has any memory allocated in the eqset
-    // at the start and the vector/matrix dimensions are not set
-    // so start by broadcasting the vector size
-    int vec_size = 0;
-    float* stiff_mat = NULL;
-    float* force_vec = NULL;
 
-    if (rank == root)
+// Jacobi update of a single sparse row. Returns the square of the row's residual for prev_x
+static inline float update_row_jacobi(const struct SparseMatrix* matrix, const float* vector_b, const float* prev_x, float* curr_x, int j)
+{
+    float sum_ax = 0.0f;
+    float a_jj = 0.0f;
+
+    for (int k = matrix->row_offsets[j]; k < matrix->row_offsets[j + 1]; ++k)
     {
-        vec_size = eqset->displacements.count;
-        stiff_mat = eqset->stiff_bc.elements;
-        force_vec = eqset->forces.elements;
+        const int i = matrix->columns[k];
+
+        if (i == j)
+        {
+            a_jj = matrix->values[k];
+        }
+        else
+        {
+            sum_ax += matrix->values[k] * prev_x[i];
+        }
     }
 
-    // MPI_Bcast: the root (main process) sends (broadcasts) to all processes (including itself)
-    // in a communicator, but all processes in comm must call Bcast with the same root
-    // to recieve. Much easier if all processes hit the same line 
-    // (It can work otherwise but without tags its confusing which matches which with multiple)
-    MPI_Bcast(&vec_size, 1, MPI_INT, root, MPI_COMM_WORLD);
+    // Inactive rows may not have a diagonal
+    if (a_jj == 0.0f)
+    {
+        a_jj = 1.0f;
+    }
 
-    // All processes now have same value for vec_size
-    if (print) printf("%d recieved vector size: %d\n", rank, vec_size);
+    curr_x[j] = (vector_b[j] - sum_ax) / a_jj;
 
+    const float residual = vector_b[j] - sum_ax - a_jj * prev_x[j];
+    return residual * residual;
+}
 
-    // MPI_Scatter acts like Bcast except instead of sending the whole array
-    // it breaks the array into portions and sends each process a chunk (including the root)
-    // The data must be evenly divisable by the number of processes in the communicator
-    // See MPI_Scatterv to allow different sizes to be sent to each process
-    // the send size is size of the resulting chunks not the size of source array
-    // MPI_Gather works in reverse to build a full array on the root process
-    // from chunks sent from each process (Both scatter and gather preserve order by rank)
 
-    // In this case chunk size is the number of rows and force terms being used
-    // we need all of the previous iterations displacement values but only update
-    // a chunks worth in the current iteration
+#if ENABLE_MPI
 
-    // Create a buffer to recieve the force chunk
-    // MPI_Scatter can handle even splits. will handle non divisible case later
-    int chunk_size = vec_size / procs;
+// Split the owned rows into interior rows that only reference owned entries and boundary rows
+// that reference at least one ghost (columns past the owned rows)
+static void split_boundary_rows(const struct SparseMatrix* matrix, int* interior_rows, int* interior_count, int* boundary_rows, int* boundary_count)
+{
+    *interior_count = 0;
+    *boundary_count = 0;
 
-    if (print) printf("%d: vec: %d, chunk: %d, procs: %d\n", rank, vec_size, chunk_size, procs);
+    for (int j = 0; j < matrix->rows; ++j)
+    {
+        int boundary = 0;
+        for (int k = matrix->row_offsets[j]; k < matrix->row_offsets[j + 1]; ++k)
+        {
+            if (matrix->columns[k] >= matrix->rows)
+            {
+                boundary = 1;
+                break;
+            }
+        }
+
+        if (boundary)
+        {
+            boundary_rows[(*boundary_count)++] = j;
+        }
+        else
+        {
+            interior_rows[(*interior_count)++] = j;
+        }
+    }
+}
+
+// Global residual checks shared by the distributed solvers (see MpiSolveSettings)
+// Only used by one thread of each process
+struct ResidualMonitor
+{
+    const struct MpiSolveSettings* settings;
+    int is_root;
+    int check_interval;
+    float local_sqr_residual;
+    float global_sqr_residual;
+    MPI_Request request;
+    int pending;
+    int pending_iteration;
+    int converged; // The last recorded norm was below the tolerance
+    int diverged; // The last recorded norm was not finite
+};
+
+static void monitor_init(struct ResidualMonitor* monitor, const struct MpiSolveSettings* settings)
+{
+    monitor->settings = settings;
+    monitor->is_root = get_rank_mpi() == get_main_mpi();
+    monitor->check_interval = settings->check_interval > 0 ? settings->check_interval : 1;
+    monitor->local_sqr_residual = 0.0f;
+    monitor->global_sqr_residual = 0.0f;
+    monitor->request = MPI_REQUEST_NULL;
+    monitor->pending = 0;
+    monitor->pending_iteration = 0;
+    monitor->converged = 0;
+    monitor->diverged = 0;
+}
+
+// Store the global residual norm of an iteration on the main process and check for convergence
+// A norm that is no longer finite also stops the solve since it can not recover from that
+static int monitor_record(struct ResidualMonitor* monitor, int iteration)
+{
+    float norm = sqrtf(monitor->global_sqr_residual);
+
+    if (monitor->is_root && monitor->settings->residuals)
+    {
+        monitor->settings->residuals[iteration] = norm;
+    }
+
+    monitor->converged = norm < monitor->settings->tolerance;
+    monitor->diverged = !isfinite(norm);
+
+    return monitor->converged || monitor->diverged;
+}
+
+// Called after iteration t with the sum of this process' squared residuals
+// Returns 1 if every process should stop. Every process gets the same global sum
+// so they all stop on the same iteration
+static int monitor_check(struct ResidualMonitor* monitor, int t, float sum_sqr_residual)
+{
+    int stop = 0;
+
+    if ((t + 1) % monitor->check_interval != 0 && t + 1 != monitor->settings->iterations)
+    {
+        return 0;
+    }
+
+    if (monitor->settings->nonblocking)
+    {
+        // Use the result of the previous check (started check_interval iterations
+        // ago) and start the next one. Stopping is delayed by one check but the
+        // processes never wait for each other here
+        if (monitor->pending)
+        {
+            MPI_Wait(&monitor->request, MPI_STATUS_IGNORE);
+            stop = monitor_record(monitor, monitor->pending_iteration);
+        }
+
+        monitor->local_sqr_residual = sum_sqr_residual;
+        monitor->pending_iteration = t;
+        MPI_Iallreduce(&monitor->local_sqr_residual, &monitor->global_sqr_residual, 1, MPI_FLOAT, MPI_SUM, MPI_COMM_WORLD, &monitor->request);
+        monitor->pending = 1;
+    }
+    else
+    {
+        monitor->local_sqr_residual = sum_sqr_residual;
+        MPI_Allreduce(&monitor->local_sqr_residual, &monitor->global_sqr_residual, 1, MPI_FLOAT, MPI_SUM, MPI_COMM_WORLD);
+        stop = monitor_record(monitor, t);
+    }
 
-    float* force_chunk = malloc(sizeof(*force_chunk) * chunk_size);
+    return stop;
+}
 
-    MPI_Scatter(force_vec, chunk_size, MPI_FLOAT, force_chunk, chunk_size, MPI_FLOAT, root, MPI_COMM_WORLD);
+// Finish a check still in flight when the iterations end
+static void monitor_finish(struct ResidualMonitor* monitor)
+{
+    if (monitor->pending)
+    {
+        MPI_Wait(&monitor->request, MPI_STATUS_IGNORE);
+        monitor_record(monitor, monitor->pending_iteration);
+        monitor->pending = 0;
+    }
+}
 
-    // Each process now has a chunk of the force vector
-    if (print) printf("%d recieved force chunk: \n", rank);
+// Outcome of a solve once the monitor is finished. Every process has the same norms so they agree
+// Returns completed or -1 if the residual norm stopped being finite
+static int monitor_result(const struct ResidualMonitor* monitor, const char* method, int completed, int* converged)
+{
+    if (converged)
+    {
+        *converged = monitor->converged;
+    }
 
-    if (print)
+    if (monitor->diverged)
     {
-        printf("%d: F   ", rank);
-        for (int i = 0; i < chunk_size; ++i)
+        if (monitor->is_root)
         {
-            printf("%4.2f ", force_chunk[i]);
+            fprintf(stderr, "Error solving with %s: the residual norm is not finite after %i iterations\n", method, completed);
         }
-        printf("\n");
+
+        return -1;
     }
 
-    // Now do the same for the stiffness matrix
-    int chunk_size_stiff = chunk_size * vec_size;
-    float* stiff_chunk = malloc(sizeof(*stiff_chunk) * chunk_size_stiff);
+    return completed;
+}
 
-    MPI_Scatter(stiff_mat, chunk_size_stiff, MPI_FLOAT, stiff_chunk, chunk_size_stiff, MPI_FLOAT, root, MPI_COMM_WORLD);
-    if (print) printf("%d recieved stiffness chunk: \n", rank);
+// Scalars of a checkpoint holding the monitor (see monitor_save)
+#define MONITOR_SCALARS 3
 
-    if (print)
+// Store the monitor in a checkpoint. A check in flight is waited for but not used yet so a
+// resumed solve still uses it one check later and stops on the same iteration
+static void monitor_save(struct ResidualMonitor* monitor, struct CheckpointState* state)
+{
+    if (monitor->pending)
     {
+        MPI_Wait(&monitor->request, MPI_STATUS_IGNORE);
+    }
+
+    state->scalars[0] = monitor->global_sqr_residual;
+    state->scalars[1] = monitor->pending;
+    state->scalars[2] = monitor->pending_iteration;
+}
+
+// Restore a monitor saved with monitor_save. A finished check is left pending on a null request
+static void monitor_restore(struct ResidualMonitor* monitor, const struct CheckpointState* state)
+{
+    monitor->global_sqr_residual = (float)state->scalars[0];
+    monitor->pending = (int)state->scalars[1];
+    monitor->pending_iteration = (int)state->scalars[2];
+    monitor->request = MPI_REQUEST_NULL;
+}
+
+// Fill in the parts of a checkpoint state shared by the distributed solvers
+static void checkpoint_state_init(struct CheckpointState* state, enum CheckpointMethod method,
+    const struct DistributedSystem* system, const struct MpiSolveSettings* settings)
+{
+    state->method = method;
+    state->iteration = 0;
+    state->rows = system->matrix.rows;
+    state->matrix = &system->matrix;
+    state->system = system->forces;
+    state->vector_count = 0;
+    state->scalar_count = 0;
+    state->residuals = settings->residuals;
+    state->residual_count = settings->iterations;
+}
+
+#endif
+
+int solve_system_mpi(struct DistributedSystem* system, struct HaloExchange* halo, float* x, const struct MpiSolveSettings* settings,
+    int* converged)
+{
+#if ENABLE_MPI == 0
+    fprintf(stderr, "Warning: Attempting to use MPI functionality with MPI disabled\n");
+    return -1;
+#else
+
+    const int iterations = settings->iterations;
+    const int threads = settings->threads > 0 ? settings->threads : 1;
+
+    // Each row only references the columns of its stored values so a process only needs
+    // the displacements of its own rows plus the few rows owned by other processes
+    // that its rows are coupled to (ghosts). The halo exchange sends exactly those values
+    // between neighboring processes so communication scales with the size of the boundary
+    // between blocks rather than the size of the model (see halo.h)
+
+    const struct SparseMatrix* matrix = &system->matrix;
+    const int chunk_size = matrix->rows;
+
+    // Interior rows only reference owned entries so they can be updated before the ghosts
+    // arrive. Boundary rows reference at least one ghost (columns past the owned rows)
+    int* interior_rows = malloc(sizeof(*interior_rows) * (chunk_size > 0 ? chunk_size : 1));
+    int* boundary_rows = malloc(sizeof(*boundary_rows) * (chunk_size > 0 ? chunk_size : 1));
+    int interior_count;
+    int boundary_count;
+
+    split_boundary_rows(matrix, interior_rows, &interior_count, boundary_rows, &boundary_count);
+
+    // x holds the previous iterations displacement values for the process' rows and ghosts
+    // and needs space for the current iterations values for its rows
+    float* prev_x = x;
+    float* curr_x = malloc(sizeof(*curr_x) * (chunk_size > 0 ? chunk_size : 1));
+
+    // The exchange always receives ghosts into prev_x
+    halo_bind(halo, prev_x);
+
+    // Shared by the team. Threads add into sum_sqr_residual through reductions and
+    // everything else is only touched by the master thread
+    float sum_sqr_residual = 0.0f;
+    int completed = 0;
+    int stop = 0;
+
+    struct ResidualMonitor monitor;
+    monitor_init(&monitor, settings);
+
+    // The owned previous values and the monitor are all that carry over between iterations
+    struct CheckpointState state;
+    checkpoint_state_init(&state, CHECKPOINT_JACOBI_MPI, system, settings);
+    state.vector_count = 1;
+    state.vectors[0] = prev_x;
+    state.scalar_count = MONITOR_SCALARS;
+
+    // Each process is a team of threads sharing its rows (hybrid MPI + OpenMP)
+    // MPI was initialized with MPI_THREAD_FUNNELED so only the master thread communicates
+#pragma omp parallel num_threads(threads)
+    {
+        // Set initial guess to x_i = b_i / A_ii
+        // Convergence may be faster with better initial guesses
+        // Each process knows the diagonal for its own rows so the guess is made locally
+#pragma omp for schedule(static)
         for (int j = 0; j < chunk_size; ++j)
         {
-            printf("%d: S   ", rank);
-            for (int i = 0; i < vec_size; ++i)
+            float a_jj = 1.0f;
+            for (int k = matrix->row_offsets[j]; k < matrix->row_offsets[j + 1]; ++k)
+            {
+                if (matrix->columns[k] == j)
+                {
+                    a_jj = matrix->values[k];
+                }
+            }
+
+            prev_x[j] = system->forces[j] / a_jj;
+        }
+
+        // Or continue a stopped solve
+#pragma omp master
+        {
+            if (checkpoint_load(&settings->checkpoint, &state, 1))
+            {
+                monitor_restore(&monitor, &state);
+                completed = state.iteration;
+            }
+        }
+
+#pragma omp barrier
+
+        // Now the iteration begins
+        // For each iteration the sends and receives of the previous values are posted first
+        // then the interior rows are updated while the messages are in flight. Only the
+        // boundary rows wait for the ghosts so communication is hidden behind the interior
+        // work instead of every process idling until the slowest neighbor has sent
+        for (int t = state.iteration; t < iterations; ++t)
+        {
+            TRACE_BEGIN("jacobi iteration");
+
+            // The exchange only reads owned entries and writes ghosts which interior rows never use
+#pragma omp master
+            {
+                halo_start(halo);
+            }
+
+            // Many MPI implementations only move messages along during MPI calls so the
+            // master thread checks on the exchange between chunks of interior rows
+            int exchanged = 0;
+
+            // Dynamic so the time the master spends communicating is picked up by the others
+#pragma omp for schedule(dynamic, INTERIOR_CHUNK) nowait reduction(+:sum_sqr_residual)
+            for (int r = 0; r < interior_count; ++r)
+            {
+                if (r % INTERIOR_CHUNK == 0 && !exchanged && omp_get_thread_num() == 0)
+                {
+                    exchanged = halo_test(halo);
+                }
+
+                sum_sqr_residual += update_row_jacobi(matrix, system->forces, prev_x, curr_x, interior_rows[r]);
+            }
+
+#pragma omp master
+            {
+                TRACE_BEGIN("halo wait");
+                halo_finish(halo);
+                TRACE_END();
+            }
+
+            // Ghosts are ready for every thread after the barrier
+#pragma omp barrier
+
+#pragma omp for schedule(static) reduction(+:sum_sqr_residual)
+            for (int r = 0; r < boundary_count; ++r)
+            {
+                sum_sqr_residual += update_row_jacobi(matrix, system->forces, prev_x, curr_x, boundary_rows[r]);
+            }
+
+            // Every thread has added its part of the residual after the loop above
+            // Only this process' rows are included so the processes sum their parts together
+#pragma omp master
+            {
+                completed = t + 1;
+                stop = monitor_check(&monitor, t, sum_sqr_residual);
+                sum_sqr_residual = 0.0f;
+            }
+
+            // The new values become the previous values for the next iteration
+            // They are copied rather than swapped since the exchange is bound to prev_x
+            // The barrier at the end also makes the decision to stop visible to every thread
+#pragma omp for schedule(static)
+            for (int j = 0; j < chunk_size; ++j)
+            {
+                prev_x[j] = curr_x[j];
+            }
+
+            if (!stop && checkpoint_due(&settings->checkpoint, t + 1))
+            {
+#pragma omp master
+                {
+                    state.iteration = t + 1;
+                    state.residual_count = t + 1;
+                    monitor_save(&monitor, &state);
+                    checkpoint_save(&settings->checkpoint, &state, 1);
+                }
+
+#pragma omp barrier
+            }
+
+            TRACE_END();
+
+            // Every process gets the same sum so they all stop on the same iteration
+            if (stop)
             {
-                printf("%4.2f ", stiff_chunk[i + j * vec_size]);
+                break;
             }
-            printf("\n");
+        }
+
+        // Leave the ghosts matching the final values and finish any residual check in flight
+#pragma omp master
+        {
+            halo_exchange(halo);
+            monitor_finish(&monitor);
         }
     }
-    // Now the iteration begins
-    // For each iteration all of the processes produce a partial result that must be gathered together
-    // then the combined result broadcast to start the next iteration
 
-    // Need space for each process to hold the previous iterations displacement values
-    // and the current iterations displacement values for the chunk (could reuse but this is much simpler)
-    float* prev_x = malloc(sizeof(*prev_x) * vec_size);
-    float* curr_x = malloc(sizeof(*curr_x) * chunk_size);
+    free(curr_x);
+    free(boundary_rows);
+    free(interior_rows);
+
+    return monitor_result(&monitor, "Jacobi", completed, converged);
+
+#endif
+}
+
 
+// SOR update of a single sparse row in place. Returns the square of the row's residual before the update
+static inline float update_row_sor(const struct SparseMatrix* matrix, const float* vector_b, float* x, int j, float relax_factor)
+{
+    float sum_ax = 0.0f;
+    float a_jj = 0.0f;
 
-    // Not uncommon to give an intial guess for the displacements
-    if (rank == root)
+    for (int k = matrix->row_offsets[j]; k < matrix->row_offsets[j + 1]; ++k)
     {
-        // Set initial guess to x_i = b_i / A_ii
-        // Convergence may be faster with better initial guesses
-        for (int i = 0; i < vec_size; ++i)
+        const int i = matrix->columns[k];
+
+        if (i == j)
         {
-            prev_x[i] = force_vec[i] / stiff_mat[i + i * vec_size];
+            a_jj = matrix->values[k];
         }
+
+        sum_ax += matrix->values[k] * x[i];
     }
 
-    // Broadcast the initial guess
-    MPI_Bcast(prev_x, vec_size, MPI_FLOAT, get_main_mpi(), MPI_COMM_WORLD);
+    if (a_jj == 0.0f)
+    {
+        a_jj = 1.0f;
+    }
 
-    struct EquationChunk chunk = { stiff_chunk, force_chunk, prev_x, curr_x, chunk_size, vec_size, rank };
+    const float residual = vector_b[j] - sum_ax;
+    const float x_prev = x[j];
+    const float x_j = (residual + a_jj * x_prev) / a_jj;
 
-    for (int t = 0; t < iterations; ++t)
+    x[j] = relax_factor * x_j + (1 - relax_factor) * x_prev;
+
+    return residual * residual;
+}
+
+
+int solve_system_sor_mpi(struct DistributedSystem* system, struct HaloExchange* halo, float* x,
+    const struct Permutation* perm, const struct MpiSolveSettings* settings, int* converged)
+{
+#if ENABLE_MPI == 0
+    fprintf(stderr, "Warning: Attempting to use MPI functionality with MPI disabled\n");
+    return -1;
+#else
+
+    // Same as solve_sor_multicolor except the rows are spread over processes. Rows of one
+    // color are never coupled to each other on any process so every process updates its rows
+    // of a color at the same time using the latest values of the other colors. Between colors
+    // only the ghosts of the color just updated are exchanged since the others have not changed
+    // The result matches the single process version visiting the colors in the same order
+
+    const struct SparseMatrix* matrix = &system->matrix;
+    const int rows = matrix->rows;
+    const int iterations = settings->iterations;
+    const int threads = settings->threads > 0 ? settings->threads : 1;
+    const float relax_factor = settings->relax_factor;
+
+    if (perm->count != rows || !perm->group_offsets)
     {
-        if (print) printf("%d: Iteration: %d\n", rank, t);
+        fprintf(stderr, "Error solving with multicolor SOR: permutation does not cover the owned rows in groups\n");
+        return -1;
+    }
+
+    const int group_count = perm->group_count;
+    const int block_size = perm->block_size > 0 ? perm->block_size : 1;
+
+    // Split the ghost exchange by color
+    int* row_groups = calloc(rows > 0 ? rows : 1, sizeof(*row_groups));
+    for (int g = 0; g < group_count; ++g)
+    {
+        for (int p = perm->group_offsets[g]; p < perm->group_offsets[g + 1]; ++p)
+        {
+            row_groups[perm->order[p]] = g;
+        }
+    }
 
-        // Perform one update iteration for a chunk of the equation
-        update_chunk_jacobi(chunk);
+    struct HaloGroups groups;
+    halo_groups_create(halo, row_groups, group_count, &groups);
+    free(row_groups);
 
-        if (print)
+    // Set initial guess to x_i = b_i / A_ii then fill in all the ghosts once
+    for (int j = 0; j < rows; ++j)
+    {
+        float a_jj = 1.0f;
+        for (int k = matrix->row_offsets[j]; k < matrix->row_offsets[j + 1]; ++k)
         {
-            printf("%d: X Prev  ", rank);
-            for (int i = 0; i < vec_size; ++i)
+            if (matrix->columns[k] == j && matrix->values[k] != 0.0f)
             {
-                printf("%4.2f ", prev_x[i]);
+                a_jj = matrix->values[k];
             }
-            printf("\n");
+        }
+
+        x[j] = system->forces[j] / a_jj;
+    }
+
+    float sum_sqr_residual = 0.0f;
+    int completed = 0;
+    int stop = 0;
+
+    struct ResidualMonitor monitor;
+    monitor_init(&monitor, settings);
+
+    // Or continue a stopped solve from its owned values. The ghosts are filled in below either way
+    struct CheckpointState state;
+    checkpoint_state_init(&state, CHECKPOINT_SOR_MPI, system, settings);
+    state.vector_count = 1;
+    state.vectors[0] = x;
+    state.scalar_count = MONITOR_SCALARS;
+
+    if (checkpoint_load(&settings->checkpoint, &state, 1))
+    {
+        monitor_restore(&monitor, &state);
+        completed = state.iteration;
+    }
+
+    halo_bind(halo, x);
+    halo_exchange(halo);
+
+#pragma omp parallel num_threads(threads)
+    {
+        for (int t = state.iteration; t < iterations; ++t)
+        {
+            TRACE_BEGIN("sor iteration");
+
+            for (int g = 0; g < group_count; ++g)
+            {
+                const int first = perm->group_offsets[g];
+                const int last = perm->group_offsets[g + 1];
+                const int blocks = (last - first + block_size - 1) / block_size;
+
+                // The rows of one block (the degrees of freedom of a node) are coupled
+                // so a block is always updated by a single thread in order
+#pragma omp for schedule(static) reduction(+:sum_sqr_residual)
+                for (int b = 0; b < blocks; ++b)
+                {
+                    const int block_end = first + (b + 1) * block_size < last ? first + (b + 1) * block_size : last;
+
+                    for (int p = first + b * block_size; p < block_end; ++p)
+                    {
+                        sum_sqr_residual += update_row_sor(matrix, system->forces, x, perm->order[p], relax_factor);
+                    }
+                }
+
+                // Send the new values of this color to the neighbors that use them
+#pragma omp master
+                {
+                    halo_groups_start(&groups, x, g);
+                    halo_groups_finish(&groups, x, g);
+                }
+
+#pragma omp barrier
+            }
+
+#pragma omp master
+            {
+                completed = t + 1;
+                stop = monitor_check(&monitor, t, sum_sqr_residual);
+                sum_sqr_residual = 0.0f;
+            }
+
+#pragma omp barrier
 
-            printf("%d: X Curr  ", rank);
-            for (int i = 0; i < chunk_size; ++i)
+            if (!stop && checkpoint_due(&settings->checkpoint, t + 1))
             {
-                printf("%4.2f ", curr_x[i]);
+#pragma omp master
+                {
+                    state.iteration = t + 1;
+                    state.residual_count = t + 1;
+                    monitor_save(&monitor, &state);
+                    checkpoint_save(&settings->checkpoint, &state, 1);
+                }
+
+#pragma omp barrier
+            }
+
+            TRACE_END();
+
+            if (stop)
+            {
+                break;
             }
-            printf("\n");
         }
+    }
+
+    monitor_finish(&monitor);
+    halo_groups_release(&groups);
+
+    return monitor_result(&monitor, "multicolor SOR", completed, converged);
+
+#endif
+}
+
+
+// Row of a sparse matrix times a vector
+static inline float multiply_row(const struct SparseMatrix* matrix, const float* x, int j)
+{
+    float sum = 0.0f;
+
+    for (int k = matrix->row_offsets[j]; k < matrix->row_offsets[j + 1]; ++k)
+    {
+        sum += matrix->values[k] * x[matrix->columns[k]];
+    }
 
+    return sum;
+}
 
-        if (rank == root)
+int solve_system_cg_mpi(struct DistributedSystem* system, struct HaloExchange* halo, float* x,
+    struct SchwarzPreconditioner* precond, const struct MpiSolveSettings* settings, int* converged)
+{
+#if ENABLE_MPI == 0
+    fprintf(stderr, "Warning: Attempting to use MPI functionality with MPI disabled\n");
+    return -1;
+#else
+
+    // Same as solve_cg_sparse except every dot product is summed over the processes and the
+    // search direction's ghosts are exchanged for the matrix product. The residual norm and
+    // r . z are summed together in one reduction so each iteration has two global reductions
+    // plus whatever the preconditioner needs (see schwarz.h)
+
+    const struct SparseMatrix* matrix = &system->matrix;
+    const int rows = matrix->rows;
+    const int iterations = settings->iterations;
+    const int threads = settings->threads > 0 ? settings->threads : 1;
+
+    int* interior_rows = malloc(sizeof(*interior_rows) * (rows > 0 ? rows : 1));
+    int* boundary_rows = malloc(sizeof(*boundary_rows) * (rows > 0 ? rows : 1));
+    int interior_count;
+    int boundary_count;
+
+    split_boundary_rows(matrix, interior_rows, &interior_count, boundary_rows, &boundary_count);
+
+    // Only the search direction is multiplied by the matrix so it is the vector with ghosts
+    float* vec_p = malloc(sizeof(*vec_p) * (rows + halo->ghost_count + 1));
+    float* vec_r = malloc(sizeof(*vec_r) * (rows > 0 ? rows : 1));
+    float* vec_z = malloc(sizeof(*vec_z) * (rows > 0 ? rows : 1));
+    float* vec_q = malloc(sizeof(*vec_q) * (rows > 0 ? rows : 1));
+    float* inv_diag = malloc(sizeof(*inv_diag) * (rows > 0 ? rows : 1));
+
+    halo_bind(halo, vec_p);
+
+    // Shared by the team. Local sums come from reductions and the master thread combines
+    // them with the other processes into the global sums read by every thread
+    double local_p_dot_q = 0.0;
+    double local_r_dot_r = 0.0;
+    double local_r_dot_z = 0.0;
+    double global_sums[2] = { 0.0, 0.0 }; // r . r and r . z
+    double p_dot_q = 0.0;
+    double r_dot_z = 0.0;
+    double r_dot_z_prev = 0.0;
+    int completed = 0;
+    int stop = 0;
+
+    struct ResidualMonitor monitor;
+    monitor_init(&monitor, settings);
+
+    // Everything carried from one iteration to the next (see solve_cg_sparse)
+    struct CheckpointState state;
+    checkpoint_state_init(&state, CHECKPOINT_CG_MPI, system, settings);
+    state.vector_count = 3;
+    state.vectors[0] = x;
+    state.vectors[1] = vec_r;
+    state.vectors[2] = vec_p;
+    state.scalar_count = 1;
+
+#pragma omp parallel num_threads(threads)
+    {
+        // Start from zero so the residual is the force vector
+#pragma omp for schedule(static)
+        for (int j = 0; j < rows; ++j)
         {
-            // Gather partial solutions (recv_count is per process not total so should be chunk_size)
-            MPI_Gather(curr_x, chunk_size, MPI_FLOAT, prev_x, chunk_size, MPI_FLOAT, root, MPI_COMM_WORLD);
+            float a_jj = 0.0f;
+            for (int k = matrix->row_offsets[j]; k < matrix->row_offsets[j + 1]; ++k)
+            {
+                if (matrix->columns[k] == j)
+                {
+                    a_jj = matrix->values[k];
+                }
+            }
+
+            inv_diag[j] = a_jj != 0.0f ? 1.0f / a_jj : 1.0f;
+            x[j] = 0.0f;
+            vec_r[j] = system->forces[j];
+            vec_p[j] = 0.0f;
         }
-        else
+
+        // Or continue a stopped solve
+#pragma omp master
         {
-            // Safe to pass NULL to recievedata on non root but it doesnt change anything if you dont
-            MPI_Gather(curr_x, chunk_size, MPI_FLOAT, NULL, 0, MPI_FLOAT, root, MPI_COMM_WORLD);
+            if (checkpoint_load(&settings->checkpoint, &state, 1))
+            {
+                r_dot_z = state.scalars[0];
+                completed = state.iteration;
+            }
         }
 
+#pragma omp barrier
 
-        // Broadcast (not scatter) the full displacement array to prepare for the next iteration
-        MPI_Bcast(prev_x, vec_size, MPI_FLOAT, root, MPI_COMM_WORLD);
+        for (int t = state.iteration; t < iterations; ++t)
+        {
+            TRACE_BEGIN("cg iteration");
 
-        MPI_Barrier(MPI_COMM_WORLD);
-    }
+            // z = M^-1 r
+            if (precond)
+            {
+                schwarz_apply(precond, vec_r, vec_z);
+            }
+            else
+            {
+#pragma omp for schedule(static)
+                for (int j = 0; j < rows; ++j)
+                {
+                    vec_z[j] = vec_r[j] * inv_diag[j];
+                }
+            }
 
-    // Copy results to equation set
-    if (rank == root)
-    {
-        for (int i = 0; i < vec_size; ++i)
+#pragma omp for schedule(static) reduction(+:local_r_dot_r, local_r_dot_z)
+            for (int j = 0; j < rows; ++j)
+            {
+                local_r_dot_r += (double)vec_r[j] * vec_r[j];
+                local_r_dot_z += (double)vec_r[j] * vec_z[j];
+            }
+
+            // The residual checked here is the one left by the previous iteration
+#pragma omp master
+            {
+                const double local_sums[2] = { local_r_dot_r, local_r_dot_z };
+                MPI_Allreduce(local_sums, global_sums, 2, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+
+                local_r_dot_r = 0.0;
+                local_r_dot_z = 0.0;
+                r_dot_z_prev = r_dot_z;
+                r_dot_z = global_sums[1];
+
+                if (t > 0)
+                {
+                    monitor.global_sqr_residual = (float)global_sums[0];
+                    stop = monitor_record(&monitor, t - 1);
+                    completed = t;
+                }
+            }
+
+#pragma omp barrier
+
+            if (stop)
+            {
+                TRACE_END();
+                break;
+            }
+
+            // New search direction p = z + beta p
+            const double beta = t > 0 && r_dot_z_prev != 0.0 ? r_dot_z / r_dot_z_prev : 0.0;
+
+#pragma omp for schedule(static)
+            for (int j = 0; j < rows; ++j)
+            {
+                vec_p[j] = vec_z[j] + (float)beta * vec_p[j];
+            }
+
+            // q = A p. Interior rows are multiplied while the ghosts of p are in flight
+#pragma omp master
+            {
+                halo_start(halo);
+            }
+
+            int exchanged = 0;
+
+#pragma omp for schedule(dynamic, INTERIOR_CHUNK) nowait reduction(+:local_p_dot_q)
+            for (int r = 0; r < interior_count; ++r)
+            {
+                if (r % INTERIOR_CHUNK == 0 && !exchanged && omp_get_thread_num() == 0)
+                {
+                    exchanged = halo_test(halo);
+                }
+
+                const int j = interior_rows[r];
+                vec_q[j] = multiply_row(matrix, vec_p, j);
+                local_p_dot_q += (double)vec_p[j] * vec_q[j];
+            }
+
+#pragma omp master
+            {
+                TRACE_BEGIN("halo wait");
+                halo_finish(halo);
+                TRACE_END();
+            }
+
+#pragma omp barrier
+
+#pragma omp for schedule(static) reduction(+:local_p_dot_q)
+            for (int r = 0; r < boundary_count; ++r)
+            {
+                const int j = boundary_rows[r];
+                vec_q[j] = multiply_row(matrix, vec_p, j);
+                local_p_dot_q += (double)vec_p[j] * vec_q[j];
+            }
+
+#pragma omp master
+            {
+                MPI_Allreduce(&local_p_dot_q, &p_dot_q, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+                local_p_dot_q = 0.0;
+            }
+
+#pragma omp barrier
+
+            // Step along p and update the residual to match
+            const double alpha = p_dot_q != 0.0 ? r_dot_z / p_dot_q : 0.0;
+
+#pragma omp for schedule(static)
+            for (int j = 0; j < rows; ++j)
+            {
+                x[j] += (float)alpha * vec_p[j];
+                vec_r[j] -= (float)alpha * vec_q[j];
+            }
+
+            // The residual of this iteration is recorded at the top of the next one
+            if (checkpoint_due(&settings->checkpoint, t + 1))
+            {
+#pragma omp master
+                {
+                    state.iteration = t + 1;
+                    state.scalars[0] = r_dot_z;
+                    state.residual_count = t;
+                    checkpoint_save(&settings->checkpoint, &state, 1);
+                }
+
+#pragma omp barrier
+            }
+
+            TRACE_END();
+        }
+
+        // Record the residual of the last iteration if it was not checked in the loop
+#pragma omp master
         {
-            eqset->displacements.elements[i] = prev_x[i];
+            if (!stop && iterations > 0)
+            {
+                double local_r_dot_r_final = 0.0;
+                for (int j = 0; j < rows; ++j)
+                {
+                    local_r_dot_r_final += (double)vec_r[j] * vec_r[j];
+                }
+
+                double global_r_dot_r = 0.0;
+                MPI_Allreduce(&local_r_dot_r_final, &global_r_dot_r, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+
+                monitor.global_sqr_residual = (float)global_r_dot_r;
+                monitor_record(&monitor, iterations - 1);
+                completed = iterations;
+            }
         }
     }
 
-    // Free process specific resources
-    free(curr_x);
-    free(prev_x);
-    free(stiff_chunk);
-    free(force_chunk);
+    // Leave the ghosts of x matching the solution like the other solvers
+    halo_bind(halo, x);
+    halo_exchange(halo);
+
+    free(inv_diag);
+    free(vec_q);
+    free(vec_z);
+    free(vec_r);
+    free(vec_p);
+    free(boundary_rows);
+    free(interior_rows);
 
-    double endTime = MPI_Wtime();
-    if (print) printf("Solve Time: %f\n", endTime - startTime);
+    return monitor_result(&monitor, "conjugate gradients", completed, converged);
 
 #endif
 }
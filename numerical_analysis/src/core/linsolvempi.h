@@ -1,8 +1,82 @@
 #pragma once
 
+#include "schwarz.h"
+#include "checkpoint.h"
+
 struct EquationSet;
+struct DistributedSystem;
+struct HaloExchange;
+struct Permutation;
+
+// Distributed solution methods
+enum MpiSolveMethod
+{
+    MPI_SOLVE_JACOBI = 0,
+    MPI_SOLVE_SOR, // Multicolor SOR (Gauss-Seidel with a relaxation factor of 1)
+    MPI_SOLVE_CG // Conjugate gradients preconditioned with additive Schwarz
+};
+
+// Options for the distributed solvers. Everything except threads and residuals must
+// match on every process or they will not agree on when to stop
+struct MpiSolveSettings
+{
+    int iterations; // Most iterations to run
+    int threads; // OpenMP threads each process uses for its own rows
+    enum MpiSolveMethod method; // Used by callers that choose the solver (such as frame_solve_mpi)
+    float relax_factor; // Only used by SOR
+    struct SchwarzSettings schwarz; // Only used by CG
+
+    // The norm of the global residual is computed by summing every process' part
+    // Checking less often (or without blocking) avoids a global synchronization each iteration
+    float tolerance; // Stop once the residual norm is below this (0 always runs every iteration)
+    int check_interval; // Iterations between residual checks
+    int nonblocking; // Overlap each check with the following iterations. Stops up to one interval late
+    float* residuals; // Residual norm of each checked iteration on the main process (may be NULL)
+
+    // Periodic saves of the solver state so a stopped solve can be resumed (see checkpoint.h)
+    // Resuming needs the same processes, partition and method as the solve that saved it
+    struct CheckpointSettings checkpoint;
+};
+
+// Fill in settings using Jacobi, the OpenMP default thread count, no tolerance, a check every iteration
+// and no checkpoints
+// (see schwarz_default_settings for the preconditioner)
+void mpisolve_default_settings(struct MpiSolveSettings* settings, int iterations);
+
+// Collective. Distribute an equation set held by the main process and solve it with Jacobi
+// eqset is only used on the main process (may be NULL elsewhere) and receives the displacements
+// residuals receives the residual norm of every iteration on the main process (may be NULL)
+// Returns 0 on success or -1 if the solve diverged
+int solve_equations_mpi(struct EquationSet* eqset, float* residuals, int iterations);
+
+// Collective. Solve a distributed system with Jacobi after its columns have been renumbered by halo_create
+// x needs room for the owned rows and ghosts. On return the owned entries hold the solution
+// and the ghosts hold the matching values from other processes
+// Each process uses a team of settings->threads threads. Ghost exchanges are started before
+// updating the rows that do not depend on ghosts and finished before the rows that do
+// converged (may be NULL) is set to 1 if the last checked residual norm was below the tolerance
+// Returns the number of iterations run or -1 if the residual norm stopped being finite (the
+// solve stops at the first check that sees it)
+int solve_system_mpi(struct DistributedSystem* system, struct HaloExchange* halo, float* x, const struct MpiSolveSettings* settings,
+    int* converged);
+
+// Collective. Solve a distributed system with multicolor SOR after halo_create
+// perm orders the owned rows in groups by color (as eqset_reorder does for a full equation set)
+// Groups must be numbered the same on every process and rows in the same group must not be
+// coupled to each other on any process. Ghosts of each color are exchanged after it is updated
+// Returns the number of iterations run or -1 on failure with converged as for solve_system_mpi
+int solve_system_sor_mpi(struct DistributedSystem* system, struct HaloExchange* halo, float* x,
+    const struct Permutation* perm, const struct MpiSolveSettings* settings, int* converged);
 
-int solve_equations_mpi(struct EquationSet* eqset, int iterations);
+// Collective. Solve a distributed system with preconditioned conjugate gradients after halo_create
+// The system must be symmetric positive definite. precond is built for the system's owned rows
+// (see frame_schwarz_create) or NULL to scale by the diagonal
+// Conjugate gradients needs global dot products every iteration so the residual is checked every
+// iteration regardless of check_interval and nonblocking. Ghost exchanges for the matrix product
+// are overlapped with the interior rows like solve_system_mpi
+// Returns the number of iterations run or -1 on failure with converged as for solve_system_mpi
+int solve_system_cg_mpi(struct DistributedSystem* system, struct HaloExchange* halo, float* x,
+    struct SchwarzPreconditioner* precond, const struct MpiSolveSettings* settings, int* converged);
 
 int send_equations(struct EquationSet* eqset, int dest);
 
@@ -0,0 +1,508 @@
+#include "matrixmarket.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+
+// Lines are at most 1024 characters in the Matrix Market format
+#define LINE_SIZE 1100
+
+struct MatrixMarketHeader
+{
+    int coordinate; // Coordinate (sparse) form or array (dense, column major) form
+    int pattern; // Coordinate entries without values (each is 1)
+    int symmetric; // Only the lower triangle is stored
+    int rows;
+    int cols;
+    long long entries; // Stored entries (rows * cols for arrays)
+};
+
+static void to_lower(char* text)
+{
+    for (; *text; ++text)
+    {
+        *text = (char)tolower((unsigned char)*text);
+    }
+}
+
+// Read the banner, comments and size line
+static int read_header(FILE* file, const char* path, struct MatrixMarketHeader* header)
+{
+    char line[LINE_SIZE];
+    char object[64] = "";
+    char format[64] = "";
+    char field[64] = "";
+    char symmetry[64] = "";
+
+    if (!fgets(line, sizeof(line), file) ||
+        sscanf(line, "%%%%MatrixMarket %63s %63s %63s %63s", object, format, field, symmetry) != 4)
+    {
+        fprintf(stderr, "Matrix Market Error: %s does not start with a Matrix Market banner\n", path);
+        return -1;
+    }
+
+    to_lower(object);
+    to_lower(format);
+    to_lower(field);
+    to_lower(symmetry);
+
+    header->coordinate = strcmp(format, "coordinate") == 0;
+    header->pattern = strcmp(field, "pattern") == 0;
+    header->symmetric = strcmp(symmetry, "symmetric") == 0;
+
+    if (strcmp(object, "matrix") != 0 || (!header->coordinate && strcmp(format, "array") != 0))
+    {
+        fprintf(stderr, "Matrix Market Error: %s is not a matrix in coordinate or array form\n", path);
+        return -1;
+    }
+
+    if (strcmp(field, "real") != 0 && strcmp(field, "integer") != 0 && !(header->pattern && header->coordinate))
+    {
+        fprintf(stderr, "Matrix Market Error: %s has unsupported %s values\n", path, field);
+        return -1;
+    }
+
+    if (!header->symmetric && strcmp(symmetry, "general") != 0)
+    {
+        fprintf(stderr, "Matrix Market Error: %s has unsupported %s symmetry\n", path, symmetry);
+        return -1;
+    }
+
+    // Comments run up to the size line
+    do
+    {
+        if (!fgets(line, sizeof(line), file))
+        {
+            fprintf(stderr, "Matrix Market Error: %s ends before its size\n", path);
+            return -1;
+        }
+    } while (line[0] == '%' || line[strspn(line, " \t\r\n")] == '\0');
+
+    int count = header->coordinate
+        ? sscanf(line, "%d %d %lld", &header->rows, &header->cols, &header->entries)
+        : sscanf(line, "%d %d", &header->rows, &header->cols);
+
+    if (count != (header->coordinate ? 3 : 2) || header->rows < 0 || header->cols < 0 ||
+        (header->coordinate && header->entries < 0))
+    {
+        fprintf(stderr, "Matrix Market Error: %s has an invalid size line\n", path);
+        return -1;
+    }
+
+    // Mirrored entries swap rows and columns so both must have the same range
+    if (header->symmetric && header->rows != header->cols)
+    {
+        fprintf(stderr, "Matrix Market Error: %s is symmetric but has %i rows and %i columns\n",
+            path, header->rows, header->cols);
+        return -1;
+    }
+
+    if (!header->coordinate)
+    {
+        header->entries = (long long)header->rows * header->cols;
+    }
+
+    return 0;
+}
+
+// Next line holding an entry (blank lines are skipped). Returns 0 on success or -1 at the end of the file
+static int next_entry(FILE* file, char* line)
+{
+    while (fgets(line, LINE_SIZE, file))
+    {
+        if (line[strspn(line, " \t\r\n")] != '\0')
+        {
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+// Parse "row col [value]" with 1 based indices. Returns 0 on success or -1 if the line is invalid
+static int parse_coordinate(const char* line, const struct MatrixMarketHeader* header, int* row, int* col, float* value)
+{
+    char* end;
+    long i = strtol(line, &end, 10);
+    const char* next = end;
+    long j = strtol(next, &end, 10);
+
+    if (end == next || i < 1 || i > header->rows || j < 1 || j > header->cols)
+    {
+        return -1;
+    }
+
+    *row = (int)i - 1;
+    *col = (int)j - 1;
+    *value = 1.0f;
+
+    if (!header->pattern)
+    {
+        next = end;
+        *value = strtof(next, &end);
+
+        if (end == next)
+        {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+int matrixmarket_is_path(const char* path)
+{
+    const char* dot = strrchr(path, '.');
+    return dot && strcmp(dot, MATRIXMARKET_EXTENSION) == 0;
+}
+
+char* matrixmarket_vector_path(const char* matrix_path, const char* suffix)
+{
+    const int base_length = matrixmarket_is_path(matrix_path)
+        ? (int)(strrchr(matrix_path, '.') - matrix_path) : (int)strlen(matrix_path);
+
+    char* path = malloc(base_length + strlen(suffix) + strlen(MATRIXMARKET_EXTENSION) + 1);
+    sprintf(path, "%.*s%s%s", base_length, matrix_path, suffix, MATRIXMARKET_EXTENSION);
+
+    return path;
+}
+
+static FILE* open_for_write(const char* path)
+{
+    FILE* file = fopen(path, "w");
+    if (!file)
+    {
+        fprintf(stderr, "Failed to open file at: %s\n", path);
+    }
+
+    return file;
+}
+
+static int finish_write(FILE* file, const char* path)
+{
+    int failed = ferror(file) != 0;
+    failed = fclose(file) != 0 || failed;
+
+    if (failed)
+    {
+        fprintf(stderr, "Matrix Market Error: failed to write %s\n", path);
+    }
+
+    return failed ? -1 : 0;
+}
+
+int matrixmarket_write_sparse(const struct SparseMatrix* matrix, const char* path, int symmetric)
+{
+    FILE* file = open_for_write(path);
+    if (!file)
+    {
+        return -1;
+    }
+
+    // The number of entries comes before them so the lower triangle is counted first
+    long long entries = 0;
+    for (int j = 0; j < matrix->rows; ++j)
+    {
+        for (int k = matrix->row_offsets[j]; k < matrix->row_offsets[j + 1]; ++k)
+        {
+            entries += !symmetric || matrix->columns[k] <= j;
+        }
+    }
+
+    fprintf(file, "%%%%MatrixMarket matrix coordinate real %s\n", symmetric ? "symmetric" : "general");
+    fprintf(file, "%i %i %lld\n", matrix->rows, matrix->cols, entries);
+
+    for (int j = 0; j < matrix->rows; ++j)
+    {
+        for (int k = matrix->row_offsets[j]; k < matrix->row_offsets[j + 1]; ++k)
+        {
+            if (!symmetric || matrix->columns[k] <= j)
+            {
+                fprintf(file, "%i %i %.9g\n", j + 1, matrix->columns[k] + 1, matrix->values[k]);
+            }
+        }
+    }
+
+    return finish_write(file, path);
+}
+
+int matrixmarket_write_dense(const struct Matrix* matrix, const char* path, int symmetric)
+{
+    FILE* file = open_for_write(path);
+    if (!file)
+    {
+        return -1;
+    }
+
+    long long entries = 0;
+    for (int j = 0; j < matrix->rows; ++j)
+    {
+        const int last = symmetric && j + 1 < matrix->cols ? j + 1 : matrix->cols;
+        const float* row = matrix->elements + (size_t)j * matrix->cols;
+
+        for (int i = 0; i < last; ++i)
+        {
+            entries += row[i] != 0.0f;
+        }
+    }
+
+    fprintf(file, "%%%%MatrixMarket matrix coordinate real %s\n", symmetric ? "symmetric" : "general");
+    fprintf(file, "%i %i %lld\n", matrix->rows, matrix->cols, entries);
+
+    for (int j = 0; j < matrix->rows; ++j)
+    {
+        const int last = symmetric && j + 1 < matrix->cols ? j + 1 : matrix->cols;
+        const float* row = matrix->elements + (size_t)j * matrix->cols;
+
+        for (int i = 0; i < last; ++i)
+        {
+            if (row[i] != 0.0f)
+            {
+                fprintf(file, "%i %i %.9g\n", j + 1, i + 1, row[i]);
+            }
+        }
+    }
+
+    return finish_write(file, path);
+}
+
+int matrixmarket_write_vector(const float* values, int rows, const char* path)
+{
+    FILE* file = open_for_write(path);
+    if (!file)
+    {
+        return -1;
+    }
+
+    fprintf(file, "%%%%MatrixMarket matrix array real general\n");
+    fprintf(file, "%i 1\n", rows);
+
+    for (int j = 0; j < rows; ++j)
+    {
+        fprintf(file, "%.9g\n", values[j]);
+    }
+
+    return finish_write(file, path);
+}
+
+
+struct SparseEntry
+{
+    int col;
+    float value;
+};
+
+static int compare_entries(const void* a, const void* b)
+{
+    int left = ((const struct SparseEntry*)a)->col;
+    int right = ((const struct SparseEntry*)b)->col;
+    return (left > right) - (left < right);
+}
+
+int matrixmarket_read_sparse(const char* path, struct SparseMatrix* matrix)
+{
+    FILE* file = fopen(path, "r");
+    if (!file)
+    {
+        fprintf(stderr, "Failed to open file at: %s\n", path);
+        return -1;
+    }
+
+    struct MatrixMarketHeader header;
+    if (read_header(file, path, &header))
+    {
+        fclose(file);
+        return -1;
+    }
+
+    if (!header.coordinate)
+    {
+        fprintf(stderr, "Matrix Market Error: %s is a dense array rather than a sparse matrix\n", path);
+        fclose(file);
+        return -1;
+    }
+
+    // Mirrored entries of a symmetric matrix are stored as well
+    const long long capacity = header.symmetric ? 2 * header.entries : header.entries;
+
+    if (capacity > 0x7fffffff)
+    {
+        fprintf(stderr, "Matrix Market Error: %s has too many entries\n", path);
+        fclose(file);
+        return -1;
+    }
+
+    int* entry_rows = malloc(sizeof(*entry_rows) * (capacity > 0 ? capacity : 1));
+    struct SparseEntry* entries = malloc(sizeof(*entries) * (capacity > 0 ? capacity : 1));
+    int* row_offsets = calloc((size_t)header.rows + 1, sizeof(*row_offsets));
+    int count = 0;
+    int failed = !entry_rows || !entries || !row_offsets;
+
+    char line[LINE_SIZE];
+
+    for (long long e = 0; e < header.entries && !failed; ++e)
+    {
+        int row;
+        int col;
+        float value;
+
+        if (next_entry(file, line) || parse_coordinate(line, &header, &row, &col, &value))
+        {
+            fprintf(stderr, "Matrix Market Error: %s has an invalid or missing entry %lld\n", path, e + 1);
+            failed = 1;
+            break;
+        }
+
+        entry_rows[count] = row;
+        entries[count].col = col;
+        entries[count].value = value;
+        row_offsets[row + 1]++;
+        count++;
+
+        if (header.symmetric && row != col)
+        {
+            entry_rows[count] = col;
+            entries[count].col = row;
+            entries[count].value = value;
+            row_offsets[col + 1]++;
+            count++;
+        }
+    }
+
+    fclose(file);
+
+    if (failed)
+    {
+        free(row_offsets);
+        free(entries);
+        free(entry_rows);
+        return -1;
+    }
+
+    // Group the entries by row then sort and combine each row
+    for (int j = 0; j < header.rows; ++j)
+    {
+        row_offsets[j + 1] += row_offsets[j];
+    }
+
+    struct SparseEntry* by_row = malloc(sizeof(*by_row) * (count > 0 ? count : 1));
+    int* cursor = malloc(sizeof(*cursor) * (header.rows > 0 ? header.rows : 1));
+    memcpy(cursor, row_offsets, sizeof(*cursor) * header.rows);
+
+    for (int e = 0; e < count; ++e)
+    {
+        by_row[cursor[entry_rows[e]]++] = entries[e];
+    }
+
+    free(cursor);
+    free(entries);
+    free(entry_rows);
+
+    sparse_init(matrix, header.rows, header.cols, count);
+
+    int nnz = 0;
+    for (int j = 0; j < header.rows; ++j)
+    {
+        struct SparseEntry* row = by_row + row_offsets[j];
+        const int length = row_offsets[j + 1] - row_offsets[j];
+
+        qsort(row, length, sizeof(*row), compare_entries);
+
+        for (int k = 0; k < length; ++k)
+        {
+            if (k > 0 && row[k].col == row[k - 1].col)
+            {
+                matrix->values[nnz - 1] += row[k].value;
+                continue;
+            }
+
+            matrix->columns[nnz] = row[k].col;
+            matrix->values[nnz] = row[k].value;
+            nnz++;
+        }
+
+        matrix->row_offsets[j + 1] = nnz;
+    }
+
+    matrix->nnz = nnz;
+
+    free(by_row);
+    free(row_offsets);
+
+    return 0;
+}
+
+int matrixmarket_read_vector(const char* path, float** values, int* rows)
+{
+    FILE* file = fopen(path, "r");
+    if (!file)
+    {
+        fprintf(stderr, "Failed to open file at: %s\n", path);
+        return -1;
+    }
+
+    struct MatrixMarketHeader header;
+    if (read_header(file, path, &header))
+    {
+        fclose(file);
+        return -1;
+    }
+
+    // A row vector is accepted as well
+    const int length = header.cols == 1 ? header.rows : header.rows == 1 ? header.cols : -1;
+
+    if (length < 0 || header.symmetric)
+    {
+        fprintf(stderr, "Matrix Market Error: %s is not a vector\n", path);
+        fclose(file);
+        return -1;
+    }
+
+    float* vector = calloc(length > 0 ? length : 1, sizeof(*vector));
+    int failed = 0;
+    char line[LINE_SIZE];
+
+    for (long long e = 0; e < header.entries && !failed; ++e)
+    {
+        if (next_entry(file, line))
+        {
+            failed = 1;
+        }
+        else if (header.coordinate)
+        {
+            int row;
+            int col;
+            float value;
+            failed = parse_coordinate(line, &header, &row, &col, &value) != 0;
+
+            if (!failed)
+            {
+                vector[header.cols == 1 ? row : col] += value;
+            }
+        }
+        else
+        {
+            char* end;
+            vector[e] = strtof(line, &end);
+            failed = end == line;
+        }
+
+        if (failed)
+        {
+            fprintf(stderr, "Matrix Market Error: %s has an invalid or missing entry %lld\n", path, e + 1);
+        }
+    }
+
+    fclose(file);
+
+    if (failed)
+    {
+        free(vector);
+        return -1;
+    }
+
+    *values = vector;
+    *rows = length;
+    return 0;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "sparse.h"
+
+// Matrix Market exchange files (https://math.nist.gov/MatrixMarket/formats.html) so assembled
+// systems can be solved by other tools and systems from other tools can be solved here
+// Matrices are written in coordinate form. Symmetric matrices only store the lower triangle
+// Vectors are written in array form (one column). Values are written with enough digits to read
+// back every float exactly
+
+#define MATRIXMARKET_EXTENSION ".mtx"
+
+// Right hand sides are stored next to their matrix with this added to the name ("system_b.mtx")
+#define MATRIXMARKET_RHS_SUFFIX "_b"
+
+// Returns 1 if path ends with MATRIXMARKET_EXTENSION or 0 otherwise
+int matrixmarket_is_path(const char* path);
+
+// Path of the vector stored next to a matrix: the matrix path with suffix added before the
+// extension. The returned string must be freed
+char* matrixmarket_vector_path(const char* matrix_path, const char* suffix);
+
+// Write a sparse matrix. If symmetric is set the matrix must be symmetric and only the entries
+// on or below the diagonal are written. Returns 0 on success or -1 on failure
+int matrixmarket_write_sparse(const struct SparseMatrix* matrix, const char* path, int symmetric);
+
+// Write the non zero entries of a dense matrix without building a sparse copy
+// Returns 0 on success or -1 on failure
+int matrixmarket_write_dense(const struct Matrix* matrix, const char* path, int symmetric);
+
+// Write a vector of rows values. Returns 0 on success or -1 on failure
+int matrixmarket_write_vector(const float* values, int rows, const char* path);
+
+// Read a real, integer or pattern coordinate matrix (general or symmetric) into CSR form
+// Symmetric matrices are expanded to both triangles, columns are sorted within each row and
+// repeated entries are added together. Returns 0 on success or -1 on failure
+int matrixmarket_read_sparse(const char* path, struct SparseMatrix* matrix);
+
+// Read a vector stored as a one column array or coordinate matrix
+// values is allocated to hold rows entries. Returns 0 on success or -1 on failure
+int matrixmarket_read_vector(const char* path, float** values, int* rows);
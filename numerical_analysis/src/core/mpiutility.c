@@ -28,7 +28,17 @@ void initialize_mpi(int* argc, char*** argv)
         return;
     }
 
-    MPI_Init(argc, argv);
+    // Processes may use OpenMP threads for their own work (hybrid MPI + OpenMP)
+    // Only the thread that initialized MPI makes MPI calls so FUNNELED support is enough
+    int provided;
+    MPI_Init_thread(argc, argv, MPI_THREAD_FUNNELED, &provided);
+
+    if (provided < MPI_THREAD_FUNNELED)
+    {
+        fprintf(stderr, "Warning: MPI implementation does not support threads, use one thread per process\n");
+    }
+
+    INITIALIZED = 1;
 
     // Total processes
     MPI_Comm_size(MPI_COMM_WORLD, &PROCS);
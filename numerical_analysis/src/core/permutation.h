@@ -0,0 +1,81 @@
+#pragma once
+
+#include <stdlib.h>
+
+// A reordering of the rows of an equation set that is applied on the fly
+// instead of physically moving rows of the matrix
+// order[new] is the original row placed at position new and inverse[original] is its new position
+// Rows may optionally be split into consecutive groups (such as multicolor sets) where
+// group g covers new positions group_offsets[g] to group_offsets[g + 1] - 1
+struct Permutation
+{
+    int* order;
+    int* inverse;
+    int count;
+
+    int* group_offsets; // group_count + 1 entries or NULL if there are no groups
+    int group_count;
+
+    // Number of consecutive rows that belong together (for instance the degrees of freedom
+    // of one node) and must not be split between threads within a group
+    int block_size;
+};
+
+// Allocate an identity permutation without groups
+static inline void permutation_init(struct Permutation* perm, int count)
+{
+    perm->count = count;
+    perm->order = malloc(sizeof(*perm->order) * (count > 0 ? count : 1));
+    perm->inverse = malloc(sizeof(*perm->inverse) * (count > 0 ? count : 1));
+    perm->group_offsets = NULL;
+    perm->group_count = 0;
+    perm->block_size = 1;
+
+    for (int i = 0; i < count; ++i)
+    {
+        perm->order[i] = i;
+        perm->inverse[i] = i;
+    }
+}
+
+static inline void permutation_release(struct Permutation* perm)
+{
+    if (perm)
+    {
+        free(perm->order);
+        free(perm->inverse);
+        free(perm->group_offsets);
+        perm->order = NULL;
+        perm->inverse = NULL;
+        perm->group_offsets = NULL;
+        perm->count = 0;
+        perm->group_count = 0;
+    }
+}
+
+// Recompute inverse after order has been filled
+static inline void permutation_update_inverse(struct Permutation* perm)
+{
+    for (int i = 0; i < perm->count; ++i)
+    {
+        perm->inverse[perm->order[i]] = i;
+    }
+}
+
+// Copy a vector from the original order into the permuted order: dest[new] = src[order[new]]
+static inline void permutation_gather(const struct Permutation* perm, float* dest, const float* src)
+{
+    for (int i = 0; i < perm->count; ++i)
+    {
+        dest[i] = src[perm->order[i]];
+    }
+}
+
+// Copy a vector from the permuted order back to the original order: dest[order[new]] = src[new]
+static inline void permutation_scatter(const struct Permutation* perm, float* dest, const float* src)
+{
+    for (int i = 0; i < perm->count; ++i)
+    {
+        dest[perm->order[i]] = src[i];
+    }
+}
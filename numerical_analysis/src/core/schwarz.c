@@ -0,0 +1,930 @@
+#include "schwarz.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include <omp.h>
+
+#include "mpiutility.h"
+#include "distribute.h"
+#include "halo.h"
+
+#ifndef ENABLE_MPI
+#define ENABLE_MPI 0
+#endif
+
+#if ENABLE_MPI
+#include <mpi.h>
+#endif
+
+// Times the diagonal shift of an incomplete factor is increased after a breakdown
+#define IC_SHIFT_ATTEMPTS 12
+
+// Pivots smaller than this relative to the original diagonal are treated as zero
+#define PIVOT_TOLERANCE 1e-10
+
+
+void schwarz_default_settings(struct SchwarzSettings* settings)
+{
+    settings->overlap = 1;
+    settings->local_solver = SCHWARZ_CHOLESKY;
+    settings->coarse = 1;
+    settings->subdomains = 0;
+}
+
+
+int schwarz_create(struct SchwarzPreconditioner* precond, const struct RowDistribution* dist, int row_start, int local_rows,
+    const int* needed, int needed_count, int subdomain_count)
+{
+    memset(precond, 0, sizeof(*precond));
+
+    precond->local_rows = local_rows;
+    precond->vector_size = local_rows;
+    precond->row_start = row_start;
+    precond->subdomain_count = subdomain_count;
+    precond->subdomains = calloc(subdomain_count > 0 ? subdomain_count : 1, sizeof(*precond->subdomains));
+
+    // The overlap rows owned by other processes are found once and exchanged every apply
+    // with the same kind of plan used for the ghosts of a distributed matrix (see halo.h)
+    if (dist)
+    {
+        precond->halo = malloc(sizeof(*precond->halo));
+
+        if (halo_create_indices(dist, get_rank_mpi(), needed, needed_count, precond->halo))
+        {
+            free(precond->halo);
+            precond->halo = NULL;
+            schwarz_release(precond);
+            return -1;
+        }
+
+        precond->vector_size += precond->halo->ghost_count;
+    }
+    else if (needed_count > 0)
+    {
+        fprintf(stderr, "Error creating Schwarz preconditioner: rows from other processes need a distribution\n");
+        schwarz_release(precond);
+        return -1;
+    }
+
+    precond->residual = malloc(sizeof(*precond->residual) * (precond->vector_size > 0 ? precond->vector_size : 1));
+    precond->correction = malloc(sizeof(*precond->correction) * (precond->vector_size > 0 ? precond->vector_size : 1));
+
+    if (precond->halo)
+    {
+        halo_bind(precond->halo, precond->residual);
+    }
+
+    return 0;
+}
+
+int schwarz_local_index(const struct SchwarzPreconditioner* precond, int global)
+{
+    if (precond->halo)
+    {
+        return halo_local_index(precond->halo, precond->row_start, global);
+    }
+
+    return global >= precond->row_start && global < precond->row_start + precond->local_rows ? global - precond->row_start : -1;
+}
+
+
+// Reverse Cuthill-McKee ordering of a symmetric matrix. order[i] is the row placed at i
+// Visiting rows breadth first from a low degree row and listing neighbors by increasing
+// degree keeps every row's nonzeros close to the diagonal. Reversing the order
+// reduces the profile further for Cholesky
+static void reverse_cuthill_mckee(const struct SparseMatrix* matrix, int* order)
+{
+    const int rows = matrix->rows;
+
+    int* degree = malloc(sizeof(*degree) * (rows > 0 ? rows : 1));
+    char* visited = calloc(rows > 0 ? rows : 1, sizeof(*visited));
+
+    for (int j = 0; j < rows; ++j)
+    {
+        degree[j] = matrix->row_offsets[j + 1] - matrix->row_offsets[j];
+    }
+
+    int head = 0;
+    int tail = 0;
+
+    while (tail < rows)
+    {
+        // Start each connected piece from its lowest degree row
+        int start = -1;
+        for (int j = 0; j < rows; ++j)
+        {
+            if (!visited[j] && (start == -1 || degree[j] < degree[start]))
+            {
+                start = j;
+            }
+        }
+
+        visited[start] = 1;
+        order[tail++] = start;
+
+        while (head < tail)
+        {
+            int j = order[head++];
+            int first_new = tail;
+
+            for (int k = matrix->row_offsets[j]; k < matrix->row_offsets[j + 1]; ++k)
+            {
+                int i = matrix->columns[k];
+
+                if (!visited[i])
+                {
+                    visited[i] = 1;
+                    order[tail++] = i;
+                }
+            }
+
+            // Insertion sort of the new rows by degree (there are only a few)
+            for (int a = first_new + 1; a < tail; ++a)
+            {
+                int row = order[a];
+                int b = a - 1;
+
+                while (b >= first_new && degree[order[b]] > degree[row])
+                {
+                    order[b + 1] = order[b];
+                    b--;
+                }
+
+                order[b + 1] = row;
+            }
+        }
+    }
+
+    for (int a = 0, b = rows - 1; a < b; ++a, --b)
+    {
+        int temp = order[a];
+        order[a] = order[b];
+        order[b] = temp;
+    }
+
+    free(visited);
+    free(degree);
+}
+
+// Most values stored in one subdomain's Cholesky factor (256 MB of doubles)
+#define SCHWARZ_PROFILE_LIMIT (1 << 25)
+
+// Profile Cholesky. Row i of the factor only stores the columns from its first nonzero
+// to the diagonal and fill can only happen inside that envelope so no symbolic step is needed
+// Returns 0 on success, 1 if the profile is over SCHWARZ_PROFILE_LIMIT or -1 on breakdown
+static int factor_cholesky(struct LocalFactor* factor, const struct SparseMatrix* matrix, const int* position)
+{
+    const int rows = factor->rows;
+
+    factor->first = malloc(sizeof(*factor->first) * (rows > 0 ? rows : 1));
+    factor->offsets = malloc(sizeof(*factor->offsets) * (rows + 1));
+
+    for (int i = 0; i < rows; ++i)
+    {
+        factor->first[i] = i;
+    }
+
+    for (int j = 0; j < rows; ++j)
+    {
+        const int i = position[j];
+
+        for (int k = matrix->row_offsets[j]; k < matrix->row_offsets[j + 1]; ++k)
+        {
+            int c = position[matrix->columns[k]];
+
+            if (c < factor->first[i])
+            {
+                factor->first[i] = c;
+            }
+        }
+    }
+
+    // The profile of a large subdomain grows much faster than its rows (especially for solid
+    // 3D frames) so past a limit the caller uses an incomplete factor instead
+    long long profile = 0;
+    for (int i = 0; i < rows; ++i)
+    {
+        profile += i - factor->first[i] + 1;
+    }
+
+    if (profile > SCHWARZ_PROFILE_LIMIT)
+    {
+        free(factor->first);
+        free(factor->offsets);
+        factor->first = NULL;
+        factor->offsets = NULL;
+        return 1;
+    }
+
+    factor->offsets[0] = 0;
+    for (int i = 0; i < rows; ++i)
+    {
+        factor->offsets[i + 1] = factor->offsets[i] + i - factor->first[i] + 1;
+    }
+
+    const int total = factor->offsets[rows];
+    factor->values = calloc(total > 0 ? total : 1, sizeof(*factor->values));
+
+    if (!factor->values)
+    {
+        return -1;
+    }
+
+    for (int j = 0; j < rows; ++j)
+    {
+        const int i = position[j];
+        double* row = factor->values + factor->offsets[i] - factor->first[i];
+
+        for (int k = matrix->row_offsets[j]; k < matrix->row_offsets[j + 1]; ++k)
+        {
+            int c = position[matrix->columns[k]];
+
+            if (c <= i)
+            {
+                row[c] += matrix->values[k];
+            }
+        }
+    }
+
+    for (int i = 0; i < rows; ++i)
+    {
+        double* row_i = factor->values + factor->offsets[i] - factor->first[i];
+
+        for (int j = factor->first[i]; j < i; ++j)
+        {
+            const double* row_j = factor->values + factor->offsets[j] - factor->first[j];
+            const int k_start = factor->first[i] > factor->first[j] ? factor->first[i] : factor->first[j];
+
+            double sum = row_i[j];
+            for (int k = k_start; k < j; ++k)
+            {
+                sum -= row_i[k] * row_j[k];
+            }
+
+            row_i[j] = sum / row_j[j];
+        }
+
+        const double diagonal = row_i[i];
+        double pivot = diagonal;
+
+        for (int k = factor->first[i]; k < i; ++k)
+        {
+            pivot -= row_i[k] * row_i[k];
+        }
+
+        // A row with nothing stored is not part of the equations (like inactive rows in the
+        // other solvers) and is left alone
+        if (diagonal == 0.0 && factor->first[i] == i)
+        {
+            pivot = 1.0;
+        }
+        else if (pivot <= PIVOT_TOLERANCE * fabs(diagonal))
+        {
+            return -1;
+        }
+
+        row_i[i] = sqrt(pivot);
+    }
+
+    return 0;
+}
+
+// Incomplete Cholesky keeping only the nonzeros of the lower triangle of the matrix
+// If a pivot breaks down the diagonal is scaled up a little and the factor is tried again
+static int factor_incomplete(struct LocalFactor* factor, const struct SparseMatrix* matrix, const int* position)
+{
+    const int rows = factor->rows;
+
+    factor->offsets = calloc(rows + 1, sizeof(*factor->offsets));
+
+    for (int j = 0; j < rows; ++j)
+    {
+        const int i = position[j];
+        int count = 0;
+
+        for (int k = matrix->row_offsets[j]; k < matrix->row_offsets[j + 1]; ++k)
+        {
+            count += position[matrix->columns[k]] < i;
+        }
+
+        // Every row keeps a diagonal even if it is not stored
+        factor->offsets[i + 1] = count + 1;
+    }
+
+    for (int i = 0; i < rows; ++i)
+    {
+        factor->offsets[i + 1] += factor->offsets[i];
+    }
+
+    const int total = factor->offsets[rows];
+    factor->columns = malloc(sizeof(*factor->columns) * (total > 0 ? total : 1));
+    factor->values = malloc(sizeof(*factor->values) * (total > 0 ? total : 1));
+
+    double* original = calloc(total > 0 ? total : 1, sizeof(*original));
+
+    // Fill the pattern with the columns of each row in increasing order and the diagonal last
+    for (int j = 0; j < rows; ++j)
+    {
+        const int i = position[j];
+        const int start = factor->offsets[i];
+        const int diagonal = factor->offsets[i + 1] - 1;
+        int fill = start;
+
+        factor->columns[diagonal] = i;
+
+        for (int k = matrix->row_offsets[j]; k < matrix->row_offsets[j + 1]; ++k)
+        {
+            int c = position[matrix->columns[k]];
+
+            if (c < i)
+            {
+                // Insertion keeps the columns sorted
+                int p = fill++;
+                while (p > start && factor->columns[p - 1] > c)
+                {
+                    factor->columns[p] = factor->columns[p - 1];
+                    original[p] = original[p - 1];
+                    p--;
+                }
+
+                factor->columns[p] = c;
+                original[p] = matrix->values[k];
+            }
+            else if (c == i)
+            {
+                original[diagonal] += matrix->values[k];
+            }
+        }
+    }
+
+    double shift = 0.0;
+
+    for (int attempt = 0; attempt < IC_SHIFT_ATTEMPTS; ++attempt)
+    {
+        int failed = 0;
+
+        for (int i = 0; i < rows && !failed; ++i)
+        {
+            const int start = factor->offsets[i];
+            const int diagonal = factor->offsets[i + 1] - 1;
+
+            for (int p = start; p < diagonal; ++p)
+            {
+                // L(i, j) = (A(i, j) - sum L(i, k) L(j, k)) / L(j, j) over the shared columns k < j
+                const int j = factor->columns[p];
+                const int j_diagonal = factor->offsets[j + 1] - 1;
+                double sum = original[p];
+
+                int a = start;
+                int b = factor->offsets[j];
+
+                while (a < p && b < j_diagonal)
+                {
+                    if (factor->columns[a] < factor->columns[b])
+                    {
+                        a++;
+                    }
+                    else if (factor->columns[a] > factor->columns[b])
+                    {
+                        b++;
+                    }
+                    else
+                    {
+                        sum -= factor->values[a++] * factor->values[b++];
+                    }
+                }
+
+                factor->values[p] = sum / factor->values[j_diagonal];
+            }
+
+            double pivot = original[diagonal] * (1.0 + shift);
+            for (int p = start; p < diagonal; ++p)
+            {
+                pivot -= factor->values[p] * factor->values[p];
+            }
+
+            if (original[diagonal] == 0.0 && start == diagonal)
+            {
+                pivot = 1.0;
+            }
+            else if (pivot <= PIVOT_TOLERANCE * fabs(original[diagonal]))
+            {
+                failed = 1;
+            }
+
+            factor->values[diagonal] = sqrt(pivot);
+        }
+
+        if (!failed)
+        {
+            free(original);
+            return 0;
+        }
+
+        shift = shift > 0.0 ? 2.0 * shift : 1e-3;
+    }
+
+    free(original);
+    return -1;
+}
+
+// Solve L L^T x = b in place on the factor's work vector
+static void factor_solve(const struct LocalFactor* factor, double* x)
+{
+    const int rows = factor->rows;
+
+    if (factor->kind == SCHWARZ_CHOLESKY)
+    {
+        for (int i = 0; i < rows; ++i)
+        {
+            const double* row = factor->values + factor->offsets[i] - factor->first[i];
+            double sum = x[i];
+
+            for (int k = factor->first[i]; k < i; ++k)
+            {
+                sum -= row[k] * x[k];
+            }
+
+            x[i] = sum / row[i];
+        }
+
+        for (int i = rows - 1; i >= 0; --i)
+        {
+            const double* row = factor->values + factor->offsets[i] - factor->first[i];
+            x[i] /= row[i];
+
+            for (int k = factor->first[i]; k < i; ++k)
+            {
+                x[k] -= row[k] * x[i];
+            }
+        }
+    }
+    else
+    {
+        for (int i = 0; i < rows; ++i)
+        {
+            const int diagonal = factor->offsets[i + 1] - 1;
+            double sum = x[i];
+
+            for (int p = factor->offsets[i]; p < diagonal; ++p)
+            {
+                sum -= factor->values[p] * x[factor->columns[p]];
+            }
+
+            x[i] = sum / factor->values[diagonal];
+        }
+
+        for (int i = rows - 1; i >= 0; --i)
+        {
+            const int diagonal = factor->offsets[i + 1] - 1;
+            x[i] /= factor->values[diagonal];
+
+            for (int p = factor->offsets[i]; p < diagonal; ++p)
+            {
+                x[factor->columns[p]] -= factor->values[p] * x[i];
+            }
+        }
+    }
+}
+
+static void factor_release(struct LocalFactor* factor)
+{
+    free(factor->order);
+    free(factor->offsets);
+    free(factor->first);
+    free(factor->columns);
+    free(factor->values);
+    free(factor->work);
+
+    memset(factor, 0, sizeof(*factor));
+}
+
+int schwarz_set_subdomain(struct SchwarzPreconditioner* precond, int s, const struct SparseMatrix* matrix,
+    const int* indices, enum SchwarzLocalSolver solver)
+{
+    struct SchwarzSubdomain* subdomain = &precond->subdomains[s];
+    struct LocalFactor* factor = &subdomain->factor;
+    const int rows = matrix->rows;
+
+    factor_release(factor);
+    free(subdomain->indices);
+
+    subdomain->rows = rows;
+    subdomain->indices = malloc(sizeof(*subdomain->indices) * (rows > 0 ? rows : 1));
+
+    for (int j = 0; j < rows; ++j)
+    {
+        subdomain->indices[j] = indices[j];
+    }
+
+    factor->kind = solver;
+    factor->rows = rows;
+    factor->order = malloc(sizeof(*factor->order) * (rows > 0 ? rows : 1));
+    factor->work = malloc(sizeof(*factor->work) * (rows > 0 ? rows : 1));
+
+    reverse_cuthill_mckee(matrix, factor->order);
+
+    int* position = malloc(sizeof(*position) * (rows > 0 ? rows : 1));
+    for (int i = 0; i < rows; ++i)
+    {
+        position[factor->order[i]] = i;
+    }
+
+    int result = solver == SCHWARZ_CHOLESKY
+        ? factor_cholesky(factor, matrix, position)
+        : factor_incomplete(factor, matrix, position);
+
+    if (result > 0)
+    {
+        factor->kind = SCHWARZ_IC0;
+        result = factor_incomplete(factor, matrix, position);
+    }
+
+    free(position);
+
+    if (result)
+    {
+        fprintf(stderr, "Error creating Schwarz preconditioner: subdomain %i is not positive definite\n", s);
+    }
+
+    return result;
+}
+
+
+// Cholesky factor of the dense coarse matrix in place (lower triangle)
+// Modes that are zero or depend on earlier modes (such as the rotations of a subdomain that is
+// a single straight line) give a zero pivot. Those are dropped by zeroing their row and column
+static void coarse_factor(double* matrix, int size)
+{
+    for (int i = 0; i < size; ++i)
+    {
+        double* row_i = matrix + i * size;
+        const double diagonal = row_i[i];
+
+        for (int j = 0; j < i; ++j)
+        {
+            const double* row_j = matrix + j * size;
+
+            if (row_j[j] == 0.0)
+            {
+                row_i[j] = 0.0;
+                continue;
+            }
+
+            double sum = row_i[j];
+            for (int k = 0; k < j; ++k)
+            {
+                sum -= row_i[k] * row_j[k];
+            }
+
+            row_i[j] = sum / row_j[j];
+        }
+
+        double pivot = diagonal;
+        for (int k = 0; k < i; ++k)
+        {
+            pivot -= row_i[k] * row_i[k];
+        }
+
+        if (diagonal <= 0.0 || pivot <= PIVOT_TOLERANCE * diagonal)
+        {
+            for (int k = 0; k <= i; ++k)
+            {
+                row_i[k] = 0.0;
+            }
+        }
+        else
+        {
+            row_i[i] = sqrt(pivot);
+        }
+    }
+}
+
+static void coarse_solve(const double* factor, int size, double* x)
+{
+    for (int i = 0; i < size; ++i)
+    {
+        const double* row = factor + i * size;
+
+        if (row[i] == 0.0)
+        {
+            x[i] = 0.0;
+            continue;
+        }
+
+        double sum = x[i];
+        for (int k = 0; k < i; ++k)
+        {
+            sum -= row[k] * x[k];
+        }
+
+        x[i] = sum / row[i];
+    }
+
+    for (int i = size - 1; i >= 0; --i)
+    {
+        const double* row = factor + i * size;
+
+        if (row[i] == 0.0)
+        {
+            continue;
+        }
+
+        x[i] /= row[i];
+
+        for (int k = 0; k < i; ++k)
+        {
+            x[k] -= row[k] * x[i];
+        }
+    }
+}
+
+int schwarz_set_coarse(struct SchwarzPreconditioner* precond, const struct SparseMatrix* matrix, struct HaloExchange* halo,
+    const int* aggregates, int aggregate_count, const float* modes, int mode_count)
+{
+    const int rows = precond->local_rows;
+
+    if (matrix->rows != rows)
+    {
+        fprintf(stderr, "Error creating Schwarz coarse space: matrix does not match the owned rows\n");
+        return -1;
+    }
+
+    if (halo && !ENABLE_MPI)
+    {
+        fprintf(stderr, "Warning: Attempting to use MPI functionality with MPI disabled\n");
+        return -1;
+    }
+
+    free(precond->aggregates);
+    free(precond->modes);
+    free(precond->coarse_factor);
+    free(precond->coarse_values);
+
+    // Aggregates are numbered across processes in rank order
+    int aggregate_start = 0;
+    int aggregate_total = aggregate_count;
+
+#if ENABLE_MPI
+    if (halo)
+    {
+        MPI_Exscan(&aggregate_count, &aggregate_start, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+        MPI_Allreduce(&aggregate_count, &aggregate_total, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+
+        if (get_rank_mpi() == 0)
+        {
+            aggregate_start = 0;
+        }
+    }
+#endif
+
+    const int size = mode_count * aggregate_total;
+
+    precond->mode_count = mode_count;
+    precond->aggregate_count = aggregate_count;
+    precond->aggregate_start = aggregate_start;
+    precond->coarse_size = size;
+    precond->aggregates = malloc(sizeof(*precond->aggregates) * (rows > 0 ? rows : 1));
+    precond->modes = malloc(sizeof(*precond->modes) * mode_count * (rows > 0 ? rows : 1));
+    precond->coarse_factor = calloc((size_t)size * size > 0 ? (size_t)size * size : 1, sizeof(*precond->coarse_factor));
+    precond->coarse_values = malloc(sizeof(*precond->coarse_values) * (size > 0 ? size : 1));
+
+    for (int j = 0; j < rows; ++j)
+    {
+        precond->aggregates[j] = aggregates[j];
+    }
+
+    for (int i = 0; i < mode_count * rows; ++i)
+    {
+        precond->modes[i] = modes[i];
+    }
+
+    // The columns of the owned rows include ghosts whose aggregate and mode values
+    // belong to other processes. They are exchanged like any other vector
+    // (aggregate numbers are sent as floats which is exact for any practical count)
+    const int columns = matrix->cols > rows ? matrix->cols : rows;
+    float* column_aggregates = malloc(sizeof(*column_aggregates) * (columns > 0 ? columns : 1));
+    float* column_modes = malloc(sizeof(*column_modes) * mode_count * (columns > 0 ? columns : 1));
+
+    for (int j = 0; j < rows; ++j)
+    {
+        column_aggregates[j] = (float)(aggregate_start + aggregates[j]);
+    }
+
+    if (halo)
+    {
+        halo_bind(halo, column_aggregates);
+        halo_exchange(halo);
+    }
+
+    for (int m = 0; m < mode_count; ++m)
+    {
+        float* column_mode = column_modes + m * columns;
+
+        for (int j = 0; j < rows; ++j)
+        {
+            column_mode[j] = modes[m * rows + j];
+        }
+
+        if (halo)
+        {
+            halo_bind(halo, column_mode);
+            halo_exchange(halo);
+        }
+    }
+
+    // Z^T A Z. Mode m of aggregate a only has values on the rows of a so each process adds
+    // the terms for its own rows and the sums are combined
+    double* coarse = precond->coarse_factor;
+
+    for (int j = 0; j < rows; ++j)
+    {
+        const int a = aggregate_start + aggregates[j];
+
+        for (int k = matrix->row_offsets[j]; k < matrix->row_offsets[j + 1]; ++k)
+        {
+            const int c = matrix->columns[k];
+            const int b = (int)column_aggregates[c];
+            const double value = matrix->values[k];
+
+            for (int m = 0; m < mode_count; ++m)
+            {
+                const double z_jm = modes[m * rows + j];
+
+                if (z_jm == 0.0)
+                {
+                    continue;
+                }
+
+                double* row = coarse + (size_t)(a * mode_count + m) * size + b * mode_count;
+
+                for (int n = 0; n < mode_count; ++n)
+                {
+                    row[n] += z_jm * value * column_modes[n * columns + c];
+                }
+            }
+        }
+    }
+
+#if ENABLE_MPI
+    if (halo)
+    {
+        MPI_Allreduce(MPI_IN_PLACE, coarse, size * size, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+    }
+#endif
+
+    coarse_factor(coarse, size);
+
+    free(column_modes);
+    free(column_aggregates);
+
+    return 0;
+}
+
+
+void schwarz_apply(struct SchwarzPreconditioner* precond, const float* r, float* z)
+{
+    const int rows = precond->local_rows;
+    const int mode_count = precond->mode_count;
+    float* residual = precond->residual;
+    float* correction = precond->correction;
+
+#pragma omp for schedule(static)
+    for (int j = 0; j < precond->vector_size; ++j)
+    {
+        if (j < rows)
+        {
+            residual[j] = r[j];
+        }
+
+        correction[j] = 0.0f;
+    }
+
+    // The residual of the overlap comes from the processes that own it
+#pragma omp master
+    {
+        if (precond->halo)
+        {
+            halo_exchange(precond->halo);
+        }
+    }
+
+#pragma omp barrier
+
+    // Every subdomain is solved on its own and subdomains that overlap add into the same entries
+#pragma omp for schedule(dynamic, 1)
+    for (int s = 0; s < precond->subdomain_count; ++s)
+    {
+        const struct SchwarzSubdomain* subdomain = &precond->subdomains[s];
+        const struct LocalFactor* factor = &subdomain->factor;
+        double* work = factor->work;
+
+        for (int i = 0; i < factor->rows; ++i)
+        {
+            work[i] = residual[subdomain->indices[factor->order[i]]];
+        }
+
+        factor_solve(factor, work);
+
+        for (int i = 0; i < factor->rows; ++i)
+        {
+            const int index = subdomain->indices[factor->order[i]];
+            const float value = (float)work[i];
+
+#pragma omp atomic
+            correction[index] += value;
+        }
+    }
+
+    // Corrections of rows owned by other processes are returned to their owners then the
+    // coarse problem is solved. The coarse residual is summed over every process
+#pragma omp master
+    {
+        if (precond->halo)
+        {
+            halo_reverse_add(precond->halo, correction);
+        }
+
+        if (precond->coarse_size > 0)
+        {
+            double* coarse = precond->coarse_values;
+
+            for (int i = 0; i < precond->coarse_size; ++i)
+            {
+                coarse[i] = 0.0;
+            }
+
+            for (int j = 0; j < rows; ++j)
+            {
+                const int a = precond->aggregate_start + precond->aggregates[j];
+
+                for (int m = 0; m < mode_count; ++m)
+                {
+                    coarse[a * mode_count + m] += (double)precond->modes[m * rows + j] * residual[j];
+                }
+            }
+
+#if ENABLE_MPI
+            if (precond->halo)
+            {
+                MPI_Allreduce(MPI_IN_PLACE, coarse, precond->coarse_size, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+            }
+#endif
+
+            coarse_solve(precond->coarse_factor, precond->coarse_size, coarse);
+        }
+    }
+
+#pragma omp barrier
+
+#pragma omp for schedule(static)
+    for (int j = 0; j < rows; ++j)
+    {
+        double value = correction[j];
+
+        if (precond->coarse_size > 0)
+        {
+            const double* coarse = precond->coarse_values + (precond->aggregate_start + precond->aggregates[j]) * mode_count;
+
+            for (int m = 0; m < mode_count; ++m)
+            {
+                value += precond->modes[m * rows + j] * coarse[m];
+            }
+        }
+
+        z[j] = (float)value;
+    }
+}
+
+void schwarz_release(struct SchwarzPreconditioner* precond)
+{
+    if (!precond)
+    {
+        return;
+    }
+
+    for (int s = 0; s < precond->subdomain_count; ++s)
+    {
+        factor_release(&precond->subdomains[s].factor);
+        free(precond->subdomains[s].indices);
+    }
+
+    if (precond->halo)
+    {
+        halo_release(precond->halo);
+        free(precond->halo);
+    }
+
+    free(precond->subdomains);
+    free(precond->residual);
+    free(precond->correction);
+    free(precond->aggregates);
+    free(precond->modes);
+    free(precond->coarse_factor);
+    free(precond->coarse_values);
+
+    memset(precond, 0, sizeof(*precond));
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include "sparse.h"
+
+struct RowDistribution;
+struct HaloExchange;
+
+// How each subdomain's equations are solved when the preconditioner is applied
+enum SchwarzLocalSolver
+{
+    SCHWARZ_CHOLESKY = 0, // Exact solve with a profile (skyline) Cholesky factor
+    SCHWARZ_IC0 // Approximate solve with an incomplete Cholesky factor that has no fill
+};
+
+// Options for building an additive Schwarz preconditioner (see frameschwarz.h)
+struct SchwarzSettings
+{
+    int overlap; // Layers of neighboring nodes added around each subdomain (0 is block Jacobi)
+    enum SchwarzLocalSolver local_solver;
+    int coarse; // Add a coarse correction built from the rigid body modes of every aggregate
+    int subdomains; // Subdomains per process (0 uses one per thread)
+};
+
+// Factor of one subdomain's matrix in double precision
+// Rows are factored in reverse Cuthill-McKee order to keep the profile (and fill) small
+// Row i of the factor is subdomain row order[i]
+struct LocalFactor
+{
+    enum SchwarzLocalSolver kind;
+    int rows;
+    int* order;
+
+    // Cholesky: row i holds L(i, first[i]) up to L(i, i) in values[offsets[i]] onwards
+    // IC(0): row i holds the lower triangle in CSR form with columns (diagonal last)
+    int* offsets;
+    int* first;
+    int* columns;
+    double* values;
+
+    double* work; // rows entries used while solving
+};
+
+// A block of equations solved on its own. indices are the local vector entries
+// (see SchwarzPreconditioner) of the subdomain's rows
+struct SchwarzSubdomain
+{
+    struct LocalFactor factor;
+    int* indices;
+    int rows;
+};
+
+// Additive Schwarz preconditioner z = sum_i R_i^T A_i^-1 R_i r (+ coarse correction)
+// Every subdomain solves the equations of its rows with the rows outside of it held at zero.
+// Overlapping subdomains share rows and their corrections are added together
+// Subdomains may cover rows owned by other processes (the overlap). A local vector holds
+// the owned rows followed by the overlap rows owned by other processes (ghosts)
+struct SchwarzPreconditioner
+{
+    int local_rows; // Owned rows
+    int vector_size; // Owned rows plus ghosts
+    int row_start; // Global index of the first owned row
+
+    int subdomain_count;
+    struct SchwarzSubdomain* subdomains;
+
+    // Moves the residual of the overlap to this process and the corrections back
+    // (NULL when the subdomains only use owned rows)
+    struct HaloExchange* halo;
+    float* residual;
+    float* correction;
+
+    // Coarse space. Rows are split into aggregates (such as one per process) that each
+    // contribute mode_count vectors. The Galerkin coarse matrix Z^T A Z is small and dense
+    // and every process factors its own copy
+    int mode_count;
+    int aggregate_count; // Owned aggregates
+    int aggregate_start; // Global index of the first owned aggregate
+    int coarse_size; // mode_count times the number of aggregates on every process
+    int* aggregates; // Local aggregate of each owned row
+    float* modes; // Mode m of owned row j is modes[m * local_rows + j]
+    double* coarse_factor; // Dense Cholesky factor (coarse_size squared)
+    double* coarse_values; // coarse_size entries used while applying
+};
+
+// One layer of overlap, exact local solves and a rigid body coarse space
+void schwarz_default_settings(struct SchwarzSettings* settings);
+
+// Collective if dist is not NULL. Prepare a preconditioner with the given number of subdomains
+// for local_rows owned rows starting at global row row_start. needed lists the global rows owned by
+// other processes that subdomains overlap (may have repeats). dist must be NULL when nothing
+// is needed from other processes (such as without MPI)
+int schwarz_create(struct SchwarzPreconditioner* precond, const struct RowDistribution* dist, int row_start, int local_rows,
+    const int* needed, int needed_count, int subdomain_count);
+
+// Local vector entry of an owned or needed global row or -1 if it is neither
+int schwarz_local_index(const struct SchwarzPreconditioner* precond, int global);
+
+// Factor subdomain s. matrix is symmetric (both triangles stored) with columns numbered by
+// subdomain row and indices gives the local vector entry of every subdomain row
+// A Cholesky factor too large to store falls back to IC(0) for that subdomain
+// Returns 0 on success or -1 if the matrix is not positive definite
+int schwarz_set_subdomain(struct SchwarzPreconditioner* precond, int s, const struct SparseMatrix* matrix,
+    const int* indices, enum SchwarzLocalSolver solver);
+
+// Collective if halo is not NULL. Build the coarse space from mode vectors of the owned rows
+// matrix holds the owned rows with columns numbered as local vector entries of halo (owned rows
+// then ghosts, see halo_create) or as owned rows when halo is NULL. aggregates gives the
+// aggregate (0 to aggregate_count - 1) of every owned row and modes holds mode_count values
+// per owned row (mode m of row j is modes[m * rows + j]). halo is rebound to a temporary vector
+// Modes that depend on the others are dropped. Returns 0 on success
+int schwarz_set_coarse(struct SchwarzPreconditioner* precond, const struct SparseMatrix* matrix, struct HaloExchange* halo,
+    const int* aggregates, int aggregate_count, const float* modes, int mode_count);
+
+// Collective. z = M^-1 r for the owned rows
+// Must be called by every thread of a team (or outside of a parallel region). Subdomains are
+// shared between threads and only the master thread communicates
+void schwarz_apply(struct SchwarzPreconditioner* precond, const float* r, float* z);
+
+// Frees resources held by the preconditioner
+void schwarz_release(struct SchwarzPreconditioner* precond);
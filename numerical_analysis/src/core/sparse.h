@@ -0,0 +1,125 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "matrix.h"
+
+// Matrix stored in compressed sparse row (CSR) form
+// Row j holds values[row_offsets[j]] up to (not including) values[row_offsets[j + 1]]
+// with the column of each value in the same position of columns
+struct SparseMatrix
+{
+    float* values;
+    int* columns;
+    int* row_offsets; // rows + 1 entries
+    int rows;
+    int cols;
+    int nnz; // Number of stored values
+};
+
+// Allocate space for a matrix with a known number of stored values
+// row_offsets is zeroed so it can be used to count values per row before filling
+static inline void sparse_init(struct SparseMatrix* matrix, int rows, int cols, int nnz)
+{
+    matrix->rows = rows;
+    matrix->cols = cols;
+    matrix->nnz = nnz;
+    matrix->row_offsets = calloc(rows + 1, sizeof(*matrix->row_offsets));
+    matrix->columns = malloc(sizeof(*matrix->columns) * (nnz > 0 ? nnz : 1));
+    matrix->values = malloc(sizeof(*matrix->values) * (nnz > 0 ? nnz : 1));
+}
+
+static inline void sparse_release(struct SparseMatrix* matrix)
+{
+    if (matrix)
+    {
+        free(matrix->values);
+        free(matrix->columns);
+        free(matrix->row_offsets);
+        matrix->values = NULL;
+        matrix->columns = NULL;
+        matrix->row_offsets = NULL;
+        matrix->rows = 0;
+        matrix->cols = 0;
+        matrix->nnz = 0;
+    }
+}
+
+// Build a sparse copy of a dense matrix keeping only the non zero values
+static inline void sparse_from_dense(struct SparseMatrix* sparse, const struct Matrix dense)
+{
+    int nnz = 0;
+    for (int i = 0; i < dense.rows * dense.cols; ++i)
+    {
+        if (dense.elements[i] != 0.0f)
+        {
+            ++nnz;
+        }
+    }
+
+    sparse_init(sparse, dense.rows, dense.cols, nnz);
+
+    int count = 0;
+    for (int j = 0; j < dense.rows; ++j)
+    {
+        for (int i = 0; i < dense.cols; ++i)
+        {
+            float value = dense.elements[i + j * dense.cols];
+            if (value != 0.0f)
+            {
+                sparse->columns[count] = i;
+                sparse->values[count] = value;
+                ++count;
+            }
+        }
+
+        sparse->row_offsets[j + 1] = count;
+    }
+}
+
+// result = matrix * vector
+static inline void sparse_premultiply(float* result, const struct SparseMatrix* matrix, const float* vector)
+{
+    for (int j = 0; j < matrix->rows; ++j)
+    {
+        float v = 0;
+
+        for (int k = matrix->row_offsets[j]; k < matrix->row_offsets[j + 1]; ++k)
+        {
+            v += matrix->values[k] * vector[matrix->columns[k]];
+        }
+
+        result[j] = v;
+    }
+}
+
+// Returns 1 if every stored value has an equal value stored at its transposed position or 0 otherwise
+static inline int sparse_is_symmetric(const struct SparseMatrix* matrix)
+{
+    if (matrix->rows != matrix->cols)
+    {
+        return 0;
+    }
+
+    for (int j = 0; j < matrix->rows; ++j)
+    {
+        for (int k = matrix->row_offsets[j]; k < matrix->row_offsets[j + 1]; ++k)
+        {
+            const int i = matrix->columns[k];
+            int matched = 0;
+
+            for (int t = matrix->row_offsets[i]; t < matrix->row_offsets[i + 1] && !matched; ++t)
+            {
+                matched = matrix->columns[t] == j && matrix->values[t] == matrix->values[k];
+            }
+
+            if (!matched)
+            {
+                return 0;
+            }
+        }
+    }
+
+    return 1;
+}
@@ -0,0 +1,391 @@
+#include "trace.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+
+#include <omp.h>
+
+#include "mpiutility.h"
+
+#ifndef ENABLE_MPI
+#define ENABLE_MPI 0
+#endif
+
+#if ENABLE_MPI
+#include <mpi.h>
+#endif
+
+#if ENABLE_TRACE
+
+#include <pthread.h>
+
+#if defined(_MSC_VER)
+#define TRACE_THREAD_LOCAL __declspec(thread)
+#else
+#define TRACE_THREAD_LOCAL _Thread_local
+#endif
+
+// A finished scope. Times are seconds since trace_start
+struct TraceEvent
+{
+    const char* name;
+    double start;
+    double duration;
+};
+
+// One per thread that has opened a scope. Only its own thread writes to it while recording
+struct TraceBuffer
+{
+    struct TraceEvent events[TRACE_BUFFER_EVENTS];
+    long long count; // Scopes finished. The newest is at (count - 1) % TRACE_BUFFER_EVENTS
+
+    const char* open_names[TRACE_MAX_DEPTH];
+    double open_starts[TRACE_MAX_DEPTH];
+    int depth; // Scopes open (may be more than TRACE_MAX_DEPTH)
+
+    int id; // Thread number shown in the trace in the order threads first traced
+    int generation; // trace_start call the buffer was last reset for
+    struct TraceBuffer* next;
+};
+
+static volatile int trace_active = 0;
+static int trace_generation = 0;
+static double trace_origin = 0.0;
+
+// Buffers are never freed since their threads keep pointers to them
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct TraceBuffer* trace_buffers = NULL;
+static int trace_buffer_count = 0;
+
+static TRACE_THREAD_LOCAL struct TraceBuffer* thread_buffer = NULL;
+
+// The calling thread's buffer emptied for the current trace or NULL if it could not be allocated
+static struct TraceBuffer* get_buffer(void)
+{
+    struct TraceBuffer* buffer = thread_buffer;
+
+    if (!buffer)
+    {
+        buffer = calloc(1, sizeof(*buffer));
+        if (!buffer)
+        {
+            return NULL;
+        }
+
+        pthread_mutex_lock(&trace_lock);
+        buffer->id = trace_buffer_count++;
+        buffer->generation = trace_generation;
+        buffer->next = trace_buffers;
+        trace_buffers = buffer;
+        pthread_mutex_unlock(&trace_lock);
+
+        thread_buffer = buffer;
+    }
+
+    // Scopes left from an earlier trace are dropped the first time the thread traces again
+    if (buffer->generation != trace_generation)
+    {
+        buffer->count = 0;
+        buffer->depth = 0;
+        buffer->generation = trace_generation;
+    }
+
+    return buffer;
+}
+
+void trace_begin(const char* name)
+{
+    if (!trace_active)
+    {
+        return;
+    }
+
+    struct TraceBuffer* buffer = get_buffer();
+    if (!buffer)
+    {
+        return;
+    }
+
+    if (buffer->depth < TRACE_MAX_DEPTH)
+    {
+        buffer->open_names[buffer->depth] = name;
+        buffer->open_starts[buffer->depth] = omp_get_wtime();
+    }
+
+    buffer->depth++;
+}
+
+void trace_end(void)
+{
+    if (!trace_active)
+    {
+        return;
+    }
+
+    const double now = omp_get_wtime();
+
+    // A scope opened before recording started has nothing to close
+    struct TraceBuffer* buffer = get_buffer();
+    if (!buffer || buffer->depth == 0)
+    {
+        return;
+    }
+
+    buffer->depth--;
+
+    if (buffer->depth < TRACE_MAX_DEPTH)
+    {
+        struct TraceEvent* event = &buffer->events[buffer->count % TRACE_BUFFER_EVENTS];
+        event->name = buffer->open_names[buffer->depth];
+        event->start = buffer->open_starts[buffer->depth] - trace_origin;
+        event->duration = now - buffer->open_starts[buffer->depth];
+        buffer->count++;
+    }
+}
+
+// Growing text buffer for one process' part of the trace
+struct TraceText
+{
+    char* data;
+    size_t length;
+    size_t capacity;
+    int failed;
+};
+
+static void text_append(struct TraceText* text, const char* format, ...)
+{
+    if (text->failed)
+    {
+        return;
+    }
+
+    for (;;)
+    {
+        va_list args;
+        va_start(args, format);
+        int written = vsnprintf(text->data + text->length, text->capacity - text->length, format, args);
+        va_end(args);
+
+        if (written < 0)
+        {
+            text->failed = 1;
+            return;
+        }
+
+        if ((size_t)written < text->capacity - text->length)
+        {
+            text->length += written;
+            return;
+        }
+
+        size_t capacity = text->capacity * 2 + written + 1;
+        char* data = realloc(text->data, capacity);
+        if (!data)
+        {
+            text->failed = 1;
+            return;
+        }
+
+        text->data = data;
+        text->capacity = capacity;
+    }
+}
+
+// Events of every thread of this process as comma separated JSON objects
+// Times are written in microseconds as the trace format expects
+static void format_events(struct TraceText* text, int rank)
+{
+    text_append(text, "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": %i, \"args\": {\"name\": \"rank %i\"}}", rank, rank);
+
+    pthread_mutex_lock(&trace_lock);
+
+    for (struct TraceBuffer* buffer = trace_buffers; buffer; buffer = buffer->next)
+    {
+        if (buffer->generation != trace_generation || buffer->count == 0)
+        {
+            continue;
+        }
+
+        text_append(text, ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": %i, \"tid\": %i, \"args\": {\"name\": \"thread %i\"}}",
+            rank, buffer->id, buffer->id);
+
+        const long long first = buffer->count > TRACE_BUFFER_EVENTS ? buffer->count - TRACE_BUFFER_EVENTS : 0;
+
+        for (long long e = first; e < buffer->count; ++e)
+        {
+            const struct TraceEvent* event = &buffer->events[e % TRACE_BUFFER_EVENTS];
+            text_append(text, ",\n{\"name\": \"%s\", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, \"pid\": %i, \"tid\": %i}",
+                event->name, event->start * 1e6, event->duration * 1e6, rank, buffer->id);
+        }
+    }
+
+    pthread_mutex_unlock(&trace_lock);
+}
+
+#endif
+
+void trace_start(void)
+{
+#if ENABLE_TRACE
+    trace_active = 0;
+
+    // Every process starts its clock as they leave the barrier
+#if ENABLE_MPI
+    if (get_initialized_mpi())
+    {
+        MPI_Barrier(MPI_COMM_WORLD);
+    }
+#endif
+
+    trace_generation++;
+    trace_origin = omp_get_wtime();
+    trace_active = 1;
+#else
+    fprintf(stderr, "Warning: Attempting to trace with tracing disabled (build with -DENABLE_TRACE=true)\n");
+#endif
+}
+
+int trace_write(const char* path)
+{
+#if ENABLE_TRACE
+    trace_active = 0;
+
+    int rank = 0;
+    int procs = 1;
+    int main_proc = 0;
+
+#if ENABLE_MPI
+    if (get_initialized_mpi())
+    {
+        rank = get_rank_mpi();
+        procs = get_procs_mpi();
+        main_proc = get_main_mpi();
+    }
+#endif
+
+    struct TraceText text = { malloc(65536), 0, 65536, 0 };
+    text.failed = text.data == NULL;
+
+    format_events(&text, rank);
+
+    int failed = text.failed;
+    char* all = text.data;
+    long long total = (long long)text.length;
+
+#if ENABLE_MPI
+    // The main process collects every process' events and writes them all
+    int* lengths = NULL;
+    int* offsets = NULL;
+
+    if (procs > 1)
+    {
+        int length = failed || text.length > 0x7fffffff ? 0 : (int)text.length;
+        failed |= length == 0;
+
+        if (rank == main_proc)
+        {
+            lengths = malloc(sizeof(*lengths) * procs);
+            offsets = malloc(sizeof(*offsets) * procs);
+        }
+
+        MPI_Gather(&length, 1, MPI_INT, lengths, 1, MPI_INT, main_proc, MPI_COMM_WORLD);
+
+        all = NULL;
+        total = 0;
+
+        if (rank == main_proc)
+        {
+            for (int p = 0; p < procs; ++p)
+            {
+                offsets[p] = (int)total;
+                total += lengths[p];
+            }
+
+            all = total <= 0x7fffffff ? malloc(total > 0 ? total : 1) : NULL;
+            failed |= all == NULL;
+        }
+
+        MPI_Gatherv(text.data, length, MPI_CHAR, all, lengths, offsets, MPI_CHAR, main_proc, MPI_COMM_WORLD);
+    }
+#endif
+
+    if (rank == main_proc && all)
+    {
+        FILE* file = fopen(path, "w");
+        if (!file)
+        {
+            fprintf(stderr, "Failed to open file at: %s\n", path);
+            failed = 1;
+        }
+        else
+        {
+            fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+
+            // Each process' part starts with its name so the parts only need a separator
+            long long start = 0;
+
+            for (int p = 0; p < procs; ++p)
+            {
+                long long length = procs > 1 ? 0 : total;
+
+#if ENABLE_MPI
+                if (procs > 1)
+                {
+                    length = lengths[p];
+                }
+#endif
+
+                if (length > 0)
+                {
+                    fprintf(file, "%s", start > 0 ? ",\n" : "");
+                    fwrite(all + start, 1, length, file);
+                    start += length;
+                }
+            }
+
+            fprintf(file, "\n]}\n");
+
+            if (fclose(file))
+            {
+                fprintf(stderr, "Trace Error: failed to write %s\n", path);
+                failed = 1;
+            }
+        }
+    }
+
+#if ENABLE_MPI
+    if (all != text.data)
+    {
+        free(all);
+    }
+
+    free(lengths);
+    free(offsets);
+
+    if (procs > 1)
+    {
+        MPI_Allreduce(MPI_IN_PLACE, &failed, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+    }
+#endif
+
+    free(text.data);
+
+    return failed ? -1 : 0;
+#else
+    return -1;
+#endif
+}
+
+#if ENABLE_TRACE == 0
+
+// Kept so code built with tracing can link against a library built without it
+void trace_begin(const char* name)
+{
+}
+
+void trace_end(void)
+{
+}
+
+#endif
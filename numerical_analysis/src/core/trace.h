@@ -0,0 +1,47 @@
+#pragma once
+
+// Scoped timers for the hot paths that are written out as Chrome / Perfetto trace files
+// (open in chrome://tracing or https://ui.perfetto.dev) to see where the wall time of a run goes
+// Built only when ENABLE_TRACE is set (cmake ../ -DENABLE_TRACE=true). Otherwise the markers
+// compile to nothing so they cost nothing in normal builds
+
+// Mark a scope with TRACE_BEGIN("name") and TRACE_END() on the same thread. Scopes nest
+// Names must be string literals (only the pointer is kept until the trace is written)
+// Markers do nothing until trace_start is called so libraries can be traced or not by the caller
+// Each thread records finished scopes into its own ring buffer without locking. Once a buffer is
+// full the oldest scopes are overwritten so a long run keeps its most recent TRACE_BUFFER_EVENTS
+// scopes per thread
+
+#ifndef ENABLE_TRACE
+#define ENABLE_TRACE 0
+#endif
+
+// Finished scopes kept per thread
+#define TRACE_BUFFER_EVENTS 65536
+
+// Most scopes open at once on one thread. Deeper scopes are not recorded
+#define TRACE_MAX_DEPTH 32
+
+#if ENABLE_TRACE
+#define TRACE_BEGIN(name) trace_begin(name)
+#define TRACE_END() trace_end()
+#else
+#define TRACE_BEGIN(name) ((void)0)
+#define TRACE_END() ((void)0)
+#endif
+
+// Collective with MPI. Start recording. Every process measures time from the moment all of them
+// have reached this call so the timelines of different processes line up
+// Prints a warning if tracing is disabled at compile time
+void trace_start(void);
+
+// Collective with MPI. Stop recording and write every thread's scopes (and every process' with MPI)
+// to one trace file on the main process. Processes are shown as separate timelines
+// Returns 0 on success or -1 on failure. The buffers are kept so the trace can be written again
+int trace_write(const char* path);
+
+// Open a scope on the calling thread
+void trace_begin(const char* name);
+
+// Close the most recent scope opened on the calling thread
+void trace_end(void);
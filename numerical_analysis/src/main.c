@@ -1,5 +1,6 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "graphics.h"
 #include "fluid.h"
@@ -7,7 +8,12 @@
 #include "mesh.h"
 #include "model.h"
 #include "frameimport.h"
+#include "framebinary.h"
+#include "frameresults.h"
 #include "frameprocess.h"
+#include "framempi.h"
+#include "distribute.h"
+#include "partition.h"
 #include "filepath.h"
 
 #include "mpiutility.h"
@@ -31,25 +37,21 @@ int main(int argc, char* argv[])
 
     int iterations = 9;
 
-    // If MPI is enabled and multiple processes are being used
-    // only the main process does anything more than participate in solving
-    if (ENABLE_MPI && procs != 1 && rank != main_proc)
-    {
-        //struct EquationSet eqset = {};
-        //solve_equations_mpi(&eqset, iterations);
-        solve_equations_mpi(NULL, iterations);
-        finalize_mpi(0);
-        return 0;
-    }
-
 
     // Specify filepaths relative to [repository]/models/
+    // Alternatively pass a model path and the results written for it by numerical_analysis_batch
+    // to view them without solving (numerical_analysis model.frame model.results)
     const char* filename = "car.frame";
-    char* filepath = get_full_filepath(filename, "models/");
+    const char* results_path = argc > 2 ? argv[2] : NULL;
+    char* filepath = argc > 1 ? strdup(argv[1]) : get_full_filepath(filename, "models/");
 
     // Load nodes, elements and boundary conditions from file
+    // Every process loads the frame so each can build its own part of the equations
+    // With several processes each reads and parses a share of a text file in parallel
+    // Binary files (see framebinary.h) need no parsing so every process maps the whole file
     struct Frame frame;
-    int load_failed = frame_import(filepath, &frame);
+    int load_failed = ENABLE_MPI && procs != 1 && !frame_is_binary(filepath) ?
+        frame_import_mpi(filepath, &frame) : frame_load(filepath, &frame);
 
     free(filepath);
 
@@ -60,43 +62,100 @@ int main(int argc, char* argv[])
     }
 
     // Assign nodes a group color such that neighbors are never in the same group
-    frame_assign_multicolor(&frame);
+    // Coloring is deterministic so every process gets the same colors
+    struct ColoringStats color_stats;
+    frame_assign_multicolor(&frame, COLORING_DSATUR, 1, &color_stats);
 
-    // Produce the set of matrices and vectors representing the problem
-    struct EquationSet eqset;
-    frame_build_equations(&frame, &eqset);
+    if (rank == main_proc)
+    {
+        printf("Colors: %i, Smallest: %i, Largest: %i, Imbalance: %.2f\n",
+            color_stats.num_colors, color_stats.min_size, color_stats.max_size, color_stats.imbalance);
+    }
 
-    for (int j = 0; j < eqset.stiffness.rows; ++j)
+    if (results_path)
+    {
+        // Visualize results solved earlier (only the main process is needed)
+        if (rank != main_proc || frame_read_results(&frame, results_path))
+        {
+            frame_release(&frame);
+            finalize_mpi(0);
+            return rank != main_proc ? 0 : 1;
+        }
+    }
+    else if (ENABLE_MPI && procs != 1)
     {
-        for (int i = 0; i < eqset.stiffness.cols; ++i)
+        // Give each process a compact block of nodes. Every process computes the
+        // same partition so no communication is needed to agree on ownership
+        struct RowDistribution node_dist;
+        struct PartitionStats part_stats;
+        int partitioned = !frame_partition(&frame, procs, &node_dist, NULL, &part_stats);
+
+        if (partitioned && rank == main_proc)
         {
-            float stiffness = eqset.stiffness.elements[i + j * eqset.stiffness.cols];
-            char symbol = '_';
-            if (stiffness != 0.0f)
+            printf("Parts: %i, Cut Elements: %i, Smallest: %i, Largest: %i, Imbalance: %.2f\n",
+                part_stats.parts, part_stats.cut_edges, part_stats.min_size, part_stats.max_size, part_stats.imbalance);
+        }
+
+        // Solve using MPI (See framempi.h/c and linsolvempi.h/c)
+        // Each process assembles and solves only the rows of the nodes it owns
+        // so the full matrix is never formed. Conjugate gradients preconditioned by
+        // overlapping subdomain solves and a rigid body coarse correction needs far
+        // fewer iterations than Jacobi or Gauss-Seidel and about as many for any
+        // number of processes. Each process uses a team of threads (set with
+        // OMP_NUM_THREADS) for its rows and subdomains
+        struct MpiSolveSettings settings;
+        mpisolve_default_settings(&settings, iterations);
+        settings.method = MPI_SOLVE_CG;
+
+        frame_solve_mpi(&frame, partitioned ? &node_dist : NULL, &settings, NULL);
+
+        if (partitioned)
+        {
+            rowdist_release(&node_dist);
+        }
+
+        // Only the main process does anything more than participate in solving
+        if (rank != main_proc)
+        {
+            frame_release(&frame);
+            finalize_mpi(0);
+            return 0;
+        }
+    }
+    else
+    {
+        // Produce the set of matrices and vectors representing the problem
+        struct EquationSet eqset;
+        frame_build_equations(&frame, &eqset);
+
+        for (int j = 0; j < eqset.stiffness.rows; ++j)
+        {
+            for (int i = 0; i < eqset.stiffness.cols; ++i)
             {
-                symbol = 'k';
+                float stiffness = eqset.stiffness.elements[i + j * eqset.stiffness.cols];
+                char symbol = '_';
+                if (stiffness != 0.0f)
+                {
+                    symbol = 'k';
+                }
+
+                printf("%c ", symbol);
             }
 
-            printf("%c ", symbol);
+            printf("\n");
         }
 
         printf("\n");
-    }
-
-    printf("\n");
 
 
-    // Create space to hold the residuals
-    struct vecf residuals;
-    vecf_init(&residuals, iterations);
+        // Create space to hold the residuals
+        struct vecf residuals;
+        vecf_init(&residuals, iterations);
 
-    // It seems for most boundary condition sets the stiffness matrix will not be
-    // diagonally dominant so convergence is not guaranteed
-    mat_diagnonal_dominance(eqset.stiff_bc);
+        // It seems for most boundary condition sets the stiffness matrix will not be
+        // diagonally dominant so convergence is not guaranteed
+        mat_diagnonal_dominance(eqset.stiff_bc);
 
-    // Solve Equations
-    if (!ENABLE_MPI || procs == 1)
-    {
         // There is only one process so solve directly
         solve_jacobi_single(eqset, residuals.elements, iterations);
 
@@ -104,23 +163,16 @@ int main(int argc, char* argv[])
         //solve_jacobi_parallel(eqset, residuals.elements, iterations, 8);
 
         //solve_sor_single(eqset, residuals.elements, iterations, 1.1f);
-    }
-    else
-    {
-        // Solve using MPI (See linsolvempi.h/c)
-        // Only uses Jacobi which has convergence problems
-        // but does get the same result as single thread
-        solve_equations_mpi(&eqset, iterations);
-    }
 
-    // Continue as normal to process and render results on the main process
+        // Populate per node properties using displacements to back calculate forces
+        frame_update_results(&frame, &eqset);
 
-    // Populate per node properties using displacements to back calculate forces
-    frame_update_results(&frame, &eqset);
+        // The equation set is no longer needed
+        vecf_release(&residuals);
+        equationset_release(&eqset);
+    }
 
-    // The equation set is no longer needed
-    vecf_release(&residuals);
-    equationset_release(&eqset);
+    // Continue as normal to process and render results on the main process
 
     //frame_print_results(&frame);
 
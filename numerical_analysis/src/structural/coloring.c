@@ -0,0 +1,539 @@
+#include "coloring.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#include <omp.h>
+
+#include "nodegraph.h"
+
+// Passes of color_balance over the graph. Most of the improvement happens in the first pass
+#define BALANCE_PASSES 3
+
+int color_greedy(const struct NodeGraph* graph, int* colors)
+{
+    // Marks colors used by the neighbors of the current node. Storing the node index
+    // instead of a flag avoids clearing the array for every node
+    // A node can never need more than max_degree + 1 colors
+    int* used_by = malloc(sizeof(*used_by) * (graph->max_degree + 1));
+    for (int c = 0; c <= graph->max_degree; ++c)
+    {
+        used_by[c] = -1;
+    }
+
+    for (int i = 0; i < graph->node_count; ++i)
+    {
+        colors[i] = -1;
+    }
+
+    int num_colors = 0;
+
+    for (int i = 0; i < graph->node_count; ++i)
+    {
+        for (int n = graph->offsets[i]; n < graph->offsets[i + 1]; ++n)
+        {
+            int color = colors[graph->neighbors[n]];
+            if (color != -1)
+            {
+                used_by[color] = i;
+            }
+        }
+
+        int color = 0;
+        while (used_by[color] == i)
+        {
+            ++color;
+        }
+
+        colors[i] = color;
+
+        if (color + 1 > num_colors)
+        {
+            num_colors = color + 1;
+        }
+    }
+
+    free(used_by);
+
+    return num_colors;
+}
+
+
+// Max heap of uncolored nodes ordered by saturation then degree then lowest index
+struct SatHeap
+{
+    int* nodes;
+    int* position; // Index of each node in the heap or -1 if it is not in the heap
+    const int* saturation;
+    const struct NodeGraph* graph;
+    int count;
+};
+
+static inline int satheap_before(const struct SatHeap* heap, int a, int b)
+{
+    if (heap->saturation[a] != heap->saturation[b])
+    {
+        return heap->saturation[a] > heap->saturation[b];
+    }
+
+    int degree_a = nodegraph_degree(heap->graph, a);
+    int degree_b = nodegraph_degree(heap->graph, b);
+
+    if (degree_a != degree_b)
+    {
+        return degree_a > degree_b;
+    }
+
+    return a < b;
+}
+
+static inline void satheap_swap(struct SatHeap* heap, int i, int j)
+{
+    int temp = heap->nodes[i];
+    heap->nodes[i] = heap->nodes[j];
+    heap->nodes[j] = temp;
+
+    heap->position[heap->nodes[i]] = i;
+    heap->position[heap->nodes[j]] = j;
+}
+
+static void satheap_sift_up(struct SatHeap* heap, int i)
+{
+    while (i > 0)
+    {
+        int parent = (i - 1) / 2;
+
+        if (!satheap_before(heap, heap->nodes[i], heap->nodes[parent]))
+        {
+            break;
+        }
+
+        satheap_swap(heap, i, parent);
+        i = parent;
+    }
+}
+
+static void satheap_sift_down(struct SatHeap* heap, int i)
+{
+    while (1)
+    {
+        int first = i;
+        int left = 2 * i + 1;
+        int right = left + 1;
+
+        if (left < heap->count && satheap_before(heap, heap->nodes[left], heap->nodes[first]))
+        {
+            first = left;
+        }
+
+        if (right < heap->count && satheap_before(heap, heap->nodes[right], heap->nodes[first]))
+        {
+            first = right;
+        }
+
+        if (first == i)
+        {
+            break;
+        }
+
+        satheap_swap(heap, i, first);
+        i = first;
+    }
+}
+
+static int satheap_pop(struct SatHeap* heap)
+{
+    int top = heap->nodes[0];
+
+    satheap_swap(heap, 0, heap->count - 1);
+    heap->count--;
+    heap->position[top] = -1;
+
+    satheap_sift_down(heap, 0);
+
+    return top;
+}
+
+// Check if any neighbor of node other than skip already has the given color
+static int neighbor_has_color(const struct NodeGraph* graph, const int* colors, int node, int skip, int color)
+{
+    for (int n = graph->offsets[node]; n < graph->offsets[node + 1]; ++n)
+    {
+        int neighbor = graph->neighbors[n];
+        if (neighbor != skip && colors[neighbor] == color)
+        {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+int color_dsatur(const struct NodeGraph* graph, int* colors)
+{
+    // The saturation of a node is the number of distinct colors among its neighbors
+    // Always coloring the most saturated node next tends to use fewer colors than greedy
+    // since the hardest nodes are handled while there is still the most freedom
+
+    const int node_count = graph->node_count;
+
+    int* saturation = calloc(node_count > 0 ? node_count : 1, sizeof(*saturation));
+
+    // Track the first 64 neighbor colors of each node with a bit mask. Frames rarely
+    // need more colors than that but larger colors fall back to checking the neighbors
+    uint64_t* seen = calloc(node_count > 0 ? node_count : 1, sizeof(*seen));
+
+    int* used_by = malloc(sizeof(*used_by) * (graph->max_degree + 1));
+    for (int c = 0; c <= graph->max_degree; ++c)
+    {
+        used_by[c] = -1;
+    }
+
+    struct SatHeap heap;
+    heap.nodes = malloc(sizeof(*heap.nodes) * (node_count > 0 ? node_count : 1));
+    heap.position = malloc(sizeof(*heap.position) * (node_count > 0 ? node_count : 1));
+    heap.saturation = saturation;
+    heap.graph = graph;
+    heap.count = node_count;
+
+    for (int i = 0; i < node_count; ++i)
+    {
+        colors[i] = -1;
+        heap.nodes[i] = i;
+        heap.position[i] = i;
+    }
+
+    for (int i = node_count / 2 - 1; i >= 0; --i)
+    {
+        satheap_sift_down(&heap, i);
+    }
+
+    int num_colors = 0;
+
+    while (heap.count > 0)
+    {
+        int node = satheap_pop(&heap);
+
+        // Smallest color not used by a neighbor
+        for (int n = graph->offsets[node]; n < graph->offsets[node + 1]; ++n)
+        {
+            int color = colors[graph->neighbors[n]];
+            if (color != -1)
+            {
+                used_by[color] = node;
+            }
+        }
+
+        int color = 0;
+        while (used_by[color] == node)
+        {
+            ++color;
+        }
+
+        colors[node] = color;
+
+        if (color + 1 > num_colors)
+        {
+            num_colors = color + 1;
+        }
+
+        // Raise the saturation of uncolored neighbors that have not seen this color yet
+        for (int n = graph->offsets[node]; n < graph->offsets[node + 1]; ++n)
+        {
+            int neighbor = graph->neighbors[n];
+
+            if (heap.position[neighbor] == -1)
+            {
+                continue;
+            }
+
+            int is_new;
+            if (color < 64)
+            {
+                is_new = !(seen[neighbor] & ((uint64_t)1 << color));
+                seen[neighbor] |= (uint64_t)1 << color;
+            }
+            else
+            {
+                is_new = !neighbor_has_color(graph, colors, neighbor, node, color);
+            }
+
+            if (is_new)
+            {
+                saturation[neighbor]++;
+                satheap_sift_up(&heap, heap.position[neighbor]);
+            }
+        }
+    }
+
+    free(heap.nodes);
+    free(heap.position);
+    free(used_by);
+    free(seen);
+    free(saturation);
+
+    return num_colors;
+}
+
+
+// Scramble the bits of a node index to give a random but reproducible priority
+static inline uint32_t node_priority(uint32_t node, uint32_t seed)
+{
+    uint32_t x = node ^ (seed * 0x9E3779B9u);
+    x ^= x >> 16;
+    x *= 0x7FEB352Du;
+    x ^= x >> 15;
+    x *= 0x846CA68Bu;
+    x ^= x >> 16;
+    return x;
+}
+
+// Compare priorities breaking ties with the node index so no two neighbors are ever equal
+static inline int priority_above(const uint32_t* priority, int a, int b)
+{
+    return priority[a] > priority[b] || (priority[a] == priority[b] && a > b);
+}
+
+int color_jones_plassmann(const struct NodeGraph* graph, int* colors, unsigned int seed)
+{
+    const int node_count = graph->node_count;
+
+    uint32_t* priority = malloc(sizeof(*priority) * (node_count > 0 ? node_count : 1));
+
+    // Uncolored nodes still to be processed and the nodes chosen in the current round
+    int* worklist = malloc(sizeof(*worklist) * (node_count > 0 ? node_count : 1));
+    unsigned char* chosen = calloc(node_count > 0 ? node_count : 1, sizeof(*chosen));
+    int remaining = node_count;
+
+#pragma omp parallel for schedule(static)
+    for (int i = 0; i < node_count; ++i)
+    {
+        colors[i] = -1;
+        priority[i] = node_priority(i, seed);
+        worklist[i] = i;
+    }
+
+    int num_colors = 0;
+
+    while (remaining > 0)
+    {
+        // Selection and coloring are separate passes so no thread reads a color
+        // being written in the same round
+
+#pragma omp parallel for schedule(static)
+        for (int w = 0; w < remaining; ++w)
+        {
+            int node = worklist[w];
+            int local_max = 1;
+
+            for (int n = graph->offsets[node]; n < graph->offsets[node + 1]; ++n)
+            {
+                int neighbor = graph->neighbors[n];
+                if (colors[neighbor] == -1 && priority_above(priority, neighbor, node))
+                {
+                    local_max = 0;
+                    break;
+                }
+            }
+
+            chosen[node] = local_max;
+        }
+
+#pragma omp parallel reduction(max:num_colors)
+        {
+            // Per thread marks for colors used by neighbors
+            int* used_by = malloc(sizeof(*used_by) * (graph->max_degree + 1));
+            for (int c = 0; c <= graph->max_degree; ++c)
+            {
+                used_by[c] = -1;
+            }
+
+#pragma omp for schedule(static)
+            for (int w = 0; w < remaining; ++w)
+            {
+                int node = worklist[w];
+
+                if (!chosen[node])
+                {
+                    continue;
+                }
+
+                for (int n = graph->offsets[node]; n < graph->offsets[node + 1]; ++n)
+                {
+                    int color = colors[graph->neighbors[n]];
+                    if (color != -1)
+                    {
+                        used_by[color] = node;
+                    }
+                }
+
+                int color = 0;
+                while (used_by[color] == node)
+                {
+                    ++color;
+                }
+
+                colors[node] = color;
+
+                if (color + 1 > num_colors)
+                {
+                    num_colors = color + 1;
+                }
+            }
+
+            free(used_by);
+        }
+
+        // Keep only the nodes that are still uncolored
+        int kept = 0;
+        for (int w = 0; w < remaining; ++w)
+        {
+            if (colors[worklist[w]] == -1)
+            {
+                worklist[kept++] = worklist[w];
+            }
+        }
+
+        remaining = kept;
+    }
+
+    free(chosen);
+    free(worklist);
+    free(priority);
+
+    return num_colors;
+}
+
+
+void color_balance(const struct NodeGraph* graph, int* colors, int num_colors)
+{
+    // Greedy style colorings put most nodes in the first few colors so a sweep that
+    // processes one color at a time in parallel has little work in the last colors
+    // Nodes in colors larger than the average are moved to the smallest color that
+    // is below the average and not used by any of their neighbors
+
+    if (num_colors < 2)
+    {
+        return;
+    }
+
+    const int node_count = graph->node_count;
+
+    // Largest size a color can have when the nodes are evenly split
+    const int target = (node_count + num_colors - 1) / num_colors;
+
+    int* sizes = calloc(num_colors, sizeof(*sizes));
+    int* used_by = malloc(sizeof(*used_by) * num_colors);
+
+    for (int c = 0; c < num_colors; ++c)
+    {
+        used_by[c] = -1;
+    }
+
+    for (int i = 0; i < node_count; ++i)
+    {
+        sizes[colors[i]]++;
+    }
+
+    for (int pass = 0; pass < BALANCE_PASSES; ++pass)
+    {
+        int moved = 0;
+
+        for (int i = 0; i < node_count; ++i)
+        {
+            int current = colors[i];
+
+            if (sizes[current] <= target)
+            {
+                continue;
+            }
+
+            for (int n = graph->offsets[i]; n < graph->offsets[i + 1]; ++n)
+            {
+                used_by[colors[graph->neighbors[n]]] = i;
+            }
+
+            int best = -1;
+            for (int c = 0; c < num_colors; ++c)
+            {
+                if (used_by[c] != i && sizes[c] < target && (best == -1 || sizes[c] < sizes[best]))
+                {
+                    best = c;
+                }
+            }
+
+            if (best != -1)
+            {
+                colors[i] = best;
+                sizes[current]--;
+                sizes[best]++;
+                moved++;
+            }
+
+            // The marks need to be cleared since the node index is reused on the next pass
+            for (int n = graph->offsets[i]; n < graph->offsets[i + 1]; ++n)
+            {
+                used_by[colors[graph->neighbors[n]]] = -1;
+            }
+        }
+
+        if (moved == 0)
+        {
+            break;
+        }
+    }
+
+    free(used_by);
+    free(sizes);
+}
+
+
+void coloring_stats(const int* colors, int node_count, struct ColoringStats* stats)
+{
+    int num_colors = 0;
+    for (int i = 0; i < node_count; ++i)
+    {
+        if (colors[i] + 1 > num_colors)
+        {
+            num_colors = colors[i] + 1;
+        }
+    }
+
+    stats->num_colors = num_colors;
+    stats->min_size = 0;
+    stats->max_size = 0;
+    stats->imbalance = 1.0f;
+
+    if (num_colors == 0)
+    {
+        return;
+    }
+
+    int* sizes = calloc(num_colors, sizeof(*sizes));
+    for (int i = 0; i < node_count; ++i)
+    {
+        sizes[colors[i]]++;
+    }
+
+    stats->min_size = sizes[0];
+    stats->max_size = sizes[0];
+
+    for (int c = 1; c < num_colors; ++c)
+    {
+        if (sizes[c] < stats->min_size)
+        {
+            stats->min_size = sizes[c];
+        }
+
+        if (sizes[c] > stats->max_size)
+        {
+            stats->max_size = sizes[c];
+        }
+    }
+
+    float average = (float)node_count / num_colors;
+    stats->imbalance = stats->max_size / average;
+
+    free(sizes);
+}
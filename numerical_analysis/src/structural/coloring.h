@@ -0,0 +1,41 @@
+#pragma once
+
+struct NodeGraph;
+
+// Algorithms available for coloring the node graph
+enum ColoringMethod
+{
+    COLORING_GREEDY = 0, // First fit in node order. Fast but colors are heavily skewed
+    COLORING_DSATUR, // Color the most constrained node first. Usually the fewest colors
+    COLORING_PARALLEL // Jones-Plassmann with random priorities. Scales with threads on large graphs
+};
+
+// Summary of a coloring
+struct ColoringStats
+{
+    int num_colors;
+    int min_size; // Nodes in the smallest color
+    int max_size; // Nodes in the largest color
+    float imbalance; // Largest color size relative to the average (1.0 is perfectly balanced)
+};
+
+// Each function writes a color from 0 to (number of colors - 1) for every node in the graph
+// such that no two neighbors share a color, then returns the number of colors used
+
+// Assign each node the first color not used by a neighbor in node order
+int color_greedy(const struct NodeGraph* graph, int* colors);
+
+// Repeatedly color the node with the most distinct neighbor colors (ties broken by degree)
+int color_dsatur(const struct NodeGraph* graph, int* colors);
+
+// Each round colors every node whose random priority is higher than all its uncolored
+// neighbors. Nodes colored in the same round are never neighbors so a round is fully parallel
+// The result only depends on the seed, not the number of threads
+int color_jones_plassmann(const struct NodeGraph* graph, int* colors, unsigned int seed);
+
+// Move nodes out of oversized colors into undersized colors where no neighbor uses
+// that color to even out the color sizes without adding colors
+void color_balance(const struct NodeGraph* graph, int* colors, int num_colors);
+
+// Count the colors and compute their size distribution
+void coloring_stats(const int* colors, int node_count, struct ColoringStats* stats);
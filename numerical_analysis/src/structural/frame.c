@@ -8,6 +8,7 @@
 #include "matrix.h"
 #include "linearsolve.h"
 #include "mesh.h"
+#include "trace.h"
 
 #include "frameprocess.h"
 
@@ -17,11 +18,14 @@
 // Forward Declarations
 void build_stiffness(struct Frame* frame, struct Matrix* k_global);
 void transform_element_stiffness(struct mat6* k_local, struct mat3 transform);
-void add_element_stiffness(struct Matrix* k_global, struct mat6* k_element, struct mat3 transform, int node1, int node2, int node_count);
-void apply_boundary_conditions(struct Frame* frame, struct Matrix* stiffness, struct vecf* forces);
+void add_element_stiffness(struct Matrix* k_global, const struct mat6* k_element, int node1, int node2, int node_count, float scale);
+void apply_boundary_conditions(struct Frame* frame, struct Matrix* stiffness, struct vecf* forces, unsigned char* fixed_dofs);
+void add_element_equations(struct Frame* frame, struct EquationSet* eqset, struct Element element, float scale);
 
 void frame_build_equations(struct Frame* frame, struct EquationSet* eqset)
 {
+    TRACE_BEGIN("assembly");
+
     int dof_count = DOF * frame->node_count;
 
     build_stiffness(frame, &eqset->stiffness);
@@ -35,8 +39,14 @@ void frame_build_equations(struct Frame* frame, struct EquationSet* eqset)
     // Copy stiffness before appling boundary conditions
     matrix_copy(&eqset->stiff_bc, &eqset->stiffness);
 
+    // Keep track of which degrees of freedom are eliminated by boundary conditions
+    // so later updates to the stiffness can skip them
+    eqset->fixed_dofs = calloc(dof_count, sizeof(*eqset->fixed_dofs));
+
     // Modify the copied stiffness matrix to reflect the boundary conditions
-    apply_boundary_conditions(frame, &eqset->stiff_bc, &eqset->forces);
+    apply_boundary_conditions(frame, &eqset->stiff_bc, &eqset->forces, eqset->fixed_dofs);
+
+    TRACE_END();
 }
 
 void build_stiffness(struct Frame* frame, struct Matrix* k_global)
@@ -51,230 +61,338 @@ void build_stiffness(struct Frame* frame, struct Matrix* k_global)
         const int node1 = frame->elements[element_idx].node1;
         const int node2 = frame->elements[element_idx].node2;
 
-        const float length = vec3_distance(frame->nodes[node1].pos, frame->nodes[node2].pos);
-        const float l2 = length * length;
-        const float l3 = l2 * length;
+        // Element stiffness in the global frame as 4 6x6 blocks (k11, k12, k21, k22)
+        struct mat6 k_element[4];
+        build_element_stiffness(frame, frame->elements[element_idx], k_element);
 
-        // Convert Gigapascals to Pascals
-        const float e = frame->elements[element_idx].elastic_modulus * 1000000000;
-        const float g = frame->elements[element_idx].shear_modulus * 1000000000;
-        const float r = frame->elements[element_idx].radius;
+        // Add the local contributions to the global stiffness matrix
+        add_element_stiffness(k_global, &k_element[0], node1, node1, frame->node_count, 1.f);
+        add_element_stiffness(k_global, &k_element[1], node1, node2, frame->node_count, 1.f);
+        add_element_stiffness(k_global, &k_element[2], node2, node1, frame->node_count, 1.f);
+        add_element_stiffness(k_global, &k_element[3], node2, node2, frame->node_count, 1.f);
+    }
 
-        //printf("Elastic: %f, Shear: %f, Radius %f, Length %f\n", e, g, r, length);
 
-        // Cross sectional area
-        const float area = r * r * 3.14159f;
+    //printf("Global Stiffness Matrix\n");
+    //matrix_print(k_global, dof_count, dof_count);
+}
 
-        // Area moment of inertia about y and z axes(for bending) m^4
-        //const double inertia_y = r * r * r * r * 3.14159f / 4.f;
-        //const double inertia_z = inertia_y;
+void build_element_stiffness(struct Frame* frame, struct Element element, struct mat6* k_element)
+{
+    // Produces the stiffness of a single element already transformed to the global frame
+    // k_element must have room for 4 matrices which are filled with k11, k12, k21, and k22
+
+    const int node1 = element.node1;
+    const int node2 = element.node2;
+
+    const float length = vec3_distance(frame->nodes[node1].pos, frame->nodes[node2].pos);
+    const float l2 = length * length;
+    const float l3 = l2 * length;
+
+    // Convert Gigapascals to Pascals
+    const float e = element.elastic_modulus * 1000000000;
+    const float g = element.shear_modulus * 1000000000;
+    const float r = element.radius;
+
+    //printf("Elastic: %f, Shear: %f, Radius %f, Length %f\n", e, g, r, length);
+
+    // Cross sectional area
+    const float area = r * r * 3.14159f;
+
+    // Area moment of inertia about y and z axes(for bending) m^4
+    //const double inertia_y = r * r * r * r * 3.14159f / 4.f;
+    //const double inertia_z = inertia_y;
+
+    const float inertia_y = r * r * r * r * 3.14159f / 4.f;
+    const float inertia_z = inertia_y;
+
+    // Polar moment of inertia about the x axis (for torsion) m^4
+    const float inertia_x = r * r * r * r * 3.14159f / 2.f;
+    //const double inertia_x = r * r * r * r * 3.14159f * 5.f / 2.f;
+
+    // Pre multipling common factors
+    const float ei_y = e * inertia_y;
+    const float ei_z = e * inertia_z;
+    const float gj = g * inertia_x;
+
+    /* printf("Ix: %.12f, Iy: %.12f, Iz: %.12f\n", inertia_x, inertia_y, inertia_z);
+
+    printf("Ix: %.12f, Iy: %.12f, Iz: %.12f\n", gj, ei_y, ei_z); */
+
+    // Axial Stiffness (for tension/compression along axis)
+    const float k = e * area / length;
+
+    // At each node there are 3 forces and 3 moments that produce 3 displacements and 3 rotations
+    // we can build a 6x6 matrix that represents the relationship between the forces and moments
+    // at one node and the displacements and rotations at another
+    // each element will produce 4 of these 6x6 matrices one for each combination
+    // they are mostly similar but some components vary in sign
+    // These 6x6 matrices are then slotted in to the global matrix after transforming to global frame
+    // The are pretty simple for axial stiffness only
+
+    // kxy is the stiffness matrix for force and moment on node x due to the displacement and rotation of node y
+
+    // General stiffness matrices for beams (fixed joints) that include
+    // bending about y and z and torsion about x along with axial stiffness
+    struct mat6 k11 = { {
+        k, 0, 0, 0, 0, 0,
+        0, (12 * ei_z / l3), 0, 0, 0, (6 * ei_z / l2),
+        0, 0, (12 * ei_y / l3), 0, -(6 * ei_y / l2), 0,
+        0, 0, 0, (gj / length), 0, 0,
+        0, 0, -(6 * ei_y / l2), 0, (4 * ei_y / length), 0,
+        0, (6 * ei_z / l2), 0, 0, 0, (4 * ei_z / length)
+    } };
+
+    struct mat6 k12 = { {
+        -k, 0, 0, 0, 0, 0,
+        0, -(12 * ei_z / l3), 0, 0, 0, (6 * ei_z / l2),
+        0, 0, -(12 * ei_y / l3), 0, -(6 * ei_y / l2), 0,
+        0, 0, 0, -(gj / length), 0, 0,
+        0, 0, (6 * ei_y / l2), 0, (2 * ei_y / length), 0,
+        0, -(6 * ei_z / l2), 0, 0, 0, (2 * ei_z / length)
+    } };
+
+    struct mat6 k21 = { {
+        -k, 0, 0, 0, 0, 0,
+        0, -(12 * ei_z / l3), 0, 0, 0, -(6 * ei_z / l2),
+        0, 0, -(12 * ei_y / l3), 0, (6 * ei_y / l2), 0,
+        0, 0, 0, -(gj / length), 0, 0,
+        0, 0, -(6 * ei_y / l2), 0, (2 * ei_y / length), 0,
+        0, (6 * ei_z / l2), 0, 0, 0, (2 * ei_z / length)
+    } };
+
+    struct mat6 k22 = { {
+        k, 0, 0, 0, 0, 0,
+        0, (12 * ei_z / l3), 0, 0, 0, -(6 * ei_z / l2),
+        0, 0, (12 * ei_y / l3), 0, (6 * ei_y / l2), 0,
+        0, 0, 0, (gj / length), 0, 0,
+        0, 0, (6 * ei_y / l2), 0, (4 * ei_y / length), 0,
+        0, -(6 * ei_z / l2), 0, 0, 0, (4 * ei_z / length)
+    } };
+
+    // Axial stiffness only for trusses (pinned-joints that are free to rotate)
+    /* struct mat6 k11[36] = {
+        k, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0,
+    };
+
+    struct mat6 k12[36] = {
+        -k, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0,
+    };
+
+    struct mat6 k21[36] = {
+        -k, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0,
+    };
+
+    struct mat6 k22[36] = {
+        k, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0,
+    }; */
+
+
+    /* printf("k11:\n");
+    matrix_print(k11, 6, 6);
+
+    printf("k12:\n");
+    matrix_print(k12, 6, 6);
+
+    printf("k21:\n");
+    matrix_print(k21, 6, 6);
+
+    printf("k22:\n");
+    matrix_print(k22, 6, 6); */
+
+    // The stiffness matrices above assume the element is lying in the global reference frame
+    // with the length oriented along the global x axis
+    // Of course the elements can be in any orientation so the global displacements do not relate
+    // to global forces via these stiffness matrices but instead relate in the local frame
+    // ie. F_l = K * U_l
+
+    // If we have a matrix T that represents the transformation from global to local frame
+    // we can transform the forces and displacements F_l = T * F_g, U_l = T * U_g
+    // relating via local stiffness K gives T * F_g = K * T * U_g
+    // Pre-multiplying both sides by T inverse gives F_g = T^-1 * K * T * U_g
+    // From here it can be seen that the stiffness matrix that relates global displacements
+    // to global forces is K_g = T^-1 * K * T
+    // so before contributing the elements stiffness to the global stiffness matrix
+    // we must first find the global to local transformation matrix T for the element
+
+    // first subtract global position of node1 from global position of node2 to give
+    // a global vector that lies along the length of the element (so along local x axis)
+    // Most likely an element in the frame is not rotated about local x when in an unstressed position
+    // so it would be fine to assume local theta_x is 0 but a boundary condition could impose a rotation about x
+
+    // If we do make the assumption that theta_x is zero then we know that a global vector pointing in the global y direction
+    // is incident on the local x-y plane of the element and likewise a global vector in the z direction is incident
+    // on the local x-z plane so we can use either as a starting point we just need one where the magnitude of the cross product
+    // with the local x axis is not close enough to zero to cause floating point errors when normalizing
+    // this can be checked easily by checking if the dot product magnitude is close to 1 and picking the other vector if so
+
+    // normalize the element axial vector to give the local x axis in global frame
+    struct vec3 x_axis = vec3_subtract(frame->nodes[node2].pos, frame->nodes[node1].pos);
+    x_axis = vec3_normalize(x_axis);
+
+    // Default initialize y and x axis
+    struct vec3 y_axis = { 0.f, 0.f, 0.f };
+    struct vec3 z_axis = { 0.f, 0.f, 0.f };
+
+    // We need a second vector that is not to close to parallel with local x
+    // to produce a cross product with reasonable magnitude
+    // if the dot product magnitude between local x and global y is small
+    // then they are close to alignment (regardless of direction) and global z
+    // becomes a better choice
+    if (abs(vec3_dot(x_axis, (struct vec3) { 0.f, 1.f, 0.f })) < 0.5f)
+    {
+        // local y is reasonably close to global y so the local z axis in global frame
+        // is the normalized cross product between the local x axis in global frame and the global y axis
+        z_axis = vec3_cross(x_axis, (struct vec3) { 0.f, 1.f, 0.f });
+        z_axis = vec3_normalize(z_axis);
+
+        // Now local y is just cross product of local z and local x
+        y_axis = vec3_cross(z_axis, x_axis);
+        y_axis = vec3_normalize(y_axis); // should be unit length already but might as well make sure
+    }
+    else
+    {
+        // local z is reasonably close to global z so the local y axis in global frame
+        // is the normalized cross product between the global z axis and the local x axis in global frame
+        // (could have also done vec3_cross(x_axis, (struct vec3) { 0.f, 0.f, -1.f }) just comfirm with right hand rule)
+        y_axis = vec3_cross((struct vec3) { 0.f, 0.f, 1.f }, x_axis);
+        y_axis = vec3_normalize(y_axis);
+
+        // Now local z is just cross product of local x and local y
+        z_axis = vec3_cross(x_axis, y_axis);
+        z_axis = vec3_normalize(z_axis); // should be unit length already but might as well make sure
+    }
 
-        const float inertia_y = r * r * r * r * 3.14159f / 4.f;
-        const float inertia_z = inertia_y;
+    // Build the transformation matrix from global to local for this element
+    struct mat3 transform = {
+        x_axis.x, x_axis.y, x_axis.z,
+        y_axis.x, y_axis.y, y_axis.z,
+        z_axis.x, z_axis.y, z_axis.z,
+    };
 
-        // Polar moment of inertia about the x axis (for torsion) m^4
-        const float inertia_x = r * r * r * r * 3.14159f / 2.f;
-        //const double inertia_x = r * r * r * r * 3.14159f * 5.f / 2.f;
 
-        // Pre multipling common factors
-        const float ei_y = e * inertia_y;
-        const float ei_z = e * inertia_z;
-        const float gj = g * inertia_x;
+    /* printf("x_axis: %2.f, %2.f, %2.f\n", x_axis.x, x_axis.y, x_axis.z);
+    printf("y_axis: %2.f, %2.f, %2.f\n", y_axis.x, y_axis.y, y_axis.z);
+    printf("z_axis: %2.f, %2.f, %2.f\n\n", z_axis.x, z_axis.y, z_axis.z); */
 
-        /* printf("Ix: %.12f, Iy: %.12f, Iz: %.12f\n", inertia_x, inertia_y, inertia_z);
+    // Transform each block from the local to the global frame
+    k_element[0] = k11;
+    k_element[1] = k12;
+    k_element[2] = k21;
+    k_element[3] = k22;
 
-        printf("Ix: %.12f, Iy: %.12f, Iz: %.12f\n", gj, ei_y, ei_z); */
+    for (int i = 0; i < 4; ++i)
+    {
+        transform_element_stiffness(&k_element[i], transform);
+    }
+}
 
-        // Axial Stiffness (for tension/compression along axis)
-        const float k = e * area / length;
+void frame_update_elements(struct Frame* frame, struct EquationSet* eqset, const int* element_ids, const struct Element* elements, int count)
+{
+    // Changing the properties of an element only changes the 4 6x6 blocks it contributes
+    // to the global stiffness so instead of rebuilding the whole matrix the contribution
+    // made with the old properties is subtracted and the one made with the new properties
+    // is added in place. The cost is proportional to the number of changed elements
+    // rather than the size of the frame
 
-        // At each node there are 3 forces and 3 moments that produce 3 displacements and 3 rotations
-        // we can build a 6x6 matrix that represents the relationship between the forces and moments
-        // at one node and the displacements and rotations at another
-        // each element will produce 4 of these 6x6 matrices one for each combination
-        // they are mostly similar but some components vary in sign
-        // These 6x6 matrices are then slotted in to the global matrix after transforming to global frame
-        // The are pretty simple for axial stiffness only
+    // Repeated updates accumulate some floating point error in the modified entries
+    // which is negligible compared to the magnitude of typical stiffness terms
 
-        // kxy is the stiffness matrix for force and moment on node x due to the displacement and rotation of node y
+    for (int n = 0; n < count; ++n)
+    {
+        int element_idx = element_ids[n];
 
-        // General stiffness matrices for beams (fixed joints) that include
-        // bending about y and z and torsion about x along with axial stiffness
-        struct mat6 k11[36] = {
-            k, 0, 0, 0, 0, 0,
-            0, (12 * ei_z / l3), 0, 0, 0, (6 * ei_z / l2),
-            0, 0, (12 * ei_y / l3), 0, -(6 * ei_y / l2), 0,
-            0, 0, 0, (gj / length), 0, 0,
-            0, 0, -(6 * ei_y / l2), 0, (4 * ei_y / length), 0,
-            0, (6 * ei_z / l2), 0, 0, 0, (4 * ei_z / length)
-        };
+        if (element_idx < 0 || element_idx >= frame->element_count)
+        {
+            fprintf(stderr, "Error updating elements: element index %i is out of range\n", element_idx);
+            continue;
+        }
 
-        struct mat6 k12[36] = {
-            -k, 0, 0, 0, 0, 0,
-            0, -(12 * ei_z / l3), 0, 0, 0, (6 * ei_z / l2),
-            0, 0, -(12 * ei_y / l3), 0, -(6 * ei_y / l2), 0,
-            0, 0, 0, -(gj / length), 0, 0,
-            0, 0, (6 * ei_y / l2), 0, (2 * ei_y / length), 0,
-            0, -(6 * ei_z / l2), 0, 0, 0, (2 * ei_z / length)
-        };
+        // Checked before the old contribution is removed so a rejected update changes nothing
+        const struct Element* element = &elements[n];
+        if (element->node1 < 0 || element->node1 >= frame->node_count ||
+            element->node2 < 0 || element->node2 >= frame->node_count)
+        {
+            fprintf(stderr, "Error updating elements: element %i references node outside of 0 to %i\n",
+                element_idx, frame->node_count - 1);
+            continue;
+        }
 
-        struct mat6 k21[36] = {
-            -k, 0, 0, 0, 0, 0,
-            0, -(12 * ei_z / l3), 0, 0, 0, -(6 * ei_z / l2),
-            0, 0, -(12 * ei_y / l3), 0, (6 * ei_y / l2), 0,
-            0, 0, 0, -(gj / length), 0, 0,
-            0, 0, -(6 * ei_y / l2), 0, (2 * ei_y / length), 0,
-            0, (6 * ei_z / l2), 0, 0, 0, (2 * ei_z / length)
-        };
+        // Remove the old contribution
+        add_element_equations(frame, eqset, frame->elements[element_idx], -1.f);
 
-        struct mat6 k22[36] = {
-            k, 0, 0, 0, 0, 0,
-            0, (12 * ei_z / l3), 0, 0, 0, -(6 * ei_z / l2),
-            0, 0, (12 * ei_y / l3), 0, (6 * ei_y / l2), 0,
-            0, 0, 0, (gj / length), 0, 0,
-            0, 0, (6 * ei_y / l2), 0, (4 * ei_y / length), 0,
-            0, -(6 * ei_z / l2), 0, 0, 0, (4 * ei_z / length)
-        };
+        frame->elements[element_idx] = *element;
 
-        // Axial stiffness only for trusses (pinned-joints that are free to rotate)
-        /* struct mat6 k11[36] = {
-            k, 0, 0, 0, 0, 0,
-            0, 0, 0, 0, 0, 0,
-            0, 0, 0, 0, 0, 0,
-            0, 0, 0, 0, 0, 0,
-            0, 0, 0, 0, 0, 0,
-            0, 0, 0, 0, 0, 0,
-        };
+        // Add the new contribution
+        add_element_equations(frame, eqset, frame->elements[element_idx], 1.f);
+    }
+}
 
-        struct mat6 k12[36] = {
-            -k, 0, 0, 0, 0, 0,
-            0, 0, 0, 0, 0, 0,
-            0, 0, 0, 0, 0, 0,
-            0, 0, 0, 0, 0, 0,
-            0, 0, 0, 0, 0, 0,
-            0, 0, 0, 0, 0, 0,
-        };
+void add_element_equations(struct Frame* frame, struct EquationSet* eqset, struct Element element, float scale)
+{
+    struct mat6 k_element[4];
+    build_element_stiffness(frame, element, k_element);
 
-        struct mat6 k21[36] = {
-            -k, 0, 0, 0, 0, 0,
-            0, 0, 0, 0, 0, 0,
-            0, 0, 0, 0, 0, 0,
-            0, 0, 0, 0, 0, 0,
-            0, 0, 0, 0, 0, 0,
-            0, 0, 0, 0, 0, 0,
-        };
+    // Blocks are ordered k11, k12, k21, k22 where kxy is at row block x and column block y
+    const int nodes[2] = { element.node1, element.node2 };
+    const int cols = eqset->stiff_bc.cols;
 
-        struct mat6 k22[36] = {
-            k, 0, 0, 0, 0, 0,
-            0, 0, 0, 0, 0, 0,
-            0, 0, 0, 0, 0, 0,
-            0, 0, 0, 0, 0, 0,
-            0, 0, 0, 0, 0, 0,
-            0, 0, 0, 0, 0, 0,
-        }; */
-
-
-        /* printf("k11:\n");
-        matrix_print(k11, 6, 6);
-
-        printf("k12:\n");
-        matrix_print(k12, 6, 6);
-
-        printf("k21:\n");
-        matrix_print(k21, 6, 6);
-
-        printf("k22:\n");
-        matrix_print(k22, 6, 6); */
-
-        // The stiffness matrices above assume the element is lying in the global reference frame
-        // with the length oriented along the global x axis
-        // Of course the elements can be in any orientation so the global displacements do not relate
-        // to global forces via these stiffness matrices but instead relate in the local frame
-        // ie. F_l = K * U_l
-
-        // If we have a matrix T that represents the transformation from global to local frame
-        // we can transform the forces and displacements F_l = T * F_g, U_l = T * U_g
-        // relating via local stiffness K gives T * F_g = K * T * U_g
-        // Pre-multiplying both sides by T inverse gives F_g = T^-1 * K * T * U_g
-        // From here it can be seen that the stiffness matrix that relates global displacements
-        // to global forces is K_g = T^-1 * K * T
-        // so before contributing the elements stiffness to the global stiffness matrix
-        // we must first find the global to local transformation matrix T for the element
-
-        // first subtract global position of node1 from global position of node2 to give
-        // a global vector that lies along the length of the element (so along local x axis)
-        // Most likely an element in the frame is not rotated about local x when in an unstressed position
-        // so it would be fine to assume local theta_x is 0 but a boundary condition could impose a rotation about x
-
-        // If we do make the assumption that theta_x is zero then we know that a global vector pointing in the global y direction
-        // is incident on the local x-y plane of the element and likewise a global vector in the z direction is incident
-        // on the local x-z plane so we can use either as a starting point we just need one where the magnitude of the cross product
-        // with the local x axis is not close enough to zero to cause floating point errors when normalizing
-        // this can be checked easily by checking if the dot product magnitude is close to 1 and picking the other vector if so
-
-        // normalize the element axial vector to give the local x axis in global frame
-        struct vec3 x_axis = vec3_subtract(frame->nodes[node2].pos, frame->nodes[node1].pos);
-        x_axis = vec3_normalize(x_axis);
-
-        // Default initialize y and x axis
-        struct vec3 y_axis = { 0.f, 0.f, 0.f };
-        struct vec3 z_axis = { 0.f, 0.f, 0.f };
-
-        // We need a second vector that is not to close to parallel with local x
-        // to produce a cross product with reasonable magnitude
-        // if the dot product magnitude between local x and global y is small
-        // then they are close to alignment (regardless of direction) and global z
-        // becomes a better choice
-        if (abs(vec3_dot(x_axis, (struct vec3) { 0.f, 1.f, 0.f })) < 0.5f)
-        {
-            // local y is reasonably close to global y so the local z axis in global frame
-            // is the normalized cross product between the local x axis in global frame and the global y axis
-            z_axis = vec3_cross(x_axis, (struct vec3) { 0.f, 1.f, 0.f });
-            z_axis = vec3_normalize(z_axis);
-
-            // Now local y is just cross product of local z and local x
-            y_axis = vec3_cross(z_axis, x_axis);
-            y_axis = vec3_normalize(y_axis); // should be unit length already but might as well make sure
-        }
-        else
-        {
-            // local z is reasonably close to global z so the local y axis in global frame
-            // is the normalized cross product between the global z axis and the local x axis in global frame
-            // (could have also done vec3_cross(x_axis, (struct vec3) { 0.f, 0.f, -1.f }) just comfirm with right hand rule)
-            y_axis = vec3_cross((struct vec3) { 0.f, 0.f, 1.f }, x_axis);
-            y_axis = vec3_normalize(y_axis);
-
-            // Now local z is just cross product of local x and local y
-            z_axis = vec3_cross(x_axis, y_axis);
-            z_axis = vec3_normalize(z_axis); // should be unit length already but might as well make sure
-        }
-
-        // Build the transformation matrix from global to local for this element
-        struct mat3 transform = {
-            x_axis.x, x_axis.y, x_axis.z,
-            y_axis.x, y_axis.y, y_axis.z,
-            z_axis.x, z_axis.y, z_axis.z,
-        };
+    for (int q = 0; q < 4; ++q)
+    {
+        const int row_node = nodes[q / 2];
+        const int col_node = nodes[q % 2];
 
+        // The full stiffness matrix (used to back calculate forces) takes the whole block
+        add_element_stiffness(&eqset->stiffness, &k_element[q], row_node, col_node, frame->node_count, scale);
 
-        /* printf("x_axis: %2.f, %2.f, %2.f\n", x_axis.x, x_axis.y, x_axis.z);
-        printf("y_axis: %2.f, %2.f, %2.f\n", y_axis.x, y_axis.y, y_axis.z);
-        printf("z_axis: %2.f, %2.f, %2.f\n\n", z_axis.x, z_axis.y, z_axis.z); */
+        // Rows and columns eliminated by boundary conditions must stay eliminated
+        // in the boundary condition matrix so only free terms are updated
+        for (int j = 0; j < 6; ++j)
+        {
+            const int row = DOF * row_node + j;
 
-        // Add the local contributions to the global stiffness matrix
-        add_element_stiffness(k_global, k11, transform, node1, node1, frame->node_count);
-        add_element_stiffness(k_global, k12, transform, node1, node2, frame->node_count);
-        add_element_stiffness(k_global, k21, transform, node2, node1, frame->node_count);
-        add_element_stiffness(k_global, k22, transform, node2, node2, frame->node_count);
-    }
+            if (eqset->fixed_dofs[row])
+            {
+                continue;
+            }
 
+            for (int i = 0; i < 6; ++i)
+            {
+                const int col = DOF * col_node + i;
 
-    //printf("Global Stiffness Matrix\n");
-    //matrix_print(k_global, dof_count, dof_count);
+                if (!eqset->fixed_dofs[col])
+                {
+                    eqset->stiff_bc.elements[col + row * cols] += scale * k_element[q].elements[i + j * 6];
+                }
+            }
+        }
+    }
 }
 
 void frame_update_results(struct Frame* frame, struct EquationSet* eqset)
 {
+    TRACE_BEGIN("results");
+
     int dof_count = DOF * frame->node_count;
 
     struct Matrix* stiffness = &eqset->stiffness;
@@ -290,24 +408,31 @@ void frame_update_results(struct Frame* frame, struct EquationSet* eqset)
     //printf("Solved Forces:\n");
     //matrix_print(forces, dof_count, 1);
 
+    frame_set_results(frame, forces->elements, displacements->elements);
+
+    TRACE_END();
+}
+
+void frame_set_results(struct Frame* frame, const float* forces, const float* displacements)
+{
     // Update the frames per node properties to use for rendering and analysis
     for (int i = 0; i < frame->node_count; ++i)
     {
-        frame->nodes[i].force.x = forces->elements[i * DOF];
-        frame->nodes[i].force.y = forces->elements[i * DOF + 1];
-        frame->nodes[i].force.z = forces->elements[i * DOF + 2];
+        frame->nodes[i].force.x = forces[i * DOF];
+        frame->nodes[i].force.y = forces[i * DOF + 1];
+        frame->nodes[i].force.z = forces[i * DOF + 2];
 
-        frame->nodes[i].moment.x = forces->elements[i * DOF + 3];
-        frame->nodes[i].moment.y = forces->elements[i * DOF + 4];
-        frame->nodes[i].moment.z = forces->elements[i * DOF + 5];
+        frame->nodes[i].moment.x = forces[i * DOF + 3];
+        frame->nodes[i].moment.y = forces[i * DOF + 4];
+        frame->nodes[i].moment.z = forces[i * DOF + 5];
 
-        frame->nodes[i].displacement.x = displacements->elements[i * DOF];
-        frame->nodes[i].displacement.y = displacements->elements[i * DOF + 1];
-        frame->nodes[i].displacement.z = displacements->elements[i * DOF + 2];
+        frame->nodes[i].displacement.x = displacements[i * DOF];
+        frame->nodes[i].displacement.y = displacements[i * DOF + 1];
+        frame->nodes[i].displacement.z = displacements[i * DOF + 2];
 
-        frame->nodes[i].rotation.y = displacements->elements[i * DOF + 3];
-        frame->nodes[i].rotation.x = displacements->elements[i * DOF + 4];
-        frame->nodes[i].rotation.z = displacements->elements[i * DOF + 5];
+        frame->nodes[i].rotation.y = displacements[i * DOF + 3];
+        frame->nodes[i].rotation.x = displacements[i * DOF + 4];
+        frame->nodes[i].rotation.z = displacements[i * DOF + 5];
     }
 }
 
@@ -406,18 +531,13 @@ void transform_element_stiffness(struct mat6* k_local, struct mat3 transform)
     mat6_join_quads(k_local->elements, quads);
 }
 
-void add_element_stiffness(struct Matrix* k_global, struct mat6* k_element, struct mat3 transform, int node1, int node2, int node_count)
+void add_element_stiffness(struct Matrix* k_global, const struct mat6* k_element, int node1, int node2, int node_count, float scale)
 {
-    //printf("Element stiffness for nodes %i and %i:\nLocal:\n", node1, node2);
-    //mat6_print(*k_element);
-
-    // Use the transformation matrix to transform the element stiffness matrix from local to global frame
-    transform_element_stiffness(k_element, transform);
-
-    //printf("Global:\n");
+    //printf("Element stiffness for nodes %i and %i:\n", node1, node2);
     //mat6_print(*k_element);
 
     // Add the element stiffness contribution to the global stiffness matrix
+    // (scale of -1 removes a contribution that was previously added)
     int offset = 6 * node2 + 36 * (node1 * node_count);
 
     // Incorrect results in k12 and k21 being swapped (3 hours later)
@@ -431,7 +551,7 @@ void add_element_stiffness(struct Matrix* k_global, struct mat6* k_element, stru
 
             int global_idx = i + offset + j * 6 * node_count;
 
-            k_global->elements[global_idx] += k_element->elements[element_idx];
+            k_global->elements[global_idx] += scale * k_element->elements[element_idx];
         }
     }
 }
@@ -460,8 +580,10 @@ void apply_displacement(int dof, float value, struct Matrix* stiffness, int leng
     stiffness->elements[rowstart + colstart] = 1;
 }
 
-void apply_boundary_conditions(struct Frame* frame, struct Matrix* stiffness, struct vecf* forces)
+void apply_boundary_conditions(struct Frame* frame, struct Matrix* stiffness, struct vecf* forces, unsigned char* fixed_dofs)
 {
+    TRACE_BEGIN("boundary conditions");
+
     int length = DOF * frame->node_count;
 
     // Modify the stiffness matrix and force vector to reflect the boundary conditions on the frame
@@ -481,6 +603,11 @@ void apply_boundary_conditions(struct Frame* frame, struct Matrix* stiffness, st
             apply_displacement(node * 6, value.x, stiffness, length);
             apply_displacement(node * 6 + 1, value.y, stiffness, length);
             apply_displacement(node * 6 + 2, value.z, stiffness, length);
+
+            for (int i = 0; i < 3; ++i)
+            {
+                fixed_dofs[node * 6 + i] = 1;
+            }
         }
         else if (frame->bconditions[n].kind == BC_Rotation)
         {
@@ -493,6 +620,11 @@ void apply_boundary_conditions(struct Frame* frame, struct Matrix* stiffness, st
             apply_displacement(node * 6 + 3, value.x, stiffness, length);
             apply_displacement(node * 6 + 4, value.y, stiffness, length);
             apply_displacement(node * 6 + 5, value.z, stiffness, length);
+
+            for (int i = 3; i < 6; ++i)
+            {
+                fixed_dofs[node * 6 + i] = 1;
+            }
         }
         else if (frame->bconditions[n].kind == BC_Force)
         {
@@ -555,6 +687,8 @@ void apply_boundary_conditions(struct Frame* frame, struct Matrix* stiffness, st
             }
         }
     }
+
+    TRACE_END();
 }
 
 void equationset_release(struct EquationSet* eqset)
@@ -565,6 +699,9 @@ void equationset_release(struct EquationSet* eqset)
         vecf_release(&eqset->displacements);
         matrix_release(&eqset->stiffness);
         matrix_release(&eqset->stiff_bc);
+
+        free(eqset->fixed_dofs);
+        eqset->fixed_dofs = NULL;
     }
 }
 
@@ -70,6 +70,9 @@ struct EquationSet
     struct Matrix stiff_bc;
     struct vecf forces;
     struct vecf displacements;
+
+    // 1 for each degree of freedom eliminated by a boundary condition
+    unsigned char* fixed_dofs;
 };
 
 // Function pointer for functions that map node data to vertex color
@@ -78,9 +81,23 @@ typedef void (*color_func_t)(struct Vertex*, struct Node*);
 // Build a set of matrices and vectors representing the problem
 void frame_build_equations(struct Frame* frame, struct EquationSet* eqset);
 
+// Stiffness of a single element in the global frame as 4 6x6 blocks
+// k_element must have room for 4 matrices which are filled with k11, k12, k21, and k22
+// where kxy relates the forces at node x to the displacements at node y
+void build_element_stiffness(struct Frame* frame, struct Element element, struct mat6* k_element);
+
+// Replace the properties of the elements at element_ids with the values in elements
+// and update the stiffness matrices in place without rebuilding them
+// Only the rows of the changed elements' nodes are modified. Updates with an element index
+// or a node out of range are reported and skipped without changing the matrices
+void frame_update_elements(struct Frame* frame, struct EquationSet* eqset, const int* element_ids, const struct Element* elements, int count);
+
 // Populate per node properties using displacements to back calculate forces
 void frame_update_results(struct Frame* frame, struct EquationSet* eqset);
 
+// Copy full length force and displacement vectors (6 entries per node) into the per node properties
+void frame_set_results(struct Frame* frame, const float* forces, const float* displacements);
+
 // Frees resources held by the frame
 void frame_release(struct Frame* frame);
 
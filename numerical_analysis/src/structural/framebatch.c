@@ -0,0 +1,330 @@
+#include "framebatch.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <omp.h>
+
+#include "frame.h"
+#include "framebinary.h"
+#include "frameimport.h"
+#include "framempi.h"
+#include "frameprocess.h"
+#include "frameresults.h"
+#include "frameschwarz.h"
+#include "distribute.h"
+#include "linearsolve.h"
+#include "matrixmarket.h"
+#include "partition.h"
+#include "mpiutility.h"
+
+#ifndef ENABLE_MPI
+#define ENABLE_MPI 0
+#endif
+
+#if ENABLE_MPI
+#include <mpi.h>
+#endif
+
+static void release_frame(struct Frame* frame)
+{
+    // frame_release does not free the boundary conditions
+    free(frame->bconditions);
+    frame->bconditions = NULL;
+    frame_release(frame);
+}
+
+static const char* method_name(enum MpiSolveMethod method)
+{
+    switch (method)
+    {
+    case MPI_SOLVE_JACOBI: return "Jacobi";
+    case MPI_SOLVE_SOR: return "Multicolor SOR";
+    case MPI_SOLVE_CG: return "Conjugate gradients";
+    default: return "Unknown solver";
+    }
+}
+
+// Load the model on every process. Text files are parsed in parallel by the processes
+static int load_model(const char* path, int procs, struct Frame* frame)
+{
+    if (ENABLE_MPI && procs > 1 && !frame_is_binary(path))
+    {
+        return frame_import_mpi(path, frame);
+    }
+
+    return frame_load(path, frame);
+}
+
+// Solve a system read from Matrix Market files on the main process with conjugate gradients
+// scaled by the diagonal (there is no frame to build a Schwarz preconditioner from)
+// The right hand side comes from the vector stored next to the matrix or is all ones without one
+static int solve_matrix_file(const struct BatchSettings* settings, int verbose, int* converged)
+{
+    double start = omp_get_wtime();
+
+    struct SparseMatrix matrix;
+    if (matrixmarket_read_sparse(settings->model_path, &matrix))
+    {
+        return -1;
+    }
+
+    if (matrix.rows != matrix.cols)
+    {
+        fprintf(stderr, "Error solving %s: the matrix is not square\n", settings->model_path);
+        sparse_release(&matrix);
+        return -1;
+    }
+
+    const int rows = matrix.rows;
+    char* rhs_path = matrixmarket_vector_path(settings->model_path, MATRIXMARKET_RHS_SUFFIX);
+    float* rhs = NULL;
+    int rhs_rows = 0;
+    int failed = 0;
+
+    FILE* rhs_file = fopen(rhs_path, "r");
+    if (rhs_file)
+    {
+        fclose(rhs_file);
+        failed = matrixmarket_read_vector(rhs_path, &rhs, &rhs_rows) != 0;
+
+        if (!failed && rhs_rows != rows)
+        {
+            fprintf(stderr, "Error solving %s: %s has %i rows but the matrix has %i\n",
+                settings->model_path, rhs_path, rhs_rows, rows);
+            failed = 1;
+        }
+    }
+    else
+    {
+        rhs = malloc(sizeof(*rhs) * (rows > 0 ? rows : 1));
+        for (int j = 0; j < rows; ++j)
+        {
+            rhs[j] = 1.0f;
+        }
+    }
+
+    double loaded = omp_get_wtime();
+
+    if (verbose && !failed)
+    {
+        printf("Loaded %s: %i rows, %i stored values%s (%.3f s)\n", settings->model_path, rows, matrix.nnz,
+            rhs_file ? "" : ", right hand side of ones", loaded - start);
+    }
+
+    float* x = malloc(sizeof(*x) * (rows > 0 ? rows : 1));
+
+    if (!failed)
+    {
+        int iterations = solve_cg_sparse(&matrix, rhs, x, NULL, settings->solve.residuals, settings->solve.iterations,
+            settings->solve.tolerance, settings->solve.threads, &settings->solve.checkpoint, converged);
+
+        if (verbose)
+        {
+            printf("Conjugate gradients ran %i iterations (%s)\n", iterations,
+                *converged ? "converged" : "did not converge");
+            printf("Solved on 1 process(es) (%.3f s)\n", omp_get_wtime() - loaded);
+        }
+
+        // The solution is a vector whatever results format was asked for
+        if (settings->results_path)
+        {
+            failed = matrixmarket_write_vector(x, rows, settings->results_path) != 0;
+        }
+    }
+
+    free(x);
+    free(rhs);
+    free(rhs_path);
+    sparse_release(&matrix);
+
+    return failed ? -1 : 0;
+}
+
+void batch_default_settings(struct BatchSettings* settings, int iterations, float tolerance)
+{
+    settings->model_path = NULL;
+    settings->results_path = NULL;
+    settings->results_format = RESULTS_TEXT;
+    settings->writer = NULL;
+    settings->verbose = 0;
+
+    mpisolve_default_settings(&settings->solve, iterations);
+    settings->solve.method = MPI_SOLVE_CG;
+    settings->solve.tolerance = tolerance;
+}
+
+int frame_batch_run(const struct BatchSettings* settings, struct Frame* frame, int* converged)
+{
+#if ENABLE_MPI
+    const int rank = get_rank_mpi();
+    const int procs = get_procs_mpi();
+    const int main_proc = get_main_mpi();
+#else
+    const int rank = 0;
+    const int procs = 1;
+    const int main_proc = 0;
+#endif
+
+    const int verbose = settings->verbose && rank == main_proc;
+    int solved_converged = 0;
+
+    if (matrixmarket_is_path(settings->model_path))
+    {
+        if (frame)
+        {
+            fprintf(stderr, "Error solving %s: a Matrix Market system has no frame to return\n", settings->model_path);
+            return -1;
+        }
+
+        if (settings->solve.method != MPI_SOLVE_CG && rank == main_proc)
+        {
+            fprintf(stderr, "Warning: %s is solved with conjugate gradients on the main process instead of %s\n",
+                settings->model_path, method_name(settings->solve.method));
+        }
+
+        int failed = rank == main_proc ? solve_matrix_file(settings, verbose, &solved_converged) != 0 : 0;
+
+#if ENABLE_MPI
+        MPI_Allreduce(MPI_IN_PLACE, &failed, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+        MPI_Bcast(&solved_converged, 1, MPI_INT, main_proc, MPI_COMM_WORLD);
+#endif
+
+        if (converged)
+        {
+            *converged = !failed && solved_converged;
+        }
+
+        return failed ? -1 : 0;
+    }
+
+    double start = omp_get_wtime();
+
+    struct Frame model;
+    if (load_model(settings->model_path, procs, &model))
+    {
+        return -1;
+    }
+
+    double loaded = omp_get_wtime();
+
+    if (verbose)
+    {
+        printf("Loaded %s: %i nodes, %i elements, %i boundary conditions (%.3f s)\n", settings->model_path,
+            model.node_count, model.element_count, model.bc_count, loaded - start);
+    }
+
+    int failed = 0;
+
+    if (ENABLE_MPI && procs > 1)
+    {
+        // Give each process a compact block of nodes. Every process computes the same
+        // partition so no communication is needed to agree on ownership. The nodes are
+        // put back in file order afterwards so the results match the model file
+        struct RowDistribution node_dist;
+        int* node_order = malloc(sizeof(*node_order) * (model.node_count > 0 ? model.node_count : 1));
+        struct PartitionStats part_stats;
+        int partitioned = !frame_partition(&model, procs, &node_dist, node_order, &part_stats);
+
+        if (verbose && partitioned)
+        {
+            printf("Parts: %i, Cut Elements: %i, Smallest: %i, Largest: %i, Imbalance: %.2f\n",
+                part_stats.parts, part_stats.cut_edges, part_stats.min_size, part_stats.max_size, part_stats.imbalance);
+        }
+
+        if (settings->solve.method == MPI_SOLVE_SOR)
+        {
+            // Coloring is deterministic so every process gets the same colors
+            frame_assign_multicolor(&model, COLORING_DSATUR, 1, NULL);
+        }
+
+        int iterations = frame_solve_mpi(&model, partitioned ? &node_dist : NULL, &settings->solve, &solved_converged);
+
+        failed = iterations < 0;
+
+        if (verbose && !failed)
+        {
+            printf("%s ran %i iterations (%s)\n", method_name(settings->solve.method), iterations,
+                solved_converged ? "converged" : "did not converge");
+        }
+
+        if (partitioned)
+        {
+            // Invert the renumbering
+            int* file_order = malloc(sizeof(*file_order) * (model.node_count > 0 ? model.node_count : 1));
+            for (int n = 0; n < model.node_count; ++n)
+            {
+                file_order[node_order[n]] = n;
+            }
+
+            frame_renumber_nodes(&model, file_order);
+
+            free(file_order);
+            rowdist_release(&node_dist);
+        }
+
+        free(node_order);
+    }
+    else
+    {
+        int iterations = frame_solve_cg(&model, &settings->solve.schwarz, settings->solve.residuals,
+            settings->solve.iterations, settings->solve.tolerance, settings->solve.threads, &settings->solve.checkpoint,
+            &solved_converged);
+
+        failed = iterations < 0;
+
+        if (verbose && !failed)
+        {
+            printf("Conjugate gradients ran %i iterations (%s)\n", iterations,
+                solved_converged ? "converged" : "did not converge");
+        }
+    }
+
+    double solved = omp_get_wtime();
+
+    if (verbose)
+    {
+        printf("Solved on %i process(es) (%.3f s)\n", procs, solved - loaded);
+    }
+
+    if (!failed && settings->results_path && rank == main_proc)
+    {
+        if (settings->writer)
+        {
+            results_writer_submit(settings->writer, &model, settings->results_path, settings->results_format);
+
+            if (verbose)
+            {
+                printf("Writing %s in the background (%.3f s)\n", settings->results_path, omp_get_wtime() - solved);
+            }
+        }
+        else
+        {
+            failed = frame_write_results_format(&model, settings->results_path, settings->results_format) != 0;
+
+            if (verbose && !failed)
+            {
+                printf("Wrote %s (%.3f s)\n", settings->results_path, omp_get_wtime() - solved);
+            }
+        }
+    }
+
+#if ENABLE_MPI
+    // Every process reports the same outcome
+    MPI_Allreduce(MPI_IN_PLACE, &failed, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+#endif
+
+    if (converged)
+    {
+        *converged = !failed && solved_converged;
+    }
+
+    if (failed || !frame)
+    {
+        release_frame(&model);
+        return failed ? -1 : 0;
+    }
+
+    *frame = model;
+    return 0;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "linsolvempi.h"
+#include "frameresults.h"
+
+struct Frame;
+
+// Options for solving a model without graphics (see frame_batch_run)
+struct BatchSettings
+{
+    // Text or binary frame file (see frameimport.h and framebinary.h) or a Matrix Market system
+    // (".mtx", see matrixmarket.h) which is solved on the main process and its solution written
+    // to results_path as a Matrix Market vector
+    const char* model_path;
+    const char* results_path; // Written by the main process (see frameresults.h). NULL skips writing
+    enum ResultsFormat results_format;
+
+    // When not NULL the results are written by the writer's background thread so the next
+    // model can be solved meanwhile. Write failures are counted by the writer
+    struct ResultsWriter* writer;
+
+    // A single process always uses conjugate gradients preconditioned with solve.schwarz since
+    // Jacobi and SOR on one process need the dense equations. With several MPI processes
+    // solve.method picks the solver. The tolerance is on the norm of the force residual
+    struct MpiSolveSettings solve;
+
+    int verbose; // Print the time taken by each step on the main process
+};
+
+// Conjugate gradients with the default Schwarz preconditioner
+void batch_default_settings(struct BatchSettings* settings, int iterations, float tolerance);
+
+// Collective with MPI. Import, assemble and solve a model and write its results without creating
+// a window or graphics context. Every process loads the model and solves its own part
+// If frame is not NULL it receives the solved model (results are only filled in on the main
+// process) in the node order of the file. Otherwise the model is released
+// converged (may be NULL) is set to 1 on every process if the solve reached the tolerance
+// Returns 0 on success or -1 if loading, solving or writing failed (frame is left empty)
+int frame_batch_run(const struct BatchSettings* settings, struct Frame* frame, int* converged);
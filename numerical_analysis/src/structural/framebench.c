@@ -0,0 +1,952 @@
+#include "framebench.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <omp.h>
+
+#include "frame.h"
+#include "framebinary.h"
+#include "framegenerate.h"
+#include "framempi.h"
+#include "frameprocess.h"
+#include "frameschwarz.h"
+#include "nodegraph.h"
+#include "coloring.h"
+#include "distribute.h"
+#include "linearsolve.h"
+#include "linsolvempi.h"
+#include "permutation.h"
+#include "schwarz.h"
+#include "sparse.h"
+#include "counters.h"
+#include "mpiutility.h"
+
+#ifndef ENABLE_MPI
+#define ENABLE_MPI 0
+#endif
+
+#if ENABLE_MPI
+#include <mpi.h>
+#endif
+
+// Kernels are called at most this many times in one sample
+#define BENCH_MAX_CALLS 100000
+
+// Weight of the weighted Jacobi benchmark (2/3 is the usual damping for smoothing)
+#define BENCH_JACOBI_WEIGHT 0.667f
+
+// Size of the model a result belongs to
+struct BenchModel
+{
+    const char* name;
+    int nodes;
+    int elements;
+    int rows;
+    int nnz; // 0 if the whole system is never built on one process
+};
+
+// Everything the benchmarks work on. Each benchmark reads what it needs and writes its outputs
+struct BenchContext
+{
+    const struct BenchSettings* settings;
+    int threads;
+    int rank;
+    int procs;
+    int main_proc;
+
+    // Source of the model for the import and generate benchmarks
+    const char* path;
+    const struct FrameGenerateSettings* generate;
+
+    struct Frame* frame;
+    struct NodeGraph graph;
+    int* colors;
+
+    struct SparseMatrix system;
+    float* forces;
+    float* x;
+    float* y;
+
+    struct EquationSet eqset;
+    struct Permutation color_order; // Rows of eqset ordered by color (see eqset_reorder)
+    int have_dense;
+
+    struct RowDistribution node_dist;
+    float* residuals;
+
+    // Outputs of the last call
+    double dot;
+    int iterations;
+    int color_count;
+    int failed;
+};
+
+typedef void (*bench_func_t)(struct BenchContext* context);
+
+enum BenchKind
+{
+    BENCH_ONCE = 0, // Runs once per sample (setup and solvers)
+    BENCH_KERNEL // Repeated within a sample until it takes settings->min_sample
+};
+
+struct BenchResult
+{
+    const char* name;
+    int threads;
+    int calls;
+    double* samples; // Seconds per call sorted from fastest to slowest
+
+    // Work done by one call (0 if not counted)
+    double flops;
+    double bytes;
+    double items;
+
+    int iterations; // -1 if not a solver
+    int converged;
+    int colors; // -1 if not a coloring
+
+    // Hardware counts of one call summed over threads and processes (see counters.h)
+    double counts[COUNTER_EVENT_COUNT];
+    int counted[COUNTER_EVENT_COUNT];
+};
+
+static void release_frame(struct Frame* frame)
+{
+    // frame_release does not free the boundary conditions
+    free(frame->bconditions);
+    frame->bconditions = NULL;
+    frame_release(frame);
+}
+
+static void barrier(const struct BenchContext* context)
+{
+#if ENABLE_MPI
+    if (context->procs > 1)
+    {
+        MPI_Barrier(MPI_COMM_WORLD);
+    }
+#endif
+}
+
+static int compare_doubles(const void* a, const void* b)
+{
+    double left = *(const double*)a;
+    double right = *(const double*)b;
+    return (left > right) - (left < right);
+}
+
+// Percentile q (0 to 1) of sorted samples interpolating between neighbors
+static double percentile(const double* sorted, int count, double q)
+{
+    double position = q * (count - 1);
+    int low = (int)position;
+    int high = low + 1 < count ? low + 1 : low;
+    return sorted[low] + (sorted[high] - sorted[low]) * (position - low);
+}
+
+// Iterations until the residual first fell below tolerance for solvers that always run every iteration
+// Returns iterations if it never did
+static int iterations_to_tolerance(const float* residuals, int iterations, float tolerance)
+{
+    for (int t = 0; t < iterations; ++t)
+    {
+        if (residuals[t] < tolerance)
+        {
+            return t + 1;
+        }
+    }
+
+    return iterations;
+}
+
+static void write_json_string(FILE* file, const char* text)
+{
+    fputc('"', file);
+
+    for (const char* c = text; *c; ++c)
+    {
+        if (*c == '"' || *c == '\\')
+        {
+            fprintf(file, "\\%c", *c);
+        }
+        else if ((unsigned char)*c < 0x20)
+        {
+            fprintf(file, "\\u%04x", (unsigned char)*c);
+        }
+        else
+        {
+            fputc(*c, file);
+        }
+    }
+
+    fputc('"', file);
+}
+
+static void write_result(struct BenchReport* report, const struct BenchModel* model, const struct BenchResult* result,
+    int count, int procs)
+{
+    FILE* file = report->file;
+    const double median = percentile(result->samples, count, 0.5);
+
+    fprintf(file, "%s\n    {\"model\": ", report->results > 0 ? "," : "");
+    write_json_string(file, model->name);
+    fprintf(file, ", \"nodes\": %i, \"elements\": %i, \"rows\": %i", model->nodes, model->elements, model->rows);
+
+    if (model->nnz > 0)
+    {
+        fprintf(file, ", \"nnz\": %i", model->nnz);
+    }
+
+    fprintf(file, ", \"name\": \"%s\", \"threads\": %i, \"processes\": %i, \"samples\": %i, \"calls_per_sample\": %i",
+        result->name, result->threads, procs, count, result->calls);
+    fprintf(file, ", \"min_s\": %.9g, \"p10_s\": %.9g, \"median_s\": %.9g, \"p90_s\": %.9g, \"max_s\": %.9g",
+        result->samples[0], percentile(result->samples, count, 0.1), median,
+        percentile(result->samples, count, 0.9), result->samples[count - 1]);
+
+    if (median > 0.0)
+    {
+        if (result->flops > 0.0)
+        {
+            fprintf(file, ", \"gflops\": %.6g", result->flops / median * 1e-9);
+        }
+
+        if (result->bytes > 0.0)
+        {
+            fprintf(file, ", \"gbytes_per_s\": %.6g", result->bytes / median * 1e-9);
+        }
+
+        if (result->items > 0.0)
+        {
+            fprintf(file, ", \"items_per_s\": %.6g", result->items / median);
+        }
+    }
+
+    if (result->iterations >= 0)
+    {
+        fprintf(file, ", \"iterations\": %i, \"converged\": %s", result->iterations, result->converged ? "true" : "false");
+    }
+
+    if (result->colors >= 0)
+    {
+        fprintf(file, ", \"colors\": %i", result->colors);
+    }
+
+    for (int e = 0; e < COUNTER_EVENT_COUNT; ++e)
+    {
+        if (result->counted[e])
+        {
+            fprintf(file, ", \"%s\": %.6g", counter_event_name(e), result->counts[e]);
+        }
+    }
+
+    if (result->counted[COUNTER_CYCLES] && result->counted[COUNTER_INSTRUCTIONS] && result->counts[COUNTER_CYCLES] > 0.0)
+    {
+        fprintf(file, ", \"ipc\": %.4g", result->counts[COUNTER_INSTRUCTIONS] / result->counts[COUNTER_CYCLES]);
+    }
+
+    // Memory traffic estimated from the misses gives the measured side of a roofline
+    // next to the bytes the kernel has to move at least
+    if (result->counted[COUNTER_LLC_MISSES])
+    {
+        const double dram_bytes = result->counts[COUNTER_LLC_MISSES] * counters_line_bytes();
+        fprintf(file, ", \"dram_bytes\": %.6g", dram_bytes);
+
+        if (median > 0.0)
+        {
+            fprintf(file, ", \"dram_gbytes_per_s\": %.6g", dram_bytes / median * 1e-9);
+        }
+
+        if (result->flops > 0.0 && dram_bytes > 0.0)
+        {
+            fprintf(file, ", \"flops_per_dram_byte\": %.6g", result->flops / dram_bytes);
+        }
+    }
+
+    fprintf(file, "}");
+    fflush(file);
+
+    report->results++;
+}
+
+// Time a benchmark with the context's thread count and add its result to the report
+// flops, bytes and items are the work of one call. Solvers fill in their own flops once they
+// know the iterations. Returns 0 on success or -1 if a call failed
+static int run_benchmark(struct BenchContext* context, struct BenchReport* report, const struct BenchModel* model,
+    const char* name, bench_func_t func, enum BenchKind kind, double flops, double bytes, double items)
+{
+    const struct BenchSettings* settings = context->settings;
+    const int count = settings->repeat;
+
+    struct BenchResult result = { name, context->threads, 1, malloc(sizeof(double) * count), flops, bytes, items, -1, 0, -1 };
+
+    // Benchmarks that use the default team (such as import) follow the thread count too
+    omp_set_num_threads(context->threads);
+
+    context->failed = 0;
+    context->iterations = -1;
+    context->color_count = -1;
+
+    if (kind == BENCH_KERNEL)
+    {
+        // A first call warms the caches and sets how many calls fill a sample
+        double start = omp_get_wtime();
+        func(context);
+        double elapsed = omp_get_wtime() - start;
+
+        double calls = elapsed > 0.0 ? settings->min_sample / elapsed : BENCH_MAX_CALLS;
+        result.calls = calls < 1.0 ? 1 : calls > BENCH_MAX_CALLS ? BENCH_MAX_CALLS : (int)calls + 1;
+    }
+
+    // Counted over every sample. Starting and stopping happens outside the timed parts
+    struct Counters counters;
+    const int counting = settings->counters && counters_open(&counters, context->threads) > 0;
+
+    if (counting)
+    {
+        counters_start(&counters);
+    }
+
+    int samples = 0;
+
+    for (int s = 0; s < count && !context->failed; ++s)
+    {
+        barrier(context);
+        double start = omp_get_wtime();
+
+        for (int c = 0; c < result.calls; ++c)
+        {
+            func(context);
+        }
+
+        barrier(context);
+        result.samples[s] = (omp_get_wtime() - start) / result.calls;
+        samples++;
+    }
+
+    struct CounterValues values = { { 0 }, { 0 } };
+
+    if (counting)
+    {
+        counters_stop(&counters, &values);
+    }
+
+    if (settings->counters)
+    {
+        counters_close(&counters);
+    }
+
+#if ENABLE_MPI
+    // Every process counts its own part of the work
+    if (settings->counters && context->procs > 1)
+    {
+        MPI_Allreduce(MPI_IN_PLACE, values.values, COUNTER_EVENT_COUNT, MPI_LONG_LONG, MPI_SUM, MPI_COMM_WORLD);
+        MPI_Allreduce(MPI_IN_PLACE, values.valid, COUNTER_EVENT_COUNT, MPI_INT, MPI_MIN, MPI_COMM_WORLD);
+    }
+#endif
+
+    for (int e = 0; e < COUNTER_EVENT_COUNT; ++e)
+    {
+        result.counted[e] = values.valid[e] && samples > 0;
+        result.counts[e] = result.counted[e] ? (double)values.values[e] / ((double)samples * result.calls) : 0.0;
+    }
+
+    if (context->failed)
+    {
+        if (context->rank == context->main_proc)
+        {
+            fprintf(stderr, "Benchmark Error: %s failed on %s\n", name, model->name);
+        }
+
+        free(result.samples);
+        return -1;
+    }
+
+    qsort(result.samples, count, sizeof(*result.samples), compare_doubles);
+
+    result.iterations = context->iterations;
+    result.converged = context->iterations >= 0 && context->iterations < settings->iterations;
+    result.colors = context->color_count;
+
+    if (context->iterations >= 0)
+    {
+        // Solvers give the work of one iteration
+        result.flops *= context->iterations;
+    }
+
+    if (context->rank == context->main_proc)
+    {
+        write_result(report, model, &result, count, context->procs);
+    }
+
+    free(result.samples);
+    return 0;
+}
+
+static void bench_import(struct BenchContext* context)
+{
+    struct Frame frame;
+
+    int failed = ENABLE_MPI && context->procs > 1 && !frame_is_binary(context->path) ?
+        frame_import_mpi(context->path, &frame) : frame_load(context->path, &frame);
+
+    if (failed)
+    {
+        context->failed = 1;
+        return;
+    }
+
+    release_frame(&frame);
+}
+
+static void bench_generate(struct BenchContext* context)
+{
+    struct Frame frame;
+
+    if (frame_generate(context->generate, &frame))
+    {
+        context->failed = 1;
+        return;
+    }
+
+    release_frame(&frame);
+}
+
+static void bench_nodegraph(struct BenchContext* context)
+{
+    struct NodeGraph graph;
+
+    if (nodegraph_build(context->frame, &graph))
+    {
+        context->failed = 1;
+        return;
+    }
+
+    nodegraph_release(&graph);
+}
+
+static void bench_color_greedy(struct BenchContext* context)
+{
+    context->color_count = color_greedy(&context->graph, context->colors);
+}
+
+static void bench_color_dsatur(struct BenchContext* context)
+{
+    context->color_count = color_dsatur(&context->graph, context->colors);
+}
+
+static void bench_color_jones_plassmann(struct BenchContext* context)
+{
+    context->color_count = color_jones_plassmann(&context->graph, context->colors, 1);
+}
+
+static void bench_element_stiffness(struct BenchContext* context)
+{
+    struct Frame* frame = context->frame;
+
+#pragma omp parallel num_threads(context->threads)
+    {
+        struct mat6 k_element[4];
+
+#pragma omp for schedule(static)
+        for (int e = 0; e < frame->element_count; ++e)
+        {
+            build_element_stiffness(frame, frame->elements[e], k_element);
+        }
+    }
+}
+
+static void bench_assemble_sparse(struct BenchContext* context)
+{
+    struct SparseMatrix stiffness;
+    float* forces = NULL;
+
+    if (frame_build_system(context->frame, &stiffness, NULL, &forces))
+    {
+        context->failed = 1;
+        return;
+    }
+
+    free(forces);
+    sparse_release(&stiffness);
+}
+
+static void bench_assemble_dense(struct BenchContext* context)
+{
+    struct EquationSet eqset;
+    frame_build_equations(context->frame, &eqset);
+    equationset_release(&eqset);
+}
+
+// Matrix vector product split by rows like the one in solve_cg_sparse
+static void bench_matvec(struct BenchContext* context)
+{
+    const struct SparseMatrix* matrix = &context->system;
+    const float* x = context->x;
+    float* y = context->y;
+
+#pragma omp parallel for schedule(static) num_threads(context->threads)
+    for (int j = 0; j < matrix->rows; ++j)
+    {
+        float sum = 0.0f;
+
+        for (int p = matrix->row_offsets[j]; p < matrix->row_offsets[j + 1]; ++p)
+        {
+            sum += matrix->values[p] * x[matrix->columns[p]];
+        }
+
+        y[j] = sum;
+    }
+}
+
+// Dot product reduction like the ones conjugate gradients does every iteration
+static void bench_dot(struct BenchContext* context)
+{
+    const int rows = context->system.rows;
+    const float* x = context->x;
+    const float* y = context->y;
+    double sum = 0.0;
+
+#pragma omp parallel for schedule(static) num_threads(context->threads) reduction(+:sum)
+    for (int j = 0; j < rows; ++j)
+    {
+        sum += (double)x[j] * y[j];
+    }
+
+    context->dot = sum;
+}
+
+static void bench_cg_diagonal(struct BenchContext* context)
+{
+    const struct BenchSettings* settings = context->settings;
+
+    context->iterations = solve_cg_sparse(&context->system, context->forces, context->x, NULL, context->residuals,
+        settings->iterations, settings->tolerance, context->threads, NULL, NULL);
+}
+
+static void bench_cg_schwarz(struct BenchContext* context)
+{
+    const struct BenchSettings* settings = context->settings;
+
+    struct SchwarzSettings schwarz;
+    schwarz_default_settings(&schwarz);
+
+    context->iterations = frame_solve_cg(context->frame, &schwarz, context->residuals, settings->iterations,
+        settings->tolerance, context->threads, NULL, NULL);
+    context->failed = context->iterations < 0;
+}
+
+static void bench_jacobi_single(struct BenchContext* context)
+{
+    const struct BenchSettings* settings = context->settings;
+
+    solve_jacobi_single(context->eqset, context->residuals, settings->iterations);
+    context->iterations = iterations_to_tolerance(context->residuals, settings->iterations, settings->tolerance);
+}
+
+static void bench_jacobi_parallel(struct BenchContext* context)
+{
+    const struct BenchSettings* settings = context->settings;
+
+    solve_jacobi_parallel(context->eqset, context->residuals, settings->iterations, context->threads);
+    context->iterations = iterations_to_tolerance(context->residuals, settings->iterations, settings->tolerance);
+}
+
+static void bench_jacobi_weighted_parallel(struct BenchContext* context)
+{
+    const struct BenchSettings* settings = context->settings;
+
+    solve_jacobi_weighted_parallel(context->eqset, context->residuals, settings->iterations, context->threads, BENCH_JACOBI_WEIGHT);
+    context->iterations = iterations_to_tolerance(context->residuals, settings->iterations, settings->tolerance);
+}
+
+static void bench_sor_single(struct BenchContext* context)
+{
+    const struct BenchSettings* settings = context->settings;
+
+    solve_sor_single(context->eqset, context->residuals, settings->iterations, 1);
+    context->iterations = iterations_to_tolerance(context->residuals, settings->iterations, settings->tolerance);
+}
+
+// Same relaxation factor as solve_sor_single so the two can be compared directly
+static void bench_sor_multicolor(struct BenchContext* context)
+{
+    const struct BenchSettings* settings = context->settings;
+
+    solve_sor_multicolor(context->eqset, &context->color_order, context->residuals, settings->iterations, 1.0f, context->threads);
+    context->iterations = iterations_to_tolerance(context->residuals, settings->iterations, settings->tolerance);
+}
+
+static void solve_mpi(struct BenchContext* context, enum MpiSolveMethod method)
+{
+    const struct BenchSettings* settings = context->settings;
+
+    struct MpiSolveSettings solve;
+    mpisolve_default_settings(&solve, settings->iterations);
+    solve.method = method;
+    solve.tolerance = settings->tolerance;
+    solve.threads = context->threads;
+    solve.residuals = context->residuals;
+
+    // Only checked iterations get a residual so the count of them is the iterations run
+    for (int t = 0; t < settings->iterations; ++t)
+    {
+        context->residuals[t] = -1.0f;
+    }
+
+    context->failed = frame_solve_mpi(context->frame, &context->node_dist, &solve, NULL) < 0;
+
+    int iterations = 0;
+    while (iterations < settings->iterations && context->residuals[iterations] >= 0.0f)
+    {
+        iterations++;
+    }
+
+    context->iterations = iterations;
+}
+
+static void bench_cg_mpi(struct BenchContext* context)
+{
+    solve_mpi(context, MPI_SOLVE_CG);
+}
+
+static void bench_jacobi_mpi(struct BenchContext* context)
+{
+    solve_mpi(context, MPI_SOLVE_JACOBI);
+}
+
+static void bench_sor_mpi(struct BenchContext* context)
+{
+    solve_mpi(context, MPI_SOLVE_SOR);
+}
+
+// Benchmarks that need the whole system on one process
+static int bench_single_process(struct BenchContext* context, struct BenchReport* report, struct BenchModel* model)
+{
+    const struct BenchSettings* settings = context->settings;
+    struct Frame* frame = context->frame;
+    int failed = 0;
+
+    if (nodegraph_build(frame, &context->graph))
+    {
+        return -1;
+    }
+
+    context->colors = malloc(sizeof(*context->colors) * (frame->node_count > 0 ? frame->node_count : 1));
+
+    if (frame_build_system(frame, &context->system, NULL, &context->forces))
+    {
+        free(context->colors);
+        nodegraph_release(&context->graph);
+        return -1;
+    }
+
+    const struct SparseMatrix* system = &context->system;
+    model->nnz = system->nnz;
+
+    context->x = malloc(sizeof(*context->x) * (system->rows > 0 ? system->rows : 1));
+    context->y = malloc(sizeof(*context->y) * (system->rows > 0 ? system->rows : 1));
+
+    for (int j = 0; j < system->rows; ++j)
+    {
+        context->x[j] = 1.0f;
+    }
+
+    context->have_dense = system->rows <= settings->dense_rows;
+
+    if (context->have_dense)
+    {
+        frame_build_equations(frame, &context->eqset);
+
+        // Multicolor SOR visits the rows color by color
+        frame_assign_multicolor(frame, COLORING_DSATUR, 1, NULL);
+        eqset_reorder(frame, &context->eqset, &context->color_order);
+    }
+
+    // Each value is read once with its column index. x is counted once (it mostly stays in
+    // cache between neighboring rows) along with the row offsets and the result
+    const double matvec_flops = 2.0 * system->nnz;
+    const double matvec_bytes = 8.0 * system->nnz + 12.0 * system->rows + 4.0;
+
+    // Conjugate gradients does a product, two dot products, three updates and the diagonal
+    // scaling each iteration
+    const double cg_flops = matvec_flops + 11.0 * system->rows;
+
+    for (int c = 0; c < settings->thread_count_count && !failed; ++c)
+    {
+        context->threads = settings->thread_counts[c];
+        const int first = c == 0;
+
+        // Serial steps only run with the first thread count
+        if (first)
+        {
+            context->threads = 1;
+            failed |= run_benchmark(context, report, model, "nodegraph", bench_nodegraph, BENCH_ONCE, 0.0, 0.0, frame->element_count);
+            failed |= run_benchmark(context, report, model, "color_greedy", bench_color_greedy, BENCH_ONCE, 0.0, 0.0, frame->node_count);
+            failed |= run_benchmark(context, report, model, "color_dsatur", bench_color_dsatur, BENCH_ONCE, 0.0, 0.0, frame->node_count);
+            failed |= run_benchmark(context, report, model, "assemble_sparse", bench_assemble_sparse, BENCH_ONCE, 0.0, 0.0, frame->element_count);
+
+            if (context->have_dense)
+            {
+                failed |= run_benchmark(context, report, model, "assemble_dense", bench_assemble_dense, BENCH_ONCE, 0.0, 0.0, frame->element_count);
+                failed |= run_benchmark(context, report, model, "solve_jacobi_single", bench_jacobi_single, BENCH_ONCE, 0.0, 0.0, 0.0);
+                failed |= run_benchmark(context, report, model, "solve_sor_single", bench_sor_single, BENCH_ONCE, 0.0, 0.0, 0.0);
+            }
+
+            context->threads = settings->thread_counts[c];
+        }
+
+        failed |= run_benchmark(context, report, model, "color_jones_plassmann", bench_color_jones_plassmann, BENCH_ONCE, 0.0, 0.0, frame->node_count);
+        failed |= run_benchmark(context, report, model, "element_stiffness", bench_element_stiffness, BENCH_KERNEL, 0.0, 0.0, frame->element_count);
+        failed |= run_benchmark(context, report, model, "matvec", bench_matvec, BENCH_KERNEL, matvec_flops, matvec_bytes, system->rows);
+        failed |= run_benchmark(context, report, model, "dot", bench_dot, BENCH_KERNEL, 2.0 * system->rows, 8.0 * system->rows, system->rows);
+        failed |= run_benchmark(context, report, model, "solve_cg_diagonal", bench_cg_diagonal, BENCH_ONCE, cg_flops, 0.0, 0.0);
+        failed |= run_benchmark(context, report, model, "solve_cg_schwarz", bench_cg_schwarz, BENCH_ONCE, 0.0, 0.0, 0.0);
+
+        if (context->have_dense)
+        {
+            failed |= run_benchmark(context, report, model, "solve_jacobi_parallel", bench_jacobi_parallel, BENCH_ONCE, 0.0, 0.0, 0.0);
+            failed |= run_benchmark(context, report, model, "solve_jacobi_weighted_parallel", bench_jacobi_weighted_parallel, BENCH_ONCE, 0.0, 0.0, 0.0);
+            failed |= run_benchmark(context, report, model, "solve_sor_multicolor", bench_sor_multicolor, BENCH_ONCE, 0.0, 0.0, 0.0);
+        }
+    }
+
+    if (context->have_dense)
+    {
+        permutation_release(&context->color_order);
+        equationset_release(&context->eqset);
+    }
+
+    free(context->x);
+    free(context->y);
+    free(context->forces);
+    sparse_release(&context->system);
+    free(context->colors);
+    nodegraph_release(&context->graph);
+
+    return failed ? -1 : 0;
+}
+
+// Collective. Benchmarks of the distributed solvers
+static int bench_distributed(struct BenchContext* context, struct BenchReport* report, struct BenchModel* model)
+{
+    const struct BenchSettings* settings = context->settings;
+    int failed = 0;
+
+    // Every process computes the same partition and colors so the solves need no setup to agree
+    if (frame_partition(context->frame, context->procs, &context->node_dist, NULL, NULL))
+    {
+        return -1;
+    }
+
+    frame_assign_multicolor(context->frame, COLORING_DSATUR, 1, NULL);
+
+    for (int c = 0; c < settings->thread_count_count && !failed; ++c)
+    {
+        context->threads = settings->thread_counts[c];
+        failed |= run_benchmark(context, report, model, "solve_cg_mpi", bench_cg_mpi, BENCH_ONCE, 0.0, 0.0, 0.0);
+        failed |= run_benchmark(context, report, model, "solve_jacobi_mpi", bench_jacobi_mpi, BENCH_ONCE, 0.0, 0.0, 0.0);
+        failed |= run_benchmark(context, report, model, "solve_sor_mpi", bench_sor_mpi, BENCH_ONCE, 0.0, 0.0, 0.0);
+    }
+
+    rowdist_release(&context->node_dist);
+
+    return failed ? -1 : 0;
+}
+
+static void context_init(struct BenchContext* context, const struct BenchSettings* settings)
+{
+    memset(context, 0, sizeof(*context));
+    context->settings = settings;
+
+#if ENABLE_MPI
+    context->rank = get_rank_mpi();
+    context->procs = get_procs_mpi();
+    context->main_proc = get_main_mpi();
+#else
+    context->rank = 0;
+    context->procs = 1;
+    context->main_proc = 0;
+#endif
+
+    context->residuals = malloc(sizeof(*context->residuals) * (settings->iterations > 0 ? settings->iterations : 1));
+}
+
+// Load the model once to run the other benchmarks on, then time loading it with source
+static int bench_model(struct BenchContext* context, struct BenchReport* report, const char* name,
+    const char* source_name, bench_func_t source)
+{
+    const struct BenchSettings* settings = context->settings;
+    const int max_threads = omp_get_max_threads();
+
+    struct Frame frame;
+    int failed = context->path ? (ENABLE_MPI && context->procs > 1 && !frame_is_binary(context->path) ?
+        frame_import_mpi(context->path, &frame) : frame_load(context->path, &frame)) :
+        frame_generate(context->generate, &frame);
+
+    if (failed)
+    {
+        return -1;
+    }
+
+    context->frame = &frame;
+
+    struct BenchModel model = { name, frame.node_count, frame.element_count, 6 * frame.node_count, 0 };
+
+    failed = context->procs > 1 ? bench_distributed(context, report, &model) :
+        bench_single_process(context, report, &model);
+
+    // Loading is timed last so its results have the stored values counted by the other benchmarks
+    for (int c = 0; c < settings->thread_count_count && !failed; ++c)
+    {
+        context->threads = settings->thread_counts[c];
+        failed |= run_benchmark(context, report, &model, source_name, source, BENCH_ONCE, 0.0, 0.0, frame.node_count);
+    }
+
+    omp_set_num_threads(max_threads);
+
+    release_frame(&frame);
+
+    return failed ? -1 : 0;
+}
+
+void bench_default_settings(struct BenchSettings* settings)
+{
+    memset(settings, 0, sizeof(*settings));
+    settings->repeat = 5;
+    settings->thread_counts[0] = 1;
+    settings->thread_count_count = 1;
+
+    const int max_threads = omp_get_max_threads();
+    if (max_threads > 1)
+    {
+        settings->thread_counts[settings->thread_count_count++] = max_threads;
+    }
+
+    settings->iterations = 1000;
+    settings->tolerance = 0.001f;
+    settings->dense_rows = 1000;
+    settings->min_sample = 0.01;
+}
+
+int bench_report_open(struct BenchReport* report, const char* path, const struct BenchSettings* settings)
+{
+#if ENABLE_MPI
+    const int rank = get_rank_mpi();
+    const int procs = get_procs_mpi();
+    const int main_proc = get_main_mpi();
+#else
+    const int rank = 0;
+    const int procs = 1;
+    const int main_proc = 0;
+#endif
+
+    report->file = NULL;
+    report->results = 0;
+    report->close_file = 0;
+
+    int failed = 0;
+
+    // Say once why the results have no counts instead of leaving them out silently
+    if (settings->counters)
+    {
+        struct Counters counters;
+        int available = counters_open(&counters, 1);
+        counters_close(&counters);
+
+#if ENABLE_MPI
+        MPI_Allreduce(MPI_IN_PLACE, &available, 1, MPI_INT, MPI_MIN, MPI_COMM_WORLD);
+#endif
+
+        if (available < COUNTER_EVENT_COUNT && rank == main_proc)
+        {
+            fprintf(stderr, "Warning: Only %i of %i hardware counters are available. Check perf_event_paranoid "
+                "and that the machine exposes its performance monitoring unit\n", available, COUNTER_EVENT_COUNT);
+        }
+    }
+
+    if (rank == main_proc)
+    {
+        report->file = path ? fopen(path, "w") : stdout;
+        report->close_file = path != NULL;
+
+        if (!report->file)
+        {
+            fprintf(stderr, "Failed to open file at: %s\n", path);
+            failed = 1;
+        }
+        else
+        {
+            fprintf(report->file, "{\n  \"version\": %i,\n  \"processes\": %i,\n  \"max_threads\": %i,\n"
+                "  \"repeat\": %i,\n  \"iterations\": %i,\n  \"tolerance\": %.9g,\n  \"counters\": %s,\n"
+                "  \"line_bytes\": %i,\n  \"results\": [",
+                BENCH_VERSION, procs, omp_get_max_threads(), settings->repeat, settings->iterations, settings->tolerance,
+                settings->counters ? "true" : "false", counters_line_bytes());
+        }
+    }
+
+#if ENABLE_MPI
+    MPI_Allreduce(MPI_IN_PLACE, &failed, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+#endif
+
+    return failed ? -1 : 0;
+}
+
+int bench_report_close(struct BenchReport* report)
+{
+    int failed = 0;
+
+    if (report->file)
+    {
+        fprintf(report->file, "\n  ]\n}\n");
+        failed = ferror(report->file) != 0;
+
+        if (report->close_file)
+        {
+            failed |= fclose(report->file) != 0;
+        }
+        else
+        {
+            fflush(report->file);
+        }
+
+        report->file = NULL;
+    }
+
+#if ENABLE_MPI
+    MPI_Allreduce(MPI_IN_PLACE, &failed, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+#endif
+
+    return failed ? -1 : 0;
+}
+
+int frame_bench_file(const struct BenchSettings* settings, const char* path, struct BenchReport* report)
+{
+    struct BenchContext context;
+    context_init(&context, settings);
+    context.path = path;
+
+    int failed = bench_model(&context, report, path, "import", bench_import);
+
+    free(context.residuals);
+    return failed;
+}
+
+int frame_bench_generated(const struct BenchSettings* settings, const struct FrameGenerateSettings* generate,
+    struct BenchReport* report)
+{
+    struct BenchContext context;
+    context_init(&context, settings);
+    context.generate = generate;
+
+    // Name generated models after their shape and size
+    char name[96];
+    snprintf(name, sizeof(name), "%s %ix%ix%i seed %llu", frame_shape_name(generate->shape), generate->size[0],
+        generate->size[1], generate->size[2], (unsigned long long)generate->seed);
+
+    int failed = bench_model(&context, report, name, "generate", bench_generate);
+
+    free(context.residuals);
+    return failed;
+}
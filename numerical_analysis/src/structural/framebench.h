@@ -0,0 +1,68 @@
+#pragma once
+
+#include <stdio.h>
+
+struct FrameGenerateSettings;
+
+// Benchmarks of the steps of solving a frame (see frame_bench_file) written as JSON so results
+// can be compared between builds and machines. The report is one object with the run's settings
+// and a "results" array holding one flat object per model, benchmark and thread count:
+// model, nodes, elements, rows, nnz (if the whole system is built on one process), name, threads,
+// processes, samples, calls_per_sample, min_s, p10_s, median_s, p90_s, max_s (seconds per call)
+// and where they apply gflops, gbytes_per_s, items_per_s (elements or nodes handled), iterations,
+// converged and colors. Rates are computed from the median
+// With counters on, results also have cycles, instructions and llc_misses per call, ipc and the memory
+// traffic estimated from the misses (dram_bytes, dram_gbytes_per_s and flops_per_dram_byte) so
+// kernels can be placed on a roofline (see counters.h)
+
+#define BENCH_MAX_THREAD_COUNTS 16
+#define BENCH_VERSION 2
+
+struct BenchSettings
+{
+    int repeat; // Samples of each benchmark
+    int thread_counts[BENCH_MAX_THREAD_COUNTS]; // Threaded benchmarks run once with each count
+    int thread_count_count;
+
+    // Solvers stop at the tolerance on the residual norm or after this many iterations
+    int iterations;
+    float tolerance;
+
+    // Largest system the dense assembly and solvers are run on. They need rows^2 floats and
+    // always run every iteration so the iterations reported are when the tolerance was first met
+    int dense_rows;
+    double min_sample; // Short kernels are called repeatedly until a sample takes at least this long (seconds)
+    int counters; // Count hardware events over every sample of each benchmark
+};
+
+// JSON output written by the main process (file is NULL on the other processes)
+struct BenchReport
+{
+    FILE* file;
+    int results;
+    int close_file;
+};
+
+// 5 samples, 1 thread and the OpenMP default, 1000 iterations to a tolerance of 0.001,
+// dense solvers up to 1000 rows, samples of at least 10 ms and no hardware counters
+void bench_default_settings(struct BenchSettings* settings);
+
+// Collective with MPI. Start a report at path (or standard output if path is NULL)
+// Returns 0 on success or -1 if the file could not be opened
+int bench_report_open(struct BenchReport* report, const char* path, const struct BenchSettings* settings);
+
+// Collective with MPI. Finish the report. Returns 0 on success or -1 if writing failed
+int bench_report_close(struct BenchReport* report);
+
+// Collective with MPI. Benchmark a model file and add the results to report
+// With one process this times import, node graph and coloring, element stiffness, sparse and
+// dense assembly, the sparse matrix vector product, a dot product and the single and OpenMP solvers
+// With several processes every process takes part in import and the MPI solvers instead since
+// anything else would only time the main process while the others wait
+// Returns 0 on success or -1 if the model could not be loaded or a benchmark failed
+int frame_bench_file(const struct BenchSettings* settings, const char* path, struct BenchReport* report);
+
+// Collective with MPI. Benchmark a synthetic frame (see framegenerate.h) like frame_bench_file
+// with generation timed in place of import
+int frame_bench_generated(const struct BenchSettings* settings, const struct FrameGenerateSettings* generate,
+    struct BenchReport* report);
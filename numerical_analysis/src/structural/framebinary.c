@@ -0,0 +1,369 @@
+#include "framebinary.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "frame.h"
+#include "frameimport.h"
+#include "trace.h"
+
+// Number of entries in each section
+static int section_length(const struct FrameBinaryHeader* header, enum FrameBinarySection section)
+{
+    if (section <= FRAME_SECTION_NODE_Z)
+    {
+        return header->node_count;
+    }
+
+    if (section <= FRAME_SECTION_ELEMENT_RADIUS)
+    {
+        return header->element_count;
+    }
+
+    return header->bc_count;
+}
+
+static uint64_t align_offset(uint64_t offset)
+{
+    return (offset + FRAME_BINARY_ALIGN - 1) / FRAME_BINARY_ALIGN * FRAME_BINARY_ALIGN;
+}
+
+// Check the header describes arrays that lie inside the file. Returns 0 if it does
+static int check_header(const struct FrameBinaryHeader* header, size_t size)
+{
+    if (memcmp(header->magic, FRAME_BINARY_MAGIC, sizeof(header->magic)) != 0)
+    {
+        fprintf(stderr, "Frame Binary Error: not a binary frame file\n");
+        return -1;
+    }
+
+    if (header->byte_order != FRAME_BINARY_BYTE_ORDER)
+    {
+        fprintf(stderr, "Frame Binary Error: file was written with a different byte order\n");
+        return -1;
+    }
+
+    if (header->version != FRAME_BINARY_VERSION || header->header_size != sizeof(*header))
+    {
+        fprintf(stderr, "Frame Binary Error: unsupported version %u (expected %u)\n",
+            header->version, FRAME_BINARY_VERSION);
+        return -1;
+    }
+
+    if (header->node_count < 0 || header->element_count < 0 || header->bc_count < 0)
+    {
+        fprintf(stderr, "Frame Binary Error: negative counts\n");
+        return -1;
+    }
+
+    if (header->file_size != size)
+    {
+        fprintf(stderr, "Frame Binary Error: file is %zu bytes but the header expects %llu (truncated?)\n",
+            size, (unsigned long long)header->file_size);
+        return -1;
+    }
+
+    for (int s = 0; s < FRAME_SECTION_COUNT; ++s)
+    {
+        uint64_t offset = header->sections[s];
+        uint64_t bytes = (uint64_t)section_length(header, s) * 4;
+
+        // Every value is 4 bytes so aligned sections can be read in place as arrays
+        if (offset % FRAME_BINARY_ALIGN != 0 || offset < sizeof(*header) || offset > size || bytes > size - offset)
+        {
+            fprintf(stderr, "Frame Binary Error: section %i lies outside of the file\n", s);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+int frame_binary_map(const char* path, struct FrameMapping* map)
+{
+    memset(map, 0, sizeof(*map));
+
+    if (filemap_open(path, &map->file))
+    {
+        fprintf(stderr, "Failed to open file at: %s\n", path);
+        return -1;
+    }
+
+    if (map->file.size < sizeof(struct FrameBinaryHeader))
+    {
+        fprintf(stderr, "Frame Binary Error: %s is too small to be a binary frame\n", path);
+        filemap_close(&map->file);
+        return -1;
+    }
+
+    const struct FrameBinaryHeader* header = (const struct FrameBinaryHeader*)map->file.data;
+
+    if (check_header(header, map->file.size))
+    {
+        fprintf(stderr, "Frame Binary Error: failed to load %s\n", path);
+        frame_binary_unmap(map);
+        return -1;
+    }
+
+    map->header = header;
+    map->node_count = header->node_count;
+    map->element_count = header->element_count;
+    map->bc_count = header->bc_count;
+
+    const char* base = map->file.data;
+    map->node_x = (const float*)(base + header->sections[FRAME_SECTION_NODE_X]);
+    map->node_y = (const float*)(base + header->sections[FRAME_SECTION_NODE_Y]);
+    map->node_z = (const float*)(base + header->sections[FRAME_SECTION_NODE_Z]);
+    map->element_node1 = (const int32_t*)(base + header->sections[FRAME_SECTION_ELEMENT_NODE1]);
+    map->element_node2 = (const int32_t*)(base + header->sections[FRAME_SECTION_ELEMENT_NODE2]);
+    map->element_elastic_modulus = (const float*)(base + header->sections[FRAME_SECTION_ELEMENT_ELASTIC_MODULUS]);
+    map->element_shear_modulus = (const float*)(base + header->sections[FRAME_SECTION_ELEMENT_SHEAR_MODULUS]);
+    map->element_radius = (const float*)(base + header->sections[FRAME_SECTION_ELEMENT_RADIUS]);
+    map->bc_node = (const int32_t*)(base + header->sections[FRAME_SECTION_BC_NODE]);
+    map->bc_kind = (const int32_t*)(base + header->sections[FRAME_SECTION_BC_KIND]);
+    map->bc_x = (const float*)(base + header->sections[FRAME_SECTION_BC_X]);
+    map->bc_y = (const float*)(base + header->sections[FRAME_SECTION_BC_Y]);
+    map->bc_z = (const float*)(base + header->sections[FRAME_SECTION_BC_Z]);
+
+    return 0;
+}
+
+void frame_binary_unmap(struct FrameMapping* map)
+{
+    if (map)
+    {
+        filemap_close(&map->file);
+        memset(map, 0, sizeof(*map));
+    }
+}
+
+int frame_from_mapping(const struct FrameMapping* map, struct Frame* frame)
+{
+    const int node_count = map->node_count;
+    const int element_count = map->element_count;
+    const int bc_count = map->bc_count;
+
+    frame->node_count = node_count;
+    frame->element_count = element_count;
+    frame->bc_count = bc_count;
+    frame->nodes = malloc(sizeof(*frame->nodes) * node_count);
+    frame->elements = malloc(sizeof(*frame->elements) * element_count);
+    frame->bconditions = malloc(sizeof(*frame->bconditions) * bc_count);
+
+    // Gathering the arrays into structs is the only pass over the data. With threads the
+    // page faults of the mapping are taken in parallel and each thread first touches
+    // the part of the frame it copies
+    int invalid = 0;
+
+    #pragma omp parallel reduction(|:invalid)
+    {
+        #pragma omp for schedule(static)
+        for (int i = 0; i < node_count; ++i)
+        {
+            frame->nodes[i] = (struct Node){ (struct vec3) { map->node_x[i], map->node_y[i], map->node_z[i] } };
+        }
+
+        #pragma omp for schedule(static)
+        for (int i = 0; i < element_count; ++i)
+        {
+            int n1 = map->element_node1[i];
+            int n2 = map->element_node2[i];
+
+            invalid |= n1 < 0 || n1 >= node_count || n2 < 0 || n2 >= node_count;
+
+            frame->elements[i] = (struct Element){ n1, n2, map->element_elastic_modulus[i],
+                map->element_shear_modulus[i], map->element_radius[i] };
+        }
+
+        #pragma omp for schedule(static)
+        for (int i = 0; i < bc_count; ++i)
+        {
+            int n = map->bc_node[i];
+            int kind = map->bc_kind[i];
+
+            invalid |= n < 0 || n >= node_count || kind < BC_Force || kind > BC_Joint;
+
+            frame->bconditions[i] = (struct BoundaryCondition){ n, (enum BoundaryKind)kind,
+                (struct vec3) { map->bc_x[i], map->bc_y[i], map->bc_z[i] } };
+        }
+    }
+
+    if (invalid)
+    {
+        fprintf(stderr, "Frame Binary Error: node index or boundary condition kind out of range\n");
+
+        // frame_release does not own the boundary conditions
+        free(frame->bconditions);
+        frame->bconditions = NULL;
+        frame_release(frame);
+        return -1;
+    }
+
+    return 0;
+}
+
+int frame_import_binary(const char* path, struct Frame* frame)
+{
+    TRACE_BEGIN("import binary");
+
+    struct FrameMapping map;
+    if (frame_binary_map(path, &map))
+    {
+        TRACE_END();
+        return -1;
+    }
+
+    // Every page is about to be read so start reading ahead of the copy
+    filemap_will_need(&map.file);
+
+    int result = frame_from_mapping(&map, frame);
+
+    frame_binary_unmap(&map);
+
+    TRACE_END();
+    return result;
+}
+
+// Write count 4 byte values gathered by the caller into the section's place in the file
+// padding from the current position (*written bytes) up to the section's offset
+static int write_section(FILE* file, uint64_t* written, uint64_t offset, const void* values, int count)
+{
+    static const char padding[FRAME_BINARY_ALIGN] = { 0 };
+
+    if (fwrite(padding, 1, offset - *written, file) != offset - *written)
+    {
+        return -1;
+    }
+
+    if (count > 0 && fwrite(values, 4, count, file) != (size_t)count)
+    {
+        return -1;
+    }
+
+    *written = offset + (uint64_t)count * 4;
+    return 0;
+}
+
+// A 4 byte value of any section
+union FrameValue
+{
+    float f;
+    int32_t i;
+};
+
+// Copy one property of every node, element or boundary condition into values
+static void gather_section(const struct Frame* frame, enum FrameBinarySection section, union FrameValue* values)
+{
+    const struct Node* nodes = frame->nodes;
+    const struct Element* elements = frame->elements;
+    const struct BoundaryCondition* bcs = frame->bconditions;
+
+    switch (section)
+    {
+    case FRAME_SECTION_NODE_X: for (int i = 0; i < frame->node_count; ++i) values[i].f = nodes[i].pos.x; break;
+    case FRAME_SECTION_NODE_Y: for (int i = 0; i < frame->node_count; ++i) values[i].f = nodes[i].pos.y; break;
+    case FRAME_SECTION_NODE_Z: for (int i = 0; i < frame->node_count; ++i) values[i].f = nodes[i].pos.z; break;
+    case FRAME_SECTION_ELEMENT_NODE1: for (int i = 0; i < frame->element_count; ++i) values[i].i = elements[i].node1; break;
+    case FRAME_SECTION_ELEMENT_NODE2: for (int i = 0; i < frame->element_count; ++i) values[i].i = elements[i].node2; break;
+    case FRAME_SECTION_ELEMENT_ELASTIC_MODULUS: for (int i = 0; i < frame->element_count; ++i) values[i].f = elements[i].elastic_modulus; break;
+    case FRAME_SECTION_ELEMENT_SHEAR_MODULUS: for (int i = 0; i < frame->element_count; ++i) values[i].f = elements[i].shear_modulus; break;
+    case FRAME_SECTION_ELEMENT_RADIUS: for (int i = 0; i < frame->element_count; ++i) values[i].f = elements[i].radius; break;
+    case FRAME_SECTION_BC_NODE: for (int i = 0; i < frame->bc_count; ++i) values[i].i = bcs[i].node; break;
+    case FRAME_SECTION_BC_KIND: for (int i = 0; i < frame->bc_count; ++i) values[i].i = bcs[i].kind; break;
+    case FRAME_SECTION_BC_X: for (int i = 0; i < frame->bc_count; ++i) values[i].f = bcs[i].value.x; break;
+    case FRAME_SECTION_BC_Y: for (int i = 0; i < frame->bc_count; ++i) values[i].f = bcs[i].value.y; break;
+    case FRAME_SECTION_BC_Z: for (int i = 0; i < frame->bc_count; ++i) values[i].f = bcs[i].value.z; break;
+    default: break;
+    }
+}
+
+int frame_export_binary(const struct Frame* frame, const char* path)
+{
+    // Lay out the sections one after another each on an aligned offset
+    struct FrameBinaryHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, FRAME_BINARY_MAGIC, sizeof(header.magic));
+    header.version = FRAME_BINARY_VERSION;
+    header.byte_order = FRAME_BINARY_BYTE_ORDER;
+    header.header_size = sizeof(header);
+    header.node_count = frame->node_count;
+    header.element_count = frame->element_count;
+    header.bc_count = frame->bc_count;
+
+    uint64_t offset = sizeof(header);
+    int largest = 0;
+
+    for (int s = 0; s < FRAME_SECTION_COUNT; ++s)
+    {
+        int length = section_length(&header, s);
+        header.sections[s] = align_offset(offset);
+        offset = header.sections[s] + (uint64_t)length * 4;
+
+        if (length > largest)
+        {
+            largest = length;
+        }
+    }
+
+    header.file_size = offset;
+
+    FILE* file = fopen(path, "wb");
+    if (!file)
+    {
+        fprintf(stderr, "Failed to open file at: %s\n", path);
+        return -1;
+    }
+
+    // Each section is gathered from the frame's structs into one scratch array
+    union FrameValue* scratch = malloc(sizeof(*scratch) * (largest > 0 ? largest : 1));
+
+    uint64_t written = 0;
+    int failed = fwrite(&header, sizeof(header), 1, file) != 1;
+    written = sizeof(header);
+
+    for (int s = 0; s < FRAME_SECTION_COUNT && !failed; ++s)
+    {
+        int length = section_length(&header, s);
+
+        gather_section(frame, s, scratch);
+
+        failed = write_section(file, &written, header.sections[s], scratch, length);
+    }
+
+    free(scratch);
+
+    if (fclose(file) || failed)
+    {
+        fprintf(stderr, "Frame Binary Error: failed to write %s\n", path);
+        return -1;
+    }
+
+    return 0;
+}
+
+int frame_is_binary(const char* path)
+{
+    FILE* file = fopen(path, "rb");
+    if (!file)
+    {
+        return 0;
+    }
+
+    char magic[8];
+    int binary = fread(magic, 1, sizeof(magic), file) == sizeof(magic) &&
+        memcmp(magic, FRAME_BINARY_MAGIC, sizeof(magic)) == 0;
+
+    fclose(file);
+    return binary;
+}
+
+int frame_load(const char* path, struct Frame* frame)
+{
+    if (frame_is_binary(path))
+    {
+        return frame_import_binary(path, frame);
+    }
+
+    return frame_import(path, frame);
+}
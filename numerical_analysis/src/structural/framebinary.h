@@ -0,0 +1,105 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "filemap.h"
+
+struct Frame;
+
+// Binary ".framebin" files hold the same data as ".frame" files laid out so they can be
+// memory mapped and read in place. A fixed header is followed by one array per property
+// (structure of arrays) with every array starting on a FRAME_BINARY_ALIGN byte boundary
+// All values are 4 bytes (int32 or float) in the byte order of the machine that wrote the file
+
+#define FRAME_BINARY_MAGIC "FRAMEBIN"
+#define FRAME_BINARY_VERSION 1
+#define FRAME_BINARY_ALIGN 64
+
+// Written as a native uint32 so a reader on a machine with the other byte order can tell
+#define FRAME_BINARY_BYTE_ORDER 0x01020304u
+
+// Arrays stored in a binary frame file in the order they are written
+enum FrameBinarySection
+{
+    FRAME_SECTION_NODE_X = 0, // float per node
+    FRAME_SECTION_NODE_Y,
+    FRAME_SECTION_NODE_Z,
+    FRAME_SECTION_ELEMENT_NODE1, // int32 per element
+    FRAME_SECTION_ELEMENT_NODE2,
+    FRAME_SECTION_ELEMENT_ELASTIC_MODULUS, // float per element
+    FRAME_SECTION_ELEMENT_SHEAR_MODULUS,
+    FRAME_SECTION_ELEMENT_RADIUS,
+    FRAME_SECTION_BC_NODE, // int32 per boundary condition
+    FRAME_SECTION_BC_KIND, // int32 enum BoundaryKind per boundary condition
+    FRAME_SECTION_BC_X, // float per boundary condition
+    FRAME_SECTION_BC_Y,
+    FRAME_SECTION_BC_Z,
+    FRAME_SECTION_COUNT
+};
+
+struct FrameBinaryHeader
+{
+    char magic[8]; // FRAME_BINARY_MAGIC without the terminating null
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t header_size; // sizeof(struct FrameBinaryHeader) when written
+    int32_t node_count;
+    int32_t element_count;
+    int32_t bc_count;
+    uint64_t file_size;
+
+    // Byte offset of each array from the start of the file
+    uint64_t sections[FRAME_SECTION_COUNT];
+};
+
+// Read only view of a mapped binary frame file. The arrays point straight into the mapping
+// and are valid until frame_binary_unmap
+struct FrameMapping
+{
+    struct FileMap file;
+    const struct FrameBinaryHeader* header;
+
+    int node_count;
+    int element_count;
+    int bc_count;
+
+    const float* node_x;
+    const float* node_y;
+    const float* node_z;
+
+    const int32_t* element_node1;
+    const int32_t* element_node2;
+    const float* element_elastic_modulus;
+    const float* element_shear_modulus;
+    const float* element_radius;
+
+    const int32_t* bc_node;
+    const int32_t* bc_kind;
+    const float* bc_x;
+    const float* bc_y;
+    const float* bc_z;
+};
+
+// Map a binary frame file read only and check its header and array bounds
+// Pages are only read from disk when first touched. Returns 0 on success or -1 on failure
+int frame_binary_map(const char* path, struct FrameMapping* map);
+
+// Unmap a file mapped with frame_binary_map
+void frame_binary_unmap(struct FrameMapping* map);
+
+// Fill a frame from a mapped file. Node and boundary condition indices and boundary kinds are
+// checked while copying. Returns 0 on success or -1 if the data is invalid
+int frame_from_mapping(const struct FrameMapping* map, struct Frame* frame);
+
+// Load a frame from a binary ".framebin" file
+int frame_import_binary(const char* path, struct Frame* frame);
+
+// Write a frame (without results) to a binary ".framebin" file
+// Returns 0 on success or -1 on failure
+int frame_export_binary(const struct Frame* frame, const char* path);
+
+// Returns 1 if the file at path starts with FRAME_BINARY_MAGIC or 0 otherwise
+int frame_is_binary(const char* path);
+
+// Load a frame from either a binary or a text file (see frameimport.h) depending on its contents
+int frame_load(const char* path, struct Frame* frame);
@@ -0,0 +1,633 @@
+#include "framegenerate.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+
+#include "frame.h"
+
+#define DOF 6
+
+static const char* shape_names[FRAME_SHAPE_COUNT] = { "grid2d", "grid3d", "truss", "tower", "bridge" };
+
+// splitmix64 gives the same sequence on every platform unlike rand()
+static uint64_t next_random(uint64_t* state)
+{
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+// Uniform in [-1, 1) from the top 24 bits so the float is exact
+static float random_unit(uint64_t* state)
+{
+    const int32_t bits = (int32_t)(next_random(state) >> 40);
+    return (float)(bits - (1 << 23)) / (float)(1 << 23);
+}
+
+// Elements are added through a builder that only counts them when the frame has no element array
+// so each shape's connectivity is written once for both counting and filling in
+struct ElementBuilder
+{
+    struct Element* elements;
+    int64_t count;
+    struct Element properties;
+};
+
+static inline void add_element(struct ElementBuilder* builder, int64_t node1, int64_t node2)
+{
+    if (builder->elements)
+    {
+        struct Element* element = &builder->elements[builder->count];
+        *element = builder->properties;
+        element->node1 = (int)node1;
+        element->node2 = (int)node2;
+    }
+
+    builder->count++;
+}
+
+// Nodes around the outline of an a by b grid (the ring of a tower level)
+static int64_t ring_length(int a, int b)
+{
+    return 2 * (int64_t)a + 2 * (int64_t)b - 4;
+}
+
+// Grid coordinates of position r around the outline of an a by b grid (counter clockwise from the origin)
+static void ring_position(int a, int b, int64_t r, int* i, int* j)
+{
+    if (r < a)
+    {
+        *i = (int)r;
+        *j = 0;
+    }
+    else if (r < a + b - 1)
+    {
+        *i = a - 1;
+        *j = (int)(r - a + 1);
+    }
+    else if (r < 2 * a + b - 2)
+    {
+        *i = (int)(2 * a + b - 3 - r);
+        *j = b - 1;
+    }
+    else
+    {
+        *i = 0;
+        *j = (int)(ring_length(a, b) - r);
+    }
+}
+
+static void build_grid_elements(const int* size, int diagonals, struct ElementBuilder* builder)
+{
+    const int64_t a = size[0];
+    const int64_t b = size[1];
+    const int64_t c = size[2];
+
+    for (int64_t k = 0; k < c; ++k)
+    {
+        for (int64_t j = 0; j < b; ++j)
+        {
+            for (int64_t i = 0; i < a; ++i)
+            {
+                const int64_t n = i + a * (j + b * k);
+                const int x = i + 1 < a;
+                const int y = j + 1 < b;
+                const int z = k + 1 < c;
+
+                if (x)
+                {
+                    add_element(builder, n, n + 1);
+                }
+
+                if (y)
+                {
+                    add_element(builder, n, n + a);
+                }
+
+                if (z)
+                {
+                    add_element(builder, n, n + a * b);
+                }
+
+                if (!diagonals)
+                {
+                    continue;
+                }
+
+                // One diagonal across the face in each plane and one through the cell
+                if (x && y)
+                {
+                    add_element(builder, n, n + 1 + a);
+                }
+
+                if (x && z)
+                {
+                    add_element(builder, n, n + 1 + a * b);
+                }
+
+                if (y && z)
+                {
+                    add_element(builder, n, n + a + a * b);
+                }
+
+                if (x && y && z)
+                {
+                    add_element(builder, n, n + 1 + a + a * b);
+                }
+            }
+        }
+    }
+}
+
+static void build_tower_elements(const int* size, struct ElementBuilder* builder)
+{
+    const int64_t ring = ring_length(size[0], size[1]);
+
+    for (int64_t k = 0; k < size[2]; ++k)
+    {
+        for (int64_t r = 0; r < ring; ++r)
+        {
+            const int64_t n = r + ring * k;
+            const int64_t next = (r + 1) % ring + ring * k;
+
+            add_element(builder, n, next);
+
+            if (k + 1 < size[2])
+            {
+                add_element(builder, n, n + ring);
+
+                // Bracing alternates direction from level to level
+                if (k % 2 == 0)
+                {
+                    add_element(builder, n, next + ring);
+                }
+                else
+                {
+                    add_element(builder, next, n + ring);
+                }
+            }
+        }
+    }
+}
+
+static void build_bridge_elements(const int* size, struct ElementBuilder* builder)
+{
+    const int64_t a = size[0];
+    const int64_t b = size[1];
+    const int64_t c = size[2];
+
+    // Each level is a grid
+    const int deck[3] = { size[0], size[1], 1 };
+
+    for (int64_t k = 0; k < c; ++k)
+    {
+        struct ElementBuilder level = *builder;
+        level.count = 0;
+
+        if (builder->elements)
+        {
+            level.elements = builder->elements + builder->count;
+        }
+
+        build_grid_elements(deck, 0, &level);
+
+        // Shift the grid's node numbers up to its level
+        if (builder->elements)
+        {
+            for (int64_t e = 0; e < level.count; ++e)
+            {
+                level.elements[e].node1 += (int)(a * b * k);
+                level.elements[e].node2 += (int)(a * b * k);
+            }
+        }
+
+        builder->count += level.count;
+    }
+
+    // Verticals and diagonals between levels with the diagonals sloping down toward mid span
+    for (int64_t k = 0; k + 1 < c; ++k)
+    {
+        for (int64_t j = 0; j < b; ++j)
+        {
+            for (int64_t i = 0; i < a; ++i)
+            {
+                const int64_t n = i + a * (j + b * k);
+                const int64_t up = n + a * b;
+
+                add_element(builder, n, up);
+
+                if (i + 1 < a)
+                {
+                    if (2 * i + 1 < a)
+                    {
+                        add_element(builder, up, n + 1);
+                    }
+                    else
+                    {
+                        add_element(builder, n, up + 1);
+                    }
+                }
+            }
+        }
+    }
+}
+
+static int64_t shape_node_count(const struct FrameGenerateSettings* settings)
+{
+    const int* size = settings->size;
+
+    if (settings->shape == FRAME_SHAPE_GRID2D)
+    {
+        return (int64_t)size[0] * size[1];
+    }
+
+    if (settings->shape == FRAME_SHAPE_TOWER)
+    {
+        return ring_length(size[0], size[1]) * size[2];
+    }
+
+    return (int64_t)size[0] * size[1] * size[2];
+}
+
+static void build_elements(const struct FrameGenerateSettings* settings, struct ElementBuilder* builder)
+{
+    switch (settings->shape)
+    {
+    case FRAME_SHAPE_GRID2D:
+    {
+        const int size[3] = { settings->size[0], settings->size[1], 1 };
+        build_grid_elements(size, 0, builder);
+        break;
+    }
+    case FRAME_SHAPE_GRID3D: build_grid_elements(settings->size, 0, builder); break;
+    case FRAME_SHAPE_TRUSS: build_grid_elements(settings->size, 1, builder); break;
+    case FRAME_SHAPE_TOWER: build_tower_elements(settings->size, builder); break;
+    case FRAME_SHAPE_BRIDGE: build_bridge_elements(settings->size, builder); break;
+    default: break;
+    }
+}
+
+void frame_generate_default_settings(struct FrameGenerateSettings* settings)
+{
+    memset(settings, 0, sizeof(*settings));
+    settings->shape = FRAME_SHAPE_TRUSS;
+    settings->size[0] = 10;
+    settings->size[1] = 10;
+    settings->size[2] = 10;
+    settings->spacing = 1.0f;
+    settings->jitter = 0.0f;
+    settings->elastic_modulus = 200.0f;
+    settings->shear_modulus = 80.0f;
+    settings->radius = 0.01f;
+    settings->loading = FRAME_LOADING_STRUCTURED;
+    settings->load = 1000.0f;
+    settings->random_loads = 0;
+    settings->random_supports = 0;
+    settings->seed = 1;
+}
+
+int frame_parse_shape(const char* name, enum FrameShape* shape)
+{
+    for (int s = 0; s < FRAME_SHAPE_COUNT; ++s)
+    {
+        if (strcmp(name, shape_names[s]) == 0)
+        {
+            *shape = (enum FrameShape)s;
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+const char* frame_shape_name(enum FrameShape shape)
+{
+    return shape >= 0 && shape < FRAME_SHAPE_COUNT ? shape_names[shape] : NULL;
+}
+
+static int round_positive(double value)
+{
+    return value < 1.0 ? 1 : value > INT_MAX ? INT_MAX : (int)(value + 0.5);
+}
+
+int frame_generate_size(struct FrameGenerateSettings* settings, int64_t nodes)
+{
+    int* size = settings->size;
+    const double n = (double)nodes;
+
+    switch (settings->shape)
+    {
+    case FRAME_SHAPE_GRID2D:
+        size[0] = round_positive(sqrt(n));
+        size[1] = round_positive(n / size[0]);
+        size[2] = 1;
+        break;
+    case FRAME_SHAPE_GRID3D:
+    case FRAME_SHAPE_TRUSS:
+        size[0] = round_positive(cbrt(n));
+        size[1] = size[0];
+        size[2] = round_positive(n / ((double)size[0] * size[1]));
+        break;
+    case FRAME_SHAPE_TOWER:
+        // A square outline of side a has 4a - 4 nodes and the tower is 10a levels tall
+        size[0] = round_positive((40.0 + sqrt(1600.0 + 160.0 * n)) / 80.0);
+        size[0] = size[0] < 2 ? 2 : size[0];
+        size[1] = size[0];
+        size[2] = round_positive(n / (double)ring_length(size[0], size[1]));
+        break;
+    case FRAME_SHAPE_BRIDGE:
+        // 10 times longer than wide and as deep as wide (a span 10 times its depth)
+        size[1] = round_positive(cbrt(n / 10.0));
+        size[1] = size[1] < 2 ? 2 : size[1];
+        size[2] = size[1];
+        size[0] = round_positive(n / ((double)size[1] * size[2]));
+        break;
+    default:
+        return -1;
+    }
+
+    int node_count;
+    int element_count;
+    return frame_generate_counts(settings, &node_count, &element_count);
+}
+
+int frame_generate_counts(const struct FrameGenerateSettings* settings, int* node_count, int* element_count)
+{
+    const int* size = settings->size;
+    const int shape = settings->shape;
+
+    int valid = shape >= 0 && shape < FRAME_SHAPE_COUNT && size[0] >= 1 && size[1] >= 1 &&
+        (shape == FRAME_SHAPE_GRID2D || size[2] >= 1);
+
+    if (shape == FRAME_SHAPE_TOWER)
+    {
+        valid = valid && size[0] >= 2 && size[1] >= 2;
+    }
+    else if (shape == FRAME_SHAPE_BRIDGE)
+    {
+        // The span needs a node between the supports to carry the load and supports on a
+        // single line would let it turn about that line
+        valid = valid && size[0] >= 3 && size[1] >= 2;
+    }
+
+    if (!valid)
+    {
+        fprintf(stderr, "Frame Generate Error: size %i x %i x %i is not valid for a %s\n",
+            size[0], size[1], size[2], shape >= 0 && shape < FRAME_SHAPE_COUNT ? shape_names[shape] : "shape");
+        return -1;
+    }
+
+    const int64_t nodes = shape_node_count(settings);
+
+    // Every degree of freedom must be indexable by an int in the solvers
+    if (nodes < 2 || nodes > INT_MAX / DOF)
+    {
+        fprintf(stderr, "Frame Generate Error: %lld nodes is outside of 2 to %i\n", (long long)nodes, INT_MAX / DOF);
+        return -1;
+    }
+
+    struct ElementBuilder builder = { 0 };
+    build_elements(settings, &builder);
+
+    if (builder.count > INT_MAX)
+    {
+        fprintf(stderr, "Frame Generate Error: %lld elements is more than a frame can hold\n", (long long)builder.count);
+        return -1;
+    }
+
+    *node_count = (int)nodes;
+    *element_count = (int)builder.count;
+    return 0;
+}
+
+static void add_condition(struct Frame* frame, int node, enum BoundaryKind kind, struct vec3 value)
+{
+    frame->bconditions[frame->bc_count++] = (struct BoundaryCondition){ node, kind, value };
+}
+
+// Sides of the frame held by supports and carrying the structured loads
+// Returns 1 if node is on the supported side, 2 if it is on the loaded side or 0 otherwise
+static int node_side(const struct FrameGenerateSettings* settings, int64_t n)
+{
+    const int64_t a = settings->size[0];
+    const int64_t b = settings->size[1];
+
+    switch (settings->shape)
+    {
+    case FRAME_SHAPE_GRID2D:
+    {
+        const int64_t j = n / a;
+        return j == 0 ? 1 : j == b - 1 ? 2 : 0;
+    }
+    case FRAME_SHAPE_TOWER:
+    {
+        const int64_t k = n / ring_length(settings->size[0], settings->size[1]);
+        return k == 0 ? 1 : k == settings->size[2] - 1 ? 2 : 0;
+    }
+    case FRAME_SHAPE_BRIDGE:
+    {
+        // Both ends of the bottom level are supported and the rest of it is loaded
+        if (n >= a * b)
+        {
+            return 0;
+        }
+
+        const int64_t i = n % a;
+        return i == 0 || i == a - 1 ? 1 : 2;
+    }
+    default:
+    {
+        const int64_t k = n / (a * b);
+        return k == 0 ? 1 : k == settings->size[2] - 1 ? 2 : 0;
+    }
+    }
+}
+
+// Next node from a random start that has no condition yet. Probing forward keeps the result
+// deterministic and always finds one while any are left
+static int random_free_node(uint64_t* state, const unsigned char* used, int node_count)
+{
+    int n = (int)(next_random(state) % (uint64_t)node_count);
+
+    while (used[n])
+    {
+        n = n + 1 < node_count ? n + 1 : 0;
+    }
+
+    return n;
+}
+
+int frame_generate(const struct FrameGenerateSettings* settings, struct Frame* frame)
+{
+    memset(frame, 0, sizeof(*frame));
+
+    int node_count;
+    int element_count;
+
+    if (frame_generate_counts(settings, &node_count, &element_count))
+    {
+        return -1;
+    }
+
+    uint64_t state = settings->seed;
+
+    frame->node_count = node_count;
+    frame->element_count = element_count;
+    frame->nodes = calloc(node_count, sizeof(*frame->nodes));
+    frame->elements = malloc(sizeof(*frame->elements) * (element_count > 0 ? element_count : 1));
+
+    // Conditions only go on nodes without one so every node needs one flag
+    unsigned char* used = calloc(node_count, sizeof(*used));
+
+    if (!frame->nodes || !frame->elements || !used)
+    {
+        fprintf(stderr, "Frame Generate Error: failed to allocate %i nodes and %i elements\n", node_count, element_count);
+        free(used);
+        frame_release(frame);
+        return -1;
+    }
+
+    const int* size = settings->size;
+    const float spacing = settings->spacing;
+    const float jitter = settings->jitter * spacing;
+
+    for (int64_t n = 0; n < node_count; ++n)
+    {
+        int i;
+        int j;
+        int64_t k;
+
+        if (settings->shape == FRAME_SHAPE_TOWER)
+        {
+            const int64_t ring = ring_length(size[0], size[1]);
+            ring_position(size[0], size[1], n % ring, &i, &j);
+            k = n / ring;
+        }
+        else
+        {
+            i = (int)(n % size[0]);
+            j = (int)(n / size[0] % size[1]);
+            k = n / ((int64_t)size[0] * size[1]);
+        }
+
+        // The offsets are drawn even without jitter so the loads are the same either way
+        struct vec3 offset;
+        offset.x = random_unit(&state) * jitter;
+        offset.y = random_unit(&state) * jitter;
+        offset.z = random_unit(&state) * jitter;
+
+        // 2D grids stay in their plane
+        if (settings->shape == FRAME_SHAPE_GRID2D)
+        {
+            offset.z = 0.0f;
+        }
+
+        frame->nodes[n].pos = (struct vec3){ i * spacing + offset.x, j * spacing + offset.y, (float)k * spacing + offset.z };
+    }
+
+    struct ElementBuilder builder = { frame->elements, 0,
+        { 0, 0, settings->elastic_modulus, settings->shear_modulus, settings->radius } };
+    build_elements(settings, &builder);
+
+    // Count the conditions before placing them. Supports fix displacements (and rotations except
+    // for the pinned ends of a bridge)
+    const int pinned = settings->shape == FRAME_SHAPE_BRIDGE;
+    int supports = 0;
+    int loaded = 0;
+
+    for (int64_t n = 0; n < node_count; ++n)
+    {
+        const int side = node_side(settings, n);
+        supports += side == 1;
+        loaded += side == 2;
+    }
+
+    const int free_nodes = node_count - supports;
+    int random_loads = settings->random_loads > 0 ? settings->random_loads : (node_count + 99) / 100;
+    int random_supports = settings->random_supports;
+
+    if (settings->loading == FRAME_LOADING_RANDOM && (int64_t)random_loads + random_supports > free_nodes)
+    {
+        fprintf(stderr, "Frame Generate Error: %i random loads and supports do not fit on %i free nodes\n",
+            random_loads + random_supports, free_nodes);
+        free(used);
+        frame_release(frame);
+        return -1;
+    }
+
+    int64_t bc_total = (int64_t)supports * (pinned ? 1 : 2) +
+        (settings->loading == FRAME_LOADING_RANDOM ? (int64_t)random_loads + random_supports : loaded);
+
+    frame->bconditions = malloc(sizeof(*frame->bconditions) * (bc_total > 0 ? bc_total : 1));
+
+    if (!frame->bconditions)
+    {
+        fprintf(stderr, "Frame Generate Error: failed to allocate %lld boundary conditions\n", (long long)bc_total);
+        free(used);
+        frame_release(frame);
+        return -1;
+    }
+
+    const struct vec3 zero = { 0.0f, 0.0f, 0.0f };
+
+    // Structured loads push down and half as hard sideways (y is up for 2D grids)
+    const float load = settings->load;
+    const struct vec3 side_load = settings->shape == FRAME_SHAPE_GRID2D ?
+        (struct vec3) { 0.5f * load, -load, 0.0f } : (struct vec3) { 0.5f * load, 0.0f, -load };
+    const struct vec3 deck_load = { 0.0f, 0.0f, -load };
+
+    for (int n = 0; n < node_count; ++n)
+    {
+        const int side = node_side(settings, n);
+
+        if (side == 1)
+        {
+            add_condition(frame, n, BC_Displacement, zero);
+
+            if (!pinned)
+            {
+                add_condition(frame, n, BC_Rotation, zero);
+            }
+
+            used[n] = 1;
+        }
+        else if (side == 2 && settings->loading == FRAME_LOADING_STRUCTURED)
+        {
+            add_condition(frame, n, BC_Force, pinned ? deck_load : side_load);
+        }
+    }
+
+    if (settings->loading == FRAME_LOADING_RANDOM)
+    {
+        for (int s = 0; s < random_supports; ++s)
+        {
+            const int n = random_free_node(&state, used, node_count);
+            add_condition(frame, n, BC_Displacement, zero);
+            used[n] = 1;
+        }
+
+        // A force or moment (one in four) in a random direction on each node. Conditions stay
+        // off supported nodes since a load on a fixed degree of freedom would move it
+        for (int l = 0; l < random_loads; ++l)
+        {
+            const int n = random_free_node(&state, used, node_count);
+            const int moment = next_random(&state) % 4 == 0;
+            const float scale = moment ? load * spacing : load;
+
+            struct vec3 value;
+            value.x = random_unit(&state) * scale;
+            value.y = random_unit(&state) * scale;
+            value.z = random_unit(&state) * scale;
+
+            add_condition(frame, n, moment ? BC_Moment : BC_Force, value);
+            used[n] = 1;
+        }
+    }
+
+    free(used);
+    return 0;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <stdint.h>
+
+struct Frame;
+
+// Synthetic frames of any size for scaling tests and benchmarks
+// A frame is built from its shape, size and seed alone so the same settings always give the same
+// file (the random numbers come from a fixed generator rather than the C library)
+// Every shape is held by supports on one side so the system is never singular, whichever loads
+// are placed on it
+
+enum FrameShape
+{
+    FRAME_SHAPE_GRID2D = 0, // size x by size y nodes in the xy plane with members along x and y
+    FRAME_SHAPE_GRID3D, // size x by size y by size z nodes with members along x, y and z
+    FRAME_SHAPE_TRUSS, // 3D grid with a diagonal across every face direction and through every cell
+    FRAME_SHAPE_TOWER, // size z levels of the outline of a size x by size y grid braced on each face
+    FRAME_SHAPE_BRIDGE, // size z levels of size x by size y nodes (span along x) with verticals and
+                        // diagonals between them, pinned at both ends of the bottom level
+    FRAME_SHAPE_COUNT
+};
+
+enum FrameLoading
+{
+    FRAME_LOADING_STRUCTURED = 0, // The same load on every node of the side opposite the supports
+    FRAME_LOADING_RANDOM // Forces and moments at random nodes and extra supports at random nodes
+};
+
+struct FrameGenerateSettings
+{
+    enum FrameShape shape;
+    int size[3]; // Nodes along x, y and z (see FrameShape for what each means per shape)
+
+    float spacing; // Distance between neighboring nodes (meters)
+    float jitter; // Nodes are moved up to this fraction of spacing in each direction at random
+
+    // Properties given to every element
+    float elastic_modulus; // GPa
+    float shear_modulus; // GPa
+    float radius; // meters
+
+    enum FrameLoading loading;
+    float load; // Size of each force (newtons). Moments are load times spacing (newton meters)
+    int random_loads; // Loads placed with FRAME_LOADING_RANDOM (0 for one per 100 nodes)
+    int random_supports; // Extra fixed nodes placed with FRAME_LOADING_RANDOM
+
+    uint64_t seed;
+};
+
+// A 10 by 10 by 10 truss of the same members as the sample models with structured loads and seed 1
+void frame_generate_default_settings(struct FrameGenerateSettings* settings);
+
+// Convert a shape name ("grid2d", "grid3d", "truss", "tower" or "bridge")
+// Returns 0 on success or -1 if the name is not recognized
+int frame_parse_shape(const char* name, enum FrameShape* shape);
+
+// Name of a shape as accepted by frame_parse_shape or NULL if the shape is not valid
+const char* frame_shape_name(enum FrameShape shape);
+
+// Pick a size for settings->shape with about the given number of nodes keeping the shape's
+// usual proportions (cubes for grids, a tower 10 times taller than wide, a bridge 10 times
+// longer than wide or deep). Returns 0 on success or -1 if the count is too small or too large
+int frame_generate_size(struct FrameGenerateSettings* settings, int64_t nodes);
+
+// Number of nodes and elements a frame with these settings has
+// Returns 0 on success or -1 if the size is invalid for the shape or too large for a frame
+int frame_generate_counts(const struct FrameGenerateSettings* settings, int* node_count, int* element_count);
+
+// Build a frame from settings. The frame owns its boundary conditions (free them separately as
+// for imported frames). Returns 0 on success or -1 on failure
+int frame_generate(const struct FrameGenerateSettings* settings, struct Frame* frame);
@@ -2,188 +2,772 @@
 
 #include <stdlib.h>
 #include <stdio.h>
-#include <unistd.h>
+#include <stdint.h>
 #include <string.h>
+#include <limits.h>
+#include <float.h>
 
+#include <omp.h>
+
+#include "filemap.h"
 #include "filepath.h"
 #include "frame.h"
+#include "trace.h"
 
-int frame_import(const char* filename, struct Frame* frame)
+int frame_parse_boundary_kind(const char* name, enum BoundaryKind* kind)
 {
-    // Get the full filepath looking for a file (or filepath) relative to repo/models/
-    //char* path = get_full_filepath(filename, "models/");
+    if (strcmp(name, "force") == 0)
+    {
+        *kind = BC_Force;
+    }
+    else if (strcmp(name, "displacement") == 0)
+    {
+        *kind = BC_Displacement;
+    }
+    else if (strcmp(name, "moment") == 0)
+    {
+        *kind = BC_Moment;
+    }
+    else if (strcmp(name, "rotation") == 0)
+    {
+        *kind = BC_Rotation;
+    }
+    else if (strcmp(name, "joint") == 0)
+    {
+        *kind = BC_Joint;
+    }
+    else
+    {
+        return -1;
+    }
 
-    // Typical file handling
-    FILE* file = fopen(filename, "r");
+    return 0;
+}
 
-    // Free the path string regardless of success 
-    //free(path);
+const char* frame_boundary_kind_name(enum BoundaryKind kind)
+{
+    switch (kind)
+    {
+    case BC_Force: return "force";
+    case BC_Displacement: return "displacement";
+    case BC_Moment: return "moment";
+    case BC_Rotation: return "rotation";
+    case BC_Joint: return "joint";
+    default: return NULL;
+    }
+}
 
+int frame_export(const struct Frame* frame, const char* path)
+{
+    FILE* file = fopen(path, "w");
     if (!file)
     {
-        fprintf(stderr, "Failed to open file at: %s\n", filename);
+        fprintf(stderr, "Failed to open file at: %s\n", path);
         return -1;
     }
 
-    // Variables to store data when reading commands
-    char buffer[256];
-    int count = 0;
-    int check;
+    // Large frames write hundreds of megabytes so use a bigger buffer than the default
+    setvbuf(file, NULL, _IOFBF, 1 << 20);
+
+    int failed = 0;
 
-    // Continuously read from the file until the end or an unrecognized command
-    while (1)
+    fprintf(file, "nodes %i\n", frame->node_count);
+
+    for (int n = 0; n < frame->node_count; ++n)
     {
-        // Start by attempting to read a command into buffer as well as an integer count
-        // if the incorrect format or end of file is encountered, break the loop
-        check = fscanf(file, "%s %i", buffer, &count);
-        if (check != 2)
+        const struct vec3 pos = frame->nodes[n].pos;
+        fprintf(file, "%i %.9g %.9g %.9g\n", n, pos.x, pos.y, pos.z);
+    }
+
+    fprintf(file, "\nelements %i\n", frame->element_count);
+
+    for (int e = 0; e < frame->element_count; ++e)
+    {
+        const struct Element* element = &frame->elements[e];
+        fprintf(file, "%i %i %.9g %.9g %.9g\n", element->node1, element->node2,
+            element->elastic_modulus, element->shear_modulus, element->radius);
+    }
+
+    fprintf(file, "\nboundary_conditions %i\n", frame->bc_count);
+
+    for (int b = 0; b < frame->bc_count && !failed; ++b)
+    {
+        const struct BoundaryCondition* bc = &frame->bconditions[b];
+        const char* kind = frame_boundary_kind_name(bc->kind);
+
+        if (!kind)
         {
+            fprintf(stderr, "Frame Export Error: boundary condition %i has an invalid kind\n", b);
+            failed = 1;
             break;
         }
 
-        //printf("%s %i\n", buffer, count);
+        fprintf(file, "%i %.9g %.9g %.9g %s\n", bc->node, bc->value.x, bc->value.y, bc->value.z, kind);
+    }
+
+    if (fclose(file) || failed)
+    {
+        fprintf(stderr, "Frame Export Error: failed to write %s\n", path);
+        return -1;
+    }
+
+    return 0;
+}
+
+// Ranges smaller than this are not worth a thread of their own
+#define IMPORT_MIN_BYTES 65536
+
+// Longest number handed to strtof when the fast path can not round it exactly
+#define IMPORT_MAX_TOKEN 64
+
+// Powers of ten that are exact in double precision
+static const double exact_powers_of_ten[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static inline int is_space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+static inline int is_digit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+static inline int is_letter(char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+// Find the end of the line starting at p (the newline or end of text)
+static inline size_t line_end(const char* text, size_t p, size_t length)
+{
+    const char* newline = memchr(text + p, '\n', length - p);
+    return newline ? (size_t)(newline - text) : length;
+}
+
+// Skip spaces (not newlines) and return the first position that is not one
+static inline const char* skip_spaces(const char* p, const char* end)
+{
+    while (p < end && is_space(*p))
+    {
+        p++;
+    }
+
+    return p;
+}
+
+// Parse a decimal integer after any spaces and advance *p past it. Returns 0 on success
+static inline int parse_int(const char** p, const char* end, int* value)
+{
+    const char* c = skip_spaces(*p, end);
+
+    int negative = c < end && *c == '-';
+    if (c < end && (*c == '-' || *c == '+'))
+    {
+        c++;
+    }
+
+    if (c == end || !is_digit(*c))
+    {
+        return -1;
+    }
+
+    long long result = 0;
+    while (c < end && is_digit(*c))
+    {
+        result = result * 10 + (*c - '0');
+        if (result > INT_MAX)
+        {
+            return -1;
+        }
+
+        c++;
+    }
+
+    // The number must end at a field boundary
+    if (c < end && !is_space(*c))
+    {
+        return -1;
+    }
+
+    *value = (int)(negative ? -result : result);
+    *p = c;
+    return 0;
+}
+
+// Parse a float after any spaces and advance *p past it. Returns 0 on success
+// Numbers with at most 15 significant digits and a small exponent are converted exactly with
+// one double precision multiply or divide (both operands are exact so the result is correctly
+// rounded). That double rounds to the same float as the decimal unless it lies exactly halfway
+// between two floats. Those and any other numbers (long, huge, tiny, inf, nan) use strtof
+static inline int parse_float(const char** p, const char* end, float* value)
+{
+    const char* c = skip_spaces(*p, end);
+    const char* token = c;
+
+    int negative = c < end && *c == '-';
+    if (c < end && (*c == '-' || *c == '+'))
+    {
+        c++;
+    }
 
-        // Check the contents of buffer to see if it matches a valid command
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int significant = 0;
+    int exponent = 0;
 
-        if (strcmp(buffer, "nodes") == 0)
+    while (c < end && is_digit(*c))
+    {
+        if (significant < 19)
         {
-            // Allocate space to hold as many nodes as the count parameter
-            frame->node_count = count;
-            frame->nodes = malloc(sizeof(*frame->nodes) * frame->node_count);
+            mantissa = mantissa * 10 + (uint64_t)(*c - '0');
+            significant += mantissa != 0;
+        }
+        else
+        {
+            exponent++;
+            significant++;
+        }
 
-            // Scan as many times as specified by count
-            for (int i = 0; i < count; ++i)
+        digits++;
+        c++;
+    }
+
+    if (c < end && *c == '.')
+    {
+        c++;
+
+        while (c < end && is_digit(*c))
+        {
+            if (significant < 19)
             {
-                int n;
-                float x;
-                float y;
-                float z;
+                mantissa = mantissa * 10 + (uint64_t)(*c - '0');
+                significant += mantissa != 0;
+                exponent--;
+            }
 
-                // Read a line for each node to get the node index and position vector
-                if (fscanf(file, "%i %f %f %f", &n, &x, &y, &z) != 4)
-                {
-                    fprintf(stderr, "Frame Import Error: Invalid node format\n");
-                    break;
-                }
+            digits++;
+            c++;
+        }
+    }
 
-                //printf("%i, %f, %f, %f\n", n, x, y, z);
+    if (digits > 0 && c < end && (*c == 'e' || *c == 'E'))
+    {
+        c++;
+
+        int exponent_negative = c < end && *c == '-';
+        if (c < end && (*c == '-' || *c == '+'))
+        {
+            c++;
+        }
 
-                // Initialize a node with the values that were read
-                frame->nodes[i] = (struct Node){ (struct vec3) { x, y, z } };
+        if (c == end || !is_digit(*c))
+        {
+            return -1;
+        }
+
+        int e = 0;
+        while (c < end && is_digit(*c))
+        {
+            if (e < 10000)
+            {
+                e = e * 10 + (*c - '0');
             }
+
+            c++;
+        }
+
+        exponent += exponent_negative ? -e : e;
+    }
+
+    int fast = digits > 0 && (c == end || is_space(*c)) && significant <= 15 &&
+        exponent >= -22 && exponent <= 22;
+
+    if (fast)
+    {
+        double result = (double)mantissa;
+        result = exponent < 0 ? result / exact_powers_of_ten[-exponent] : result * exact_powers_of_ten[exponent];
+
+        uint64_t bits;
+        memcpy(&bits, &result, sizeof(bits));
+
+        // Halfway between floats (the 29 bits a float drops are exactly one half) or outside
+        // of the normal float range
+        if ((bits & 0x1FFFFFFFu) == 0x10000000u || (result != 0.0 && (result < FLT_MIN || result > FLT_MAX)))
+        {
+            fast = 0;
+        }
+        else
+        {
+            *value = (float)(negative ? -result : result);
+        }
+    }
+
+    if (!fast)
+    {
+        // Copy the field so strtof can not read past the end of the text
+        const char* field_end = token;
+        while (field_end < end && !is_space(*field_end))
+        {
+            field_end++;
         }
-        else if (strcmp(buffer, "elements") == 0)
+
+        char buffer[IMPORT_MAX_TOKEN];
+        size_t field_length = (size_t)(field_end - token);
+
+        if (field_length == 0 || field_length >= sizeof(buffer))
+        {
+            return -1;
+        }
+
+        memcpy(buffer, token, field_length);
+        buffer[field_length] = '\0';
+
+        char* parsed_end;
+        *value = strtof(buffer, &parsed_end);
+
+        if (parsed_end != buffer + field_length)
+        {
+            return -1;
+        }
+
+        c = field_end;
+    }
+
+    *p = c;
+    return 0;
+}
+
+// Parse a word of letters and underscores after any spaces into buffer (size bytes)
+// Returns 0 on success
+static inline int parse_word(const char** p, const char* end, char* buffer, size_t size)
+{
+    const char* c = skip_spaces(*p, end);
+    size_t length = 0;
+
+    while (c < end && !is_space(*c))
+    {
+        if (length + 1 >= size)
         {
-            // Allocate space to hold as many elements as the count parameter
-            frame->element_count = count;
-            frame->elements = malloc(sizeof(*frame->elements) * frame->element_count);
+            return -1;
+        }
+
+        buffer[length++] = *c++;
+    }
+
+    buffer[length] = '\0';
+    *p = c;
+    return length > 0 ? 0 : -1;
+}
+
+// Returns 1 if nothing but spaces remain
+static inline int at_end(const char* p, const char* end)
+{
+    return skip_spaces(p, end) == end;
+}
 
-            // Scan as many times as specified by count
-            for (int i = 0; i < count; ++i)
+// Parse a section command ("nodes 34"). Returns 0 on success
+static int parse_command(const char* line, const char* end, struct ImportHeader* header)
+{
+    char name[32];
+    const char* p = line;
+
+    if (parse_word(&p, end, name, sizeof(name)) || parse_int(&p, end, &header->count) || !at_end(p, end))
+    {
+        fprintf(stderr, "Frame Import Error: Invalid command format\n");
+        return -1;
+    }
+
+    if (strcmp(name, "nodes") == 0)
+    {
+        header->section = SECTION_NODES;
+    }
+    else if (strcmp(name, "elements") == 0)
+    {
+        header->section = SECTION_ELEMENTS;
+    }
+    else if (strcmp(name, "boundary_conditions") == 0)
+    {
+        header->section = SECTION_BCONDITIONS;
+    }
+    else
+    {
+        fprintf(stderr, "Frame Import Error: unrecognized command: %s\n", name);
+        return -1;
+    }
+
+    return 0;
+}
+
+// Parse one data line of a section into the frame at the given index. Returns 0 on success
+static int parse_data_line(struct Frame* frame, int section, int index, const char* line, const char* end)
+{
+    const char* p = line;
+
+    if (section == SECTION_NODES)
+    {
+        // The node number at the start of the line is not checked (some models skip numbers)
+        int n;
+        float x;
+        float y;
+        float z;
+
+        if (parse_int(&p, end, &n) || parse_float(&p, end, &x) || parse_float(&p, end, &y) ||
+            parse_float(&p, end, &z) || !at_end(p, end))
+        {
+            fprintf(stderr, "Frame Import Error: Invalid node format for node %i\n", index);
+            return -1;
+        }
+
+        frame->nodes[index] = (struct Node){ (struct vec3) { x, y, z } };
+    }
+    else if (section == SECTION_ELEMENTS)
+    {
+        int n1;
+        int n2;
+        float elastic_modulus;
+        float shear_modulus;
+        float radius;
+
+        if (parse_int(&p, end, &n1) || parse_int(&p, end, &n2) || parse_float(&p, end, &elastic_modulus) ||
+            parse_float(&p, end, &shear_modulus) || parse_float(&p, end, &radius) || !at_end(p, end))
+        {
+            fprintf(stderr, "Frame Import Error : Invalid element format for element %i\n", index);
+            return -1;
+        }
+
+        if (n1 < 0 || n1 >= frame->node_count || n2 < 0 || n2 >= frame->node_count)
+        {
+            fprintf(stderr, "Frame Import Error: element %i uses a node outside of the frame\n", index);
+            return -1;
+        }
+
+        frame->elements[index] = (struct Element){ n1, n2, elastic_modulus, shear_modulus, radius };
+    }
+    else
+    {
+        int n;
+        float x;
+        float y;
+        float z;
+        char name[32];
+
+        if (parse_int(&p, end, &n) || parse_float(&p, end, &x) || parse_float(&p, end, &y) ||
+            parse_float(&p, end, &z) || parse_word(&p, end, name, sizeof(name)) || !at_end(p, end))
+        {
+            fprintf(stderr, "Frame Import Error: Invalid boundary condition format for condition %i\n", index);
+            return -1;
+        }
+
+        if (n < 0 || n >= frame->node_count)
+        {
+            fprintf(stderr, "Frame Import Error: boundary condition %i uses a node outside of the frame\n", index);
+            return -1;
+        }
+
+        enum BoundaryKind kind;
+        if (frame_parse_boundary_kind(name, &kind))
+        {
+            fprintf(stderr, "Frame Import Error: unknown boundary condition type: %s\n", name);
+            return -1;
+        }
+
+        frame->bconditions[index] = (struct BoundaryCondition){ n, kind, (struct vec3) { x, y, z } };
+    }
+
+    return 0;
+}
+
+size_t frame_line_start(const char* text, size_t length, size_t position)
+{
+    if (position == 0 || position >= length)
+    {
+        return position < length ? position : length;
+    }
+
+    // A line starts at position only if the previous character ends a line
+    size_t end = line_end(text, position - 1, length);
+    return end < length ? end + 1 : length;
+}
+
+void frame_index_lines(const char* text, size_t length, size_t first, size_t end, struct ImportIndex* index)
+{
+    // Section commands start with a letter and everything else that is not blank is data
+    for (size_t p = first; p < end && p < length; )
+    {
+        size_t stop = line_end(text, p, length);
+        const char* start = skip_spaces(text + p, text + stop);
+
+        if (start < text + stop && is_letter(*start))
+        {
+            struct ImportHeader header;
+
+            if (parse_command(start, text + stop, &header))
+            {
+                index->error = 1;
+            }
+            else
             {
-                int n1;
-                int n2;
-                float elastic_modulus;
-                float shear_modulus;
-                float radius;
-
-                // Read a line for each node to get the stat and end node indices and material properties
-                if (fscanf(file, "%i %i %f %f %f", &n1, &n2, &elastic_modulus, &shear_modulus, &radius) != 5)
+                if (index->header_count == index->header_capacity)
                 {
-                    fprintf(stderr, "Frame Import Error : Invalid element format for element %i\n", i);
-                    break;
+                    index->header_capacity = index->header_capacity > 0 ? 2 * index->header_capacity : 4;
+                    index->headers = realloc(index->headers, sizeof(*index->headers) * index->header_capacity);
                 }
 
-                //printf("%i, %i, %f, %f, %f\n", n1, n2, elastic_modulus, shear_modulus, radius);
+                header.position = index->data_lines;
+                index->headers[index->header_count++] = header;
+            }
+        }
+        else if (start < text + stop)
+        {
+            index->data_lines++;
+        }
+
+        p = stop + 1;
+    }
+}
+
+int frame_prepare_sections(struct Frame* frame, const struct ImportHeader* headers, int header_count,
+    int total_lines, int report)
+{
+    int error = 0;
+    int section_counts[SECTION_COUNT] = { 0 };
+    int section_seen[SECTION_COUNT] = { 0 };
+
+    if (header_count == 0 && total_lines > 0)
+    {
+        if (report)
+        {
+            fprintf(stderr, "Frame Import Error: data before the first section command\n");
+        }
 
-                // Initialize an element with the values that were read
-                frame->elements[i] = (struct Element){ n1, n2, elastic_modulus, shear_modulus, radius };
+        error = 1;
+    }
+
+    for (int h = 0; h < header_count; ++h)
+    {
+        int section = headers[h].section;
+
+        if (h == 0 && headers[h].position != 0)
+        {
+            if (report)
+            {
+                fprintf(stderr, "Frame Import Error: data before the first section command\n");
             }
+
+            error = 1;
         }
-        else if (strcmp(buffer, "boundary_conditions") == 0)
+
+        if (section < 0 || section >= SECTION_COUNT || section_seen[section] || headers[h].count < 0)
         {
-            // Allocate space to hold as many boundary conditions as the count parameter
-            frame->bc_count = count;
-            frame->bconditions = malloc(sizeof(*frame->bconditions) * frame->bc_count);
+            if (report)
+            {
+                fprintf(stderr, "Frame Import Error: Invalid command format\n");
+            }
+
+            error = 1;
+            continue;
+        }
+
+        section_seen[section] = 1;
+        section_counts[section] = headers[h].count;
 
-            // Scan as many times as specified by count
-            for (int i = 0; i < count; ++i)
+        // Each section's data lines must fill exactly the lines before the next section
+        int next = h + 1 < header_count ? headers[h + 1].position : total_lines;
+        if (next - headers[h].position != headers[h].count)
+        {
+            if (report)
             {
-                int n;
-                float x;
-                float y;
-                float z;
-
-                // Read a line for each boundary condition to get the node index it applies to
-                // a vector value and a string corresponding to the property type
-                if (fscanf(file, "%i %f %f %f %s", &n, &x, &y, &z, buffer) != 5)
-                {
-                    fprintf(stderr, "Frame Import Error: Invalid boundary condition format\n");
-                    break;
-                }
+                fprintf(stderr, "Frame Import Error: section has %i lines but expected %i\n",
+                    next - headers[h].position, headers[h].count);
+            }
 
-                // Determine the boundary condition kind by comparing the string in the buffer
-                enum BoundaryKind boundary_kind;
+            error = 1;
+        }
+    }
 
-                if (strcmp(buffer, "force") == 0)
-                {
-                    boundary_kind = BC_Force;
-                }
-                else if (strcmp(buffer, "displacement") == 0)
-                {
-                    boundary_kind = BC_Displacement;
-                }
-                else if (strcmp(buffer, "moment") == 0)
-                {
-                    boundary_kind = BC_Moment;
-                }
-                else if (strcmp(buffer, "rotation") == 0)
-                {
-                    boundary_kind = BC_Rotation;
-                }
-                else if (strcmp(buffer, "joint") == 0)
-                {
-                    boundary_kind = BC_Joint;
-                }
-                else
-                {
-                    fprintf(stderr, "Frame Import Error: unknown boundary condition type: %s\n", buffer);
-                    break;
-                }
+    frame->node_count = section_counts[SECTION_NODES];
+    frame->element_count = section_counts[SECTION_ELEMENTS];
+    frame->bc_count = section_counts[SECTION_BCONDITIONS];
+    frame->nodes = calloc(frame->node_count > 0 ? frame->node_count : 1, sizeof(*frame->nodes));
+    frame->elements = calloc(frame->element_count > 0 ? frame->element_count : 1, sizeof(*frame->elements));
+    frame->bconditions = calloc(frame->bc_count > 0 ? frame->bc_count : 1, sizeof(*frame->bconditions));
+
+    return error ? -1 : 0;
+}
+
+int frame_parse_lines(struct Frame* frame, const char* text, size_t length, size_t first, size_t end,
+    const struct ImportHeader* headers, int header_count, int line, int* ranges)
+{
+    if (ranges)
+    {
+        for (int section = 0; section < SECTION_COUNT; ++section)
+        {
+            ranges[2 * section] = -1;
+            ranges[2 * section + 1] = 0;
+        }
+    }
 
-                // Initialize a boundary condition with the values that were read
-                frame->bconditions[i] = (struct BoundaryCondition){ n, boundary_kind, (struct vec3) { x, y, z } };
+    int current = -1;
 
-                //printf("%i, %f, %f, %f, %s\n", n, x, y, z, buffer);
+    for (size_t p = first; p < end && p < length; )
+    {
+        size_t stop = line_end(text, p, length);
+        const char* start = skip_spaces(text + p, text + stop);
+
+        if (start < text + stop && !is_letter(*start))
+        {
+            // The section holding this line is the last one starting at or before it
+            while (current + 1 < header_count && headers[current + 1].position <= line)
+            {
+                current++;
+            }
 
-                /* printf("%i, %f, %f, %f, %s, %i\n", n,
-                    frame->bconditions[i].value.x,
-                    frame->bconditions[i].value.y,
-                    frame->bconditions[i].value.z,
-                    buffer,
-                    boundary_kind
-                ); */
+            if (current < 0 || line - headers[current].position >= headers[current].count)
+            {
+                fprintf(stderr, "Frame Import Error: Invalid command format\n");
+                return -1;
             }
+
+            const int section = headers[current].section;
+            const int index = line - headers[current].position;
+
+            if (parse_data_line(frame, section, index, start, text + stop))
+            {
+                return -1;
+            }
+
+            if (ranges)
+            {
+                if (ranges[2 * section] == -1)
+                {
+                    ranges[2 * section] = index;
+                }
+
+                ranges[2 * section + 1]++;
+            }
+
+            line++;
         }
-        else
+
+        p = stop + 1;
+    }
+
+    return 0;
+}
+
+int frame_import(const char* filename, struct Frame* frame)
+{
+    TRACE_BEGIN("import");
+
+    // Map the whole file instead of reading it through a stream so every thread
+    // can parse its own part in place
+    struct FileMap file;
+    if (filemap_open(filename, &file))
+    {
+        fprintf(stderr, "Failed to open file at: %s\n", filename);
+        TRACE_END();
+        return -1;
+    }
+
+    filemap_will_need(&file);
+
+    const char* text = file.data;
+    const size_t length = file.size;
+
+    // Split the file into a range of bytes per thread. Each range handles the lines that start in it
+    int ranges = omp_get_max_threads();
+    if ((size_t)ranges > length / IMPORT_MIN_BYTES + 1)
+    {
+        ranges = (int)(length / IMPORT_MIN_BYTES + 1);
+    }
+
+    size_t* bounds = malloc(sizeof(*bounds) * (ranges + 1));
+    struct ImportIndex* indices = calloc(ranges, sizeof(*indices));
+    int* line_offsets = malloc(sizeof(*line_offsets) * ranges);
+
+    #pragma omp parallel for schedule(static)
+    for (int r = 0; r <= ranges; ++r)
+    {
+        bounds[r] = frame_line_start(text, length, length / ranges * r + length % ranges * r / ranges);
+    }
+
+    // Index pass
+    TRACE_BEGIN("import index");
+
+    #pragma omp parallel for schedule(static)
+    for (int r = 0; r < ranges; ++r)
+    {
+        frame_index_lines(text, length, bounds[r], bounds[r + 1], &indices[r]);
+    }
+
+    TRACE_END();
+
+    // Every range's first data line follows the data lines of the ranges before it
+    int error = 0;
+    int total_lines = 0;
+    int header_count = 0;
+
+    for (int r = 0; r < ranges; ++r)
+    {
+        line_offsets[r] = total_lines;
+        total_lines += indices[r].data_lines;
+        header_count += indices[r].header_count;
+        error |= indices[r].error;
+    }
+
+    struct ImportHeader* headers = malloc(sizeof(*headers) * (header_count > 0 ? header_count : 1));
+    header_count = 0;
+
+    for (int r = 0; r < ranges; ++r)
+    {
+        for (int h = 0; h < indices[r].header_count; ++h)
         {
-            fprintf(stderr, "Frame Import Error: unrecognized command: %s\n", buffer);
-            break;
+            headers[header_count] = indices[r].headers[h];
+            headers[header_count].position += line_offsets[r];
+            header_count++;
         }
+
+        free(indices[r].headers);
     }
 
+    error |= frame_prepare_sections(frame, headers, header_count, total_lines, 1) != 0;
+
+    // Parse pass
+    if (!error)
+    {
+        TRACE_BEGIN("import parse");
+
+        #pragma omp parallel for schedule(static) reduction(|:error)
+        for (int r = 0; r < ranges; ++r)
+        {
+            error |= frame_parse_lines(frame, text, length, bounds[r], bounds[r + 1],
+                headers, header_count, line_offsets[r], NULL) != 0;
+        }
 
-    // Close the file before returning regardless of whether the file was parsed correctly
-    fclose(file);
+        TRACE_END();
+    }
 
-    // Return success if the end of the file was reached without incident
-    if (check != EOF)
+    free(headers);
+    free(line_offsets);
+    free(indices);
+    free(bounds);
+    filemap_close(&file);
+
+    if (error)
     {
-        fprintf(stderr, "Frame Import Error: Invalid command format\n");
+        // frame_release does not free the boundary conditions
+        free(frame->bconditions);
+        frame->bconditions = NULL;
+        frame_release(frame);
+        TRACE_END();
         return -1;
     }
 
-    //printf("End of File\n\n");
+    TRACE_END();
     return 0;
 }
 
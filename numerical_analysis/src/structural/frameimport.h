@@ -1,10 +1,78 @@
 #pragma once
 
-struct Frame;
+#include <stddef.h>
+
+#include "frame.h"
 
 // Load a frame from a ".frame" file
+// The file is mapped and parsed by a team of threads (set with OMP_NUM_THREADS)
+// Expects one command or entry per line (as the model files are written)
 int frame_import(const char* path, struct Frame* frame);
 
+// Convert the name of a boundary condition kind used in ".frame" files ("force", "moment", etc.)
+// Returns 0 on success or -1 if the name is not recognized
+int frame_parse_boundary_kind(const char* name, enum BoundaryKind* kind);
+
+// Name of a boundary condition kind as used in ".frame" files or NULL if the kind is not valid
+const char* frame_boundary_kind_name(enum BoundaryKind kind);
+
+// Write a frame (without results) to a ".frame" text file with enough digits to read back every
+// float exactly. Returns 0 on success or -1 on failure
+int frame_export(const struct Frame* frame, const char* path);
+
 // Constructs a frame with hardcoded values for testing
 // generally best to import from a file instead
-void frame_create_sample(struct Frame* frame);
\ No newline at end of file
+void frame_create_sample(struct Frame* frame);
+
+// The text importers (frame_import with threads and frame_import_mpi with processes) split a file
+// into byte ranges that each handle the lines starting in them. A cheap first pass finds the
+// section commands and counts data lines in every range. Once every range knows the global index
+// of its first data line a second pass parses its lines straight into place
+
+// Sections of a ".frame" file
+enum ImportSection
+{
+    SECTION_NODES = 0,
+    SECTION_ELEMENTS,
+    SECTION_BCONDITIONS,
+    SECTION_COUNT
+};
+
+// A section command ("nodes 34") and the index of the first data line after it
+// counting data lines across the whole file
+struct ImportHeader
+{
+    int section;
+    int count;
+    int position;
+};
+
+// Result of the first pass over one range. Zero initialize before use and free headers after
+// Header positions count data lines from the start of the range
+struct ImportIndex
+{
+    struct ImportHeader* headers;
+    int header_count;
+    int header_capacity;
+    int data_lines;
+    int error;
+};
+
+// Start of the first line starting at or after position in text (length bytes)
+size_t frame_line_start(const char* text, size_t length, size_t position);
+
+// First pass over the lines starting in [first, end) of text (length bytes)
+void frame_index_lines(const char* text, size_t length, size_t first, size_t end, struct ImportIndex* index);
+
+// Check the section commands of a whole file (in file order with global positions) against the
+// total number of data lines and allocate the frame's arrays. Errors are printed if report is set
+// Returns 0 on success or -1 if a section repeats or has the wrong number of lines
+int frame_prepare_sections(struct Frame* frame, const struct ImportHeader* headers, int header_count,
+    int total_lines, int report);
+
+// Second pass over the lines starting in [first, end) of text (length bytes). line is the global
+// index of the range's first data line. ranges (may be NULL) receives the first entry and number
+// of entries parsed in each section (2 * SECTION_COUNT values, first is -1 if there are none)
+// Node indices are checked against the frame's node count. Returns 0 on success
+int frame_parse_lines(struct Frame* frame, const char* text, size_t length, size_t first, size_t end,
+    const struct ImportHeader* headers, int header_count, int line, int* ranges);
\ No newline at end of file
@@ -0,0 +1,899 @@
+#include "framempi.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "frame.h"
+#include "frameimport.h"
+#include "frameschwarz.h"
+#include "frameprocess.h"
+#include "distribute.h"
+#include "halo.h"
+#include "linsolvempi.h"
+#include "permutation.h"
+#include "schwarz.h"
+#include "mpiutility.h"
+#include "trace.h"
+
+#ifndef ENABLE_MPI
+#define ENABLE_MPI 0
+#endif
+
+#if ENABLE_MPI
+#include <mpi.h>
+#endif
+
+// Degrees of freedom (3 translation and 3 rotation)
+#define DOF 6
+
+// Values in a 6x6 block sent between processes
+#define BLOCK_VALUES 36
+
+// Bytes read at a time past the end of a process' part of a file looking for the end of its last line
+#define IMPORT_LOOKAHEAD 4096
+
+// Largest read in one call since MPI counts are int
+#define IMPORT_READ_CHUNK (1 << 30)
+
+#if ENABLE_MPI
+
+static int compare_ints(const void* a, const void* b)
+{
+    int left = *(const int*)a;
+    int right = *(const int*)b;
+    return (left > right) - (left < right);
+}
+
+// Binary search a sorted array
+static int find_sorted(const int* values, int count, int value)
+{
+    int low = 0;
+    int high = count - 1;
+
+    while (low <= high)
+    {
+        int mid = (low + high) / 2;
+
+        if (values[mid] < value)
+        {
+            low = mid + 1;
+        }
+        else if (values[mid] > value)
+        {
+            high = mid - 1;
+        }
+        else
+        {
+            return mid;
+        }
+    }
+
+    return -1;
+}
+
+// Sparsity of the owned rows by node. The block columns (neighbor nodes including itself)
+// of local node n are block_cols[block_offsets[n]] to block_cols[block_offsets[n + 1] - 1] sorted
+struct LocalPattern
+{
+    int* block_offsets;
+    int* block_cols;
+    int node_start;
+    int node_count;
+};
+
+// Add a 6x6 block at (row_node, col_node) into the local rows
+static void add_local_block(const struct LocalPattern* pattern, struct SparseMatrix* matrix, int row_node, int col_node, const float* block)
+{
+    int local = row_node - pattern->node_start;
+    int first = pattern->block_offsets[local];
+    int count = pattern->block_offsets[local + 1] - first;
+
+    int p = find_sorted(pattern->block_cols + first, count, col_node);
+
+    for (int j = 0; j < DOF; ++j)
+    {
+        float* row = matrix->values + matrix->row_offsets[local * DOF + j] + DOF * p;
+
+        for (int i = 0; i < DOF; ++i)
+        {
+            row[i] += block[i + j * DOF];
+        }
+    }
+}
+
+#endif
+
+int frame_build_distributed(struct Frame* frame, const struct RowDistribution* node_dist, struct DistributedSystem* system, float** stiffness_values)
+{
+#if ENABLE_MPI == 0
+    fprintf(stderr, "Warning: Attempting to use MPI functionality with MPI disabled\n");
+    return -1;
+#else
+
+    const int rank = get_rank_mpi();
+    const int procs = get_procs_mpi();
+    const int node_count = frame->node_count;
+
+    if (node_dist && (node_dist->procs != procs || node_dist->row_starts[procs] != node_count))
+    {
+        fprintf(stderr, "Error building distributed equations: node distribution does not match the processes and frame\n");
+        return -1;
+    }
+
+    TRACE_BEGIN("assembly");
+
+    // Every process reads the same frame so the ownership can be computed redundantly
+    // without communication. The work of a node is its number of connections
+    int* connections = calloc(node_count + 1, sizeof(*connections));
+
+    for (int i = 0; i < frame->element_count; ++i)
+    {
+        int n1 = frame->elements[i].node1;
+        int n2 = frame->elements[i].node2;
+
+        if (n1 < 0 || n1 >= node_count || n2 < 0 || n2 >= node_count)
+        {
+            fprintf(stderr, "Error building distributed equations: element %i references node outside of 0 to %i\n", i, node_count - 1);
+            free(connections);
+            TRACE_END();
+            return -1;
+        }
+
+        connections[n1 + 1]++;
+        connections[n2 + 1]++;
+    }
+
+    for (int n = 0; n < node_count; ++n)
+    {
+        connections[n + 1] += connections[n];
+    }
+
+    // Work on a copy of the node blocks so both cases are released the same way
+    struct RowDistribution owned_nodes;
+
+    if (node_dist)
+    {
+        owned_nodes.procs = procs;
+        owned_nodes.row_starts = malloc(sizeof(*owned_nodes.row_starts) * (procs + 1));
+
+        for (int r = 0; r <= procs; ++r)
+        {
+            owned_nodes.row_starts[r] = node_dist->row_starts[r];
+        }
+    }
+    else
+    {
+        rowdist_balance(&owned_nodes, connections, node_count, procs);
+    }
+
+    free(connections);
+
+    // Rows follow nodes
+    system->dist.procs = procs;
+    system->dist.row_starts = malloc(sizeof(*system->dist.row_starts) * (procs + 1));
+
+    for (int r = 0; r <= procs; ++r)
+    {
+        system->dist.row_starts[r] = DOF * owned_nodes.row_starts[r];
+    }
+
+    const int node_start = owned_nodes.row_starts[rank];
+    const int node_end = owned_nodes.row_starts[rank + 1];
+    const int local_nodes = node_end - node_start;
+
+    system->global_rows = DOF * node_count;
+    system->row_start = DOF * node_start;
+
+    // Build the block sparsity of the owned nodes from every element touching them
+    struct LocalPattern pattern;
+    pattern.node_start = node_start;
+    pattern.node_count = local_nodes;
+    pattern.block_offsets = calloc(local_nodes + 1, sizeof(*pattern.block_offsets));
+
+    // Every node is coupled to itself
+    for (int n = 0; n < local_nodes; ++n)
+    {
+        pattern.block_offsets[n + 1] = 1;
+    }
+
+    for (int i = 0; i < frame->element_count; ++i)
+    {
+        int n1 = frame->elements[i].node1;
+        int n2 = frame->elements[i].node2;
+
+        if (n1 >= node_start && n1 < node_end)
+        {
+            pattern.block_offsets[n1 - node_start + 1]++;
+        }
+
+        if (n2 >= node_start && n2 < node_end)
+        {
+            pattern.block_offsets[n2 - node_start + 1]++;
+        }
+    }
+
+    for (int n = 0; n < local_nodes; ++n)
+    {
+        pattern.block_offsets[n + 1] += pattern.block_offsets[n];
+    }
+
+    int total_blocks = pattern.block_offsets[local_nodes];
+    pattern.block_cols = malloc(sizeof(*pattern.block_cols) * (total_blocks > 0 ? total_blocks : 1));
+
+    int* cursor = malloc(sizeof(*cursor) * (local_nodes > 0 ? local_nodes : 1));
+    for (int n = 0; n < local_nodes; ++n)
+    {
+        cursor[n] = pattern.block_offsets[n];
+        pattern.block_cols[cursor[n]++] = node_start + n;
+    }
+
+    for (int i = 0; i < frame->element_count; ++i)
+    {
+        int n1 = frame->elements[i].node1;
+        int n2 = frame->elements[i].node2;
+
+        if (n1 >= node_start && n1 < node_end)
+        {
+            pattern.block_cols[cursor[n1 - node_start]++] = n2;
+        }
+
+        if (n2 >= node_start && n2 < node_end)
+        {
+            pattern.block_cols[cursor[n2 - node_start]++] = n1;
+        }
+    }
+
+    // Sort each node's blocks and remove duplicates compacting in place
+    int write = 0;
+    for (int n = 0; n < local_nodes; ++n)
+    {
+        int first = pattern.block_offsets[n];
+        int last = pattern.block_offsets[n + 1];
+        int start = write;
+
+        qsort(pattern.block_cols + first, last - first, sizeof(*pattern.block_cols), compare_ints);
+
+        for (int b = first; b < last; ++b)
+        {
+            if (write == start || pattern.block_cols[write - 1] != pattern.block_cols[b])
+            {
+                pattern.block_cols[write++] = pattern.block_cols[b];
+            }
+        }
+
+        pattern.block_offsets[n] = start;
+    }
+
+    pattern.block_offsets[local_nodes] = write;
+    free(cursor);
+
+    // Expand the block pattern into scalar rows. Every row of a node has 6 columns per block
+    struct SparseMatrix* matrix = &system->matrix;
+    sparse_init(matrix, DOF * local_nodes, system->global_rows, DOF * DOF * write);
+
+    for (int n = 0; n < local_nodes; ++n)
+    {
+        int blocks = pattern.block_offsets[n + 1] - pattern.block_offsets[n];
+
+        for (int j = 0; j < DOF; ++j)
+        {
+            int row = n * DOF + j;
+            matrix->row_offsets[row + 1] = matrix->row_offsets[row] + DOF * blocks;
+
+            for (int b = 0; b < blocks; ++b)
+            {
+                int col_node = pattern.block_cols[pattern.block_offsets[n] + b];
+
+                for (int i = 0; i < DOF; ++i)
+                {
+                    matrix->columns[matrix->row_offsets[row] + DOF * b + i] = DOF * col_node + i;
+                    matrix->values[matrix->row_offsets[row] + DOF * b + i] = 0.0f;
+                }
+            }
+        }
+    }
+
+    // Each element is assembled once by the owner of its first node. The blocks for the
+    // second node's rows belong to another process when the second node is not owned
+    // so they are collected and sent to that process
+    int* send_counts = calloc(procs, sizeof(*send_counts));
+
+    for (int i = 0; i < frame->element_count; ++i)
+    {
+        int n1 = frame->elements[i].node1;
+        int n2 = frame->elements[i].node2;
+
+        if (n1 >= node_start && n1 < node_end && !(n2 >= node_start && n2 < node_end))
+        {
+            send_counts[rowdist_owner(&owned_nodes, n2)] += 2;
+        }
+    }
+
+    int* send_displs = malloc(sizeof(*send_displs) * procs);
+    int send_total = 0;
+    for (int r = 0; r < procs; ++r)
+    {
+        send_displs[r] = send_total;
+        send_total += send_counts[r];
+    }
+
+    // Blocks to send are described by their (row node, column node) and 36 values
+    int* send_nodes = malloc(sizeof(*send_nodes) * 2 * (send_total > 0 ? send_total : 1));
+    float* send_values = malloc(sizeof(*send_values) * BLOCK_VALUES * (send_total > 0 ? send_total : 1));
+    int* fill = malloc(sizeof(*fill) * procs);
+
+    for (int r = 0; r < procs; ++r)
+    {
+        fill[r] = send_displs[r];
+    }
+
+    for (int i = 0; i < frame->element_count; ++i)
+    {
+        int n1 = frame->elements[i].node1;
+        int n2 = frame->elements[i].node2;
+
+        if (!(n1 >= node_start && n1 < node_end))
+        {
+            continue;
+        }
+
+        struct mat6 k_element[4];
+        build_element_stiffness(frame, frame->elements[i], k_element);
+
+        add_local_block(&pattern, matrix, n1, n1, k_element[0].elements);
+        add_local_block(&pattern, matrix, n1, n2, k_element[1].elements);
+
+        if (n2 >= node_start && n2 < node_end)
+        {
+            add_local_block(&pattern, matrix, n2, n1, k_element[2].elements);
+            add_local_block(&pattern, matrix, n2, n2, k_element[3].elements);
+        }
+        else
+        {
+            int owner = rowdist_owner(&owned_nodes, n2);
+
+            for (int q = 2; q < 4; ++q)
+            {
+                int slot = fill[owner]++;
+
+                send_nodes[2 * slot] = n2;
+                send_nodes[2 * slot + 1] = q == 2 ? n1 : n2;
+
+                for (int v = 0; v < BLOCK_VALUES; ++v)
+                {
+                    send_values[BLOCK_VALUES * slot + v] = k_element[q].elements[v];
+                }
+            }
+        }
+    }
+
+    // Exchange the off process contributions. Only processes sharing nodes send anything
+    int* recv_counts = malloc(sizeof(*recv_counts) * procs);
+    MPI_Alltoall(send_counts, 1, MPI_INT, recv_counts, 1, MPI_INT, MPI_COMM_WORLD);
+
+    int* recv_displs = malloc(sizeof(*recv_displs) * procs);
+    int recv_total = 0;
+    for (int r = 0; r < procs; ++r)
+    {
+        recv_displs[r] = recv_total;
+        recv_total += recv_counts[r];
+    }
+
+    int* recv_nodes = malloc(sizeof(*recv_nodes) * 2 * (recv_total > 0 ? recv_total : 1));
+    float* recv_values = malloc(sizeof(*recv_values) * BLOCK_VALUES * (recv_total > 0 ? recv_total : 1));
+
+    // Counts are in blocks so scale them for the node pairs and values
+    for (int r = 0; r < procs; ++r)
+    {
+        send_counts[r] *= 2;
+        send_displs[r] *= 2;
+        recv_counts[r] *= 2;
+        recv_displs[r] *= 2;
+    }
+
+    MPI_Alltoallv(send_nodes, send_counts, send_displs, MPI_INT,
+        recv_nodes, recv_counts, recv_displs, MPI_INT, MPI_COMM_WORLD);
+
+    for (int r = 0; r < procs; ++r)
+    {
+        send_counts[r] = send_counts[r] / 2 * BLOCK_VALUES;
+        send_displs[r] = send_displs[r] / 2 * BLOCK_VALUES;
+        recv_counts[r] = recv_counts[r] / 2 * BLOCK_VALUES;
+        recv_displs[r] = recv_displs[r] / 2 * BLOCK_VALUES;
+    }
+
+    MPI_Alltoallv(send_values, send_counts, send_displs, MPI_FLOAT,
+        recv_values, recv_counts, recv_displs, MPI_FLOAT, MPI_COMM_WORLD);
+
+    for (int b = 0; b < recv_total; ++b)
+    {
+        add_local_block(&pattern, matrix, recv_nodes[2 * b], recv_nodes[2 * b + 1], recv_values + BLOCK_VALUES * b);
+    }
+
+    free(recv_values);
+    free(recv_nodes);
+    free(recv_displs);
+    free(recv_counts);
+    free(fill);
+    free(send_values);
+    free(send_nodes);
+    free(send_displs);
+    free(send_counts);
+    free(pattern.block_cols);
+    free(pattern.block_offsets);
+    rowdist_release(&owned_nodes);
+
+    // Keep the values before boundary conditions if requested
+    if (stiffness_values)
+    {
+        *stiffness_values = malloc(sizeof(**stiffness_values) * (matrix->nnz > 0 ? matrix->nnz : 1));
+
+        for (int k = 0; k < matrix->nnz; ++k)
+        {
+            (*stiffness_values)[k] = matrix->values[k];
+        }
+    }
+
+    // Apply boundary conditions the same way as apply_boundary_conditions in frame.c
+    // Eliminated degrees of freedom have their row and column set to zero with 1 on the diagonal
+    // The fixed degrees of freedom are kept as a sorted list so memory scales with the conditions
+    TRACE_BEGIN("boundary conditions");
+
+    int* fixed = malloc(sizeof(*fixed) * DOF * (frame->bc_count > 0 ? frame->bc_count : 1));
+    int fixed_count = 0;
+
+    system->forces = calloc(matrix->rows > 0 ? matrix->rows : 1, sizeof(*system->forces));
+
+    for (int n = 0; n < frame->bc_count; ++n)
+    {
+        const struct BoundaryCondition* bc = &frame->bconditions[n];
+        const float values[3] = { bc->value.x, bc->value.y, bc->value.z };
+        const int owned = bc->node >= node_start && bc->node < node_end;
+
+        if (bc->kind == BC_Displacement || bc->kind == BC_Rotation)
+        {
+            if (values[0] != 0.f || values[1] != 0.f || values[2] != 0.f)
+            {
+                if (rank == get_main_mpi())
+                {
+                    printf("Warning: Non-homogeneous boundary conditions applied: (%f, %f, %f\n", values[0], values[1], values[2]);
+                }
+
+                continue;
+            }
+
+            int first = bc->kind == BC_Displacement ? 0 : 3;
+            for (int i = 0; i < 3; ++i)
+            {
+                fixed[fixed_count++] = DOF * bc->node + first + i;
+            }
+        }
+        else if ((bc->kind == BC_Force || bc->kind == BC_Moment) && owned)
+        {
+            // Set known boundary forces and moments
+            int first = bc->kind == BC_Force ? 0 : 3;
+            for (int i = 0; i < 3; ++i)
+            {
+                system->forces[DOF * (bc->node - node_start) + first + i] = values[i];
+            }
+        }
+    }
+
+    qsort(fixed, fixed_count, sizeof(*fixed), compare_ints);
+
+    for (int j = 0; j < matrix->rows; ++j)
+    {
+        const int row = system->row_start + j;
+        const int row_fixed = find_sorted(fixed, fixed_count, row) != -1;
+
+        for (int k = matrix->row_offsets[j]; k < matrix->row_offsets[j + 1]; ++k)
+        {
+            const int col = matrix->columns[k];
+
+            if (row_fixed)
+            {
+                matrix->values[k] = col == row ? 1.0f : 0.0f;
+            }
+            else if (find_sorted(fixed, fixed_count, col) != -1)
+            {
+                matrix->values[k] = 0.0f;
+            }
+        }
+    }
+
+    free(fixed);
+
+    TRACE_END();
+    TRACE_END();
+    return 0;
+
+#endif
+}
+
+int frame_solve_mpi(struct Frame* frame, const struct RowDistribution* node_dist, const struct MpiSolveSettings* settings,
+    int* converged)
+{
+#if ENABLE_MPI == 0
+    fprintf(stderr, "Warning: Attempting to use MPI functionality with MPI disabled\n");
+    return -1;
+#else
+
+    const int rank = get_rank_mpi();
+    const int root = get_main_mpi();
+
+    struct DistributedSystem system;
+    float* stiffness_values = NULL;
+
+    if (frame_build_distributed(frame, node_dist, &system, &stiffness_values))
+    {
+        return -1;
+    }
+
+    // Renumbers the columns to local vector indices (the saved values share the same layout)
+    struct HaloExchange halo;
+    halo_create(&system, &halo);
+
+    const int rows = system.matrix.rows;
+    float* x = malloc(sizeof(*x) * (rows + halo.ghost_count + 1));
+    int completed = 0;
+
+    if (settings->method == MPI_SOLVE_CG)
+    {
+        // Subdomains come from the frame so the preconditioner can overlap other processes' nodes
+        TRACE_BEGIN("preconditioner setup");
+
+        struct SchwarzPreconditioner precond;
+        int have_precond = !frame_schwarz_create(frame, &system.dist, &halo, system.row_start / DOF, rows / DOF,
+            &system.matrix, &settings->schwarz, settings->threads, &precond);
+
+        TRACE_END();
+
+        if (!have_precond && rank == root)
+        {
+            fprintf(stderr, "Warning: Failed to build Schwarz preconditioner. Scaling by the diagonal instead\n");
+        }
+
+        completed = solve_system_cg_mpi(&system, &halo, x, have_precond ? &precond : NULL, settings, converged);
+
+        if (have_precond)
+        {
+            schwarz_release(&precond);
+        }
+    }
+    else if (settings->method == MPI_SOLVE_SOR)
+    {
+        // Every process has the whole frame so they all see the same unassigned nodes
+        struct Permutation perm;
+        int uncolored = frame_order_by_color(frame, system.row_start / DOF, rows / DOF, DOF, &perm);
+
+        if (uncolored > 0)
+        {
+            if (rank == root)
+            {
+                fprintf(stderr, "Error solving with multicolor SOR: %i nodes have no color (see frame_assign_multicolor)\n", uncolored);
+            }
+
+            completed = -1;
+        }
+        else
+        {
+            completed = solve_system_sor_mpi(&system, &halo, x, &perm, settings, converged);
+        }
+
+        permutation_release(&perm);
+    }
+    else
+    {
+        completed = solve_system_mpi(&system, &halo, x, settings, converged);
+    }
+
+    // Every process gets the same result so they all skip the results together
+    if (completed < 0)
+    {
+        free(x);
+        free(stiffness_values);
+        halo_release(&halo);
+        distributed_release(&system);
+        return -1;
+    }
+
+    // Back calculate forces with the stiffness before boundary conditions F = KU
+    // The solve leaves the ghosts up to date so this only needs local data
+    TRACE_BEGIN("results");
+
+    struct SparseMatrix stiffness = system.matrix;
+    stiffness.values = stiffness_values;
+
+    float* forces = malloc(sizeof(*forces) * (rows > 0 ? rows : 1));
+    sparse_premultiply(forces, &stiffness, x);
+
+    // Collect the results on the main process
+    float* all_forces = NULL;
+    float* all_displacements = NULL;
+
+    if (rank == root)
+    {
+        all_forces = malloc(sizeof(*all_forces) * system.global_rows);
+        all_displacements = malloc(sizeof(*all_displacements) * system.global_rows);
+    }
+
+    distributed_gather(&system, forces, all_forces);
+    distributed_gather(&system, x, all_displacements);
+
+    if (rank == root)
+    {
+        frame_set_results(frame, all_forces, all_displacements);
+    }
+
+    TRACE_END();
+
+    free(all_displacements);
+    free(all_forces);
+    free(forces);
+    free(x);
+    free(stiffness_values);
+    halo_release(&halo);
+    distributed_release(&system);
+
+    return completed;
+
+#endif
+}
+
+
+#if ENABLE_MPI
+
+// Read bytes from offset in chunks small enough for an int count
+// Returns the number of bytes read which is less than bytes only at the end of the file
+static MPI_Offset read_at_chunked(MPI_File file, MPI_Offset offset, char* buffer, MPI_Offset bytes)
+{
+    MPI_Offset done = 0;
+
+    while (done < bytes)
+    {
+        const int chunk = (int)(bytes - done < IMPORT_READ_CHUNK ? bytes - done : IMPORT_READ_CHUNK);
+
+        MPI_Status status;
+        int count = 0;
+        MPI_File_read_at(file, offset + done, buffer + done, chunk, MPI_CHAR, &status);
+        MPI_Get_count(&status, MPI_CHAR, &count);
+
+        if (count <= 0)
+        {
+            break;
+        }
+
+        done += count;
+    }
+
+    return done;
+}
+
+// Read the part of the file owned by this process. Processes own the lines that start in
+// their equal share of the bytes. The byte before the share is read to tell whether the
+// first line starts in the share and bytes past the end are read until the last line ends
+// Returns the buffer (null terminated) and sets first and own_end to the range of line starts
+static char* read_file_share(MPI_File file, MPI_Offset size, int rank, int procs, size_t* first, size_t* own_end, size_t* length)
+{
+    const MPI_Offset start = size * rank / procs;
+    const MPI_Offset end = size * (rank + 1) / procs;
+    const MPI_Offset read_start = start > 0 ? start - 1 : 0;
+
+    MPI_Offset capacity = end - read_start + IMPORT_LOOKAHEAD;
+    char* buffer = malloc((size_t)capacity + 1);
+
+    MPI_Offset count = read_at_chunked(file, read_start, buffer, end - read_start);
+
+    // The last owned line ends at the first newline at or after the last owned byte
+    MPI_Offset search = end - read_start - 1;
+    if (search < 0)
+    {
+        search = 0;
+    }
+
+    while (read_start + count < size)
+    {
+        while (search < count && buffer[search] != '\n')
+        {
+            search++;
+        }
+
+        if (search < count)
+        {
+            break;
+        }
+
+        if (count + IMPORT_LOOKAHEAD > capacity)
+        {
+            capacity *= 2;
+            buffer = realloc(buffer, (size_t)capacity + 1);
+        }
+
+        MPI_Offset more = read_at_chunked(file, read_start + count, buffer + count, IMPORT_LOOKAHEAD);
+
+        if (more <= 0)
+        {
+            break;
+        }
+
+        count += more;
+    }
+
+    buffer[count] = '\0';
+
+    // Skip the end of a line started by the previous process
+    MPI_Offset p = 0;
+    if (start > 0)
+    {
+        while (p < count && buffer[p] != '\n')
+        {
+            p++;
+        }
+
+        p++;
+    }
+
+    *first = (size_t)p;
+    *own_end = (size_t)(end - read_start);
+    *length = (size_t)count;
+
+    return buffer;
+}
+
+#endif
+
+int frame_import_mpi(const char* path, struct Frame* frame)
+{
+#if ENABLE_MPI == 0
+    fprintf(stderr, "Warning: Attempting to use MPI functionality with MPI disabled\n");
+    return -1;
+#else
+
+    TRACE_BEGIN("import");
+
+    const int rank = get_rank_mpi();
+    const int procs = get_procs_mpi();
+
+    // Every process opens the file and reads an equal share of the bytes so the
+    // parsing is split between them. A cheap first pass over each share finds the
+    // section commands and counts data lines. Sharing those between processes tells
+    // each process which entries its lines are without having seen the earlier parts
+    // of the file. The second pass parses the lines straight into place
+    MPI_File file;
+    if (MPI_File_open(MPI_COMM_WORLD, path, MPI_MODE_RDONLY, MPI_INFO_NULL, &file) != MPI_SUCCESS)
+    {
+        if (rank == get_main_mpi())
+        {
+            fprintf(stderr, "Failed to open file at: %s\n", path);
+        }
+
+        TRACE_END();
+        return -1;
+    }
+
+    MPI_Offset size;
+    MPI_File_get_size(file, &size);
+
+    size_t first;
+    size_t own_end;
+    size_t length;
+    char* buffer = read_file_share(file, size, rank, procs, &first, &own_end, &length);
+
+    MPI_File_close(&file);
+
+    // Index pass
+    struct ImportIndex index = { 0 };
+    frame_index_lines(buffer, length, first, own_end, &index);
+
+    int error = index.error;
+    int data_lines = index.data_lines;
+    struct ImportHeader* local_headers = index.headers;
+    int local_header_count = index.header_count;
+
+    // Global index of this process' first data line
+    int data_offset = 0;
+    MPI_Exscan(&data_lines, &data_offset, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    if (rank == 0)
+    {
+        data_offset = 0;
+    }
+
+    int total_lines = 0;
+    MPI_Allreduce(&data_lines, &total_lines, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+
+    for (int h = 0; h < local_header_count; ++h)
+    {
+        local_headers[h].position += data_offset;
+    }
+
+    // Every process gets every header in file order (there are only a few)
+    int* header_counts = malloc(sizeof(*header_counts) * procs);
+    int* header_displs = malloc(sizeof(*header_displs) * procs);
+    int local_ints = 3 * local_header_count;
+
+    MPI_Allgather(&local_ints, 1, MPI_INT, header_counts, 1, MPI_INT, MPI_COMM_WORLD);
+
+    int total_ints = 0;
+    for (int r = 0; r < procs; ++r)
+    {
+        header_displs[r] = total_ints;
+        total_ints += header_counts[r];
+    }
+
+    struct ImportHeader* headers = malloc(sizeof(*headers) * (total_ints / 3 + 1));
+    MPI_Allgatherv(local_headers, local_ints, MPI_INT, headers, header_counts, header_displs, MPI_INT, MPI_COMM_WORLD);
+
+    const int header_count = total_ints / 3;
+
+    free(header_displs);
+    free(header_counts);
+    free(local_headers);
+
+    // Allocate the whole frame on every process
+    if (frame_prepare_sections(frame, headers, header_count, total_lines, rank == get_main_mpi()))
+    {
+        error = 1;
+    }
+
+    // Parse pass. Each process fills a contiguous range of each section
+    int ranges[2 * SECTION_COUNT];
+    if (!error && frame_parse_lines(frame, buffer, length, first, own_end, headers, header_count, data_offset, ranges))
+    {
+        error = 1;
+    }
+
+    free(buffer);
+    free(headers);
+
+    // Every process must agree before exchanging entries
+    MPI_Allreduce(MPI_IN_PLACE, &error, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+
+    if (!error)
+    {
+        // Collect every process' entries so each process has the whole frame
+        // (the distributed assembly and partitioner need the full connectivity)
+        int* all_ranges = malloc(sizeof(*all_ranges) * 2 * SECTION_COUNT * procs);
+        MPI_Allgather(ranges, 2 * SECTION_COUNT, MPI_INT, all_ranges, 2 * SECTION_COUNT, MPI_INT, MPI_COMM_WORLD);
+
+        int* counts = malloc(sizeof(*counts) * procs);
+        int* displs = malloc(sizeof(*displs) * procs);
+
+        void* arrays[SECTION_COUNT] = { frame->nodes, frame->elements, frame->bconditions };
+        const int sizes[SECTION_COUNT] = { sizeof(*frame->nodes), sizeof(*frame->elements), sizeof(*frame->bconditions) };
+
+        for (int section = 0; section < SECTION_COUNT; ++section)
+        {
+            // Counts and displacements are in entries rather than bytes so they stay
+            // within an int for as many entries as a frame can hold
+            MPI_Datatype entry;
+            MPI_Type_contiguous(sizes[section], MPI_BYTE, &entry);
+            MPI_Type_commit(&entry);
+
+            for (int r = 0; r < procs; ++r)
+            {
+                int start = all_ranges[2 * SECTION_COUNT * r + 2 * section];
+                counts[r] = all_ranges[2 * SECTION_COUNT * r + 2 * section + 1];
+                displs[r] = start > 0 ? start : 0;
+            }
+
+            MPI_Allgatherv(MPI_IN_PLACE, 0, MPI_DATATYPE_NULL, arrays[section], counts, displs, entry, MPI_COMM_WORLD);
+            MPI_Type_free(&entry);
+        }
+
+        free(displs);
+        free(counts);
+        free(all_ranges);
+
+        TRACE_END();
+        return 0;
+    }
+
+    free(frame->bconditions);
+    frame->bconditions = NULL;
+    frame_release(frame);
+    TRACE_END();
+    return -1;
+
+#endif
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+struct Frame;
+struct DistributedSystem;
+struct RowDistribution;
+struct MpiSolveSettings;
+
+// Collective. Load a ".frame" file on every process using MPI-IO. Each process reads and parses
+// an equal share of the file after a quick pass to find where each share's lines belong, then
+// the parsed entries are shared so every process ends up with the whole frame
+// Expects one command or entry per line (as the model files are written)
+int frame_import_mpi(const char* path, struct Frame* frame);
+
+// Collective. Every process builds only the rows of the equations for the nodes it owns
+// The frame must be loaded on every process. Processes own the contiguous blocks of nodes
+// given by node_dist (such as from frame_partition) or blocks balanced by the number of
+// connections if node_dist is NULL. Each element is assembled by the owner of its
+// first node with contributions to rows owned by other processes sent to them
+// If stiffness_values is not NULL it receives the stored values before boundary conditions
+// are applied (same sparsity as system->matrix) for back calculating forces
+int frame_build_distributed(struct Frame* frame, const struct RowDistribution* node_dist, struct DistributedSystem* system, float** stiffness_values);
+
+// Collective. Build, solve and back calculate forces for a frame loaded on every process
+// The per node results are only filled in on the main process. node_dist is as above
+// Multicolor SOR (settings->method) uses the node colors from frame_assign_multicolor
+// which must be assigned the same way on every process. Conjugate gradients is preconditioned
+// with additive Schwarz using settings->schwarz (see frameschwarz.h)
+// converged (may be NULL) is set to 1 if the solve reached settings->tolerance
+// Returns the number of iterations run or -1 on failure (including a residual norm that is not
+// finite) in which case no results are filled in
+int frame_solve_mpi(struct Frame* frame, const struct RowDistribution* node_dist, const struct MpiSolveSettings* settings,
+    int* converged);
@@ -1,253 +1,282 @@
 #include "frameprocess.h"
 
+#include <stdlib.h>
+#include <stdio.h>
+
 #include "frame.h"
+#include "nodegraph.h"
+#include "partition.h"
+#include "distribute.h"
+#include "trace.h"
 
 
-void print_neighbors(const int* neighbors, int node, int max_neighbors)
+void frame_assign_multicolor(struct Frame* frame, enum ColoringMethod method, int balance, struct ColoringStats* stats)
 {
-    printf("Neighbor List for N%i: ", node);
+    //Typical Red-Black method does not work for FEM meshes without some preprocessing
+
+    // The goal is to assign each node a "color" such that no element has the
+    // same color at both nodes after doing this all the nodes with the same 
+    // color are decoupled from nodes of other colors and can be processed 
+    // separately by multiple processes/threads after sorting the rows by color
+
+    // The frame stores the graph as a list of edges each having a start and end point
+    // which does not give an easy way to check the neighbors of a node so the first step
+    // is to build the adjacency (see nodegraph.h)
+    TRACE_BEGIN("coloring");
 
-    for (int p = 0; p < max_neighbors; ++p)
+    struct NodeGraph graph;
+    if (nodegraph_build(frame, &graph))
     {
-        int neighbor = neighbors[p + node * max_neighbors];
-        if (neighbor != -1)
-        {
-            printf("%i ", neighbor);
-        }
+        fprintf(stderr, "Error assigning multicolor: Failed to build node graph\n");
+        TRACE_END();
+        return;
     }
 
-    printf("\n");
-}
+    int* colors = malloc(sizeof(*colors) * (frame->node_count > 0 ? frame->node_count : 1));
+    int num_colors = 0;
 
-void print_neighbor_colors(const int* neighbors, const struct Node* nodes, int node, int max_neighbors)
-{
-    printf("Neighbor Colors for N%i: ", node);
+    // See coloring.h for the trade offs between methods
+    switch (method)
+    {
+    case COLORING_DSATUR:
+        num_colors = color_dsatur(&graph, colors);
+        break;
+    case COLORING_PARALLEL:
+        num_colors = color_jones_plassmann(&graph, colors, 0);
+        break;
+    case COLORING_GREEDY:
+    default:
+        num_colors = color_greedy(&graph, colors);
+        break;
+    }
 
-    for (int p = 0; p < max_neighbors; ++p)
+    // Even out the color sizes so per color parallel sweeps have similar work for every color
+    if (balance)
     {
-        int neighbor = neighbors[p + node * max_neighbors];
-        if (neighbor != -1)
-        {
-            printf("%i ", nodes[neighbor].multicolor);
-        }
+        color_balance(&graph, colors, num_colors);
+    }
+
+    if (stats)
+    {
+        coloring_stats(colors, frame->node_count, stats);
+    }
+
+    // Node colors start at 1 so 0 can mean unassigned
+    for (int i = 0; i < frame->node_count; ++i)
+    {
+        frame->nodes[i].multicolor = colors[i] + 1;
     }
 
-    printf("\n");
+    free(colors);
+    nodegraph_release(&graph);
+
+    TRACE_END();
 }
 
 
-void frame_assign_multicolor(struct Frame* frame)
+int frame_order_by_color(const struct Frame* frame, int node_start, int node_count, int dof, struct Permutation* perm)
 {
-    //Typical Red-Black method does not work for FEM meshes without some preprocessing
-
-    // The goal is to assign each node a "color" such that no element has the
-    // same color at both nodes after doing this all the nodes with the same 
-    // color are decoupled from nodes of other colors and can be processed 
-    // separately by multiple processes/threads after sorting the rows by color
+    // Rather than copying rows of the matrix into a new matrix ordered by color
+    // build a permutation that lists the rows by color. Solvers visit the rows
+    // through the permutation so the matrix is never duplicated and the cost is
+    // a counting sort over the nodes
+
+    // Colors start at 1 (0 means unassigned but is still given a group)
+    // The whole frame is checked so every process numbers the groups the same
+    int num_colors = 0;
+    int uncolored = 0;
+    for (int n = 0; n < frame->node_count; ++n)
+    {
+        if (frame->nodes[n].multicolor > num_colors)
+        {
+            num_colors = frame->nodes[n].multicolor;
+        }
 
-    // At the moment the graph is stored as a list of edges each having a start
-    // and end point. this is not an easy representation use since for a given
-    // node we do not have an easy way to check its neighbors so the first step
-    // is to build a data structure that allows checking neighbors
+        uncolored += frame->nodes[n].multicolor == 0;
+    }
 
-    // Simple Adjancency list with fixed size
-    const int max_neighbors = 8;
-    int degree = 0;
+    permutation_init(perm, dof * node_count);
+    perm->block_size = dof;
+    perm->group_count = num_colors + 1;
+    perm->group_offsets = calloc(perm->group_count + 1, sizeof(*perm->group_offsets));
 
-    int neighbors_count = frame->node_count * max_neighbors;
-    int* neighbors = malloc(sizeof(*neighbors) * neighbors_count);
+    // Count rows of each color then turn the counts into offsets
+    for (int n = 0; n < node_count; ++n)
+    {
+        perm->group_offsets[frame->nodes[node_start + n].multicolor + 1] += dof;
+    }
 
-    // Initialize to -1 to signify no neighbors
-    for (int i = 0; i < neighbors_count; ++i)
+    for (int color = 0; color <= num_colors; ++color)
     {
-        neighbors[i] = -1;
+        perm->group_offsets[color + 1] += perm->group_offsets[color];
     }
 
-    for (int i = 0; i < frame->node_count; ++i)
+    // Place each nodes rows at the next free position of its color
+    int* cursor = malloc(sizeof(*cursor) * (num_colors + 1));
+    for (int color = 0; color <= num_colors; ++color)
     {
-        frame->nodes[i].multicolor = 0;
+        cursor[color] = perm->group_offsets[color];
     }
 
-    for (int i = 0; i < frame->element_count; ++i)
+    for (int n = 0; n < node_count; ++n)
     {
-        int n1 = frame->elements[i].node1;
-        int n2 = frame->elements[i].node2;
+        int color = frame->nodes[node_start + n].multicolor;
 
-        // Check the list of n1's neighbors to see if n2 needs to be added
-        for (int n = 0; n < max_neighbors; ++n)
+        for (int d = 0; d < dof; ++d)
         {
-            if (neighbors[n + n1 * max_neighbors] == n2)
-            {
-                // List already contains n2
-                break;
-            }
-            else if (neighbors[n + n1 * max_neighbors] == -1)
-            {
-                // Empty space found without having found n2 yet
-                // so add n2 to the list of n1's neighbors
-                neighbors[n + n1 * max_neighbors] = n2;
-
-                // Update the graph degree if a node has a higher degree
-                if (n >= degree)
-                {
-                    degree = n + 1;
-                }
-
-                break;
-            }
-            else if (n == max_neighbors - 1)
-            {
-                // End of list reached without finding space to place n2
-                fprintf(stderr, "Error building Adjacency List: max_neighbors exceeded\n");
-                print_neighbors(neighbors, n1, max_neighbors);
-                //return;
-            }
+            perm->order[cursor[color]++] = n * dof + d;
         }
+    }
 
-        // Repeat the same process for n2
-        for (int n = 0; n < max_neighbors; ++n)
-        {
-            // Update the graph degree if a node has a higher degree
-            if (n > degree)
-            {
-                degree = n;
-            }
-
-            if (neighbors[n + n2 * max_neighbors] == n1)
-            {
-                // List already contains n2
-                break;
-            }
-            else if (neighbors[n + n2 * max_neighbors] == -1)
-            {
-                // Empty space found without having found n2 yet
-                // so add n2 to the list of n1's neighbors
-                neighbors[n + n2 * max_neighbors] = n1;
-                break;
-            }
-            else if (n == max_neighbors - 1)
-            {
-                // End of list reached without finding space to place n1
-                fprintf(stderr, "Error building Adjacency List: max_neighbors exceeded\n");
-                print_neighbors(neighbors, n2, max_neighbors);
-                //return;
-            }
-        }
+    permutation_update_inverse(perm);
+
+    free(cursor);
+
+    // Unassigned nodes may be coupled to each other so group 0 can not be split between threads
+    // Leaving out the groups makes solvers visit the rows in order on a single thread instead
+    if (uncolored > 0)
+    {
+        free(perm->group_offsets);
+        perm->group_offsets = NULL;
+        perm->group_count = 0;
     }
 
-    printf("Graph Degree: %i\n", degree);
+    return uncolored;
+}
 
-    // Want to have at least degree + 1 colors available to ensure no node has
-    // a neighbor with the same color
-    int num_colors = degree + 1;
+void eqset_reorder(struct Frame* frame, struct EquationSet* eqset, struct Permutation* perm)
+{
+    const int dof = 6;
+    const int rows = eqset->stiff_bc.rows;
 
-    // Assign a multicolor value to each node such that no node has a color in common
-    // with any of it's neighbors
-    for (int i = 0; i < frame->node_count; ++i)
+    if (rows != dof * frame->node_count)
     {
-        // Look through the set of colors and pick the first color that is not
-        // a color of any of the neighbors. This yields an uneven distribution
-        // that can be fixed later by applying randomness
-        for (int color = 1; color <= num_colors; ++color)
-        {
-            int available = 1;
-            for (int n = 0; n < degree; ++n)
-            {
-                // Check if a color is already used by a neighbor
-                int node = neighbors[n + i * max_neighbors];
-                if (node != -1 && color == frame->nodes[node].multicolor)
-                {
-                    available = 0;
-                    break;
-                }
-            }
-
-            // Set the nodes color if available
-            if (available)
-            {
-                frame->nodes[i].multicolor = color;
-                break;
-            }
-        }
+        fprintf(stderr, "Error reordering equations: equation set does not match the frame\n");
+        return;
+    }
 
-        if (frame->nodes[i].multicolor == 0)
-        {
-            fprintf(stderr, "Error assigning multicolor: Failed to find available multicolor\n");
-            print_neighbor_colors(neighbors, frame->nodes, i, max_neighbors);
-        }
+    int uncolored = frame_order_by_color(frame, 0, frame->node_count, dof, perm);
+
+    if (uncolored > 0)
+    {
+        fprintf(stderr, "Warning: %i nodes have no color (see frame_assign_multicolor). "
+            "Equations will be solved on a single thread\n", uncolored);
     }
 }
 
 
-void eqset_reorder(struct Frame* frame, struct EquationSet* eqset, int** order)
+int frame_partition(struct Frame* frame, int parts, struct RowDistribution* node_dist, int* node_order, struct PartitionStats* stats)
 {
-    int rows = eqset->stiffness.rows;
-    int cols = eqset->stiffness.cols;
-    float* matrix_src = eqset->stiff_bc.elements;
-    float* vec_b_src = eqset->forces.elements;
-    float* vec_x_src = eqset->displacements.elements;
-
-    float* matrix_dest = malloc(sizeof(*matrix_dest) * rows * cols);
-    float* vec_b_dest = malloc(sizeof(*vec_b_dest) * rows);
-    float* vec_x_dest = malloc(sizeof(*vec_x_dest) * rows);
+    // Rows are owned by processes and threads in contiguous blocks so the file order
+    // decides which nodes are solved together. Partitioning the node graph then
+    // renumbering the nodes part by part makes each block a compact region of the frame
+    // with only a few elements connecting it to other blocks. Fewer connections between
+    // blocks means fewer ghost values exchanged between processes and better locality
+    // for threads
+
+    struct NodeGraph graph;
+    if (nodegraph_build(frame, &graph))
+    {
+        fprintf(stderr, "Error partitioning frame: Failed to build node graph\n");
+        return -1;
+    }
 
+    const int node_count = frame->node_count;
 
-    // Create array where the ith entry will hold the index where the ith row of the
-    // original equation moved to during reorder
-    *order = malloc(sizeof(**order) * eqset->displacements.count);
+    for (int i = 0; i < frame->bc_count; ++i)
+    {
+        if (frame->bconditions[i].node < 0 || frame->bconditions[i].node >= node_count)
+        {
+            fprintf(stderr, "Error partitioning frame: boundary condition %i references node outside of 0 to %i\n", i, node_count - 1);
+            nodegraph_release(&graph);
+            return -1;
+        }
+    }
 
-    int num_colors = 10;
+    int* part = malloc(sizeof(*part) * (node_count > 0 ? node_count : 1));
 
-    int dest_row = 0;
-    int skip_rows = 0;
+    if (partition_graph(&graph, parts, part, 0) < 0)
+    {
+        free(part);
+        nodegraph_release(&graph);
+        return -1;
+    }
 
-    //for (int color = 0; color <= num_colors; ++color)
-    for (int color = num_colors; color >= 0; --color)
+    if (stats)
     {
-        int color_count = 0;
-        int none_of_color = 1;
+        partition_stats(&graph, part, parts, stats);
 
-        for (int n = 0; n < frame->node_count; ++n)
+        // Count elements rather than graph connections since that is what crosses blocks
+        stats->cut_edges = 0;
+        for (int i = 0; i < frame->element_count; ++i)
         {
-            if (frame->nodes[n].multicolor == color)
-            {
-                int src_row = n * 6;
-
-                for (int dof = 0; dof < 6; ++dof)
-                {
-                    // Copy src row to dest row
-                    for (int i = 0; i < cols; ++i)
-                    {
-                        matrix_dest[i + dest_row * cols] = matrix_src[i + src_row * cols];
-                    }
-
-                    // Copy b and x from src to dest
-                    vec_b_dest[dest_row] = vec_b_src[src_row];
-                    vec_x_dest[dest_row] = vec_x_src[src_row];
-
-                    // Record the new position for the row
-                    (*order)[src_row] = dest_row;
-                    ++src_row;
-                    ++dest_row;
-                }
-
-                none_of_color = 0;
-                color_count++;
-            }
+            stats->cut_edges += part[frame->elements[i].node1] != part[frame->elements[i].node2];
         }
+    }
+
+    nodegraph_release(&graph);
+
+    // Counting sort of the nodes by part keeping the original order within a part
+    node_dist->procs = parts;
+    node_dist->row_starts = calloc(parts + 1, sizeof(*node_dist->row_starts));
+
+    for (int n = 0; n < node_count; ++n)
+    {
+        node_dist->row_starts[part[n] + 1]++;
+    }
+
+    for (int p = 0; p < parts; ++p)
+    {
+        node_dist->row_starts[p + 1] += node_dist->row_starts[p];
+    }
+
+    int* new_index = node_order ? node_order : malloc(sizeof(*new_index) * (node_count > 0 ? node_count : 1));
+    int* cursor = malloc(sizeof(*cursor) * parts);
+
+    for (int p = 0; p < parts; ++p)
+    {
+        cursor[p] = node_dist->row_starts[p];
+    }
 
-        printf("Count of Color %i: %i\n", color, color_count);
+    for (int n = 0; n < node_count; ++n)
+    {
+        new_index[n] = cursor[part[n]]++;
     }
 
-    printf("Rows Copied: %i, Rows Skipped: %i\n", dest_row, skip_rows);
+    frame_renumber_nodes(frame, new_index);
 
-    // Swap pointers
-    eqset->stiff_bc.elements = matrix_dest;
-    eqset->forces.elements = vec_b_dest;
-    eqset->displacements.elements = vec_x_dest;
+    free(cursor);
+    if (new_index != node_order)
+    {
+        free(new_index);
+    }
+    free(part);
 
-    // Free old data
-    free(matrix_src);
-    free(vec_b_src);
-    free(vec_x_src);
+    return 0;
 }
+
+
+void frame_renumber_nodes(struct Frame* frame, const int* new_index)
+{
+    const int node_count = frame->node_count;
+
+    struct Node* nodes = malloc(sizeof(*nodes) * (node_count > 0 ? node_count : 1));
+    for (int n = 0; n < node_count; ++n)
+    {
+        nodes[new_index[n]] = frame->nodes[n];
+    }
+
+    free(frame->nodes);
+    frame->nodes = nodes;
+
+    for (int i = 0; i < frame->element_count; ++i)
+    {
+        frame->elements[i].node1 = new_index[frame->elements[i].node1];
+        frame->elements[i].node2 = new_index[frame->elements[i].node2];
+    }
+
+    for (int i = 0; i < frame->bc_count; ++i)
+    {
+        frame->bconditions[i].node = new_index[frame->bconditions[i].node];
+    }
+}
\ No newline at end of file
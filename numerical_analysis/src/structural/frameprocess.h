@@ -1,10 +1,37 @@
 #pragma once
 
+#include "coloring.h"
+#include "permutation.h"
+
 struct Frame;
 struct EquationSet;
+struct RowDistribution;
+struct PartitionStats;
+
+// Assign nodes to independent groups using the given coloring method
+// if balance is set the group sizes are evened out afterwards
+// stats (may be NULL) receives the number and sizes of the colors
+void frame_assign_multicolor(struct Frame* frame, enum ColoringMethod method, int balance, struct ColoringStats* stats);
+
+// Order the rows of the nodes node_start to node_start + node_count - 1 by node color with dof
+// rows per node. Rows are numbered from the first row of node_start. perm is initialized with one
+// group per color (including 0 for unassigned nodes) numbered by the largest color in the whole
+// frame so processes ordering their own nodes agree on the groups. If any node of the frame is
+// unassigned the rows are still ordered by color but perm has no groups since those nodes may be
+// coupled. Returns the number of unassigned nodes in the frame
+int frame_order_by_color(const struct Frame* frame, int node_start, int node_count, int dof, struct Permutation* perm);
+
+// Order the equations by color group without moving them (see frame_order_by_color)
+void eqset_reorder(struct Frame* frame, struct EquationSet* eqset, struct Permutation* perm);
 
-// Assign nodes to independent groups
-void frame_assign_multicolor(struct Frame* frame);
+// Split the nodes into parts with few elements between them (see partition.h) and renumber
+// the nodes so each part is a contiguous range. Elements and boundary conditions are updated
+// to the new numbering. node_dist receives the node range of each part which can be used
+// as the process ownership for frame_build_distributed. node_order (may be NULL) has room
+// for every node and receives the new number of each node as frame_renumber_nodes takes it
+// stats (may be NULL) receives the part sizes with cut_edges counting the elements between parts
+// Returns 0 on success or -1 on failure (the frame is unchanged)
+int frame_partition(struct Frame* frame, int parts, struct RowDistribution* node_dist, int* node_order, struct PartitionStats* stats);
 
-// Rearrange equations by color group
-void eqset_reorder(struct Frame* frame, struct EquationSet* eqset, int** order);
\ No newline at end of file
+// Move node n to new_index[n] (a permutation) and update elements and boundary conditions to match
+void frame_renumber_nodes(struct Frame* frame, const int* new_index);
@@ -0,0 +1,524 @@
+#include "frameresults.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+#include "frame.h"
+#include "framebinary.h"
+#include "filemap.h"
+#include "trace.h"
+
+// Nodes gathered into a buffer at a time while streaming a field
+#define RESULTS_CHUNK 4096
+
+// The x, y and z of one field of a node
+static inline const struct vec3* node_field(const struct Node* node, enum ResultsField field)
+{
+    switch (field)
+    {
+    case RESULTS_ROTATION: return &node->rotation;
+    case RESULTS_FORCE: return &node->force;
+    case RESULTS_MOMENT: return &node->moment;
+    default: return &node->displacement;
+    }
+}
+
+static inline struct vec3* node_field_mutable(struct Node* node, enum ResultsField field)
+{
+    return (struct vec3*)node_field(node, field);
+}
+
+static uint64_t align_offset(uint64_t offset)
+{
+    return (offset + FRAME_BINARY_ALIGN - 1) / FRAME_BINARY_ALIGN * FRAME_BINARY_ALIGN;
+}
+
+// Legacy VTK binary data is big endian
+static inline uint32_t to_big_endian(uint32_t value)
+{
+    const uint32_t one = 1;
+    if (*(const unsigned char*)&one == 0)
+    {
+        return value;
+    }
+
+    return (value >> 24) | ((value >> 8) & 0xFF00u) | ((value << 8) & 0xFF0000u) | (value << 24);
+}
+
+static inline uint32_t float_big_endian(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return to_big_endian(bits);
+}
+
+int frame_write_results(const struct Frame* frame, const char* path)
+{
+    FILE* file = fopen(path, "w");
+    if (!file)
+    {
+        fprintf(stderr, "Failed to open file at: %s\n", path);
+        return -1;
+    }
+
+    fprintf(file, "results %i\n", frame->node_count);
+
+    // 9 significant digits are enough to get back the same float
+    for (int n = 0; n < frame->node_count; ++n)
+    {
+        const struct Node* node = &frame->nodes[n];
+
+        fprintf(file, "%i %.9g %.9g %.9g %.9g %.9g %.9g %.9g %.9g %.9g %.9g %.9g %.9g\n", n,
+            node->displacement.x, node->displacement.y, node->displacement.z,
+            node->rotation.x, node->rotation.y, node->rotation.z,
+            node->force.x, node->force.y, node->force.z,
+            node->moment.x, node->moment.y, node->moment.z);
+    }
+
+    if (fclose(file))
+    {
+        fprintf(stderr, "Results Error: failed to write %s\n", path);
+        return -1;
+    }
+
+    return 0;
+}
+
+int frame_write_results_binary(const struct Frame* frame, const char* path)
+{
+    const int node_count = frame->node_count;
+
+    // Lay out the fields one after another each on an aligned offset
+    struct ResultsBinaryHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, RESULTS_BINARY_MAGIC, sizeof(header.magic));
+    header.version = RESULTS_BINARY_VERSION;
+    header.byte_order = FRAME_BINARY_BYTE_ORDER;
+    header.header_size = sizeof(header);
+    header.node_count = node_count;
+
+    uint64_t offset = sizeof(header);
+    for (int f = 0; f < RESULTS_FIELD_COUNT; ++f)
+    {
+        header.fields[f] = align_offset(offset);
+        offset = header.fields[f] + (uint64_t)node_count * 3 * sizeof(float);
+    }
+
+    header.file_size = offset;
+
+    FILE* file = fopen(path, "wb");
+    if (!file)
+    {
+        fprintf(stderr, "Failed to open file at: %s\n", path);
+        return -1;
+    }
+
+    static const char padding[FRAME_BINARY_ALIGN] = { 0 };
+    float* buffer = malloc(sizeof(*buffer) * 3 * RESULTS_CHUNK);
+
+    int failed = fwrite(&header, sizeof(header), 1, file) != 1;
+    uint64_t written = sizeof(header);
+
+    for (int f = 0; f < RESULTS_FIELD_COUNT && !failed; ++f)
+    {
+        size_t pad = (size_t)(header.fields[f] - written);
+        failed = fwrite(padding, 1, pad, file) != pad;
+
+        // Gather a chunk of nodes at a time so the buffer stays small for any model size
+        for (int start = 0; start < node_count && !failed; start += RESULTS_CHUNK)
+        {
+            int count = node_count - start < RESULTS_CHUNK ? node_count - start : RESULTS_CHUNK;
+
+            for (int i = 0; i < count; ++i)
+            {
+                const struct vec3* value = node_field(&frame->nodes[start + i], f);
+                buffer[3 * i] = value->x;
+                buffer[3 * i + 1] = value->y;
+                buffer[3 * i + 2] = value->z;
+            }
+
+            failed = fwrite(buffer, sizeof(*buffer), 3 * (size_t)count, file) != 3 * (size_t)count;
+        }
+
+        written = header.fields[f] + (uint64_t)node_count * 3 * sizeof(float);
+    }
+
+    free(buffer);
+
+    if (fclose(file) || failed)
+    {
+        fprintf(stderr, "Results Error: failed to write %s\n", path);
+        return -1;
+    }
+
+    return 0;
+}
+
+int frame_write_results_vtk(const struct Frame* frame, const char* path)
+{
+    const int node_count = frame->node_count;
+    const int element_count = frame->element_count;
+
+    FILE* file = fopen(path, "wb");
+    if (!file)
+    {
+        fprintf(stderr, "Failed to open file at: %s\n", path);
+        return -1;
+    }
+
+    uint32_t* buffer = malloc(sizeof(*buffer) * 3 * RESULTS_CHUNK);
+    int failed = 0;
+
+    fprintf(file, "# vtk DataFile Version 3.0\nframe results\nBINARY\nDATASET UNSTRUCTURED_GRID\n");
+
+    // Points
+    fprintf(file, "POINTS %i float\n", node_count);
+
+    for (int start = 0; start < node_count && !failed; start += RESULTS_CHUNK)
+    {
+        int count = node_count - start < RESULTS_CHUNK ? node_count - start : RESULTS_CHUNK;
+
+        for (int i = 0; i < count; ++i)
+        {
+            const struct vec3* pos = &frame->nodes[start + i].pos;
+            buffer[3 * i] = float_big_endian(pos->x);
+            buffer[3 * i + 1] = float_big_endian(pos->y);
+            buffer[3 * i + 2] = float_big_endian(pos->z);
+        }
+
+        failed = fwrite(buffer, sizeof(*buffer), 3 * (size_t)count, file) != 3 * (size_t)count;
+    }
+
+    // Each element is a line cell given by its point count (2) and two point indices
+    fprintf(file, "\nCELLS %i %i\n", element_count, 3 * element_count);
+
+    for (int start = 0; start < element_count && !failed; start += RESULTS_CHUNK)
+    {
+        int count = element_count - start < RESULTS_CHUNK ? element_count - start : RESULTS_CHUNK;
+
+        for (int i = 0; i < count; ++i)
+        {
+            buffer[3 * i] = to_big_endian(2);
+            buffer[3 * i + 1] = to_big_endian((uint32_t)frame->elements[start + i].node1);
+            buffer[3 * i + 2] = to_big_endian((uint32_t)frame->elements[start + i].node2);
+        }
+
+        failed = fwrite(buffer, sizeof(*buffer), 3 * (size_t)count, file) != 3 * (size_t)count;
+    }
+
+    // VTK_LINE
+    fprintf(file, "\nCELL_TYPES %i\n", element_count);
+
+    for (int i = 0; i < 3 * RESULTS_CHUNK; ++i)
+    {
+        buffer[i] = to_big_endian(3);
+    }
+
+    for (int start = 0; start < element_count && !failed; start += 3 * RESULTS_CHUNK)
+    {
+        int count = element_count - start < 3 * RESULTS_CHUNK ? element_count - start : 3 * RESULTS_CHUNK;
+        failed = fwrite(buffer, sizeof(*buffer), (size_t)count, file) != (size_t)count;
+    }
+
+    // Fields
+    static const char* names[RESULTS_FIELD_COUNT] = { "displacement", "rotation", "force", "moment" };
+
+    fprintf(file, "\nPOINT_DATA %i\n", node_count);
+
+    for (int f = 0; f < RESULTS_FIELD_COUNT && !failed; ++f)
+    {
+        fprintf(file, "VECTORS %s float\n", names[f]);
+
+        for (int start = 0; start < node_count && !failed; start += RESULTS_CHUNK)
+        {
+            int count = node_count - start < RESULTS_CHUNK ? node_count - start : RESULTS_CHUNK;
+
+            for (int i = 0; i < count; ++i)
+            {
+                const struct vec3* value = node_field(&frame->nodes[start + i], f);
+                buffer[3 * i] = float_big_endian(value->x);
+                buffer[3 * i + 1] = float_big_endian(value->y);
+                buffer[3 * i + 2] = float_big_endian(value->z);
+            }
+
+            failed = fwrite(buffer, sizeof(*buffer), 3 * (size_t)count, file) != 3 * (size_t)count;
+        }
+
+        fprintf(file, "\n");
+    }
+
+    free(buffer);
+
+    if (fclose(file) || failed)
+    {
+        fprintf(stderr, "Results Error: failed to write %s\n", path);
+        return -1;
+    }
+
+    return 0;
+}
+
+int frame_write_results_format(const struct Frame* frame, const char* path, enum ResultsFormat format)
+{
+    TRACE_BEGIN("write results");
+
+    int result;
+    switch (format)
+    {
+    case RESULTS_BINARY: result = frame_write_results_binary(frame, path); break;
+    case RESULTS_VTK: result = frame_write_results_vtk(frame, path); break;
+    default: result = frame_write_results(frame, path); break;
+    }
+
+    TRACE_END();
+    return result;
+}
+
+enum ResultsFormat results_format_from_path(const char* path)
+{
+    const char* dot = strrchr(path, '.');
+
+    if (dot && strcmp(dot, results_format_extension(RESULTS_BINARY)) == 0)
+    {
+        return RESULTS_BINARY;
+    }
+
+    if (dot && strcmp(dot, results_format_extension(RESULTS_VTK)) == 0)
+    {
+        return RESULTS_VTK;
+    }
+
+    return RESULTS_TEXT;
+}
+
+const char* results_format_extension(enum ResultsFormat format)
+{
+    switch (format)
+    {
+    case RESULTS_BINARY: return ".resultsbin";
+    case RESULTS_VTK: return ".vtk";
+    default: return ".results";
+    }
+}
+
+// Read a binary results file in place through a mapping. Returns 0 on success
+static int read_results_binary(struct Frame* frame, const char* path)
+{
+    struct FileMap file;
+    if (filemap_open(path, &file))
+    {
+        fprintf(stderr, "Failed to open file at: %s\n", path);
+        return -1;
+    }
+
+    const struct ResultsBinaryHeader* header = (const struct ResultsBinaryHeader*)file.data;
+    const uint64_t field_bytes = (uint64_t)frame->node_count * 3 * sizeof(float);
+
+    int valid = file.size >= sizeof(*header) &&
+        header->version == RESULTS_BINARY_VERSION &&
+        header->byte_order == FRAME_BINARY_BYTE_ORDER &&
+        header->header_size == sizeof(*header) &&
+        header->file_size == file.size;
+
+    for (int f = 0; f < RESULTS_FIELD_COUNT && valid; ++f)
+    {
+        uint64_t offset = header->fields[f];
+        valid = offset % FRAME_BINARY_ALIGN == 0 && offset >= sizeof(*header) && offset <= file.size &&
+            field_bytes <= file.size - offset;
+    }
+
+    if (!valid)
+    {
+        fprintf(stderr, "Results Error: %s is not a valid results file (version %u expected)\n", path, RESULTS_BINARY_VERSION);
+        filemap_close(&file);
+        return -1;
+    }
+
+    if (header->node_count != frame->node_count)
+    {
+        fprintf(stderr, "Results Error: %s has %i nodes but the frame has %i\n", path, header->node_count, frame->node_count);
+        filemap_close(&file);
+        return -1;
+    }
+
+    for (int f = 0; f < RESULTS_FIELD_COUNT; ++f)
+    {
+        const float* values = (const float*)(file.data + header->fields[f]);
+
+        for (int n = 0; n < frame->node_count; ++n)
+        {
+            *node_field_mutable(&frame->nodes[n], f) = (struct vec3){ values[3 * n], values[3 * n + 1], values[3 * n + 2] };
+        }
+    }
+
+    filemap_close(&file);
+    return 0;
+}
+
+int frame_read_results(struct Frame* frame, const char* path)
+{
+    FILE* file = fopen(path, "r");
+    if (!file)
+    {
+        fprintf(stderr, "Failed to open file at: %s\n", path);
+        return -1;
+    }
+
+    // Binary files start with their magic and text files with the "results" command
+    char magic[sizeof(RESULTS_BINARY_MAGIC) - 1];
+    if (fread(magic, 1, sizeof(magic), file) == sizeof(magic) && memcmp(magic, RESULTS_BINARY_MAGIC, sizeof(magic)) == 0)
+    {
+        fclose(file);
+        return read_results_binary(frame, path);
+    }
+
+    rewind(file);
+
+    char command[32];
+    int count = 0;
+
+    if (fscanf(file, "%31s %i", command, &count) != 2 || strcmp(command, "results") != 0)
+    {
+        fprintf(stderr, "Results Error: %s is not a results file\n", path);
+        fclose(file);
+        return -1;
+    }
+
+    if (count != frame->node_count)
+    {
+        fprintf(stderr, "Results Error: %s has %i nodes but the frame has %i\n", path, count, frame->node_count);
+        fclose(file);
+        return -1;
+    }
+
+    int error = 0;
+
+    for (int n = 0; n < count && !error; ++n)
+    {
+        struct Node* node = &frame->nodes[n];
+        int index;
+
+        if (fscanf(file, "%i %f %f %f %f %f %f %f %f %f %f %f %f", &index,
+            &node->displacement.x, &node->displacement.y, &node->displacement.z,
+            &node->rotation.x, &node->rotation.y, &node->rotation.z,
+            &node->force.x, &node->force.y, &node->force.z,
+            &node->moment.x, &node->moment.y, &node->moment.z) != 13 || index != n)
+        {
+            fprintf(stderr, "Results Error: Invalid result format for node %i\n", n);
+            error = 1;
+        }
+    }
+
+    fclose(file);
+
+    return error ? -1 : 0;
+}
+
+
+
+// Write the snapshot then free it. Runs on the background thread
+static void write_snapshot(struct ResultsWriter* writer)
+{
+    writer->result = frame_write_results_format(writer->snapshot, writer->path, writer->format);
+    writer->failures += writer->result != 0;
+
+    free(writer->snapshot->nodes);
+    free(writer->snapshot->elements);
+    free(writer->snapshot);
+    free(writer->path);
+    writer->snapshot = NULL;
+    writer->path = NULL;
+}
+
+#ifdef _WIN32
+static DWORD WINAPI write_thread(LPVOID data)
+{
+    write_snapshot(data);
+    return 0;
+}
+#else
+static void* write_thread(void* data)
+{
+    write_snapshot(data);
+    return NULL;
+}
+#endif
+
+void results_writer_init(struct ResultsWriter* writer)
+{
+    memset(writer, 0, sizeof(*writer));
+}
+
+int results_writer_submit(struct ResultsWriter* writer, const struct Frame* frame, const char* path, enum ResultsFormat format)
+{
+    int previous = results_writer_wait(writer);
+
+    // Copying the nodes and elements is a small part of the cost of formatting and writing them
+    struct Frame* snapshot = calloc(1, sizeof(*snapshot));
+    snapshot->node_count = frame->node_count;
+    snapshot->element_count = frame->element_count;
+    snapshot->nodes = malloc(sizeof(*snapshot->nodes) * (frame->node_count > 0 ? frame->node_count : 1));
+    snapshot->elements = malloc(sizeof(*snapshot->elements) * (frame->element_count > 0 ? frame->element_count : 1));
+    memcpy(snapshot->nodes, frame->nodes, sizeof(*snapshot->nodes) * frame->node_count);
+    memcpy(snapshot->elements, frame->elements, sizeof(*snapshot->elements) * frame->element_count);
+
+    writer->snapshot = snapshot;
+    writer->path = malloc(strlen(path) + 1);
+    strcpy(writer->path, path);
+    writer->format = format;
+    writer->result = 0;
+
+#ifdef _WIN32
+    HANDLE thread = CreateThread(NULL, 0, write_thread, writer, 0, NULL);
+    writer->thread = thread;
+    int started = thread != NULL;
+#else
+    pthread_t* thread = malloc(sizeof(*thread));
+    int started = pthread_create(thread, NULL, write_thread, writer) == 0;
+    if (started)
+    {
+        writer->thread = thread;
+    }
+    else
+    {
+        free(thread);
+    }
+#endif
+
+    // Write on this thread if another could not be started
+    if (!started)
+    {
+        write_snapshot(writer);
+    }
+
+    return previous;
+}
+
+int results_writer_wait(struct ResultsWriter* writer)
+{
+    if (writer->thread)
+    {
+#ifdef _WIN32
+        WaitForSingleObject(writer->thread, INFINITE);
+        CloseHandle(writer->thread);
+#else
+        pthread_join(*(pthread_t*)writer->thread, NULL);
+        free(writer->thread);
+#endif
+        writer->thread = NULL;
+    }
+
+    return writer->result;
+}
+
+void results_writer_release(struct ResultsWriter* writer)
+{
+    results_writer_wait(writer);
+}
\ No newline at end of file
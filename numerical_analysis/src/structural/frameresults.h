@@ -0,0 +1,102 @@
+#pragma once
+
+#include <stdint.h>
+
+struct Frame;
+
+// Per node results are written to ".results" text files laid out like ".frame" files
+// A "results" command with the node count is followed by one line per node:
+// node dx dy dz rx ry rz fx fy fz mx my mz
+// (displacement, rotation, force and moment) with enough digits to read back every float exactly
+
+// Binary ".resultsbin" files hold the same values laid out like binary frame files (see
+// framebinary.h). A fixed header is followed by one array per field with x, y and z of each
+// node together (node_count * 3 floats) and every array aligned to FRAME_BINARY_ALIGN bytes
+
+// VTK files are legacy unstructured grids for ParaView and similar tools. Nodes are points,
+// elements are lines and the four fields are point vectors
+
+#define RESULTS_BINARY_MAGIC "FRAMERES"
+#define RESULTS_BINARY_VERSION 1
+
+enum ResultsFormat
+{
+    RESULTS_TEXT = 0,
+    RESULTS_BINARY,
+    RESULTS_VTK
+};
+
+// Arrays stored in a binary results file in the order they are written
+enum ResultsField
+{
+    RESULTS_DISPLACEMENT = 0,
+    RESULTS_ROTATION,
+    RESULTS_FORCE,
+    RESULTS_MOMENT,
+    RESULTS_FIELD_COUNT
+};
+
+struct ResultsBinaryHeader
+{
+    char magic[8]; // RESULTS_BINARY_MAGIC without the terminating null
+    uint32_t version;
+    uint32_t byte_order; // FRAME_BINARY_BYTE_ORDER
+    uint32_t header_size;
+    int32_t node_count;
+    uint64_t file_size;
+
+    // Byte offset of each array from the start of the file
+    uint64_t fields[RESULTS_FIELD_COUNT];
+};
+
+// Write the per node results of a solved frame. Returns 0 on success or -1 on failure
+int frame_write_results(const struct Frame* frame, const char* path);
+
+// Write the results as a binary ".resultsbin" file. Values are streamed in fixed size chunks
+// so no copy of the whole result is made. Returns 0 on success or -1 on failure
+int frame_write_results_binary(const struct Frame* frame, const char* path);
+
+// Write the frame and its results as a legacy binary VTK unstructured grid
+// Returns 0 on success or -1 on failure
+int frame_write_results_vtk(const struct Frame* frame, const char* path);
+
+// Write the results in the given format
+int frame_write_results_format(const struct Frame* frame, const char* path, enum ResultsFormat format);
+
+// Format matching the extension of path (".resultsbin", ".vtk" or text for anything else)
+enum ResultsFormat results_format_from_path(const char* path);
+
+// File extension used for each format including the dot
+const char* results_format_extension(enum ResultsFormat format);
+
+// Read text or binary results into a frame loaded from the same model
+// Returns 0 on success or -1 if the file can not be read or does not match the frame
+int frame_read_results(struct Frame* frame, const char* path);
+
+
+// Writes results on a background thread so the caller can go on (such as to the next solve)
+// Only one write runs at a time. Submitting another waits for the previous one to finish
+struct ResultsWriter
+{
+    // Copy of the frame being written (nodes and elements only) so the caller can change
+    // or release its own frame while the write runs
+    struct Frame* snapshot;
+    char* path;
+    enum ResultsFormat format;
+    int result; // Result of the last finished write (0 on success)
+    int failures; // Number of writes that failed
+
+    void* thread; // Handle of the running write or NULL
+};
+
+void results_writer_init(struct ResultsWriter* writer);
+
+// Wait for the previous write, copy the frame's nodes and elements and start writing them to path
+// Returns the result of the previous write (0 if it succeeded or there was none)
+int results_writer_submit(struct ResultsWriter* writer, const struct Frame* frame, const char* path, enum ResultsFormat format);
+
+// Wait for the running write to finish. Returns its result (0 if it succeeded or there was none)
+int results_writer_wait(struct ResultsWriter* writer);
+
+// Wait for the running write and free the writer's resources
+void results_writer_release(struct ResultsWriter* writer);
@@ -0,0 +1,672 @@
+#include "frameschwarz.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "frame.h"
+#include "nodegraph.h"
+#include "partition.h"
+#include "sparse.h"
+#include "schwarz.h"
+#include "linearsolve.h"
+#include "trace.h"
+
+#ifndef ENABLE_MPI
+#define ENABLE_MPI 0
+#endif
+
+#if ENABLE_MPI
+#include <mpi.h>
+#endif
+
+// Degrees of freedom (3 translation and 3 rotation)
+#define DOF 6
+
+// Rigid body modes of a group of nodes (3 translations and 3 rotations)
+#define RIGID_BODY_MODES 6
+
+static int compare_ints(const void* a, const void* b)
+{
+    int left = *(const int*)a;
+    int right = *(const int*)b;
+    return (left > right) - (left < right);
+}
+
+// First degree of freedom fixed by a boundary condition (0 for displacements and 3 for rotations)
+// or -1 if it does not fix any. Only homogeneous conditions are applied (see apply_boundary_conditions)
+static int fixed_first_dof(const struct BoundaryCondition* bc)
+{
+    if (bc->value.x != 0.f || bc->value.y != 0.f || bc->value.z != 0.f)
+    {
+        return -1;
+    }
+
+    if (bc->kind == BC_Displacement)
+    {
+        return 0;
+    }
+
+    if (bc->kind == BC_Rotation)
+    {
+        return 3;
+    }
+
+    return -1;
+}
+
+// Add a 6x6 block into the rows of local node row_node at the block column of local node col_node
+static void add_subdomain_block(struct SparseMatrix* matrix, const int* block_offsets, const int* block_cols,
+    int row_node, int col_node, const float* block)
+{
+    const int first = block_offsets[row_node];
+    const int count = block_offsets[row_node + 1] - first;
+    const int* found = bsearch(&col_node, block_cols + first, count, sizeof(*block_cols), compare_ints);
+    const int p = (int)(found - (block_cols + first));
+
+    for (int j = 0; j < DOF; ++j)
+    {
+        float* row = matrix->values + matrix->row_offsets[row_node * DOF + j] + DOF * p;
+
+        for (int i = 0; i < DOF; ++i)
+        {
+            row[i] += block[i + j * DOF];
+        }
+    }
+}
+
+int frame_build_subdomain(struct Frame* frame, const struct NodeGraph* graph, const int* nodes, int count,
+    struct SparseMatrix* matrix, float** stiffness_values)
+{
+    // Position of every frame node in the set or -1 if it is not in the set
+    int* local = malloc(sizeof(*local) * (frame->node_count > 0 ? frame->node_count : 1));
+
+    for (int n = 0; n < frame->node_count; ++n)
+    {
+        local[n] = -1;
+    }
+
+    for (int i = 0; i < count; ++i)
+    {
+        if (nodes[i] < 0 || nodes[i] >= frame->node_count)
+        {
+            fprintf(stderr, "Error building subdomain: node %i is outside of 0 to %i\n", nodes[i], frame->node_count - 1);
+            free(local);
+            return -1;
+        }
+
+        local[nodes[i]] = i;
+    }
+
+    // Block sparsity from the node graph. Every node is coupled to itself and its neighbors in the set
+    int* block_offsets = calloc(count + 1, sizeof(*block_offsets));
+
+    for (int i = 0; i < count; ++i)
+    {
+        int blocks = 1;
+        for (int k = graph->offsets[nodes[i]]; k < graph->offsets[nodes[i] + 1]; ++k)
+        {
+            blocks += local[graph->neighbors[k]] != -1;
+        }
+
+        block_offsets[i + 1] = block_offsets[i] + blocks;
+    }
+
+    int* block_cols = malloc(sizeof(*block_cols) * (block_offsets[count] > 0 ? block_offsets[count] : 1));
+
+    for (int i = 0; i < count; ++i)
+    {
+        int fill = block_offsets[i];
+        block_cols[fill++] = i;
+
+        for (int k = graph->offsets[nodes[i]]; k < graph->offsets[nodes[i] + 1]; ++k)
+        {
+            if (local[graph->neighbors[k]] != -1)
+            {
+                block_cols[fill++] = local[graph->neighbors[k]];
+            }
+        }
+
+        qsort(block_cols + block_offsets[i], fill - block_offsets[i], sizeof(*block_cols), compare_ints);
+    }
+
+    // Expand the blocks into scalar rows with 6 columns per block
+    sparse_init(matrix, DOF * count, DOF * count, DOF * DOF * block_offsets[count]);
+
+    for (int i = 0; i < count; ++i)
+    {
+        const int blocks = block_offsets[i + 1] - block_offsets[i];
+
+        for (int j = 0; j < DOF; ++j)
+        {
+            const int row = DOF * i + j;
+            matrix->row_offsets[row + 1] = matrix->row_offsets[row] + DOF * blocks;
+
+            for (int b = 0; b < blocks; ++b)
+            {
+                for (int d = 0; d < DOF; ++d)
+                {
+                    matrix->columns[matrix->row_offsets[row] + DOF * b + d] = DOF * block_cols[block_offsets[i] + b] + d;
+                    matrix->values[matrix->row_offsets[row] + DOF * b + d] = 0.0f;
+                }
+            }
+        }
+    }
+
+    // Every element touching the set adds to the diagonal blocks of its nodes in the set
+    // and to the blocks between them when both are in the set
+    for (int e = 0; e < frame->element_count; ++e)
+    {
+        const int l1 = local[frame->elements[e].node1];
+        const int l2 = local[frame->elements[e].node2];
+
+        if (l1 == -1 && l2 == -1)
+        {
+            continue;
+        }
+
+        struct mat6 k_element[4];
+        build_element_stiffness(frame, frame->elements[e], k_element);
+
+        if (l1 != -1)
+        {
+            add_subdomain_block(matrix, block_offsets, block_cols, l1, l1, k_element[0].elements);
+        }
+
+        if (l1 != -1 && l2 != -1)
+        {
+            add_subdomain_block(matrix, block_offsets, block_cols, l1, l2, k_element[1].elements);
+            add_subdomain_block(matrix, block_offsets, block_cols, l2, l1, k_element[2].elements);
+        }
+
+        if (l2 != -1)
+        {
+            add_subdomain_block(matrix, block_offsets, block_cols, l2, l2, k_element[3].elements);
+        }
+    }
+
+    free(block_cols);
+    free(block_offsets);
+
+    if (stiffness_values)
+    {
+        *stiffness_values = malloc(sizeof(**stiffness_values) * (matrix->nnz > 0 ? matrix->nnz : 1));
+
+        for (int k = 0; k < matrix->nnz; ++k)
+        {
+            (*stiffness_values)[k] = matrix->values[k];
+        }
+    }
+
+    // Eliminated degrees of freedom have their row and column set to zero with 1 on the diagonal
+    unsigned char* fixed = calloc(DOF * count > 0 ? DOF * count : 1, sizeof(*fixed));
+
+    for (int n = 0; n < frame->bc_count; ++n)
+    {
+        const int node = frame->bconditions[n].node;
+        const int first = fixed_first_dof(&frame->bconditions[n]);
+
+        if (first != -1 && node >= 0 && node < frame->node_count && local[node] != -1)
+        {
+            for (int i = 0; i < 3; ++i)
+            {
+                fixed[DOF * local[node] + first + i] = 1;
+            }
+        }
+    }
+
+    for (int j = 0; j < matrix->rows; ++j)
+    {
+        for (int k = matrix->row_offsets[j]; k < matrix->row_offsets[j + 1]; ++k)
+        {
+            const int col = matrix->columns[k];
+
+            if (fixed[j])
+            {
+                matrix->values[k] = col == j ? 1.0f : 0.0f;
+            }
+            else if (fixed[col])
+            {
+                matrix->values[k] = 0.0f;
+            }
+        }
+    }
+
+    free(fixed);
+    free(local);
+
+    return 0;
+}
+
+
+// Split a block of nodes into compact parts using the connections inside the block
+static void partition_block(const struct NodeGraph* graph, int node_start, int node_count, int parts, int* part)
+{
+    if (parts <= 1)
+    {
+        for (int i = 0; i < node_count; ++i)
+        {
+            part[i] = 0;
+        }
+
+        return;
+    }
+
+    struct NodeGraph block;
+    block.node_count = node_count;
+    block.edge_count = 0;
+    block.max_degree = 0;
+    block.offsets = calloc(node_count + 1, sizeof(*block.offsets));
+    block.neighbors = malloc(sizeof(*block.neighbors) *
+        (graph->offsets[node_start + node_count] - graph->offsets[node_start] + 1));
+
+    for (int i = 0; i < node_count; ++i)
+    {
+        const int n = node_start + i;
+
+        for (int k = graph->offsets[n]; k < graph->offsets[n + 1]; ++k)
+        {
+            const int neighbor = graph->neighbors[k];
+
+            if (neighbor >= node_start && neighbor < node_start + node_count)
+            {
+                block.neighbors[block.edge_count++] = neighbor - node_start;
+            }
+        }
+
+        block.offsets[i + 1] = block.edge_count;
+
+        if (block.offsets[i + 1] - block.offsets[i] > block.max_degree)
+        {
+            block.max_degree = block.offsets[i + 1] - block.offsets[i];
+        }
+    }
+
+    if (partition_graph(&block, parts, part, 0) < 0)
+    {
+        // Contiguous ranges are a reasonable fallback since nodes are usually numbered compactly
+        for (int i = 0; i < node_count; ++i)
+        {
+            part[i] = (int)((long long)i * parts / node_count);
+        }
+    }
+
+    nodegraph_release(&block);
+}
+
+// Rigid body modes of the nodes in each aggregate about the aggregate's center
+// Mode m of local node i's degree of freedom d is modes[m * rows + DOF * i + d]
+static void rigid_body_modes(const struct Frame* frame, int node_start, int node_count, const int* aggregate,
+    int aggregate_count, float* modes)
+{
+    const int rows = DOF * node_count;
+
+    struct vec3* centers = calloc(aggregate_count > 0 ? aggregate_count : 1, sizeof(*centers));
+    int* sizes = calloc(aggregate_count > 0 ? aggregate_count : 1, sizeof(*sizes));
+
+    for (int i = 0; i < node_count; ++i)
+    {
+        const struct vec3 pos = frame->nodes[node_start + i].pos;
+        const int a = aggregate[i];
+
+        centers[a].x += pos.x;
+        centers[a].y += pos.y;
+        centers[a].z += pos.z;
+        sizes[a]++;
+    }
+
+    for (int a = 0; a < aggregate_count; ++a)
+    {
+        if (sizes[a] > 0)
+        {
+            centers[a].x /= sizes[a];
+            centers[a].y /= sizes[a];
+            centers[a].z /= sizes[a];
+        }
+    }
+
+    for (int i = 0; i < rows * RIGID_BODY_MODES; ++i)
+    {
+        modes[i] = 0.0f;
+    }
+
+    for (int i = 0; i < node_count; ++i)
+    {
+        const struct vec3 pos = frame->nodes[node_start + i].pos;
+        const struct vec3 c = centers[aggregate[i]];
+        const float x = pos.x - c.x;
+        const float y = pos.y - c.y;
+        const float z = pos.z - c.z;
+        float* row = modes + DOF * i;
+
+        // Translations
+        row[0 * rows + 0] = 1.0f;
+        row[1 * rows + 1] = 1.0f;
+        row[2 * rows + 2] = 1.0f;
+
+        // Rotations about each axis move the node by axis x (position - center)
+        row[3 * rows + 1] = -z;
+        row[3 * rows + 2] = y;
+        row[3 * rows + 3] = 1.0f;
+
+        row[4 * rows + 0] = z;
+        row[4 * rows + 2] = -x;
+        row[4 * rows + 4] = 1.0f;
+
+        row[5 * rows + 0] = -y;
+        row[5 * rows + 1] = x;
+        row[5 * rows + 5] = 1.0f;
+    }
+
+    // Fixed degrees of freedom never move
+    for (int n = 0; n < frame->bc_count; ++n)
+    {
+        const int node = frame->bconditions[n].node;
+        const int first = fixed_first_dof(&frame->bconditions[n]);
+
+        if (first == -1 || node < node_start || node >= node_start + node_count)
+        {
+            continue;
+        }
+
+        for (int m = 0; m < RIGID_BODY_MODES; ++m)
+        {
+            for (int i = 0; i < 3; ++i)
+            {
+                modes[m * rows + DOF * (node - node_start) + first + i] = 0.0f;
+            }
+        }
+    }
+
+    free(sizes);
+    free(centers);
+}
+
+int frame_schwarz_create(struct Frame* frame, const struct RowDistribution* dist, struct HaloExchange* halo,
+    int node_start, int node_count, const struct SparseMatrix* matrix, const struct SchwarzSettings* settings,
+    int threads, struct SchwarzPreconditioner* precond)
+{
+    // Point Jacobi only uses each row's diagonal so information crosses the frame one node per
+    // iteration. Solving whole subdomains at once moves it across a subdomain per iteration
+    // and overlapping the subdomains smooths the jumps where they meet. The coarse space
+    // moves every subdomain as a rigid body at once which is what the local solves cannot do
+    // so the iteration count stops growing with the number of subdomains
+
+    struct NodeGraph graph;
+    if (nodegraph_build(frame, &graph))
+    {
+        fprintf(stderr, "Error creating Schwarz preconditioner: Failed to build node graph\n");
+        return -1;
+    }
+
+    if (threads < 1)
+    {
+        threads = 1;
+    }
+
+    int subdomain_count = settings->subdomains > 0 ? settings->subdomains : threads;
+    if (subdomain_count > node_count)
+    {
+        subdomain_count = node_count;
+    }
+
+    // Compact cores that do not overlap
+    int* part = malloc(sizeof(*part) * (node_count > 0 ? node_count : 1));
+    partition_block(&graph, node_start, node_count, subdomain_count, part);
+
+    int* core_offsets = calloc(subdomain_count + 1, sizeof(*core_offsets));
+    int* core_nodes = malloc(sizeof(*core_nodes) * (node_count > 0 ? node_count : 1));
+
+    for (int i = 0; i < node_count; ++i)
+    {
+        core_offsets[part[i] + 1]++;
+    }
+
+    for (int s = 0; s < subdomain_count; ++s)
+    {
+        core_offsets[s + 1] += core_offsets[s];
+    }
+
+    int* cursor = malloc(sizeof(*cursor) * (subdomain_count > 0 ? subdomain_count : 1));
+    for (int s = 0; s < subdomain_count; ++s)
+    {
+        cursor[s] = core_offsets[s];
+    }
+
+    for (int i = 0; i < node_count; ++i)
+    {
+        core_nodes[cursor[part[i]]++] = node_start + i;
+    }
+
+    free(cursor);
+
+    // Grow each core by the overlap. Nodes outside of the owned block are needed from other processes
+    int** subdomain_nodes = malloc(sizeof(*subdomain_nodes) * (subdomain_count > 0 ? subdomain_count : 1));
+    int* subdomain_sizes = malloc(sizeof(*subdomain_sizes) * (subdomain_count > 0 ? subdomain_count : 1));
+    int needed_count = 0;
+
+    for (int s = 0; s < subdomain_count; ++s)
+    {
+        subdomain_sizes[s] = nodegraph_expand(&graph, core_nodes + core_offsets[s], core_offsets[s + 1] - core_offsets[s],
+            settings->overlap, &subdomain_nodes[s]);
+
+        needed_count += DOF * (subdomain_sizes[s] - (core_offsets[s + 1] - core_offsets[s]));
+    }
+
+    int* needed = malloc(sizeof(*needed) * (needed_count > 0 ? needed_count : 1));
+    needed_count = 0;
+
+    for (int s = 0; s < subdomain_count; ++s)
+    {
+        for (int i = 0; i < subdomain_sizes[s]; ++i)
+        {
+            const int n = subdomain_nodes[s][i];
+
+            if (n < node_start || n >= node_start + node_count)
+            {
+                for (int d = 0; d < DOF; ++d)
+                {
+                    needed[needed_count++] = DOF * n + d;
+                }
+            }
+        }
+    }
+
+    int failed = schwarz_create(precond, dist, DOF * node_start, DOF * node_count, needed, needed_count, subdomain_count);
+    free(needed);
+
+    if (!failed)
+    {
+        // Subdomains are assembled and factored independently
+#pragma omp parallel for num_threads(threads) schedule(dynamic, 1) reduction(|:failed)
+        for (int s = 0; s < subdomain_count; ++s)
+        {
+            struct SparseMatrix local_matrix;
+            failed |= frame_build_subdomain(frame, &graph, subdomain_nodes[s], subdomain_sizes[s], &local_matrix, NULL) != 0;
+
+            if (failed)
+            {
+                continue;
+            }
+
+            int* indices = malloc(sizeof(*indices) * (local_matrix.rows > 0 ? local_matrix.rows : 1));
+            for (int i = 0; i < subdomain_sizes[s]; ++i)
+            {
+                for (int d = 0; d < DOF; ++d)
+                {
+                    indices[DOF * i + d] = schwarz_local_index(precond, DOF * subdomain_nodes[s][i] + d);
+                }
+            }
+
+            failed |= schwarz_set_subdomain(precond, s, &local_matrix, indices, settings->local_solver) != 0;
+
+            free(indices);
+            sparse_release(&local_matrix);
+        }
+    }
+
+    // Every process must take part in building the coarse space so they all agree to go on
+#if ENABLE_MPI
+    if (dist)
+    {
+        MPI_Allreduce(MPI_IN_PLACE, &failed, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+    }
+#endif
+
+    if (!failed && settings->coarse)
+    {
+        // One aggregate per process keeps the coarse matrix small. A single process uses its parts
+        const int aggregate_count = dist ? 1 : subdomain_count;
+        int* aggregate = malloc(sizeof(*aggregate) * (node_count > 0 ? node_count : 1));
+        int* row_aggregates = malloc(sizeof(*row_aggregates) * (DOF * node_count > 0 ? DOF * node_count : 1));
+        float* modes = malloc(sizeof(*modes) * RIGID_BODY_MODES * (DOF * node_count > 0 ? DOF * node_count : 1));
+
+        for (int i = 0; i < node_count; ++i)
+        {
+            aggregate[i] = dist ? 0 : part[i];
+
+            for (int d = 0; d < DOF; ++d)
+            {
+                row_aggregates[DOF * i + d] = aggregate[i];
+            }
+        }
+
+        rigid_body_modes(frame, node_start, node_count, aggregate, aggregate_count, modes);
+
+        failed = schwarz_set_coarse(precond, matrix, halo, row_aggregates, aggregate_count, modes, RIGID_BODY_MODES) != 0;
+
+        free(modes);
+        free(row_aggregates);
+        free(aggregate);
+    }
+
+    for (int s = 0; s < subdomain_count; ++s)
+    {
+        free(subdomain_nodes[s]);
+    }
+
+    free(subdomain_sizes);
+    free(subdomain_nodes);
+    free(core_nodes);
+    free(core_offsets);
+    free(part);
+    nodegraph_release(&graph);
+
+    if (failed)
+    {
+        schwarz_release(precond);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+int frame_build_system(struct Frame* frame, struct SparseMatrix* stiffness, float** stiffness_values, float** forces)
+{
+    const int node_count = frame->node_count;
+    const int rows = DOF * node_count;
+
+    TRACE_BEGIN("assembly");
+
+    struct NodeGraph graph;
+    if (nodegraph_build(frame, &graph))
+    {
+        fprintf(stderr, "Error building frame system: Failed to build node graph\n");
+        TRACE_END();
+        return -1;
+    }
+
+    // The whole frame is the subdomain of every node
+    int* nodes = malloc(sizeof(*nodes) * (node_count > 0 ? node_count : 1));
+    for (int n = 0; n < node_count; ++n)
+    {
+        nodes[n] = n;
+    }
+
+    int failed = frame_build_subdomain(frame, &graph, nodes, node_count, stiffness, stiffness_values);
+
+    free(nodes);
+    nodegraph_release(&graph);
+
+    if (failed)
+    {
+        TRACE_END();
+        return -1;
+    }
+
+    // Set known boundary forces and moments
+    *forces = calloc(rows > 0 ? rows : 1, sizeof(**forces));
+
+    for (int n = 0; n < frame->bc_count; ++n)
+    {
+        const struct BoundaryCondition* bc = &frame->bconditions[n];
+
+        if (bc->kind == BC_Force || bc->kind == BC_Moment)
+        {
+            const int first = bc->kind == BC_Force ? 0 : 3;
+
+            (*forces)[DOF * bc->node + first] = bc->value.x;
+            (*forces)[DOF * bc->node + first + 1] = bc->value.y;
+            (*forces)[DOF * bc->node + first + 2] = bc->value.z;
+        }
+    }
+
+    TRACE_END();
+    return 0;
+}
+
+int frame_solve_cg(struct Frame* frame, const struct SchwarzSettings* settings, float* residuals,
+    int iterations, float tolerance, int threads, const struct CheckpointSettings* checkpoint, int* converged)
+{
+    const int node_count = frame->node_count;
+    const int rows = DOF * node_count;
+
+    struct SparseMatrix stiffness;
+    float* stiffness_values = NULL;
+    float* forces = NULL;
+
+    if (frame_build_system(frame, &stiffness, &stiffness_values, &forces))
+    {
+        return -1;
+    }
+
+    // Exact subdomain solves of a large frame can run out of memory. Go on like the MPI solve does
+    TRACE_BEGIN("preconditioner setup");
+
+    struct SchwarzPreconditioner precond;
+    int have_precond = !frame_schwarz_create(frame, NULL, NULL, 0, node_count, &stiffness, settings, threads, &precond);
+
+    TRACE_END();
+
+    if (!have_precond)
+    {
+        fprintf(stderr, "Warning: Failed to build Schwarz preconditioner. Scaling by the diagonal instead\n");
+    }
+
+    float* displacements = malloc(sizeof(*displacements) * (rows > 0 ? rows : 1));
+    int completed = solve_cg_sparse(&stiffness, forces, displacements, have_precond ? &precond : NULL,
+        residuals, iterations, tolerance, threads, checkpoint, converged);
+
+    // Back calculate forces with the stiffness before boundary conditions F = KU
+    TRACE_BEGIN("results");
+
+    struct SparseMatrix original = stiffness;
+    original.values = stiffness_values;
+    sparse_premultiply(forces, &original, displacements);
+
+    frame_set_results(frame, forces, displacements);
+
+    TRACE_END();
+
+    free(displacements);
+    free(forces);
+    free(stiffness_values);
+    sparse_release(&stiffness);
+
+    if (have_precond)
+    {
+        schwarz_release(&precond);
+    }
+
+    return completed;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+struct Frame;
+struct NodeGraph;
+struct SparseMatrix;
+struct RowDistribution;
+struct HaloExchange;
+struct SchwarzSettings;
+struct SchwarzPreconditioner;
+struct CheckpointSettings;
+
+// Stiffness equations of a set of nodes with every node outside of the set held fixed
+// Row DOF * i + d of the matrix is degree of freedom d of nodes[i] and only the columns of the set
+// are kept (the set's part of the full stiffness matrix). Boundary conditions are applied like
+// apply_boundary_conditions. If stiffness_values is not NULL it receives the stored values before
+// boundary conditions are applied. Returns 0 on success or -1 if a node is outside of the frame
+int frame_build_subdomain(struct Frame* frame, const struct NodeGraph* graph, const int* nodes, int count,
+    struct SparseMatrix* matrix, float** stiffness_values);
+
+// Stiffness equations of the whole frame with boundary conditions applied (see frame_build_subdomain)
+// and the matching force vector. stiffness_values (may be NULL) receives the stored values before
+// boundary conditions are applied and forces is allocated to hold every row
+// Returns 0 on success or -1 on failure
+int frame_build_system(struct Frame* frame, struct SparseMatrix* stiffness, float** stiffness_values, float** forces);
+
+// Collective if dist is not NULL. Build an additive Schwarz preconditioner (see schwarz.h) for
+// the equations of nodes node_start to node_start + node_count - 1
+// The nodes are split into settings->subdomains compact parts (see partition.h) that are grown by
+// settings->overlap layers of neighbors in the node graph. Each part's equations come straight
+// from the frame so overlap owned by other processes needs no matrix values from them
+// With MPI dist is the row distribution of the system and matrix holds its owned rows with
+// columns numbered by halo (see halo_create). Without MPI dist and halo are NULL and matrix holds
+// every row of the frame. The coarse space uses the rigid body modes of each process' nodes or of
+// each part when there is only one process. Every process must have the whole frame
+// Returns 0 on success
+int frame_schwarz_create(struct Frame* frame, const struct RowDistribution* dist, struct HaloExchange* halo,
+    int node_start, int node_count, const struct SparseMatrix* matrix, const struct SchwarzSettings* settings,
+    int threads, struct SchwarzPreconditioner* precond);
+
+// Solve a frame on a single process with conjugate gradients preconditioned by additive Schwarz
+// using OpenMP threads. Fills in the per node results
+// residuals receives the residual norm of every iteration (may be NULL)
+// checkpoint (may be NULL) saves and resumes the solve (see solve_cg_sparse)
+// converged (may be NULL) is set to 1 if the solve reached tolerance
+// Returns the number of iterations run or -1 on failure
+int frame_solve_cg(struct Frame* frame, const struct SchwarzSettings* settings, float* residuals,
+    int iterations, float tolerance, int threads, const struct CheckpointSettings* checkpoint, int* converged);
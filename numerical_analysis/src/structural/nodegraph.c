@@ -0,0 +1,194 @@
+#include "nodegraph.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "frame.h"
+
+int nodegraph_build(const struct Frame* frame, struct NodeGraph* graph)
+{
+    // The element list is a list of edges so the adjacency is built with a counting sort
+    // first count how many edges touch each node, turn the counts into offsets with
+    // a prefix sum, then place each edge (in both directions) at its node's next free slot
+    // Finally remove duplicate neighbors (multiple elements between the same pair of nodes)
+    // All steps are linear in the number of elements and nodes
+
+    const int node_count = frame->node_count;
+
+    graph->node_count = node_count;
+    graph->edge_count = 0;
+    graph->max_degree = 0;
+    graph->offsets = calloc(node_count + 1, sizeof(*graph->offsets));
+    graph->neighbors = NULL;
+
+    // Count the edges at each node (offset by one so the prefix sum leaves offsets in place)
+    for (int i = 0; i < frame->element_count; ++i)
+    {
+        int n1 = frame->elements[i].node1;
+        int n2 = frame->elements[i].node2;
+
+        if (n1 < 0 || n1 >= node_count || n2 < 0 || n2 >= node_count)
+        {
+            fprintf(stderr, "Error building node graph: element %i references node outside of 0 to %i\n", i, node_count - 1);
+            nodegraph_release(graph);
+            return -1;
+        }
+
+        // A zero length element does not connect two different nodes
+        if (n1 == n2)
+        {
+            continue;
+        }
+
+        graph->offsets[n1 + 1]++;
+        graph->offsets[n2 + 1]++;
+    }
+
+    for (int n = 0; n < node_count; ++n)
+    {
+        graph->offsets[n + 1] += graph->offsets[n];
+    }
+
+    int total = graph->offsets[node_count];
+    graph->neighbors = malloc(sizeof(*graph->neighbors) * (total > 0 ? total : 1));
+
+    // Next free slot for each node
+    int* cursor = malloc(sizeof(*cursor) * (node_count > 0 ? node_count : 1));
+    for (int n = 0; n < node_count; ++n)
+    {
+        cursor[n] = graph->offsets[n];
+    }
+
+    for (int i = 0; i < frame->element_count; ++i)
+    {
+        int n1 = frame->elements[i].node1;
+        int n2 = frame->elements[i].node2;
+
+        if (n1 != n2)
+        {
+            graph->neighbors[cursor[n1]++] = n2;
+            graph->neighbors[cursor[n2]++] = n1;
+        }
+    }
+
+    // Remove duplicates by compacting in place. last_seen records the last node that listed
+    // a neighbor so repeats are found without searching. Writes never pass reads since
+    // a node's compacted list starts at or before its original position
+    int* last_seen = cursor;
+    for (int n = 0; n < node_count; ++n)
+    {
+        last_seen[n] = -1;
+    }
+
+    int write = 0;
+    int read = 0;
+
+    for (int n = 0; n < node_count; ++n)
+    {
+        int end = graph->offsets[n + 1];
+        int start = write;
+
+        for (; read < end; ++read)
+        {
+            int neighbor = graph->neighbors[read];
+
+            if (last_seen[neighbor] != n)
+            {
+                last_seen[neighbor] = n;
+                graph->neighbors[write++] = neighbor;
+            }
+        }
+
+        graph->offsets[n] = start;
+
+        if (write - start > graph->max_degree)
+        {
+            graph->max_degree = write - start;
+        }
+    }
+
+    graph->offsets[node_count] = write;
+    graph->edge_count = write;
+
+    free(cursor);
+
+    // Give back the space used by duplicates
+    if (write > 0 && write < total)
+    {
+        graph->neighbors = realloc(graph->neighbors, sizeof(*graph->neighbors) * write);
+    }
+
+    return 0;
+}
+
+int nodegraph_expand(const struct NodeGraph* graph, const int* nodes, int count, int layers, int** expanded)
+{
+    // Breadth first search started from every node of the set at once. Each layer is the
+    // unvisited neighbors of the previous layer so layer k holds the nodes k steps away
+    char* in_set = calloc(graph->node_count > 0 ? graph->node_count : 1, sizeof(*in_set));
+    int capacity = count > 0 ? 2 * count : 1;
+    int* result = malloc(sizeof(*result) * capacity);
+    int total = 0;
+
+    for (int i = 0; i < count; ++i)
+    {
+        if (!in_set[nodes[i]])
+        {
+            in_set[nodes[i]] = 1;
+            result[total++] = nodes[i];
+        }
+    }
+
+    int layer_start = 0;
+
+    for (int layer = 0; layer < layers; ++layer)
+    {
+        const int layer_end = total;
+
+        for (int i = layer_start; i < layer_end; ++i)
+        {
+            const int n = result[i];
+
+            for (int k = graph->offsets[n]; k < graph->offsets[n + 1]; ++k)
+            {
+                const int neighbor = graph->neighbors[k];
+
+                if (in_set[neighbor])
+                {
+                    continue;
+                }
+
+                if (total == capacity)
+                {
+                    capacity *= 2;
+                    result = realloc(result, sizeof(*result) * capacity);
+                }
+
+                in_set[neighbor] = 1;
+                result[total++] = neighbor;
+            }
+        }
+
+        layer_start = layer_end;
+    }
+
+    free(in_set);
+
+    *expanded = result;
+    return total;
+}
+
+void nodegraph_release(struct NodeGraph* graph)
+{
+    if (graph)
+    {
+        free(graph->offsets);
+        free(graph->neighbors);
+
+        graph->offsets = NULL;
+        graph->neighbors = NULL;
+        graph->node_count = 0;
+        graph->edge_count = 0;
+        graph->max_degree = 0;
+    }
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+struct Frame;
+
+// Node adjacency of a frame in compressed sparse row (CSR) form
+// The neighbors of node n are neighbors[offsets[n]] up to (not including) neighbors[offsets[n + 1]]
+// Each neighbor appears once per node even if several elements connect the same pair
+struct NodeGraph
+{
+    int* offsets; // node_count + 1 entries
+    int* neighbors; // edge_count entries
+    int node_count;
+    int edge_count; // Every connection is counted once in each direction
+    int max_degree;
+};
+
+// Build the adjacency of the nodes in a frame from its element list
+// Returns 0 on success or -1 if an element references a node that does not exist
+int nodegraph_build(const struct Frame* frame, struct NodeGraph* graph);
+
+// Grow a set of nodes by the given number of layers of neighbors
+// expanded receives the original nodes (in the same order) followed by the nodes of each
+// layer in breadth first order. Returns the number of nodes in the expanded set
+int nodegraph_expand(const struct NodeGraph* graph, const int* nodes, int count, int layers, int** expanded);
+
+// Frees resources held by the graph
+void nodegraph_release(struct NodeGraph* graph);
+
+// Number of neighbors of a node
+static inline int nodegraph_degree(const struct NodeGraph* graph, int node)
+{
+    return graph->offsets[node + 1] - graph->offsets[node];
+}
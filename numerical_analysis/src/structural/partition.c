@@ -0,0 +1,906 @@
+#include "partition.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#include "nodegraph.h"
+
+// Coarsening stops once a graph has this many nodes or fewer
+#define COARSEST_NODES 64
+
+// Coarsening also stops when a level fails to shrink the graph by at least 10 percent
+// which happens when most remaining nodes are too heavy to merge
+#define MIN_REDUCTION 0.9f
+
+// Limit on the number of coarsening levels (each level roughly halves the graph)
+#define MAX_LEVELS 40
+
+// Number of seeds tried when splitting the coarsest graph
+#define INITIAL_TRIES 4
+
+// Refinement passes per level. Later passes rarely find much
+#define REFINE_PASSES 4
+
+// A pass gives up after this many moves without finding a better split
+#define STALL_MOVES 64
+
+// How far a side may exceed its share of the node weight
+#define BALANCE_TOLERANCE 1.01f
+
+// Graph with weights on nodes and connections. Coarse nodes weigh as much as the nodes merged
+// into them and coarse connections as much as the connections they replace
+struct WeightedGraph
+{
+    int* offsets;
+    int* neighbors;
+    int* edge_weights;
+    int* node_weights;
+    int node_count;
+    int total_weight;
+};
+
+static void wgraph_init(struct WeightedGraph* graph, int node_count, int edge_count)
+{
+    graph->offsets = calloc(node_count + 1, sizeof(*graph->offsets));
+    graph->neighbors = malloc(sizeof(*graph->neighbors) * (edge_count > 0 ? edge_count : 1));
+    graph->edge_weights = malloc(sizeof(*graph->edge_weights) * (edge_count > 0 ? edge_count : 1));
+    graph->node_weights = malloc(sizeof(*graph->node_weights) * (node_count > 0 ? node_count : 1));
+    graph->node_count = node_count;
+    graph->total_weight = 0;
+}
+
+static void wgraph_release(struct WeightedGraph* graph)
+{
+    free(graph->offsets);
+    free(graph->neighbors);
+    free(graph->edge_weights);
+    free(graph->node_weights);
+
+    graph->offsets = NULL;
+    graph->neighbors = NULL;
+    graph->edge_weights = NULL;
+    graph->node_weights = NULL;
+    graph->node_count = 0;
+}
+
+// Small reproducible random number generator (xorshift)
+static inline uint32_t next_random(uint32_t* state)
+{
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+
+// Merge pairs of neighboring nodes into a coarser graph (heavy edge matching)
+// Each node is visited in random order and paired with the unmatched neighbor it shares the
+// heaviest connection with. Hiding heavy connections inside coarse nodes means the coarse
+// split can only cut light connections. cmap receives the coarse node of every fine node
+static void coarsen(const struct WeightedGraph* fine, struct WeightedGraph* coarse, int* cmap, uint32_t* rng)
+{
+    const int n = fine->node_count;
+
+    // Keep coarse nodes from growing so heavy that the coarsest graph cannot be balanced
+    const int max_weight = 1 + (3 * fine->total_weight) / (2 * COARSEST_NODES);
+
+    int* match = malloc(sizeof(*match) * (n > 0 ? n : 1));
+    int* order = malloc(sizeof(*order) * (n > 0 ? n : 1));
+
+    for (int v = 0; v < n; ++v)
+    {
+        match[v] = -1;
+        order[v] = v;
+    }
+
+    for (int v = n - 1; v > 0; --v)
+    {
+        int k = next_random(rng) % (v + 1);
+        int temp = order[v];
+        order[v] = order[k];
+        order[k] = temp;
+    }
+
+    for (int o = 0; o < n; ++o)
+    {
+        int v = order[o];
+
+        if (match[v] != -1)
+        {
+            continue;
+        }
+
+        int best = v;
+        int best_weight = -1;
+
+        for (int e = fine->offsets[v]; e < fine->offsets[v + 1]; ++e)
+        {
+            int u = fine->neighbors[e];
+
+            if (match[u] == -1 && fine->edge_weights[e] > best_weight &&
+                fine->node_weights[v] + fine->node_weights[u] <= max_weight)
+            {
+                best = u;
+                best_weight = fine->edge_weights[e];
+            }
+        }
+
+        match[v] = best;
+        match[best] = v;
+    }
+
+    // Number the coarse nodes by their lowest fine node so the loop building the
+    // coarse adjacency below produces them in order
+    int coarse_count = 0;
+    for (int v = 0; v < n; ++v)
+    {
+        if (match[v] >= v)
+        {
+            cmap[v] = coarse_count;
+            cmap[match[v]] = coarse_count;
+            coarse_count++;
+        }
+    }
+
+    // A coarse graph never has more connections than the fine graph
+    wgraph_init(coarse, coarse_count, fine->offsets[n]);
+
+    // Position of each coarse neighbor in the adjacency of the coarse node being built
+    // Entries from earlier nodes are recognized by being before the current node's start
+    int* slot = malloc(sizeof(*slot) * (coarse_count > 0 ? coarse_count : 1));
+    for (int c = 0; c < coarse_count; ++c)
+    {
+        slot[c] = -1;
+    }
+
+    int edges = 0;
+
+    for (int v = 0; v < n; ++v)
+    {
+        if (match[v] < v)
+        {
+            continue;
+        }
+
+        const int c = cmap[v];
+        const int start = edges;
+        const int members[2] = { v, match[v] };
+        const int member_count = match[v] == v ? 1 : 2;
+
+        coarse->node_weights[c] = 0;
+
+        for (int m = 0; m < member_count; ++m)
+        {
+            int f = members[m];
+            coarse->node_weights[c] += fine->node_weights[f];
+
+            for (int e = fine->offsets[f]; e < fine->offsets[f + 1]; ++e)
+            {
+                int cn = cmap[fine->neighbors[e]];
+
+                // The connection between the merged pair disappears
+                if (cn == c)
+                {
+                    continue;
+                }
+
+                if (slot[cn] >= start)
+                {
+                    coarse->edge_weights[slot[cn]] += fine->edge_weights[e];
+                }
+                else
+                {
+                    slot[cn] = edges;
+                    coarse->neighbors[edges] = cn;
+                    coarse->edge_weights[edges] = fine->edge_weights[e];
+                    edges++;
+                }
+            }
+        }
+
+        coarse->offsets[c + 1] = edges;
+        coarse->total_weight += coarse->node_weights[c];
+    }
+
+    free(slot);
+    free(order);
+    free(match);
+}
+
+
+// Max heap of nodes ordered by gain (reduction in cut weight from moving the node)
+// position is shared between the heaps of both sides since a node is only ever in one
+struct GainHeap
+{
+    int* nodes;
+    int* position; // Index of each node in its heap or -1 if it is not in a heap
+    const int* gain;
+    int count;
+};
+
+static inline void gainheap_swap(struct GainHeap* heap, int i, int j)
+{
+    int temp = heap->nodes[i];
+    heap->nodes[i] = heap->nodes[j];
+    heap->nodes[j] = temp;
+
+    heap->position[heap->nodes[i]] = i;
+    heap->position[heap->nodes[j]] = j;
+}
+
+static void gainheap_sift_up(struct GainHeap* heap, int i)
+{
+    while (i > 0)
+    {
+        int parent = (i - 1) / 2;
+
+        if (heap->gain[heap->nodes[i]] <= heap->gain[heap->nodes[parent]])
+        {
+            break;
+        }
+
+        gainheap_swap(heap, i, parent);
+        i = parent;
+    }
+}
+
+static void gainheap_sift_down(struct GainHeap* heap, int i)
+{
+    while (1)
+    {
+        int first = i;
+        int left = 2 * i + 1;
+        int right = left + 1;
+
+        if (left < heap->count && heap->gain[heap->nodes[left]] > heap->gain[heap->nodes[first]])
+        {
+            first = left;
+        }
+
+        if (right < heap->count && heap->gain[heap->nodes[right]] > heap->gain[heap->nodes[first]])
+        {
+            first = right;
+        }
+
+        if (first == i)
+        {
+            break;
+        }
+
+        gainheap_swap(heap, i, first);
+        i = first;
+    }
+}
+
+static void gainheap_push(struct GainHeap* heap, int node)
+{
+    heap->nodes[heap->count] = node;
+    heap->position[node] = heap->count;
+    heap->count++;
+
+    gainheap_sift_up(heap, heap->count - 1);
+}
+
+static int gainheap_pop(struct GainHeap* heap)
+{
+    int top = heap->nodes[0];
+
+    gainheap_swap(heap, 0, heap->count - 1);
+    heap->count--;
+    heap->position[top] = -1;
+
+    gainheap_sift_down(heap, 0);
+
+    return top;
+}
+
+// Restore the heap after the gain of a node in it changed
+static void gainheap_update(struct GainHeap* heap, int node)
+{
+    gainheap_sift_up(heap, heap->position[node]);
+    gainheap_sift_down(heap, heap->position[node]);
+}
+
+
+// Working state of a bisection shared by the refinement passes
+struct Bisection
+{
+    int* side; // 0 or 1 for every node
+    int weights[2]; // Node weight on each side
+    int targets[2]; // Desired node weight on each side
+    int limits[2]; // Largest allowed node weight on each side
+    int cut; // Weight of the connections between sides
+};
+
+static void compute_gains(const struct WeightedGraph* graph, struct Bisection* bisect, int* gain, int* external)
+{
+    bisect->weights[0] = 0;
+    bisect->weights[1] = 0;
+    bisect->cut = 0;
+
+    for (int v = 0; v < graph->node_count; ++v)
+    {
+        int ext = 0;
+        int in = 0;
+
+        for (int e = graph->offsets[v]; e < graph->offsets[v + 1]; ++e)
+        {
+            if (bisect->side[graph->neighbors[e]] != bisect->side[v])
+            {
+                ext += graph->edge_weights[e];
+            }
+            else
+            {
+                in += graph->edge_weights[e];
+            }
+        }
+
+        gain[v] = ext - in;
+        external[v] = ext;
+        bisect->weights[bisect->side[v]] += graph->node_weights[v];
+        bisect->cut += ext;
+    }
+
+    // Every cut connection was counted from both ends
+    bisect->cut /= 2;
+}
+
+static inline int bisection_balanced(const struct Bisection* bisect)
+{
+    return bisect->weights[0] <= bisect->limits[0] && bisect->weights[1] <= bisect->limits[1];
+}
+
+// Fiduccia-Mattheyses refinement
+// Each pass repeatedly moves the unlocked node with the highest gain to the other side as long
+// as the move keeps the sides within their limits, even if the gain is negative, which lets
+// the pass climb out of local minima. The best split seen during the pass is kept and the
+// moves after it are undone. Passes repeat until one fails to improve the split
+static void refine(const struct WeightedGraph* graph, struct Bisection* bisect)
+{
+    const int n = graph->node_count;
+
+    int* gain = malloc(sizeof(*gain) * (n > 0 ? n : 1));
+    int* external = malloc(sizeof(*external) * (n > 0 ? n : 1));
+    int* position = malloc(sizeof(*position) * (n > 0 ? n : 1));
+    int* moves = malloc(sizeof(*moves) * (n > 0 ? n : 1));
+    unsigned char* locked = malloc(sizeof(*locked) * (n > 0 ? n : 1));
+
+    struct GainHeap heaps[2];
+    for (int s = 0; s < 2; ++s)
+    {
+        heaps[s].nodes = malloc(sizeof(*heaps[s].nodes) * (n > 0 ? n : 1));
+        heaps[s].position = position;
+        heaps[s].gain = gain;
+        heaps[s].count = 0;
+    }
+
+    for (int pass = 0; pass < REFINE_PASSES; ++pass)
+    {
+        compute_gains(graph, bisect, gain, external);
+
+        // Only nodes on the boundary between sides start in the heaps. Interior nodes
+        // are added when a neighbor moves and puts them on the boundary
+        for (int v = 0; v < n; ++v)
+        {
+            locked[v] = 0;
+            position[v] = -1;
+
+            if (external[v] > 0)
+            {
+                gainheap_push(&heaps[bisect->side[v]], v);
+            }
+        }
+
+        int best_cut = bisect->cut;
+        int best_balanced = bisection_balanced(bisect);
+        int best_offset = abs(bisect->weights[0] - bisect->targets[0]);
+        int best_moves = 0;
+        int move_count = 0;
+        int stalled = 0;
+
+        while (stalled < STALL_MOVES)
+        {
+            // Pick the side to move from. An overweight side must give up nodes
+            // otherwise take the higher gain of the moves that stay within limits
+            int from = -1;
+
+            for (int s = 0; s < 2; ++s)
+            {
+                if (heaps[s].count == 0)
+                {
+                    continue;
+                }
+
+                int v = heaps[s].nodes[0];
+                int other = 1 - s;
+
+                if (bisect->weights[other] + graph->node_weights[v] > bisect->limits[other] &&
+                    bisect->weights[s] <= bisect->limits[s])
+                {
+                    continue;
+                }
+
+                if (from == -1)
+                {
+                    from = s;
+                }
+                else if (bisect->weights[s] > bisect->limits[s] && bisect->weights[from] <= bisect->limits[from])
+                {
+                    from = s;
+                }
+                else if (gain[v] > gain[heaps[from].nodes[0]] &&
+                    !(bisect->weights[from] > bisect->limits[from] && bisect->weights[s] <= bisect->limits[s]))
+                {
+                    from = s;
+                }
+            }
+
+            if (from == -1)
+            {
+                break;
+            }
+
+            int v = gainheap_pop(&heaps[from]);
+            int to = 1 - from;
+
+            bisect->side[v] = to;
+            bisect->weights[from] -= graph->node_weights[v];
+            bisect->weights[to] += graph->node_weights[v];
+            bisect->cut -= gain[v];
+            locked[v] = 1;
+            moves[move_count++] = v;
+
+            // Connections to the old side are now cut and connections to the new side are not
+            for (int e = graph->offsets[v]; e < graph->offsets[v + 1]; ++e)
+            {
+                int u = graph->neighbors[e];
+
+                if (locked[u])
+                {
+                    continue;
+                }
+
+                gain[u] += bisect->side[u] == to ? -2 * graph->edge_weights[e] : 2 * graph->edge_weights[e];
+
+                if (position[u] == -1)
+                {
+                    gainheap_push(&heaps[bisect->side[u]], u);
+                }
+                else
+                {
+                    gainheap_update(&heaps[bisect->side[u]], u);
+                }
+            }
+
+            // A balanced split always beats an unbalanced one, then the lower cut,
+            // then the split closer to the target sizes
+            int balanced = bisection_balanced(bisect);
+            int offset = abs(bisect->weights[0] - bisect->targets[0]);
+
+            int better;
+            if (balanced != best_balanced)
+            {
+                better = balanced;
+            }
+            else if (bisect->cut != best_cut)
+            {
+                better = bisect->cut < best_cut;
+            }
+            else
+            {
+                better = offset < best_offset;
+            }
+
+            if (better)
+            {
+                best_cut = bisect->cut;
+                best_balanced = balanced;
+                best_offset = offset;
+                best_moves = move_count;
+                stalled = 0;
+            }
+            else
+            {
+                stalled++;
+            }
+        }
+
+        // Undo the moves made after the best split
+        for (int m = move_count - 1; m >= best_moves; --m)
+        {
+            int v = moves[m];
+            int from = bisect->side[v];
+
+            bisect->side[v] = 1 - from;
+            bisect->weights[from] -= graph->node_weights[v];
+            bisect->weights[1 - from] += graph->node_weights[v];
+        }
+
+        bisect->cut = best_cut;
+
+        heaps[0].count = 0;
+        heaps[1].count = 0;
+
+        if (best_moves == 0)
+        {
+            break;
+        }
+    }
+
+    free(heaps[0].nodes);
+    free(heaps[1].nodes);
+    free(locked);
+    free(moves);
+    free(position);
+    free(external);
+    free(gain);
+}
+
+
+// Split the coarsest graph by growing side 0 breadth first from a random seed until it
+// holds its share of the weight. The best of several refined attempts is kept
+static void initial_bisection(const struct WeightedGraph* graph, struct Bisection* bisect, uint32_t* rng)
+{
+    const int n = graph->node_count;
+
+    int* best_side = malloc(sizeof(*best_side) * (n > 0 ? n : 1));
+    int* queue = malloc(sizeof(*queue) * (n > 0 ? n : 1));
+    int best_cut = -1;
+    int best_balanced = 0;
+
+    for (int attempt = 0; attempt < INITIAL_TRIES && n > 0; ++attempt)
+    {
+        for (int v = 0; v < n; ++v)
+        {
+            bisect->side[v] = 1;
+        }
+
+        int grown = 0;
+        int head = 0;
+        int tail = 0;
+        int next_seed = next_random(rng) % n;
+
+        while (grown < bisect->targets[0])
+        {
+            if (head == tail)
+            {
+                // Start again from an unvisited node if the graph is not connected
+                int tried = 0;
+                while (bisect->side[next_seed] == 0 && tried < n)
+                {
+                    next_seed = (next_seed + 1) % n;
+                    tried++;
+                }
+
+                if (tried == n)
+                {
+                    break;
+                }
+
+                bisect->side[next_seed] = 0;
+                queue[tail++] = next_seed;
+                grown += graph->node_weights[next_seed];
+                continue;
+            }
+
+            int v = queue[head++];
+
+            for (int e = graph->offsets[v]; e < graph->offsets[v + 1] && grown < bisect->targets[0]; ++e)
+            {
+                int u = graph->neighbors[e];
+
+                if (bisect->side[u] == 1)
+                {
+                    bisect->side[u] = 0;
+                    queue[tail++] = u;
+                    grown += graph->node_weights[u];
+                }
+            }
+        }
+
+        refine(graph, bisect);
+
+        int balanced = bisection_balanced(bisect);
+
+        if (best_cut == -1 || (balanced && !best_balanced) ||
+            (balanced == best_balanced && bisect->cut < best_cut))
+        {
+            best_cut = bisect->cut;
+            best_balanced = balanced;
+
+            for (int v = 0; v < n; ++v)
+            {
+                best_side[v] = bisect->side[v];
+            }
+        }
+    }
+
+    for (int v = 0; v < n; ++v)
+    {
+        bisect->side[v] = best_side[v];
+    }
+
+    free(queue);
+    free(best_side);
+}
+
+static void set_targets(const struct WeightedGraph* graph, struct Bisection* bisect, float fraction)
+{
+    int max_weight = 0;
+    for (int v = 0; v < graph->node_count; ++v)
+    {
+        if (graph->node_weights[v] > max_weight)
+        {
+            max_weight = graph->node_weights[v];
+        }
+    }
+
+    bisect->targets[0] = (int)(fraction * graph->total_weight + 0.5f);
+    bisect->targets[1] = graph->total_weight - bisect->targets[0];
+
+    // Coarse nodes are heavy so allow a side to be over by at least one node
+    for (int s = 0; s < 2; ++s)
+    {
+        int limit = (int)(BALANCE_TOLERANCE * bisect->targets[s]);
+        bisect->limits[s] = limit > bisect->targets[s] + max_weight ? limit : bisect->targets[s] + max_weight;
+    }
+}
+
+// Multilevel split of a graph into two sides with fraction of the weight on side 0
+static void bisect_multilevel(const struct WeightedGraph* graph, int* side, float fraction, uint32_t* rng)
+{
+    struct WeightedGraph levels[MAX_LEVELS];
+    int* cmaps[MAX_LEVELS];
+    int level_count = 0;
+
+    const struct WeightedGraph* current = graph;
+
+    while (current->node_count > COARSEST_NODES && level_count < MAX_LEVELS)
+    {
+        int* cmap = malloc(sizeof(*cmap) * current->node_count);
+
+        coarsen(current, &levels[level_count], cmap, rng);
+
+        if (levels[level_count].node_count > MIN_REDUCTION * current->node_count)
+        {
+            wgraph_release(&levels[level_count]);
+            free(cmap);
+            break;
+        }
+
+        cmaps[level_count] = cmap;
+        current = &levels[level_count];
+        level_count++;
+    }
+
+    struct Bisection bisect;
+    bisect.side = malloc(sizeof(*bisect.side) * (current->node_count > 0 ? current->node_count : 1));
+
+    set_targets(current, &bisect, fraction);
+    initial_bisection(current, &bisect, rng);
+
+    // Project the split onto each finer level and refine it there where
+    // individual nodes can move across the boundary
+    for (int level = level_count - 1; level >= 0; --level)
+    {
+        const struct WeightedGraph* finer = level > 0 ? &levels[level - 1] : graph;
+
+        int* finer_side = malloc(sizeof(*finer_side) * (finer->node_count > 0 ? finer->node_count : 1));
+        for (int v = 0; v < finer->node_count; ++v)
+        {
+            finer_side[v] = bisect.side[cmaps[level][v]];
+        }
+
+        free(bisect.side);
+        bisect.side = finer_side;
+
+        set_targets(finer, &bisect, fraction);
+        refine(finer, &bisect);
+
+        wgraph_release(&levels[level]);
+        free(cmaps[level]);
+    }
+
+    for (int v = 0; v < graph->node_count; ++v)
+    {
+        side[v] = bisect.side[v];
+    }
+
+    free(bisect.side);
+}
+
+// Copy the nodes on one side and the connections between them into a new graph
+// ids maps nodes of the new graph to the original nodes
+static void extract_side(const struct WeightedGraph* graph, const int* graph_ids, const int* side, int which,
+    struct WeightedGraph* sub, int** sub_ids)
+{
+    const int n = graph->node_count;
+
+    int* local = malloc(sizeof(*local) * (n > 0 ? n : 1));
+    int count = 0;
+    int edges = 0;
+
+    for (int v = 0; v < n; ++v)
+    {
+        local[v] = side[v] == which ? count++ : -1;
+
+        if (side[v] == which)
+        {
+            for (int e = graph->offsets[v]; e < graph->offsets[v + 1]; ++e)
+            {
+                edges += side[graph->neighbors[e]] == which;
+            }
+        }
+    }
+
+    wgraph_init(sub, count, edges);
+    *sub_ids = malloc(sizeof(**sub_ids) * (count > 0 ? count : 1));
+
+    edges = 0;
+    for (int v = 0; v < n; ++v)
+    {
+        if (local[v] == -1)
+        {
+            continue;
+        }
+
+        int s = local[v];
+        (*sub_ids)[s] = graph_ids[v];
+        sub->node_weights[s] = graph->node_weights[v];
+        sub->total_weight += graph->node_weights[v];
+
+        for (int e = graph->offsets[v]; e < graph->offsets[v + 1]; ++e)
+        {
+            int u = local[graph->neighbors[e]];
+
+            if (u != -1)
+            {
+                sub->neighbors[edges] = u;
+                sub->edge_weights[edges] = graph->edge_weights[e];
+                edges++;
+            }
+        }
+
+        sub->offsets[s + 1] = edges;
+    }
+
+    free(local);
+}
+
+// Bisect then split each side into its share of the parts
+static void partition_recursive(const struct WeightedGraph* graph, const int* ids, int parts, int first_part,
+    int* part, uint32_t* rng)
+{
+    if (parts == 1 || graph->node_count == 0)
+    {
+        for (int v = 0; v < graph->node_count; ++v)
+        {
+            part[ids[v]] = first_part;
+        }
+
+        return;
+    }
+
+    // Odd part counts put proportionally less weight on the first side
+    const int left_parts = parts / 2;
+
+    int* side = malloc(sizeof(*side) * graph->node_count);
+    bisect_multilevel(graph, side, (float)left_parts / parts, rng);
+
+    for (int s = 0; s < 2; ++s)
+    {
+        struct WeightedGraph sub;
+        int* sub_ids;
+
+        extract_side(graph, ids, side, s, &sub, &sub_ids);
+
+        if (s == 0)
+        {
+            partition_recursive(&sub, sub_ids, left_parts, first_part, part, rng);
+        }
+        else
+        {
+            partition_recursive(&sub, sub_ids, parts - left_parts, first_part + left_parts, part, rng);
+        }
+
+        free(sub_ids);
+        wgraph_release(&sub);
+    }
+
+    free(side);
+}
+
+
+int partition_graph(const struct NodeGraph* graph, int parts, int* part, unsigned int seed)
+{
+    if (parts < 1)
+    {
+        fprintf(stderr, "Error partitioning graph: %i parts requested\n", parts);
+        return -1;
+    }
+
+    const int n = graph->node_count;
+
+    // The unweighted node graph is the finest level
+    struct WeightedGraph full;
+    wgraph_init(&full, n, graph->edge_count);
+
+    int* ids = malloc(sizeof(*ids) * (n > 0 ? n : 1));
+
+    for (int v = 0; v <= n; ++v)
+    {
+        full.offsets[v] = graph->offsets[v];
+    }
+
+    for (int e = 0; e < graph->edge_count; ++e)
+    {
+        full.neighbors[e] = graph->neighbors[e];
+        full.edge_weights[e] = 1;
+    }
+
+    for (int v = 0; v < n; ++v)
+    {
+        full.node_weights[v] = 1;
+        ids[v] = v;
+    }
+
+    full.total_weight = n;
+
+    // xorshift must not start at 0
+    uint32_t rng = seed * 0x9E3779B9u + 0x6A09E667u;
+    if (rng == 0)
+    {
+        rng = 1;
+    }
+
+    partition_recursive(&full, ids, parts, 0, part, &rng);
+
+    free(ids);
+    wgraph_release(&full);
+
+    struct PartitionStats stats;
+    partition_stats(graph, part, parts, &stats);
+
+    return stats.cut_edges;
+}
+
+void partition_stats(const struct NodeGraph* graph, const int* part, int parts, struct PartitionStats* stats)
+{
+    int* sizes = calloc(parts > 0 ? parts : 1, sizeof(*sizes));
+    int cut = 0;
+
+    for (int v = 0; v < graph->node_count; ++v)
+    {
+        sizes[part[v]]++;
+
+        for (int e = graph->offsets[v]; e < graph->offsets[v + 1]; ++e)
+        {
+            cut += part[graph->neighbors[e]] != part[v];
+        }
+    }
+
+    stats->parts = parts;
+    stats->cut_edges = cut / 2;
+    stats->min_size = graph->node_count;
+    stats->max_size = 0;
+
+    for (int p = 0; p < parts; ++p)
+    {
+        if (sizes[p] < stats->min_size)
+        {
+            stats->min_size = sizes[p];
+        }
+
+        if (sizes[p] > stats->max_size)
+        {
+            stats->max_size = sizes[p];
+        }
+    }
+
+    stats->imbalance = graph->node_count > 0 ? (float)stats->max_size * parts / graph->node_count : 1.0f;
+
+    free(sizes);
+}
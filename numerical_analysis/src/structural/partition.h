@@ -0,0 +1,26 @@
+#pragma once
+
+struct NodeGraph;
+
+// Summary of a partition
+struct PartitionStats
+{
+    int parts;
+    int cut_edges; // Connections between nodes in different parts
+    int min_size; // Nodes in the smallest part
+    int max_size; // Nodes in the largest part
+    float imbalance; // Largest part size relative to the average (1.0 is perfectly balanced)
+};
+
+// Split the nodes of the graph into parts of close to equal size with as few connections
+// between parts as possible. Writes a part from 0 to (parts - 1) for every node and returns
+// the number of cut connections or -1 on failure
+// Uses multilevel recursive bisection. Each bisection coarsens the graph by merging nodes
+// along their heaviest connections, splits the smallest graph by growing a region from
+// a seed node, then refines the split with Fiduccia-Mattheyses (a linear time form of
+// Kernighan-Lin) moves at every level on the way back to the full graph
+// The result only depends on the seed so every process computes the same partition
+int partition_graph(const struct NodeGraph* graph, int parts, int* part, unsigned int seed);
+
+// Count the cut connections and part sizes of a partition
+void partition_stats(const struct NodeGraph* graph, const int* part, int parts, struct PartitionStats* stats);
@@ -0,0 +1,88 @@
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "frame.h"
+#include "framebinary.h"
+#include "frameschwarz.h"
+#include "matrixmarket.h"
+#include "sparse.h"
+
+// Write the assembled stiffness (with boundary conditions) and forces of a frame as Matrix
+// Market files so the system can be solved by other tools
+static int export_system(struct Frame* frame, const char* path)
+{
+    struct SparseMatrix stiffness;
+    float* forces = NULL;
+
+    if (frame_build_system(frame, &stiffness, NULL, &forces))
+    {
+        return -1;
+    }
+
+    char* rhs_path = matrixmarket_vector_path(path, MATRIXMARKET_RHS_SUFFIX);
+
+    // Boundary conditions zero both the row and column of a fixed degree of freedom so the
+    // matrix keeps its symmetry. Element blocks above and below the diagonal are computed
+    // separately though and can differ in the last bit so only exactly symmetric matrices
+    // are written as symmetric
+    const int symmetric = sparse_is_symmetric(&stiffness);
+
+    int failed = matrixmarket_write_sparse(&stiffness, path, symmetric) != 0 ||
+        matrixmarket_write_vector(forces, stiffness.rows, rhs_path) != 0;
+
+    if (!failed)
+    {
+        printf("Wrote %i %s equations with %i stored values to %s and %s\n", stiffness.rows,
+            symmetric ? "symmetric" : "general", stiffness.nnz, path, rhs_path);
+    }
+
+    free(rhs_path);
+    free(forces);
+    sparse_release(&stiffness);
+
+    return failed ? -1 : 0;
+}
+
+// Converts a text ".frame" file into the binary ".framebin" format (see framebinary.h)
+// or exports its assembled system when the output ends with ".mtx" (see matrixmarket.h)
+// Usage: frame_convert input.frame output.framebin
+//        frame_convert input.frame output.mtx
+int main(int argc, char* argv[])
+{
+    if (argc != 3)
+    {
+        fprintf(stderr, "Usage: %s input.frame output.framebin\n", argv[0]);
+        fprintf(stderr, "       %s input.frame output.mtx (writes the system and output_b.mtx with the forces)\n", argv[0]);
+        return 1;
+    }
+
+    // Either format is accepted as input so older binary files can be rewritten
+    // with the current version
+    struct Frame frame;
+    if (frame_load(argv[1], &frame))
+    {
+        return 1;
+    }
+
+    int failed = 0;
+
+    if (matrixmarket_is_path(argv[2]))
+    {
+        failed = export_system(&frame, argv[2]);
+    }
+    else
+    {
+        failed = frame_export_binary(&frame, argv[2]);
+
+        if (!failed)
+        {
+            printf("Wrote %i nodes, %i elements and %i boundary conditions to %s\n",
+                frame.node_count, frame.element_count, frame.bc_count, argv[2]);
+        }
+    }
+
+    free(frame.bconditions);
+    frame_release(&frame);
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,158 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "frame.h"
+#include "framebinary.h"
+#include "framegenerate.h"
+#include "frameimport.h"
+
+static void print_usage(const char* program)
+{
+    fprintf(stderr,
+        "Usage: %s shape output [options]\n"
+        "  Shapes are grid2d, grid3d, truss, tower and bridge (see framegenerate.h)\n"
+        "  Output ending with .framebin is written as a binary frame and anything else as text\n"
+        "  --size x y z   Nodes along each direction (default 10 10 10)\n"
+        "  --nodes n      Pick a size with about n nodes in the shape's usual proportions\n"
+        "  --spacing s    Distance between nodes in meters (default 1)\n"
+        "  --jitter f     Move nodes up to f times the spacing at random (default 0)\n"
+        "  --radius r     Element radius in meters (default 0.01)\n"
+        "  --load f       Size of each force in newtons (default 1000)\n"
+        "  --random       Place loads at random nodes instead of across the loaded side\n"
+        "  --loads n      Random loads to place (default one per 100 nodes)\n"
+        "  --supports n   Extra random supports to place (default 0)\n"
+        "  --seed n       Seed for the jitter and random loads (default 1)\n",
+        program);
+}
+
+// Generates synthetic frames for scaling tests. The same options always give the same file
+// Usage: frame_generate truss big.framebin --nodes 1000000 --random --seed 7
+int main(int argc, char* argv[])
+{
+    struct FrameGenerateSettings settings;
+    frame_generate_default_settings(&settings);
+
+    int valid = argc >= 3 && frame_parse_shape(argv[1], &settings.shape) == 0;
+    long long nodes = 0;
+
+    for (int i = 3; i < argc && valid; ++i)
+    {
+        const char* arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+
+        if (strcmp(arg, "--random") == 0)
+        {
+            settings.loading = FRAME_LOADING_RANDOM;
+        }
+        else if (!value)
+        {
+            valid = 0;
+        }
+        else if (strcmp(arg, "--size") == 0)
+        {
+            // Takes three values
+            valid = i + 3 < argc;
+
+            for (int d = 0; d < 3 && valid; ++d)
+            {
+                settings.size[d] = atoi(argv[i + 1 + d]);
+            }
+
+            i += 3;
+        }
+        else
+        {
+            // Every other option takes one value
+            if (strcmp(arg, "--nodes") == 0)
+            {
+                nodes = atoll(value);
+                valid = nodes > 0;
+            }
+            else if (strcmp(arg, "--spacing") == 0)
+            {
+                settings.spacing = (float)atof(value);
+                valid = settings.spacing > 0.0f;
+            }
+            else if (strcmp(arg, "--jitter") == 0)
+            {
+                settings.jitter = (float)atof(value);
+                valid = settings.jitter >= 0.0f && settings.jitter < 0.5f;
+            }
+            else if (strcmp(arg, "--radius") == 0)
+            {
+                settings.radius = (float)atof(value);
+                valid = settings.radius > 0.0f;
+            }
+            else if (strcmp(arg, "--load") == 0)
+            {
+                settings.load = (float)atof(value);
+            }
+            else if (strcmp(arg, "--loads") == 0)
+            {
+                settings.random_loads = atoi(value);
+                settings.loading = FRAME_LOADING_RANDOM;
+                valid = settings.random_loads > 0;
+            }
+            else if (strcmp(arg, "--supports") == 0)
+            {
+                settings.random_supports = atoi(value);
+                settings.loading = FRAME_LOADING_RANDOM;
+                valid = settings.random_supports >= 0;
+            }
+            else if (strcmp(arg, "--seed") == 0)
+            {
+                settings.seed = strtoull(value, NULL, 10);
+            }
+            else
+            {
+                valid = 0;
+            }
+
+            i++;
+        }
+    }
+
+    if (!valid)
+    {
+        print_usage(argv[0]);
+        return 2;
+    }
+
+    // 2D grids have one layer whatever size was given
+    if (settings.shape == FRAME_SHAPE_GRID2D)
+    {
+        settings.size[2] = 1;
+    }
+
+    if (nodes > 0 && frame_generate_size(&settings, nodes))
+    {
+        return 1;
+    }
+
+    struct Frame frame;
+    if (frame_generate(&settings, &frame))
+    {
+        return 1;
+    }
+
+    const char* output = argv[2];
+    const size_t length = strlen(output);
+    const char* extension = ".framebin";
+    const size_t extension_length = strlen(extension);
+    const int binary = length >= extension_length && strcmp(output + length - extension_length, extension) == 0;
+
+    int failed = binary ? frame_export_binary(&frame, output) : frame_export(&frame, output);
+
+    if (!failed)
+    {
+        printf("Wrote a %i x %i x %i %s with %i nodes, %i elements and %i boundary conditions to %s\n",
+            settings.size[0], settings.size[1], settings.size[2], argv[1],
+            frame.node_count, frame.element_count, frame.bc_count, output);
+    }
+
+    free(frame.bconditions);
+    frame_release(&frame);
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,147 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "frame.h"
+#include "framegenerate.h"
+
+// Changes elements of a generated frame in place with frame_update_elements and checks the
+// matrices match the ones built from scratch for the changed frame. Also checks rejected
+// updates leave the matrices alone
+
+static int check(int passed, const char* name)
+{
+    if (!passed)
+    {
+        fprintf(stderr, "FAILED: %s\n", name);
+    }
+
+    return passed ? 0 : 1;
+}
+
+static void release_frame(struct Frame* frame)
+{
+    // frame_release does not free the boundary conditions
+    free(frame->bconditions);
+    frame->bconditions = NULL;
+    frame_release(frame);
+}
+
+// Largest difference between two matrices relative to the largest entry of the expected one
+// Updating in place subtracts and adds so it rounds differently than a fresh build
+static float relative_difference(const struct Matrix* actual, const struct Matrix* expected)
+{
+    const int count = expected->rows * expected->cols;
+    float largest = 0.0f;
+    float difference = 0.0f;
+
+    for (int i = 0; i < count; ++i)
+    {
+        largest = fmaxf(largest, fabsf(expected->elements[i]));
+        difference = fmaxf(difference, fabsf(actual->elements[i] - expected->elements[i]));
+    }
+
+    return largest > 0.0f ? difference / largest : difference;
+}
+
+static int generate(struct Frame* frame)
+{
+    struct FrameGenerateSettings settings;
+    frame_generate_default_settings(&settings);
+    settings.shape = FRAME_SHAPE_TRUSS;
+    frame_generate_size(&settings, 60);
+
+    return frame_generate(&settings, frame);
+}
+
+static int test_matches_rebuild(void)
+{
+    struct Frame frame;
+    if (generate(&frame))
+    {
+        return check(0, "frame was generated");
+    }
+
+    struct EquationSet updated;
+    frame_build_equations(&frame, &updated);
+
+    // Resize a few members, soften one and reconnect one to different nodes
+    const int count = 4;
+    int ids[4] = { 0, frame.element_count / 2, frame.element_count / 3, frame.element_count - 1 };
+    struct Element elements[4];
+
+    for (int n = 0; n < count; ++n)
+    {
+        elements[n] = frame.elements[ids[n]];
+        elements[n].radius *= 1.5f;
+    }
+
+    elements[1].elastic_modulus *= 0.5f;
+    elements[2].node2 = (elements[2].node1 + frame.node_count / 2) % frame.node_count;
+
+    frame_update_elements(&frame, &updated, ids, elements, count);
+
+    // frame_update_elements also replaced the elements so the frame now has the changes
+    struct EquationSet rebuilt;
+    frame_build_equations(&frame, &rebuilt);
+
+    int failures = 0;
+    failures += check(relative_difference(&updated.stiffness, &rebuilt.stiffness) < 1e-5f, "updated stiffness matches rebuild");
+    failures += check(relative_difference(&updated.stiff_bc, &rebuilt.stiff_bc) < 1e-5f, "updated stiff_bc matches rebuild");
+    failures += check(memcmp(updated.forces.elements, rebuilt.forces.elements, sizeof(float) * rebuilt.forces.count) == 0,
+        "forces are unchanged");
+
+    equationset_release(&rebuilt);
+    equationset_release(&updated);
+    release_frame(&frame);
+    return failures;
+}
+
+static int test_rejected_updates(void)
+{
+    struct Frame frame;
+    if (generate(&frame))
+    {
+        return check(0, "frame was generated");
+    }
+
+    struct EquationSet eqset;
+    frame_build_equations(&frame, &eqset);
+
+    const size_t bytes = sizeof(float) * eqset.stiff_bc.rows * eqset.stiff_bc.cols;
+    float* stiffness = malloc(bytes);
+    float* stiff_bc = malloc(bytes);
+    memcpy(stiffness, eqset.stiffness.elements, bytes);
+    memcpy(stiff_bc, eqset.stiff_bc.elements, bytes);
+
+    const struct Element original = frame.elements[0];
+
+    int ids[3] = { -1, frame.element_count, 0 };
+    struct Element elements[3] = { original, original, original };
+    elements[2].node2 = frame.node_count;
+
+    frame_update_elements(&frame, &eqset, ids, elements, 3);
+
+    int failures = 0;
+    failures += check(memcmp(stiffness, eqset.stiffness.elements, bytes) == 0, "rejected updates leave stiffness unchanged");
+    failures += check(memcmp(stiff_bc, eqset.stiff_bc.elements, bytes) == 0, "rejected updates leave stiff_bc unchanged");
+    failures += check(frame.elements[0].node2 == original.node2, "rejected update leaves the element unchanged");
+
+    free(stiff_bc);
+    free(stiffness);
+    equationset_release(&eqset);
+    release_frame(&frame);
+    return failures;
+}
+
+int main(void)
+{
+    int failures = 0;
+
+    failures += test_matches_rebuild();
+    failures += test_rejected_updates();
+
+    printf("%i checks failed\n", failures);
+    return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,224 @@
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "matrixmarket.h"
+#include "sparse.h"
+
+// Reads well formed and malformed Matrix Market files and checks malformed ones are rejected
+// instead of read out of bounds, that the values read back are the ones in the file and that
+// written matrices read back exactly. Files are written to the working directory
+
+struct MatrixMarketCase
+{
+    const char* name;
+    const char* text;
+    int valid;
+};
+
+static const struct MatrixMarketCase cases[] =
+{
+    { "valid symmetric", "%%MatrixMarket matrix coordinate real symmetric\n2 2 2\n1 1 4.0\n2 1 1.0\n", 1 },
+    { "valid general", "%%MatrixMarket matrix coordinate real general\n2 40 2\n1 1 4.0\n1 40 1.0\n", 1 },
+    { "symmetric with more columns", "%%MatrixMarket matrix coordinate real symmetric\n2 40 2\n1 1 4.0\n1 40 1.0\n", 0 },
+    { "symmetric with more rows", "%%MatrixMarket matrix coordinate real symmetric\n40 2 2\n1 1 4.0\n40 1 1.0\n", 0 },
+    { "row out of range", "%%MatrixMarket matrix coordinate real general\n2 2 1\n3 1 1.0\n", 0 },
+    { "column out of range", "%%MatrixMarket matrix coordinate real general\n2 2 1\n1 0 1.0\n", 0 },
+    { "missing entries", "%%MatrixMarket matrix coordinate real general\n2 2 3\n1 1 1.0\n", 0 },
+    { "negative size", "%%MatrixMarket matrix coordinate real general\n-2 2 1\n1 1 1.0\n", 0 },
+    { "missing size", "%%MatrixMarket matrix coordinate real general\n", 0 },
+    { "not matrix market", "1 1 1\n1 1 1.0\n", 0 },
+};
+
+static const char* path = "matrixmarket_test.mtx";
+
+static int write_text(const char* text)
+{
+    FILE* file = fopen(path, "w");
+    if (!file)
+    {
+        fprintf(stderr, "Failed to open file at: %s\n", path);
+        return -1;
+    }
+
+    fputs(text, file);
+    fclose(file);
+    return 0;
+}
+
+// Stored value at row and col (both from 0) or 0 if there is none
+static float entry(const struct SparseMatrix* matrix, int row, int col)
+{
+    for (int k = matrix->row_offsets[row]; k < matrix->row_offsets[row + 1]; ++k)
+    {
+        if (matrix->columns[k] == col)
+        {
+            return matrix->values[k];
+        }
+    }
+
+    return 0.0f;
+}
+
+static int check(int passed, const char* name)
+{
+    if (!passed)
+    {
+        fprintf(stderr, "FAILED: %s\n", name);
+    }
+
+    return passed ? 0 : 1;
+}
+
+static int test_cases(void)
+{
+    int failures = 0;
+
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); ++c)
+    {
+        if (write_text(cases[c].text))
+        {
+            return failures + 1;
+        }
+
+        struct SparseMatrix matrix;
+        const int read = matrixmarket_read_sparse(path, &matrix) == 0;
+
+        if (read != cases[c].valid)
+        {
+            fprintf(stderr, "FAILED: %s was %s\n", cases[c].name, read ? "accepted" : "rejected");
+            failures++;
+        }
+
+        if (read)
+        {
+            sparse_release(&matrix);
+        }
+    }
+
+    return failures;
+}
+
+// Entries below the diagonal of a symmetric file are mirrored above it. The diagonal is not
+static int test_symmetric_values(void)
+{
+    struct SparseMatrix matrix;
+    if (write_text("%%MatrixMarket matrix coordinate real symmetric\n3 3 3\n1 1 4.0\n2 1 1.5\n3 2 -2.0\n") ||
+        matrixmarket_read_sparse(path, &matrix))
+    {
+        return check(0, "symmetric values were read");
+    }
+
+    int failures = 0;
+    failures += check(matrix.rows == 3 && matrix.cols == 3 && matrix.nnz == 5, "symmetric size");
+    failures += check(entry(&matrix, 0, 0) == 4.0f, "symmetric diagonal");
+    failures += check(entry(&matrix, 1, 0) == 1.5f && entry(&matrix, 0, 1) == 1.5f, "symmetric (2, 1) mirrored");
+    failures += check(entry(&matrix, 2, 1) == -2.0f && entry(&matrix, 1, 2) == -2.0f, "symmetric (3, 2) mirrored");
+
+    sparse_release(&matrix);
+    return failures;
+}
+
+static int test_duplicates_summed(void)
+{
+    struct SparseMatrix matrix;
+    if (write_text("%%MatrixMarket matrix coordinate real general\n2 2 4\n1 1 1.0\n2 1 3.0\n1 1 2.5\n2 1 -1.0\n") ||
+        matrixmarket_read_sparse(path, &matrix))
+    {
+        return check(0, "duplicate entries were read");
+    }
+
+    int failures = 0;
+    failures += check(matrix.nnz == 2, "duplicates stored once");
+    failures += check(entry(&matrix, 0, 0) == 3.5f && entry(&matrix, 1, 0) == 2.0f, "duplicates summed");
+
+    sparse_release(&matrix);
+    return failures;
+}
+
+static int test_array_vector(void)
+{
+    float* values = NULL;
+    int rows = 0;
+
+    if (write_text("%%MatrixMarket matrix array real general\n% comment\n3 1\n1.5\n-2\n3.25e2\n") ||
+        matrixmarket_read_vector(path, &values, &rows))
+    {
+        return check(0, "array vector was read");
+    }
+
+    int failures = check(rows == 3 && values[0] == 1.5f && values[1] == -2.0f && values[2] == 325.0f, "array vector values");
+
+    free(values);
+    return failures;
+}
+
+// Values without a short decimal form must come back bit for bit
+static int test_round_trip(int symmetric)
+{
+    const float values[4][4] =
+    {
+        { 4.0f, 0.1f, 0.0f, -1.0e-7f },
+        { 0.1f, 3.3333333f, 2.0e10f, 0.0f },
+        { 0.0f, 2.0e10f, 1.0f / 3.0f, 0.0f },
+        { -1.0e-7f, 0.0f, 0.0f, 7.0f },
+    };
+
+    struct SparseMatrix matrix;
+    sparse_init(&matrix, 4, 4, 10);
+
+    int nnz = 0;
+    for (int j = 0; j < 4; ++j)
+    {
+        for (int i = 0; i < 4; ++i)
+        {
+            if (values[j][i] != 0.0f)
+            {
+                matrix.columns[nnz] = i;
+                matrix.values[nnz++] = values[j][i];
+            }
+        }
+
+        matrix.row_offsets[j + 1] = nnz;
+    }
+
+    struct SparseMatrix read;
+    int written = matrixmarket_write_sparse(&matrix, path, symmetric) == 0;
+    int failures = check(written && matrixmarket_read_sparse(path, &read) == 0,
+        symmetric ? "symmetric round trip was read" : "general round trip was read");
+
+    if (failures == 0)
+    {
+        int same = read.rows == 4 && read.cols == 4 && read.nnz == nnz;
+
+        for (int j = 0; j < 4 && same; ++j)
+        {
+            for (int i = 0; i < 4; ++i)
+            {
+                same &= entry(&read, j, i) == values[j][i];
+            }
+        }
+
+        failures += check(same, symmetric ? "symmetric round trip values" : "general round trip values");
+        sparse_release(&read);
+    }
+
+    sparse_release(&matrix);
+    return failures;
+}
+
+int main(void)
+{
+    int failures = 0;
+
+    failures += test_cases();
+    failures += test_symmetric_values();
+    failures += test_duplicates_summed();
+    failures += test_array_vector();
+    failures += test_round_trip(0);
+    failures += test_round_trip(1);
+
+    remove(path);
+
+    printf("%i checks failed\n", failures);
+    return failures > 0 ? 1 : 0;
+}